@@ -44,6 +44,7 @@ struct core_enumerator {
 
 		core_iterator &operator++()
 		{
+			off_++;
 			progress();
 			return *this;
 		}
@@ -99,6 +100,8 @@ public:
 
 	core &get_boot_core() const { return get_core(0); }
 
+	int nr_cores() const { return nr_cores_; }
+
 	void register_core(core &c);
 
 	__noreturn void go();
@@ -11,6 +11,8 @@
 #include <stacsos/kernel/arch/x86/msr.h>
 #include <stacsos/kernel/config.h>
 #include <stacsos/kernel/debug.h>
+#include <stacsos/kernel/lock.h>
+#include <stacsos/kernel/sched/alg/cfs.h>
 #include <stacsos/kernel/sched/alg/rr.h>
 #include <stacsos/kernel/sched/alg/scheduling-algorithm.h>
 #include <stacsos/kernel/sched/alg/sfs.h>
@@ -33,11 +35,21 @@ public:
 
 	static core &this_core();
 
+	// The frequency of the periodic timer tick, which is also the unit of the scheduler's time slices
+	// in tickless mode.
+	static const u64 tick_frequency = 100;
+
 	explicit core(int id)
 		: id_(id)
 		, status_(core_status::offline)
 		, irqs_(*this)
 		, sched_alg_(nullptr)
+		, runqueue_lock_stats_("runqueue")
+		, runqueue_lock_(runqueue_lock_stats_)
+		, nr_runnable_(0)
+		, current_(nullptr)
+		, previous_(nullptr)
+		, tickless_(false)
 	{
 		idle_thread_.entity = nullptr;
 		idle_thread_.mcontext = nullptr;
@@ -51,6 +63,8 @@ public:
 
 		if (memops::strcmp(sched_alg_name, "sfs") == 0) {
 			sched_alg_ = new alg::simple_fair_scheduler();
+		} else if (memops::strcmp(sched_alg_name, "cfs") == 0) {
+			sched_alg_ = new alg::completely_fair_scheduler();
 		} else if (memops::strcmp(sched_alg_name, "rr") == 0) {
 			sched_alg_ = new alg::round_robin();
 		} else {
@@ -58,6 +72,13 @@ public:
 		}
 
 		dprintf("core: using scheduling algorithm: %s\n", sched_alg_->name());
+
+		const char *timer_mode = config::get().get_option_or_default("timer", "periodic");
+		if (memops::strcmp(timer_mode, "tickless") == 0) {
+			tickless_ = true;
+		} else if (memops::strcmp(timer_mode, "periodic") != 0) {
+			panic("Unsupported timer mode '%s'", timer_mode);
+		}
 	}
 
 	int id() const { return id_; }
@@ -69,8 +90,22 @@ public:
 
 	virtual timer &local_timer() = 0;
 
-	void add_to_runqueue(tcb &tcb) { sched_alg_->add_to_runqueue(tcb); }
-	void remove_from_runqueue(tcb &tcb) { sched_alg_->remove_from_runqueue(tcb); }
+	/**
+	 * Interrupts this core, so that it calls schedule() and re-arms its timer.  Only used in
+	 * tickless mode, where a core that is idle (or running a single task) takes no timer interrupts.
+	 */
+	virtual void kick() = 0;
+
+	bool tickless() const { return tickless_; }
+
+	bool add_to_runqueue(tcb &tcb);
+	bool remove_from_runqueue(tcb &tcb);
+
+	/**
+	 * The number of runnable tasks on this core's runqueue (including the running task).  This is read
+	 * without the runqueue lock, so should only be used as a hint.
+	 */
+	u64 nr_runnable() const { return *(volatile const u64 *)&nr_runnable_; }
 
 	void schedule();
 
@@ -78,6 +113,7 @@ public:
 	virtual tcb *get_current_tcb() = 0;
 
 	core_status status() const { return status_; }
+	bool online() const { return status_ == core_status::online || status_ == core_status::bootstrap; }
 
 	irq_manager &irqs() { return irqs_; }
 	const irq_manager &irqs() const { return irqs_; }
@@ -91,5 +127,21 @@ private:
 
 	tcb idle_thread_;
 	alg::scheduling_algorithm *sched_alg_;
+
+	lock_stats runqueue_lock_stats_;
+	spinlock_irq runqueue_lock_;
+	u64 nr_runnable_;
+	tcb *current_, *previous_;
+
+	bool tickless_;
+
+	u64 tick_length();
+	void program_timer(tcb *next);
+	void kick_idle_core();
+
+	void enqueue_task(tcb &tcb);
+	void dequeue_task(tcb &tcb);
+	void update_current(tcb *next);
+	tcb *steal_task();
 };
 } // namespace stacsos::kernel::arch
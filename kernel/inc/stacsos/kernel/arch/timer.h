@@ -30,6 +30,16 @@ public:
 	virtual void start(u64 period) = 0;
 	virtual void stop() = 0;
 
+	/**
+	 * Puts the timer into one-shot mode.  It then only fires when armed with set_deadline().
+	 */
+	virtual void start_oneshot() = 0;
+
+	/**
+	 * Arms a one-shot timer to fire at the given TSC value, or disarms it if the deadline is ~0.
+	 */
+	virtual void set_deadline(u64 deadline) = 0;
+
 private:
 	timer_callback cb_;
 	void *cb_arg_;
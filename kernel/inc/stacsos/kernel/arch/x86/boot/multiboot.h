@@ -7,6 +7,9 @@
  */
 #pragma once
 
+#define MULTIBOOT_INFO_MODS 0x00000008
+#define MULTIBOOT_INFO_ELF_SHDR 0x00000020
+
 namespace stacsos::kernel::arch::x86::boot {
 struct multiboot_elf_section_header_table {
 	u32 num;
@@ -101,20 +101,36 @@ public:
 	static void write(cr4_flags flags) { asm volatile("mov %0, %%cr4" ::"r"((unsigned long)flags)); }
 };
 
-class fsbase {
+class rflags {
 public:
-#ifdef USE_FSGSBASE
-	static u64 read()
+	static unsigned long read()
 	{
-		u64 fsbase;
-		asm volatile("rdfsbase %0" : "=r"(fsbase));
-		return fsbase;
+		unsigned long val;
+		asm volatile("pushfq; popq %0" : "=r"(val));
+
+		return val;
 	}
 
-	static void write(u64 value) { asm volatile("wrfsbase %0" ::"r"(value)); }
-#else
+	static bool interrupts_enabled() { return !!(read() & (1ul << 9)); }
+};
+
+/**
+ * Whether the RDFSBASE/WRFSBASE family of instructions can be used, which is decided from CPUID at boot
+ * (CR4.FSGSBASE is only turned on when CPUID reports them).  Until then, the FS and GS bases are accessed
+ * through their MSRs, which always works.  This is read from assembly, so it has C linkage.
+ */
+extern "C" bool x86_fsgsbase_available;
+
+class fsbase {
+public:
 	static u64 read()
 	{
+		if (x86_fsgsbase_available) {
+			u64 fsbase;
+			asm volatile("rdfsbase %0" : "=r"(fsbase));
+			return fsbase;
+		}
+
 		u32 low, high;
 
 		asm volatile("rdmsr" : "=a"(low), "=d"(high) : "c"((u32)0xc0000100u));
@@ -123,28 +139,28 @@ public:
 
 	static void write(u64 value)
 	{
+		if (x86_fsgsbase_available) {
+			asm volatile("wrfsbase %0" ::"r"(value));
+			return;
+		}
+
 		u32 low = value & 0xffffffff;
 		u32 high = (value >> 32);
 
 		asm volatile("wrmsr" : : "c"(0xc0000100u), "a"(low), "d"(high));
 	}
-#endif
 };
 
 class gsbase {
 public:
-#ifdef USE_FSGSBASE
 	static u64 read()
 	{
-		u64 gsbase;
-		asm volatile("rdgsbase %0" : "=r"(gsbase));
-		return gsbase;
-	}
+		if (x86_fsgsbase_available) {
+			u64 gsbase;
+			asm volatile("rdgsbase %0" : "=r"(gsbase));
+			return gsbase;
+		}
 
-	static void write(u64 value) { asm volatile("wrgsbase %0" ::"r"(value)); }
-#else
-	static u64 read()
-	{
 		u32 low, high;
 
 		asm volatile("rdmsr" : "=a"(low), "=d"(high) : "c"((u32)0xc0000101u));
@@ -153,11 +169,15 @@ public:
 
 	static void write(u64 value)
 	{
+		if (x86_fsgsbase_available) {
+			asm volatile("wrgsbase %0" ::"r"(value));
+			return;
+		}
+
 		u32 low = value & 0xffffffff;
 		u32 high = (value >> 32);
 
 		asm volatile("wrmsr" : : "c"(0xc0000101u), "a"(low), "d"(high));
 	}
-#endif
 };
 } // namespace stacsos::kernel::arch::x86
@@ -23,6 +23,7 @@ enum class msr_indicies : unsigned {
 
 	IA32_APIC_BASE = 0x1b,
 	IA32_FEATURE_CONTROL = 0x3a,
+	IA32_TSC_DEADLINE = 0x6e0,
 	IA32_LOCAL_APIC_ID = 0x802,
 
 	// VMX Controls
@@ -145,6 +146,7 @@ public:
 	static wrapped_msr<msr_indicies::GS_BASE> gsbase;
 	static wrapped_msr<msr_indicies::KERNEL_GS_BASE> kernel_gsbase;
 	static wrapped_msr<msr_indicies::IA32_TSC_AUX> ia32_tsc_aux;
+	static wrapped_msr<msr_indicies::IA32_TSC_DEADLINE> ia32_tsc_deadline;
 
 	static wrapped_msr<msr_indicies::STAR> ia32_star;
 	static wrapped_msr<msr_indicies::LSTAR> ia32_lstar;
@@ -30,6 +30,7 @@ struct base_entry {
 	void size(bool v) { update_bit(7, v); }
 
 	bool xd() const { return get_bit(63); }
+	void xd(bool v) { update_bit(63, v); }
 
 	u64 base_address() const { return (bits & base_address_mask); }
 
@@ -44,7 +45,7 @@ private:
 
 	void update_bit(int bit, bool value) { bits = (bits & ~(1ull << bit)) | (((u64)(!!value)) << bit); }
 
-	bool get_bit(int bit) const { return !!(bits & (1u << bit)); }
+	bool get_bit(int bit) const { return !!(bits & (1ull << bit)); }
 
 } __packed;
 
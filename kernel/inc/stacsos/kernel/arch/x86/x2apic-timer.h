@@ -16,6 +16,7 @@ class x2apic_timer : public timer {
 public:
 	x2apic_timer(x2apic &lapic)
 		: lapic_(lapic)
+		, use_tsc_deadline_(false)
 	{
 	}
 
@@ -34,8 +35,12 @@ public:
 
 	virtual void stop() { lapic_.mask_interrupts(x2apic_lvts::timer); }
 
+	virtual void start_oneshot() override;
+	virtual void set_deadline(u64 deadline) override;
+
 private:
 	static void timer_irq_handler(u8 irq, void *context, void *arg);
 	x2apic &lapic_;
+	bool use_tsc_deadline_;
 };
 } // namespace stacsos::kernel::arch::x86
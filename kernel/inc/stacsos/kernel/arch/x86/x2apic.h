@@ -99,6 +99,14 @@ public:
 		msr::write(msr_indicies::X2APIC_LVT_TIMER, lvt);
 	}
 
+	void set_timer_tsc_deadline()
+	{
+		u64 lvt = msr::read(msr_indicies::X2APIC_LVT_TIMER);
+		lvt &= ~0x00060000;
+		lvt |= 0x00040000;
+		msr::write(msr_indicies::X2APIC_LVT_TIMER, lvt);
+	}
+
 	u32 get_timer_current_count() { return msr::read(msr_indicies::X2APIC_TIMER_CCR); }
 
 	u64 get_timer_frequency() const { return timer_frequency_; }
@@ -112,6 +120,19 @@ public:
 		set_timer_initial_count((timer_frequency_ >> 4) / frequency);
 	}
 
+	void send_ipi(u32 target, u8 vector)
+	{
+		x2apic_icr v;
+
+		v.destination = target;
+		v.vector = vector;
+		v.delivery_mode = icr_delivery_mode::fixed;
+		v.trigger_mode = icr_trigger_mode::edge;
+		v.level = icr_level::assert;
+
+		set_icr(v);
+	}
+
 	void send_remote_init(u32 target)
 	{
 		x2apic_icr v;
@@ -18,14 +18,17 @@
 namespace stacsos::kernel::arch::x86 {
 class x86_core : public core {
 public:
-	explicit x86_core(int id)
+	x86_core(int id, u32 apic_id)
 		: core(id)
+		, apic_id_(apic_id)
 		, gdt_(*this)
 		, idt_(*this)
 		, tss_(*this)
 		, irqs_(idt_)
 		, lapic_(*this)
 		, timer_(lapic_)
+		, tlb_flush_requested_(0)
+		, tlb_flush_done_(0)
 	{
 	}
 
@@ -36,6 +39,7 @@ public:
 	virtual bool remote_run() override;
 
 	virtual timer &local_timer() override { return timer_; }
+	virtual void kick() override;
 
 	tsc &local_tsc() { return tsc_; }
 
@@ -54,7 +58,18 @@ public:
 
 	void dump_regs();
 
+	/**
+	 * Flushes the TLB on every online core, and waits for them all to have done so.  This must be
+	 * called without any spinlocks held, as another core may be spinning on one with interrupts
+	 * disabled, and so not able to respond.
+	 */
+	static void shootdown_tlb();
+
+	u32 apic_id() const { return apic_id_; }
+
 private:
+	u32 apic_id_;
+
 	global_descriptor_table<16> gdt_;
 	interrupt_descriptor_table<256> idt_;
 	task_state_segment tss_;
@@ -72,6 +87,14 @@ private:
 	x2apic_timer timer_;
 	tsc tsc_;
 
+	// Requests to flush this core's TLB are numbered, and a flush completes every request made before
+	// it started.
+	volatile u64 tlb_flush_requested_;
+	volatile u64 tlb_flush_done_;
+
+	void flush_tlb();
+	static void tlb_shootdown_handler(u8 irq, void *mcontext, void *arg);
+
 	static void exception_handler(u8 irq, void *context, void *arg)
 	{
 		switch (irq) {
@@ -90,8 +113,9 @@ private:
 	}
 
 	void populate_dt();
-	// pfn_t prepare_mpstartup_code();
-	// void complete_remote_init();
+	void prepare_mpstartup_code();
+	static void mpstartup_entry(x86_core *core);
+	__noreturn void complete_remote_init();
 
 	void handle_gpf(machine_context *mc);
 	void handle_page_fault(machine_context *mc);
@@ -15,7 +15,7 @@ class page_table_allocator;
 
 namespace stacsos::kernel::arch::x86 {
 enum class mapping_size { m4k, m2m, m1g };
-enum class mapping_flags { none, present = 1, writable = 2, user_accessable = 4, write_through = 8, cache_disabled = 16 };
+enum class mapping_flags { none, present = 1, writable = 2, user_accessable = 4, write_through = 8, cache_disabled = 16, no_execute = 32 };
 
 DEFINE_ENUM_FLAG_OPERATIONS(mapping_flags)
 
@@ -34,6 +34,14 @@ public:
 	void map(mem::page_table_allocator &pta, u64 virtual_address, u64 physical_address, mapping_flags flags, mapping_size size = mapping_size::m4k);
 	void unmap(mem::page_table_allocator &pta, u64 virtual_address);
 
+	bool is_mapped(u64 virtual_address) const;
+
+	/**
+	 * Finds the physical address that a virtual address is mapped to, and whether the mapping is
+	 * writable.  Returns false if the address isn't mapped.
+	 */
+	bool translate(u64 virtual_address, u64 &physical_address, bool &writable) const;
+
 	void dump() const;
 
 	u64 effective_cr3() const { return (u64)&pml4_ - 0xffff'8000'0000'0000; }
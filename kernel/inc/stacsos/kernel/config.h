@@ -42,6 +42,26 @@ public:
 		return dfl;
 	}
 
+	u64 get_option_u64_or_default(const char *name, u64 dfl) const
+	{
+		const char *value = get_option(name);
+		if (!value || !*value) {
+			return dfl;
+		}
+
+		u64 result = 0;
+		while (*value) {
+			if (*value < '0' || *value > '9') {
+				return dfl;
+			}
+
+			result = (result * 10) + (*value - '0');
+			value++;
+		}
+
+		return result;
+	}
+
 private:
 	char command_line_[256];
 	config_option options_[32];
@@ -7,6 +7,10 @@
  */
 #pragma once
 
+namespace stacsos {
+template <int bits> struct elf_sectionheader;
+}
+
 namespace stacsos::kernel {
 namespace arch {
 	class console_interface;
@@ -23,6 +27,23 @@ private:
 	debug_helper() { }
 
 public:
-	void parse_image();
+	/**
+	 * Builds the symbol index from the kernel's ELF symbol table.  The section headers are either those
+	 * of a complete ELF image (in which case the section data is found from its offset into the image),
+	 * or have been loaded separately by the boot loader (in which case image is null, and each section's
+	 * data is at its physical address).
+	 */
+	void parse_image(const elf_sectionheader<32> *sections, u16 nr_sections, const u8 *image);
+
+	/**
+	 * Finds the function containing an address.  Returns the function's name, and its start address,
+	 * or nullptr if the address isn't inside a known function.
+	 */
+	const char *symbolize(u64 address, u64 *start = nullptr) const;
+
+	/**
+	 * Prints the return addresses on a chain of frame pointers, with their symbols.
+	 */
+	void print_backtrace(u64 rbp) const;
 };
 } // namespace stacsos::kernel
@@ -11,6 +11,7 @@
 #include <stacsos/kernel/dev/input/keys.h>
 #include <stacsos/kernel/sched/event.h>
 #include <stacsos/memops.h>
+#include <stacsos/virtual-console.h>
 
 namespace stacsos::kernel::dev::console {
 enum class virtual_console_mode { text, gfx };
@@ -81,6 +82,8 @@ public:
 
 	void clear();
 
+	bool blit(const virtual_console_blit &rect);
+
 	virtual shared_ptr<fs::file> open_as_file() override;
 
 private:
@@ -95,6 +98,11 @@ private:
 	u8 read_buffer_head_, read_buffer_tail_;
 	sched::event read_buffer_event_;
 
+	// The dimensions of the internal buffer, in cells (text mode) or pixels (graphics mode).
+	u32 buffer_width() const { return mode_ == virtual_console_mode::text ? TEXT_MODE_COLS : GFX_MODE_WIDTH; }
+	u32 buffer_height() const { return mode_ == virtual_console_mode::text ? TEXT_MODE_ROWS : GFX_MODE_HEIGHT; }
+	size_t element_size() const { return mode_ == virtual_console_mode::text ? 2 : 4; }
+
 	void render_char(int x, int y, unsigned char ch, u8 attr);
 	void update_cursor();
 };
@@ -11,6 +11,7 @@
 #include <stacsos/kernel/fs/file.h>
 #include <stacsos/kernel/fs/filesystem.h>
 #include <stacsos/kernel/fs/fs-node.h>
+#include <stacsos/kernel/lock.h>
 
 namespace stacsos::kernel::dev {
 using namespace stacsos::kernel::fs;
@@ -18,15 +19,40 @@ using namespace stacsos::kernel::fs;
 class devfs_node;
 class device;
 
+/**
+ * The device filesystem.  It holds a node for every name a device has been registered under, which is
+ * created when the device is registered, and looked up by name through a hash table.  When a device
+ * is removed, its nodes are detached rather than freed (as they may still be referenced), and are
+ * reused if a device is registered under the same name again.
+ */
 class devfs : public filesystem {
-public:
-	devfs();
+	friend class devfs_node;
+
+	DEFINE_SINGLETON(devfs)
 
+public:
 	virtual ~devfs() { }
 	virtual fs_node &root() override { return *(fs_node *)root_; }
 
+	void add_device(const string &name, device &dev);
+	void remove_device(device &dev);
+
+	bool try_get_device(const string &name, device *&dev);
+
 private:
+	devfs();
+
+	static const size_t nr_buckets = 64;
+
+	spinlock_irq lock_;
 	devfs_node *root_;
+
+	devfs_node *buckets_[nr_buckets];
+
+	// Every node, in the order they were created.
+	devfs_node *nodes_head_, *nodes_tail_;
+
+	devfs_node *find(const string &name);
 };
 
 class devfs_node : public fs_node {
@@ -36,23 +62,29 @@ public:
 	devfs_node(filesystem &fs, fs_node *parent, fs_node_kind kind, const string &name, device *dev)
 		: fs_node(fs, parent, kind, name)
 		, dev_(dev)
+		, hash_next_(nullptr)
+		, next_(nullptr)
 	{
 	}
 
 	virtual shared_ptr<file> open() override
 	{
-		if (dev_) {
-			return dev_->open_as_file();
+		device *dev = dev_;
+		if (dev) {
+			return dev->open_as_file();
 		} else {
 			return nullptr;
 		}
 	}
 	virtual fs_node *mkdir(const char *name) override { return nullptr; }
 
+	virtual void list_children(list<fs_node *> &children) override;
+
 protected:
 	virtual fs_node *resolve_child(const string &name) override;
 
 private:
-	device *dev_;
+	device *volatile dev_;
+	devfs_node *hash_next_, *next_;
 };
 } // namespace stacsos::kernel::dev
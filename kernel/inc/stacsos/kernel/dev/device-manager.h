@@ -8,8 +8,8 @@
 #pragma once
 
 #include <stacsos/kernel/dev/bus.h>
+#include <stacsos/kernel/lock.h>
 #include <stacsos/list.h>
-#include <stacsos/map.h>
 #include <stacsos/string.h>
 
 namespace stacsos::kernel::dev {
@@ -31,9 +31,17 @@ public:
 	void register_bus(bus &bus) { buses_.append(&bus); }
 	void probe_buses();
 
+	/**
+	 * Registers a device under the next name for its class, and publishes it in devfs.
+	 */
 	string register_device(device &device);
 	void add_device_alias(device &device, const string& name);
 
+	/**
+	 * Removes a device (and any aliases) from the device manager and devfs.
+	 */
+	void unregister_device(device &device);
+
 	bool try_get_device_by_class(const device_class &cls, device *&ptr);
 	bool try_get_device_by_name(const string &name, device *&ptr);
 
@@ -62,7 +70,8 @@ public:
 	bus &sysbus() { return system_bus_; }
 
 private:
-	map<u64, device *> devices_;
+	spinlock_irq lock_;
+	list<device *> devices_;
 	list<bus *> buses_;
 	system_bus system_bus_;
 };
@@ -15,5 +15,10 @@ public:
 	virtual void configure() override { }
 
 	virtual rtc_timepoint read_timepoint() override;
+
+private:
+	static u8 read_register(u8 index);
+	static bool update_in_progress() { return read_register(0x0a) & 0x80; }
+	static rtc_timepoint read_raw();
 };
 } // namespace stacsos::kernel::dev::misc
@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+#include <stacsos/kernel/dev/device.h>
+#include <stacsos/kernel/lock.h>
+
+namespace stacsos::kernel::dev::misc {
+/**
+ * Writes straight to QEMU's debug console (port 0xe9), and nowhere else, so that programs can produce
+ * output for the host to collect without it appearing on the screen.
+ */
+class debug_console_device : public device {
+public:
+	static device_class debug_console_device_class;
+
+	debug_console_device(bus &owner)
+		: device(debug_console_device_class, owner)
+	{
+	}
+
+	virtual void configure() override { }
+
+	virtual shared_ptr<fs::file> open_as_file() override;
+
+private:
+	// Writes from different processes are kept whole, rather than interleaved byte by byte.
+	spinlock_irq lock_;
+};
+} // namespace stacsos::kernel::dev::misc
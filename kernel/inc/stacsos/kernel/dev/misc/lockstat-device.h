@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+#include <stacsos/kernel/dev/device.h>
+
+namespace stacsos::kernel::dev::misc {
+/**
+ * Reports the contention statistics of the kernel's named locks, as text.  The report is taken when
+ * the device is opened.  Writing anything to an opened device resets the statistics.
+ */
+class lockstat_device : public device {
+public:
+	static device_class lockstat_device_class;
+
+	lockstat_device(bus &owner)
+		: device(lockstat_device_class, owner)
+	{
+	}
+
+	virtual void configure() override { }
+
+	virtual shared_ptr<fs::file> open_as_file() override;
+};
+} // namespace stacsos::kernel::dev::misc
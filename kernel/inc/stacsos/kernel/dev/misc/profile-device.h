@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+#include <stacsos/kernel/dev/device.h>
+
+namespace stacsos::kernel::dev::misc {
+/**
+ * Exposes the profiler.  Reading an opened profile device returns the samples taken since it was last
+ * read (or since it was opened), as an array of profile_sample structures.  Addresses in the samples
+ * can be turned into function names with an ioctl.
+ */
+class profile_device : public device {
+public:
+	static device_class profile_device_class;
+
+	profile_device(bus &owner)
+		: device(profile_device_class, owner)
+	{
+	}
+
+	virtual void configure() override { }
+
+	virtual shared_ptr<fs::file> open_as_file() override;
+};
+} // namespace stacsos::kernel::dev::misc
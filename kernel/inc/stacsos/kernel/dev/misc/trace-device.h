@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+#include <stacsos/kernel/dev/device.h>
+
+namespace stacsos::kernel::dev::misc {
+/**
+ * Exposes the kernel's trace buffers.  Reading an opened trace device returns the records written
+ * since it was last read (or since it was opened), as an array of trace_record structures.
+ */
+class trace_device : public device {
+public:
+	static device_class trace_device_class;
+
+	trace_device(bus &owner)
+		: device(trace_device_class, owner)
+	{
+	}
+
+	virtual void configure() override { }
+
+	virtual shared_ptr<fs::file> open_as_file() override;
+};
+} // namespace stacsos::kernel::dev::misc
@@ -15,19 +15,31 @@ namespace stacsos::kernel::dev::storage {
 
 enum class ahci_port_type { none, sata, other };
 
+class ahci_storage_device;
+
 class ahci_controller : public bus {
 public:
 	ahci_controller(bus &parent, pci::pci_device &pcidev)
 		: bus(parent)
 		, pcidev_(pcidev)
+		, abar_(nullptr)
 	{
+		for (auto &d : port_devices_) {
+			d = nullptr;
+		}
 	}
 
 	virtual void probe() override;
 
+	void handle_interrupt();
+
 private:
 	ahci_port_type detect_port(volatile hba_port *port);
-	void activate_port(volatile hba_port *port, u64 clb, u64 fis);
+	void activate_port(int port_index, volatile hba_port *port, u64 clb, u64 fis);
+	bool setup_msi();
+
 	pci::pci_device &pcidev_;
+	volatile hba_mem *abar_;
+	ahci_storage_device *port_devices_[32];
 };
 } // namespace stacsos::kernel::dev::storage
@@ -9,17 +9,27 @@
 
 #include <stacsos/kernel/dev/storage/ahci-structures.h>
 #include <stacsos/kernel/dev/storage/block-device.h>
+#include <stacsos/kernel/lock.h>
 
 namespace stacsos::kernel::dev::storage {
 class ahci_storage_device : public block_device {
 public:
 	static device_class ahci_storage_device_class;
 
-	ahci_storage_device(bus &parent, volatile hba_port *port)
+	ahci_storage_device(bus &parent, volatile hba_port *port, u32 nr_hba_slots, bool hba_ncq)
 		: block_device(ahci_storage_device_class, parent)
 		, port_(port)
 		, nr_blocks_(0)
+		, nr_slots_(nr_hba_slots)
+		, ncq_(hba_ncq)
+		, irq_enabled_(false)
+		, busy_slots_(0)
+		, pending_head_(nullptr)
+		, pending_tail_(nullptr)
 	{
+		for (auto &rq : slot_requests_) {
+			rq = nullptr;
+		}
 	}
 
 	virtual ~ahci_storage_device() { }
@@ -28,14 +38,50 @@ public:
 
 	virtual u64 nr_blocks() const override { return nr_blocks_; }
 
-	virtual void read_blocks_sync(void *buffer, u64 start, u64 count) override;
-	virtual void write_blocks_sync(const void *buffer, u64 start, u64 count) override;
+	virtual void submit(block_io_request &rq) override;
+	virtual void poll() override;
+
+	/**
+	 * Called by the controller once its interrupt is routed, to switch over from polling.
+	 */
+	void enable_interrupts();
+
+	/**
+	 * Called by the controller when this port has raised an interrupt.
+	 */
+	void handle_interrupt();
+
+protected:
+	virtual bool completes_with_interrupt() const override { return irq_enabled_; }
 
 private:
 	volatile hba_port *port_;
 	u64 nr_blocks_;
 
-	volatile hba_cmd_header *get_free_cmd_slot(int &slot_index);
+	// The number of command slots in use, and whether commands are queued (with NCQ).  Without NCQ,
+	// only one command is ever in flight.
+	u32 nr_slots_;
+	bool ncq_;
+	bool irq_enabled_;
+
+	spinlock_irq lock_;
+	u32 busy_slots_;
+	block_io_request *slot_requests_[32];
+	block_io_request *pending_head_, *pending_tail_;
+
+	volatile hba_cmd_header *cmd_header(int slot_index)
+	{
+		u64 clb = ((u64)port_->command_list_base_addr_hi << 32) | port_->command_list_base_addr;
+		return &((hba_cmd_header *)phys_to_virt(clb))[slot_index];
+	}
+
+	void complete_finished(bool error);
+	void recover();
+
+	int find_free_slot() const;
+	void issue(int slot_index, block_io_request &rq);
+	void issue_pending();
+
 	void identify();
 };
 } // namespace stacsos::kernel::dev::storage
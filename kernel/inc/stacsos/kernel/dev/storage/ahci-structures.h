@@ -10,18 +10,36 @@
 namespace stacsos::kernel::dev::storage {
 #define SATA_SIG_ATA 0x00000101
 
+#define HBA_CAP_SNCQ (1u << 30)
+#define HBA_CAP_NCS(__cap) ((((__cap) >> 8) & 0x1f) + 1)
+
+#define HBA_GHC_IE (1u << 1)
+
 #define HBA_PxCMD_ST 0x0001
 #define HBA_PxCMD_FRE 0x0010
 #define HBA_PxCMD_FR 0x4000
 #define HBA_PxCMD_CR 0x8000
+#define HBA_PxIS_DHRS (1u << 0)
+#define HBA_PxIS_SDBS (1u << 3)
 #define HBA_PxIS_TFES (1u << 30)
+#define HBA_PxSCTL_DET_MASK 0xf
+#define HBA_PxSCTL_DET_INIT 0x1
+#define HBA_PxSSTS_DET_MASK 0xf
+#define HBA_PxSSTS_DET_PRESENT 0x3
 
 #define ATA_DEV_BUSY 0x80
 #define ATA_DEV_DRQ 0x08
 
-#define ATA_CMD_READ_DMA_EX 0xc8
+#define ATA_CMD_READ_DMA_EX 0x25
+#define ATA_CMD_WRITE_DMA_EX 0x35
+#define ATA_CMD_READ_FPDMA_QUEUED 0x60
+#define ATA_CMD_WRITE_FPDMA_QUEUED 0x61
 #define ATA_CMD_IDENTIFY 0xec
 
+// The command tables allocated for each command slot have room for this many PRDT entries.
+#define AHCI_CMD_TABLE_SIZE 0x100
+#define AHCI_MAX_PRDT_ENTRIES ((AHCI_CMD_TABLE_SIZE - 0x80) / 16)
+
 enum class fis_type : u8 {
 	FIS_TYPE_REG_H2D = 0x27, // Register FIS - host to device
 	FIS_TYPE_REG_D2H = 0x34, // Register FIS - device to host
@@ -0,0 +1,85 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+#include <stacsos/kernel/lock.h>
+#include <stacsos/kernel/sched/event.h>
+#include <stacsos/lru-list.h>
+
+namespace stacsos::kernel::dev::storage {
+class block_device;
+
+/**
+ * A cache of data read from block devices.  Data is cached a page (i.e. a "line" of blocks) at a time,
+ * looked up by (device, line) through a hash table, and the least recently used line is evicted to
+ * make room.  A miss reads the following lines too, so sequential reads mostly hit.
+ *
+ * The cache isn't locked while a line is being read from the device.  Instead, the line is marked as
+ * not ready, and anything else wanting it waits for it to become ready.
+ */
+class block_cache {
+	DEFINE_SINGLETON(block_cache)
+
+public:
+	/**
+	 * Copies length bytes, starting offset bytes into the device, into buffer.
+	 */
+	void read(block_device &bdev, void *buffer, u64 offset, size_t length);
+
+	u64 hits() const { return hits_; }
+	u64 misses() const { return misses_; }
+
+	void dump() const;
+
+private:
+	block_cache();
+
+	static const u64 block_size = 512;
+	static const u64 blocks_per_line = PAGE_SIZE / block_size;
+
+	static const size_t nr_lines = 256;
+	static const size_t nr_buckets = 64;
+
+	// A miss reads up to (1 << readahead_order) lines in one request.
+	static const int readahead_order = 3;
+
+	struct cache_line {
+		block_device *bdev;
+		u64 index;
+		u8 *data;
+		volatile bool ready;
+
+		cache_line *hash_next;
+		cache_line *lru_prev, *lru_next;
+	};
+
+	spinlock_irq lock_;
+
+	cache_line lines_[nr_lines];
+	cache_line *buckets_[nr_buckets];
+
+	// The most recently used line is at the head, and the next to be evicted at the tail.
+	lru_list<cache_line, &cache_line::lru_prev, &cache_line::lru_next> lru_;
+
+	// Triggered whenever a line becomes ready.
+	sched::event fill_complete_;
+
+	u64 hits_, misses_, readaheads_;
+
+	static size_t bucket_of(const block_device *bdev, u64 index);
+
+	cache_line *lookup(block_device &bdev, u64 index);
+	cache_line *fill(unique_irq_lock &l, block_device &bdev, u64 index);
+	cache_line *evict();
+
+	static void read_uncached(block_device &bdev, void *buffer, u64 index, u64 line_offset, size_t length);
+
+	void hash_insert(cache_line *line);
+	void hash_remove(cache_line *line);
+};
+} // namespace stacsos::kernel::dev::storage
@@ -8,12 +8,51 @@
 #pragma once
 
 #include <stacsos/kernel/dev/device.h>
+#include <stacsos/kernel/sched/event.h>
 
 namespace stacsos::kernel::dev::storage {
+enum class block_io_direction { read, write };
+
+/**
+ * A piece of memory taking part in a transfer.  Its length must be a multiple of the block size.
+ */
+struct block_io_segment {
+	void *buffer;
+	u64 length;
+};
+
+struct block_io_request;
+using block_io_completion_fn = void (*)(block_io_request &rq, void *arg);
+
+/**
+ * A request to transfer count blocks, starting at block start, to or from the segments (which are
+ * filled in order).  When the transfer is complete, on_complete is called -- possibly from an
+ * interrupt handler, and possibly before submit() returns.
+ */
+struct block_io_request {
+	block_io_direction direction;
+	u64 start, count;
+
+	block_io_segment *segments;
+	u32 nr_segments;
+
+	block_io_completion_fn on_complete;
+	void *arg;
+
+	// Set by the device if the transfer failed, in which case the contents of the buffers are undefined.
+	bool failed;
+
+	// Used by the block layer and the device.
+	volatile bool done;
+	block_io_request *next;
+};
+
 class block_device : public device {
 public:
 	static device_class block_device_class;
 
+	static const u64 block_size = 512;
+
 	block_device(device_class &devclass, bus &parent)
 		: device(devclass, parent)
 	{
@@ -23,7 +62,48 @@ public:
 
 	virtual u64 nr_blocks() const = 0;
 
-	virtual void read_blocks_sync(void *buffer, u64 start, u64 count) = 0;
-	virtual void write_blocks_sync(const void *buffer, u64 start, u64 count) = 0;
+	/**
+	 * Queues a request with the device, and returns without waiting for it to complete.
+	 */
+	virtual void submit(block_io_request &rq) = 0;
+
+	/**
+	 * Completes any requests that the device has finished with, without waiting for an interrupt.
+	 */
+	virtual void poll() = 0;
+
+	/**
+	 * Submits a request (whose on_complete must be null) and waits for it to complete.  If it's
+	 * possible, only the calling thread is blocked.  Otherwise, e.g. with interrupts disabled, the
+	 * device is polled.  Returns false if the transfer failed.
+	 */
+	bool submit_and_wait(block_io_request &rq);
+
+	bool read_blocks_sync(void *buffer, u64 start, u64 count);
+	bool write_blocks_sync(const void *buffer, u64 start, u64 count);
+
+	/**
+	 * Whether the current context can block waiting for I/O.
+	 */
+	static bool can_sleep();
+
+protected:
+	/**
+	 * Whether the device signals completed requests with an interrupt.  If not, waiting always polls.
+	 */
+	virtual bool completes_with_interrupt() const = 0;
+
+	/**
+	 * Called by the device when a request has completed.
+	 */
+	void complete_request(block_io_request &rq);
+
+private:
+	// Requests are split up so that transfers don't get too big for the device.
+	static const u64 max_sync_blocks = 2048;
+
+	sched::event io_complete_;
+
+	bool transfer_sync(block_io_direction direction, void *buffer, u64 start, u64 count);
 };
 } // namespace stacsos::kernel::dev::storage
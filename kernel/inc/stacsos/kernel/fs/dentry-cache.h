@@ -0,0 +1,86 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+#include <stacsos/kernel/lock.h>
+#include <stacsos/lru-list.h>
+
+namespace stacsos::kernel::fs {
+class fs_node;
+
+/**
+ * A cache of directory entries, i.e. the results of looking up a name in a directory, keyed by the
+ * directory node and a hash of the name.  Names that don't exist are cached too (as negative
+ * entries), so that repeatedly searching for something that isn't there is just as cheap.  The least
+ * recently used entry is reused when the cache is full.
+ */
+class dentry_cache {
+	DEFINE_SINGLETON(dentry_cache)
+
+public:
+	// Longer names still resolve, but aren't cached.
+	static const size_t max_name_length = 55;
+
+	static u32 hash_name(const char *name, size_t length);
+
+	/**
+	 * Looks up a name in the cache.  Returns false on a miss.  On a hit, node is set to the child, or
+	 * null if the child is known not to exist.
+	 */
+	bool lookup(const fs_node &parent, const char *name, size_t length, u32 hash, fs_node *&node);
+
+	/**
+	 * Records the result of resolving a name, which began when the generation was as given.  If
+	 * anything was invalidated in the meantime, the result may be stale, and is dropped.
+	 */
+	void insert(const fs_node &parent, const char *name, size_t length, u32 hash, fs_node *node, u64 generation);
+
+	/**
+	 * Drops any entry for the name, e.g. because it has just been created.
+	 */
+	void invalidate(const fs_node &parent, const char *name, size_t length);
+
+	u64 generation() const { return generation_; }
+
+	void dump() const;
+
+private:
+	dentry_cache();
+
+	static const size_t nr_entries = 1024;
+	static const size_t nr_buckets = 512;
+
+	struct dentry {
+		const fs_node *parent;
+		fs_node *node;
+		u32 hash;
+		u32 name_length;
+		char name[max_name_length + 1];
+
+		dentry *hash_next;
+		dentry *lru_prev, *lru_next;
+	};
+
+	spinlock_irq lock_;
+
+	dentry entries_[nr_entries];
+	dentry *buckets_[nr_buckets];
+
+	// The most recently used entry is at the head, and the next to be reused at the tail.
+	lru_list<dentry, &dentry::lru_prev, &dentry::lru_next> lru_;
+
+	volatile u64 generation_;
+	u64 hits_, misses_, negative_hits_;
+
+	static size_t bucket_of(const fs_node *parent, u32 hash);
+
+	dentry *find(const fs_node &parent, const char *name, size_t length, u32 hash);
+
+	void hash_remove(dentry *d);
+};
+} // namespace stacsos::kernel::fs
@@ -9,6 +9,16 @@
 
 namespace stacsos::kernel::fs {
 class filesystem;
+
+/**
+ * Identifies the data behind a file, so that files opened separately on the same data can share cached
+ * pages.  Files whose data can't be cached (e.g. devices) have a null owner.
+ */
+struct file_identity {
+	const void *owner;
+	u64 id;
+};
+
 class file {
 public:
 	file(u64 size)
@@ -19,8 +29,12 @@ public:
 
 	virtual ~file() { }
 
+	u64 size() const { return size_; }
+
 	virtual u64 ioctl(u64 cmd, void *buffer, size_t length) { return 0; }
 
+	virtual file_identity identity() const { return file_identity { nullptr, 0 }; }
+
 	virtual size_t pread(void *buffer, size_t offset, size_t length) = 0;
 	virtual size_t pwrite(const void *buffer, size_t offset, size_t length) = 0;
 
@@ -19,11 +19,26 @@ namespace stacsos::kernel::fs {
 enum class fs_type_hint { best_guess, tarfs };
 
 class filesystem {
+	friend class fs_node;
+
 public:
+	filesystem()
+		: mount_point_(nullptr)
+	{
+	}
+
 	virtual fs_node &root() = 0;
 
+	/**
+	 * The node this filesystem is mounted on, or null if it isn't mounted.
+	 */
+	fs_node *mount_point() const { return mount_point_; }
+
 	virtual ~filesystem() { }
 	static filesystem *create_from_bdev(dev::storage::block_device &bdev, fs_type_hint hint);
+
+private:
+	fs_node *mount_point_;
 };
 
 class physical_filesystem : public filesystem {
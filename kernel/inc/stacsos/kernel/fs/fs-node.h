@@ -7,6 +7,7 @@
  */
 #pragma once
 
+#include <stacsos/list.h>
 #include <stacsos/memory.h>
 #include <stacsos/string.h>
 
@@ -28,28 +29,49 @@ public:
 	{
 	}
 
-	void mount(filesystem &fs) { mounted_fs_ = &fs; }
-	void umount() { mounted_fs_ = nullptr; }
+	void mount(filesystem &fs);
+	void umount();
 
 	fs_node_kind kind() const { return kind_; }
 
+	/**
+	 * Resolves a path relative to this node.  "." and ".." are understood.  A ".." at the root of a
+	 * mounted filesystem goes to the parent of the node it's mounted on, and at the top of the tree it
+	 * stays where it is.
+	 */
 	fs_node *lookup(const char *path);
 
 	filesystem &fs() const { return fs_; }
+	fs_node *parent() const { return parent_node_; }
 
 	const string &name() const { return name_; }
 
 	virtual shared_ptr<file> open() = 0;
 	virtual fs_node *mkdir(const char *name) = 0;
 
+	/**
+	 * Appends the children of this node to the list, for directory listings.
+	 */
+	virtual void list_children(list<fs_node *> &children) { }
+
+	virtual u64 size() const { return 0; }
+
 protected:
 	virtual fs_node *resolve_child(const string &name) { return nullptr; }
 
+	/**
+	 * Must be called when a child is created or removed, so that the lookup cache forgets about it.
+	 */
+	void child_added(const string &name);
+	void child_removed(const string &name);
+
 private:
 	filesystem &fs_;
 	fs_node *parent_node_;
 	fs_node_kind kind_;
 	filesystem *mounted_fs_;
 	string name_;
+
+	fs_node *lookup_child(const char *name, size_t length);
 };
 } // namespace stacsos::kernel::fs
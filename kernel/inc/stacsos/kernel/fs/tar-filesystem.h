@@ -43,11 +43,11 @@ public:
 	virtual size_t pread(void *buffer, size_t offset, size_t length);
 	virtual size_t pwrite(const void *buffer, size_t offset, size_t length);
 
+	virtual file_identity identity() const override { return file_identity { &fs_, data_start_ }; }
+
 private:
 	tar_filesystem &fs_;
 	u64 data_start_;
-
-	void read_file_blocks(void *buffer, u64 offset, u64 count);
 };
 
 class tarfs_node : public fs_node {
@@ -64,6 +64,15 @@ public:
 	virtual shared_ptr<file> open() override { return shared_ptr<file>(new tarfs_file((tar_filesystem &)fs(), data_start_, data_size_)); }
 	virtual fs_node *mkdir(const char *name) override;
 
+	virtual void list_children(list<fs_node *> &children) override
+	{
+		for (auto *child : children_) {
+			children.append(child);
+		}
+	}
+
+	virtual u64 size() const override { return data_size_; }
+
 	/* Created these extra functions so that in syscall.cpp, tarfs_node* are not casted to fs_node (which isn't generalisable/safe).
 	   These functions allow the access of a fs_node* through indexing. 
 	   
@@ -85,6 +94,7 @@ private:
 	{
 		auto *node = new tarfs_node(fs(), this, kind, name, data_start, data_size);
 		children_.append(node);
+		child_added(name);
 		name_ = name;
 		kind_ = kind;
 		return node;
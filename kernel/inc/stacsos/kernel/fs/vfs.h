@@ -19,8 +19,22 @@ private:
 
 	root_filesystem rootfs_;
 
+	static bool append_path(char *buffer, size_t size, size_t &length, const char *path);
+
 public:
 	void init();
-	fs_node *lookup(const char *path);
+
+	fs_node &root() { return rootfs_.root(); }
+
+	/**
+	 * Looks up a path.  Relative paths are resolved from cwd, or from the root if cwd is null.
+	 */
+	fs_node *lookup(const char *path, fs_node *cwd = nullptr);
+
+	/**
+	 * Produces the absolute form of a path, relative to the absolute path base, with any "." and ".."
+	 * components removed.  Returns false if the result doesn't fit in the buffer.
+	 */
+	static bool canonicalise_path(const char *base, const char *path, char *buffer, size_t size);
 };
 } // namespace stacsos::kernel::fs
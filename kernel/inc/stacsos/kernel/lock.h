@@ -11,41 +11,185 @@
 
 typedef unsigned int spinlock_var_t;
 extern "C" void spinlock_acquire(spinlock_var_t *lv);
+extern "C" bool spinlock_try_acquire(spinlock_var_t *lv);
 extern "C" void spinlock_release(spinlock_var_t *lv);
-extern "C" void spinlock_irq_acquire(spinlock_var_t *lv, u64 *flags);
-extern "C" void spinlock_irq_release(spinlock_var_t *lv, u64 flags);
 
 namespace stacsos::kernel {
-class spinlock {
+/**
+ * The algorithm behind every spinlock, chosen once at boot with the "spinlock" option.
+ *
+ *  - test_and_set: a single bit that every waiter hammers on.  Cheap, but unfair.
+ *  - ticket: waiters take a ticket, and are served in order.  Fair, but every waiter still spins on
+ *    the same cache line.
+ *  - mcs: waiters queue up, and each spins on its own queue node.  Fair, and a release only touches
+ *    the next waiter's cache line.
+ */
+enum class spinlock_implementation { test_and_set, ticket, mcs };
+
+/**
+ * Contention statistics for a lock.  A lock only collects statistics if it is given one of these
+ * when it is constructed, and if the "lockstat" boot option is set.  Every instance is registered on
+ * a global list (which is reported through /dev/lockstat), and is never removed, so these should
+ * only be given to locks that live forever.  Instances with the same name are reported together.
+ */
+class lock_stats {
+	friend class spinlock_base;
+
+public:
+	explicit lock_stats(const char *name);
+
+	static bool enabled() { return enabled_; }
+	static lock_stats *first() { return first_; }
+
+	const char *name() const { return name_; }
+	lock_stats *next() const { return next_; }
+
+	u64 acquisitions() const { return acquisitions_; }
+	u64 contended() const { return contended_; }
+	u64 spin_cycles() const { return spin_cycles_; }
+	u64 max_hold_cycles() const { return max_hold_cycles_; }
+
+	void reset();
+
+private:
+	DELETE_DEFAULT_COPY_AND_MOVE(lock_stats);
+
+	static bool enabled_;
+	static lock_stats *first_;
+
+	const char *name_;
+	lock_stats *next_;
+
+	// These are only updated by the holder of the lock, so don't need to be atomic.
+	u64 acquisitions_;
+	u64 contended_;
+	u64 spin_cycles_;
+	u64 max_hold_cycles_;
+};
+
+/**
+ * The state shared by all of the spinlock implementations.  Which implementation is used is a global
+ * choice, and must be made (by init()) before any lock is taken.
+ */
+class spinlock_base {
 public:
-	spinlock()
-		: spin_lock_var_(0)
+	static void init();
+
+	static spinlock_implementation implementation() { return implementation_; }
+
+protected:
+	spinlock_base()
+		: stats_(nullptr)
+		, acquired_at_(0)
+	{
+		state_.mcs.next = nullptr;
+		state_.mcs.tail = nullptr;
+	}
+
+	explicit spinlock_base(lock_stats &stats)
+		: spinlock_base()
+	{
+		stats_ = &stats;
+	}
+
+	void acquire()
 	{
+		if (stats_ && lock_stats::enabled()) {
+			acquire_with_stats();
+		} else {
+			acquire_raw();
+		}
 	}
 
-	void lock() { ::spinlock_acquire(&spin_lock_var_); }
-	void unlock() { ::spinlock_release(&spin_lock_var_); }
+	void release()
+	{
+		if (stats_ && lock_stats::enabled()) {
+			release_with_stats();
+		} else {
+			release_raw();
+		}
+	}
 
 private:
-	DELETE_DEFAULT_COPY_AND_MOVE(spinlock);
+	DELETE_DEFAULT_COPY_AND_MOVE(spinlock_base);
+
+	static spinlock_implementation implementation_;
+
+	/**
+	 * A node in an MCS queue.  The lock itself holds one, which stands in for the holder, so that the
+	 * waiters' nodes only have to live (on their stacks) for as long as they are waiting.
+	 */
+	struct mcs_node {
+		mcs_node *volatile next;
+		mcs_node *volatile tail;
+	};
+
+	struct ticket_state {
+		volatile u16 owner;
+		volatile u16 next;
+	};
+
+	union {
+		spinlock_var_t tas;
+		ticket_state ticket;
+		mcs_node mcs;
+	} state_;
+
+	lock_stats *stats_;
+	u64 acquired_at_;
+
+	void acquire_raw();
+	bool try_acquire_raw();
+	void release_raw();
+
+	void acquire_with_stats();
+	void release_with_stats();
+
+	void ticket_acquire();
+	bool ticket_try_acquire();
+	void ticket_release();
+
+	void mcs_acquire();
+	bool mcs_try_acquire();
+	void mcs_release();
+};
+
+class spinlock : public spinlock_base {
+public:
+	spinlock() { }
 
-	spinlock_var_t spin_lock_var_;
+	explicit spinlock(lock_stats &stats)
+		: spinlock_base(stats)
+	{
+	}
+
+	void lock() { acquire(); }
+	void unlock() { release(); }
 };
 
-class spinlock_irq {
+class spinlock_irq : public spinlock_base {
 public:
-	spinlock_irq()
-		: spin_lock_var_(0)
+	spinlock_irq() { }
+
+	explicit spinlock_irq(lock_stats &stats)
+		: spinlock_base(stats)
 	{
 	}
 
-	void lock(u64 *flags) { ::spinlock_irq_acquire(&spin_lock_var_, flags); }
-	void unlock(u64 flags) { ::spinlock_irq_release(&spin_lock_var_, flags); }
+	void lock(u64 *flags)
+	{
+		asm volatile("pushfq; popq %0; cli" : "=r"(*flags)::"memory");
+		acquire();
+	}
 
-private:
-	DELETE_DEFAULT_COPY_AND_MOVE(spinlock_irq);
+	void unlock(u64 flags)
+	{
+		release();
 
-	spinlock_var_t spin_lock_var_;
+		if (flags & (1ul << 9)) {
+			asm volatile("sti" ::: "memory");
+		}
+	}
 };
 
 class unique_irq_lock {
@@ -53,6 +197,7 @@ public:
 	explicit unique_irq_lock(spinlock_irq &o)
 		: mutex_(&o)
 		, owner_(false)
+		, flags_(0)
 	{
 		lock();
 		owner_ = true;
@@ -66,6 +211,7 @@ public:
 	unique_irq_lock(unique_irq_lock &&o) noexcept
 		: mutex_(o.mutex_)
 		, owner_(o.owner_)
+		, flags_(o.flags_)
 	{
 		o.mutex_ = nullptr;
 		o.owner_ = false;
@@ -7,6 +7,9 @@
  */
 #pragma once
 
+#include <stacsos/kernel/fs/file.h>
+#include <stacsos/memory.h>
+
 namespace stacsos::kernel::mem {
 class page;
 
@@ -19,5 +22,21 @@ public:
 	u64 base, size;
 	region_flags flags;
 	page *storage;
+
+	// Regions without storage are populated a page at a time, as they are touched.  If a file is
+	// attached, file_size bytes from file_offset in the file appear file_start bytes into the region,
+	// and everything else reads as zero.
+	shared_ptr<fs::file> file;
+	u64 file_offset, file_start, file_size;
+
+	// If cached is set, the file's pages are mapped straight from the page cache (and file_start is
+	// zero), rather than copied.  Writes to a shared region go to the cached page, and so are seen by
+	// everything else mapping the file.  A private region gets its own copy of a page when it's first
+	// written to.
+	bool cached, shared;
+
+	// A pinned region is being used by the kernel (e.g. it holds an I/O ring), so the process can't
+	// remove it.
+	bool pinned;
 };
 } // namespace stacsos::kernel::mem
@@ -7,6 +7,7 @@
  */
 #pragma once
 
+#include <stacsos/kernel/lock.h>
 #include <stacsos/kernel/mem/address-space-region.h>
 #include <stacsos/kernel/mem/page-table.h>
 #include <stacsos/list.h>
@@ -22,6 +23,7 @@ public:
 	address_space(page_table_allocator &pta, u64 alloc_rgn_start)
 		: pta_(pta)
 		, pt_(page_table::create_empty(pta))
+		, regions_generation_(0)
 		, next_alloc_rgn_(alloc_rgn_start)
 	{
 	}
@@ -32,7 +34,20 @@ public:
 
 	address_space_region *alloc_region(u64 size, region_flags flags, bool allocate);
 	address_space_region *add_region(u64 base, u64 size, region_flags flags, bool allocate);
-	void remove_region(u64 base, u64 size, region_flags flags);
+
+	/**
+	 * Removes the region that starts at base and is size bytes long, and releases its memory.  Only
+	 * whole regions that aren't pinned can be removed.
+	 */
+	bool remove_region(u64 base, u64 size);
+
+	/**
+	 * Maps length bytes of a file, from offset (which must be page aligned), through the page cache.
+	 * The file must have an identity.
+	 */
+	address_space_region *map_file(shared_ptr<fs::file> file, u64 offset, u64 length, region_flags flags, bool shared);
+
+	bool handle_fault(u64 address, bool write, bool present);
 
 	address_space_region *get_region_from_address(u64 address)
 	{
@@ -48,17 +63,28 @@ public:
 	address_space *create_linked(u64 alloc_rgn_start);
 
 private:
+	static mapping_flags flags_for(region_flags flags);
+	static u64 file_page_index(const address_space_region &rgn, u64 page_base) { return (rgn.file_offset + (page_base - rgn.base)) >> PAGE_BITS; }
+
+	page *copy_page(const page &source);
+
 	address_space(page_table_allocator &pta, page_table *pt, u64 alloc_rgn_start)
 		: pta_(pta)
 		, pt_(pt)
+		, regions_generation_(0)
 		, next_alloc_rgn_(alloc_rgn_start)
 	{
 	}
 
 	page_table_allocator &pta_;
 	page_table *pt_;
+	spinlock_irq fault_lock_;
 
 	list<address_space_region *> regions_;
+
+	// Bumped (under the fault lock) whenever a region is removed, so that a fault that dropped the lock
+	// can tell whether its region might have gone.
+	u64 regions_generation_;
 	u64 next_alloc_rgn_;
 };
 } // namespace stacsos::kernel::mem
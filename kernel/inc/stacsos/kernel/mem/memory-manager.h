@@ -38,7 +38,7 @@ public:
 
 	address_space &root_address_space() const { return *root_address_space_; }
 
-	bool try_handle_page_fault(u64 faulting_address);
+	bool try_handle_page_fault(u64 faulting_address, bool write, bool present);
 
 private:
 	void initialise_page_descriptors(u64 nr_page_descriptors);
@@ -23,6 +23,8 @@ public:
 	void free(void *obj);
 
 private:
+	// The slab caches do their own (per-core) locking, so this only protects the large object allocator.
+	lock_stats object_allocator_lock_stats_;
 	spinlock_irq object_allocator_lock_;
 
 	slab_cache<16, 0> cache16_;
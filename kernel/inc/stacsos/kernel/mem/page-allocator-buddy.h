@@ -7,6 +7,8 @@
  */
 #pragma once
 
+#include <stacsos/kernel/arch/core-manager.h>
+#include <stacsos/kernel/lock.h>
 #include <stacsos/kernel/mem/page-allocator.h>
 
 namespace stacsos::kernel::mem {
@@ -14,6 +16,10 @@ class page_allocator_buddy : public page_allocator {
 public:
 	page_allocator_buddy(memory_manager &mm)
 		: page_allocator(mm)
+		, lock_stats_("page-allocator")
+		, lock_(lock_stats_)
+		, total_free_(0)
+		, max_pfn_(0)
 	{
 		for (int i = 0; i <= LastOrder; i++) {
 			free_list_[i] = nullptr;
@@ -26,22 +32,59 @@ public:
 	virtual page *allocate_pages(int order, page_allocation_flags flags = page_allocation_flags::none) override;
 	virtual void free_pages(page &base, int order) override;
 
+	virtual u64 nr_free_pages() const override;
+
 	virtual void dump() const override;
 
 private:
 	static const int LastOrder = 16;
 
+	// The number of order-0 pages each core can hold on to, and the number moved between a core's
+	// cache and the free lists at once.
+	static const u32 page_cache_capacity = 32;
+	static const u32 page_cache_batch = page_cache_capacity / 2;
+
+	/**
+	 * A per-core stack of free order-0 pages.  As far as the free lists are concerned, these pages are
+	 * allocated.
+	 */
+	struct page_cache {
+		page_cache()
+			: stats("page-cache")
+			, lock(stats)
+			, count(0)
+		{
+		}
+
+		lock_stats stats;
+		spinlock_irq lock;
+		u32 count;
+		page *pages[page_cache_capacity];
+	};
+
+	lock_stats lock_stats_;
+	spinlock_irq lock_;
 	page *free_list_[LastOrder + 1];
 	u64 total_free_;
+	u64 max_pfn_;
 
-	constexpr u64 pages_per_block(int order) const { return 1 << order; }
+	page_cache page_caches_[arch::core_manager::max_cores];
+
+	constexpr u64 pages_per_block(int order) const { return 1ull << order; }
 
 	constexpr bool block_aligned(int order, u64 pfn) { return !(pfn & (pages_per_block(order) - 1)); }
 
+	bool is_free_block(int order, page &block_start) const;
+
 	void insert_free_block(int order, page &block_start);
 	void remove_free_block(int order, page &block_start);
 
 	void split_block(int order, page &block_start);
 	void merge_buddies(int order, page &buddy);
+
+	page *allocate_block(int order);
+	void free_block(int order, page &block_start);
+
+	page_cache &local_page_cache();
 };
 } // namespace stacsos::kernel::mem
@@ -7,6 +7,7 @@
  */
 #pragma once
 
+#include <stacsos/kernel/lock.h>
 #include <stacsos/kernel/mem/page-allocator.h>
 
 namespace stacsos::kernel::mem {
@@ -25,9 +26,14 @@ public:
 	virtual page *allocate_pages(int order, page_allocation_flags flags = page_allocation_flags::none) override;
 	virtual void free_pages(page &base, int order) override;
 
+	virtual u64 nr_free_pages() const override;
+
 	virtual void dump() const override;
 
 private:
+	spinlock_irq lock_;
 	page *free_list_;
+
+	void insert_free_range(page &range_start, u64 page_count);
 };
 } // namespace stacsos::kernel::mem
@@ -36,9 +36,16 @@ public:
 		return page_alloc_ref(allocate_pages(order, flags), order);
 	}
 
+	/**
+	 * The number of pages available for allocation.  This is not synchronised with allocations, so is
+	 * only a snapshot.
+	 */
+	virtual u64 nr_free_pages() const = 0;
+
 	virtual void dump() const = 0;
 
 	void perform_selftest();
+	void perform_stress_test();
 
 private:
 	memory_manager &mm_;
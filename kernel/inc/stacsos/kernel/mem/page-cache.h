@@ -0,0 +1,75 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+#include <stacsos/kernel/lock.h>
+#include <stacsos/lru-list.h>
+
+namespace stacsos::kernel::fs {
+class file;
+}
+
+namespace stacsos::kernel::mem {
+class page;
+
+/**
+ * A cache of file pages, shared by everything that maps the same file, looked up by the file's
+ * identity and the page index.  Pages are reference counted by their users, and pages that nobody is
+ * using stay cached (in least recently used order) until the cache fills up.
+ */
+class page_cache {
+	DEFINE_SINGLETON(page_cache)
+
+public:
+	/**
+	 * Returns the page holding the given page of the file, reading it in if necessary, with a
+	 * reference taken for the caller.  The file must have an identity.
+	 */
+	page *get(fs::file &f, u64 index);
+
+	/**
+	 * Drops a reference taken by get().  Returns false (and does nothing) if the page isn't the cached
+	 * page for that part of the file, e.g. because it's a private copy.
+	 */
+	bool put(fs::file &f, u64 index, page &pg);
+
+	void dump() const;
+
+private:
+	page_cache();
+
+	static const size_t nr_buckets = 256;
+
+	// Unused pages are dropped to keep the cache at this size.  Pages in use are never dropped.
+	static const size_t max_cached_pages = 4096;
+
+	struct entry {
+		const void *owner;
+		u64 id, index;
+		page *pg;
+		u32 users;
+
+		entry *hash_next;
+		entry *idle_prev, *idle_next;
+	};
+
+	spinlock_irq lock_;
+	entry *buckets_[nr_buckets];
+
+	// Entries that nobody is using, with the least recently used at the tail.
+	lru_list<entry, &entry::idle_prev, &entry::idle_next> idle_;
+
+	size_t nr_pages_;
+	u64 hits_, misses_;
+
+	static size_t bucket_of(const void *owner, u64 id, u64 index);
+
+	entry *lookup(const void *owner, u64 id, u64 index);
+	void drop(entry *e);
+};
+} // namespace stacsos::kernel::mem
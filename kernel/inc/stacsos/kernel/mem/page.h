@@ -7,7 +7,10 @@
  */
 #pragma once
 
-extern "C" void *_DYNAMIC_DATA_START;
+// The page descriptor array starts here.  This is a linker symbol, so it's declared as an array of
+// unknown size: declared as a single object, the compiler thinks every descriptor past the first is out
+// of bounds.
+extern "C" char _DYNAMIC_DATA_START[];
 
 namespace stacsos::kernel::mem {
 enum class page_type : u32 { none, reserved, system, allocable };
@@ -34,13 +37,18 @@ public:
 	void acquire() { refcount_++; }
 	bool release() { return !(refcount_--); }
 
+	// The slab this page belongs to, if it is part of the object allocator.
+	void *slab() const { return slab_; }
+	void set_slab(void *slab) { slab_ = slab; }
+
 private:
-	static page *get_pagearray() { return reinterpret_cast<page *>(&_DYNAMIC_DATA_START); }
+	static page *get_pagearray() { return reinterpret_cast<page *>(_DYNAMIC_DATA_START); }
 
 	page_type type_;
 	page_state state_;
 	page *next_free_;
 	u64 free_block_size_;
 	u64 refcount_;
+	void *slab_;
 };
 } // namespace stacsos::kernel::mem
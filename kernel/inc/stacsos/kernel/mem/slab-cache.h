@@ -8,33 +8,60 @@
 #pragma once
 
 #include <stacsos/bitset.h>
+#include <stacsos/kernel/arch/core-manager.h>
+#include <stacsos/kernel/lock.h>
 
 namespace stacsos::kernel::mem {
 enum class slab_state { empty, partial, full };
 
-template <size_t object_size, int slab_page_order> class slab_cache {
+/**
+ * The size-independent interface to a slab cache, used to return an object to the cache it came from.
+ */
+class slab_cache_base {
+public:
+	virtual void free(void *ptr) = 0;
+};
+
+/**
+ * The start of every slab.  The page descriptors of a slab's pages point here, so the cache that owns
+ * an object can be found from the object's address without searching.
+ */
+struct slab_header {
+	slab_cache_base *cache;
+};
+
+template <size_t object_size, int slab_page_order> class slab_cache : public slab_cache_base {
 private:
 	static const size_t slab_memory_size = ((1u << slab_page_order) * PAGE_SIZE);
 	static const size_t slab_object_capacity = slab_memory_size / object_size;
 
-	class slab {
+	// The number of objects each core can hold on to, and the number moved between a magazine and the
+	// slabs at once.  Moving half a magazine at a time means alternating allocations and frees at the
+	// boundary don't thrash the slab lock.
+	static const u32 magazine_capacity = 32;
+	static const u32 magazine_batch = magazine_capacity / 2;
+
+	// The number of empty slabs kept around before they are returned to the page allocator.
+	static const size_t max_empty_slabs = 1;
+
+	class slab : public slab_header {
 		friend class slab_cache;
 
 		static const size_t header_size = sizeof(slab);
 		static const size_t reserved_objects = (header_size + (object_size - 1)) / object_size;
 
-		friend class cache;
-
 		using object_index_type = u64;
 
 	public:
-		slab()
-			: next_(nullptr)
+		slab(slab_cache *owner)
+			: prev_(nullptr)
+			, next_(nullptr)
 			, used_count_(0)
 		{
+			cache = owner;
+
 			for (u64 i = 0; i < reserved_objects; i++) {
 				used_[i] = true;
-				used_count_++;
 			}
 		}
 
@@ -43,7 +70,8 @@ private:
 			return (used_objects() == 0) ? slab_state::empty : ((used_objects() == capacity()) ? slab_state::full : slab_state::partial);
 		}
 
-		size_t capacity() const { return slab_object_capacity; }
+		// The reserved objects (which hold the header) are never handed out, so aren't counted.
+		size_t capacity() const { return slab_object_capacity - reserved_objects; }
 
 		size_t used_objects() const { return used_count_; }
 
@@ -67,87 +95,111 @@ private:
 		{
 			u64 used_object = index_of(ptr);
 
+			if (used_object < reserved_objects || !used_[used_object]) {
+				panic("invalid free of object %p", ptr);
+			}
+
 			used_[used_object] = false;
 			used_count_--;
 		}
 
-		bool contains_object(void *ptr) { return ((uintptr_t)ptr >= (uintptr_t)this) && ((uintptr_t)ptr < (uintptr_t)this + slab_memory_size); }
-
 		void *object_ptr(object_index_type object_index) { return (void *)((uintptr_t)this + (object_index * object_size)); }
 
 		object_index_type index_of(void *object_ptr) { return ((uintptr_t)object_ptr - (uintptr_t)this) / object_size; }
 
 	private:
-		slab *next_;
+		slab *prev_, *next_;
 		size_t used_count_;
 		stacsos::bitset<slab_object_capacity> used_;
 	};
 
-public:
-	slab_cache()
-		: slabs_(nullptr)
-	{
-	}
+	/**
+	 * An intrusive list of slabs in the same state.
+	 */
+	struct slab_list {
+		slab *head;
+		size_t count;
 
-	void *allocate()
-	{
-		// Find a free slab
-		slab *s = slabs_;
-		while (s && s->state() == slab_state::full) {
-			s = s->next_;
-		}
+		void push(slab *s)
+		{
+			s->prev_ = nullptr;
+			s->next_ = head;
 
-		if (!s) {
-			// Allocate a new slab
-			void *slab_base = allocate_slab();
-			if (!slab_base) {
-				panic("out of memory");
+			if (head) {
+				head->prev_ = s;
 			}
 
-			s = new (slab_base) slab();
-			s->next_ = slabs_;
-			slabs_ = s;
+			head = s;
+			count++;
 		}
 
-		void *ptr = s->allocate();
-		// dprintf("malloc: cache-size=%u, slab=%p, ptr=%p\n", object_size, s, ptr);
-		return ptr;
-	}
+		void remove(slab *s)
+		{
+			if (s->prev_) {
+				s->prev_->next_ = s->next_;
+			} else {
+				head = s->next_;
+			}
 
-	bool try_free(void *ptr)
-	{
-		// Find containing slab
-		slab *s = slabs_;
-		while (s) {
-			if (s->contains_object(ptr)) {
-				break;
+			if (s->next_) {
+				s->next_->prev_ = s->prev_;
 			}
 
-			s = s->next_;
+			s->prev_ = s->next_ = nullptr;
+			count--;
 		}
+	};
 
-		if (!s) {
-			return false;
+	/**
+	 * A per-core stack of free objects, which sits in front of the slabs.  The lock is only ever
+	 * contended if a thread migrates between looking up its magazine and locking it.
+	 */
+	struct magazine {
+		spinlock_irq lock;
+		u32 count;
+		void *objects[magazine_capacity];
+	};
+
+public:
+	slab_cache()
+		: lock_stats_("slab-cache")
+		, lock_(lock_stats_)
+		, partial_ { nullptr, 0 }
+		, full_ { nullptr, 0 }
+		, empty_ { nullptr, 0 }
+	{
+		for (auto &m : magazines_) {
+			m.count = 0;
 		}
+	}
 
-		s->free(ptr);
-		// dprintf("free: ptr=%p\n", ptr);
+	void *allocate();
+	virtual void free(void *ptr) override;
 
-		// TODO: Free slabs?
+private:
+	lock_stats lock_stats_;
+	spinlock_irq lock_;
+	slab_list partial_, full_, empty_;
+	magazine magazines_[arch::core_manager::max_cores];
 
-		return true;
-	}
+	magazine &local_magazine();
 
-	void free(void *ptr)
+	slab_list &list_for(slab_state state)
 	{
-		if (!try_free(ptr)) {
-			panic("object not in cache\n");
+		switch (state) {
+		case slab_state::empty:
+			return empty_;
+		case slab_state::partial:
+			return partial_;
+		default:
+			return full_;
 		}
 	}
 
-private:
-	slab *slabs_;
+	void *allocate_object();
+	void free_object(void *ptr);
 
-	void *allocate_slab();
+	slab *allocate_slab();
+	void release_slab(slab *s);
 };
 } // namespace stacsos::kernel::mem
@@ -0,0 +1,75 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+#include <stacsos/kernel/lock.h>
+#include <stacsos/memory.h>
+
+namespace stacsos::kernel::obj {
+class object;
+
+/**
+ * A process's table of open objects, indexed by handle.  A handle is a slot index in the low 32 bits,
+ * and the slot's generation in the high 32 bits.  The generation changes every time a slot is freed, so
+ * a handle that has been closed can't be used to get at whatever takes over its slot.
+ */
+class handle_table {
+	DELETE_DEFAULT_COPY_AND_MOVE(handle_table)
+
+public:
+	handle_table()
+		: slots_(nullptr)
+		, capacity_(0)
+		, free_head_(no_slot)
+	{
+	}
+
+	~handle_table();
+
+	/**
+	 * Adds an object to the table, and sets its id to the new handle.
+	 */
+	u64 insert(shared_ptr<object> o);
+
+	/**
+	 * Returns the object with the given handle, or null if the handle isn't valid.
+	 */
+	shared_ptr<object> get(u64 handle);
+
+	/**
+	 * Takes the object with the given handle out of the table.  The object is returned, so that it is
+	 * released after the table is unlocked.  Returns null if the handle isn't valid.
+	 */
+	shared_ptr<object> remove(u64 handle);
+
+	/**
+	 * Releases every object in the table.
+	 */
+	void clear();
+
+private:
+	static const u32 no_slot = ~0u;
+	static const u32 initial_capacity = 16;
+
+	struct slot {
+		shared_ptr<object> obj;
+		u32 generation;
+		u32 next_free;
+	};
+
+	spinlock_irq lock_;
+	slot *slots_;
+	u32 capacity_;
+	u32 free_head_;
+
+	static u64 make_handle(u32 index, u32 generation) { return ((u64)generation << 32) | index; }
+
+	slot *lookup(u64 handle);
+	void grow();
+};
+} // namespace stacsos::kernel::obj
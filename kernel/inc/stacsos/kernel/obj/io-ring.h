@@ -0,0 +1,100 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+#include <stacsos/io-ring.h>
+#include <stacsos/kernel/lock.h>
+#include <stacsos/kernel/obj/object.h>
+#include <stacsos/kernel/sched/event.h>
+#include <stacsos/memory.h>
+
+namespace stacsos::kernel::mem {
+class address_space_region;
+}
+
+namespace stacsos::kernel::sched {
+class thread;
+}
+
+namespace stacsos::kernel::obj {
+/**
+ * A submission/completion ring shared with a process.  The process queues up operations on its objects
+ * in the submission queue, and they are carried out either when the process calls enter(), or by a
+ * kernel thread that polls the queue.  Either way, a whole batch costs at most one system call.
+ */
+class io_ring_object : public object {
+public:
+	/**
+	 * Creates a ring with the given number of submission entries (rounded up to a power of two) in the
+	 * owner's address space.  Returns null if the number of entries is out of range.
+	 */
+	static io_ring_object *create(sched::process &owner, u32 entries, io_ring_setup_flags flags);
+
+	/**
+	 * Stops the polling thread, and unmaps the ring.
+	 */
+	virtual ~io_ring_object();
+
+	/**
+	 * Starts the polling thread, if the ring is polled.  The thread belongs to the ring, which stops it
+	 * (and waits for it) when the ring is destroyed.
+	 */
+	void start();
+
+	/**
+	 * The address of the ring header, in the owner's address space.
+	 */
+	u64 base() const { return (u64)header_; }
+
+	/**
+	 * Carries out everything in the submission queue (or, for a polled ring, wakes up the polling
+	 * thread), and then optionally waits for completions.  Returns the number of entries submitted.
+	 */
+	virtual operation_result enter(u64 min_complete, u64 flags) override;
+
+private:
+	// The number of times the polling thread looks for work before it goes to sleep.
+	static const u32 poll_idle_spins = 1 << 16;
+
+	io_ring_object(sched::process &owner, mem::address_space_region *region, bool poll);
+
+	sched::process &owner_;
+
+	// The ring's memory is pinned in the owner's address space, so the process can't unmap it while the
+	// kernel is using it.
+	mem::address_space_region *region_;
+	io_ring_header *header_;
+	io_ring_sqe *sqes_;
+	io_ring_cqe *cqes_;
+	u32 sq_mask_, cq_entries_;
+	bool poll_;
+	shared_ptr<sched::thread> poller_;
+	volatile bool stopping_;
+
+	spinlock_irq lock_;
+	volatile bool draining_;
+	bool drain_pending_;
+
+	sched::event completion_event_, wake_event_;
+	volatile bool completed_, wake_;
+
+	u32 drain();
+	bool begin_drain();
+	bool end_drain();
+
+	u32 completions_waiting() const { return header_->cq_tail - header_->cq_head; }
+	bool submissions_waiting() const { return header_->sq_tail != header_->sq_head; }
+
+	static syscall_result_code to_result_code(operation_result_code code);
+	operation_result execute(const io_ring_sqe &sqe);
+	void wait_for_completions(u32 count);
+
+	void poll();
+	static void poll_thread_entry(void *arg);
+};
+} // namespace stacsos::kernel::obj
@@ -7,45 +7,31 @@
  */
 #pragma once
 
-#include <stacsos/atomic.h>
+#include <stacsos/kernel/obj/io-ring.h>
 #include <stacsos/kernel/obj/object.h>
-#include <stacsos/map.h>
-
-namespace stacsos::kernel::sched {
-class process;
-} // namespace stacsos::kernel::sched
+#include <stacsos/kernel/sched/process.h>
 
 namespace stacsos::kernel::obj {
 class object_manager {
 	DEFINE_SINGLETON(object_manager);
 
 private:
-	object_manager()
-		: next_id_(1)
-	{
-	}
+	object_manager() { }
 
 public:
-	shared_ptr<object> get_object(sched::process &owner, u64 id)
-	{
-		map<u64, shared_ptr<object>> *process_object_map;
-		if (!objects_.try_get_value(&owner, process_object_map)) {
-			return nullptr;
-		}
-
-		shared_ptr<object> optr;
-		if (!process_object_map->try_get_value(id, optr)) {
-			return nullptr;
-		}
-
-		return optr;
-	}
+	/**
+	 * Looks up an object by its handle, in the owner's handle table.
+	 */
+	shared_ptr<object> get_object(sched::process &owner, u64 id) { return owner.handles().get(id); }
 
-	void free_object(sched::process &owner, u64 id) { }
+	/**
+	 * Closes the owner's handle to an object.  Returns false if the handle isn't valid.
+	 */
+	bool free_object(sched::process &owner, u64 id) { return (bool)owner.handles().remove(id); }
 
 	shared_ptr<object> create_file_object(sched::process &owner, shared_ptr<fs::file> file)
 	{
-		return register_object(owner, new file_object(allocate_id(owner), file));
+		return register_object(owner, new file_object(file));
 	}
 
 	/**
@@ -54,43 +40,44 @@ public:
 	 */
 	shared_ptr<object> create_directory_object(sched::process &owner, shared_ptr<fs::directory> dir)
 	{
-		return register_object(owner, new directory_object(allocate_id(owner), dir));
+		return register_object(owner, new directory_object(dir));
 	}
 
 	shared_ptr<object> create_process_object(sched::process &owner, shared_ptr<sched::process> proc)
 	{
-		return register_object(owner, new process_object(allocate_id(owner), proc));
+		return register_object(owner, new process_object(proc));
 	}
 
 	shared_ptr<object> create_thread_object(sched::process &owner, shared_ptr<sched::thread> thread)
 	{
-		return register_object(owner, new thread_object(allocate_id(owner), thread));
+		return register_object(owner, new thread_object(thread));
 	}
 
-private:
-	atomic_u64 next_id_;
-	map<sched::process *, map<u64, shared_ptr<object>> *> objects_;
-
-	u64 allocate_id(sched::process &owner)
+	/**
+	 * Creates an I/O ring in the owner's address space.  Returns null if the ring can't be created, and
+	 * otherwise, base is set to the address of the ring.
+	 */
+	shared_ptr<object> create_io_ring_object(sched::process &owner, u32 entries, io_ring_setup_flags flags, u64 &base)
 	{
-		u64 n = next_id_++;
+		auto ring = io_ring_object::create(owner, entries, flags);
+		if (!ring) {
+			return nullptr;
+		}
+
+		base = ring->base();
 
-		dprintf("OM: %lu\n", n);
+		auto optr = register_object(owner, ring);
+		ring->start();
 
-		return n;
+		return optr;
 	}
 
+private:
 	shared_ptr<object> register_object(sched::process &owner, object *o)
 	{
-		map<u64, shared_ptr<object>> *process_object_map;
-		if (!objects_.try_get_value(&owner, process_object_map)) {
-			process_object_map = new map<u64, shared_ptr<object>>();
-			objects_.add(&owner, process_object_map);
-		}
-
 		auto object_ptr = shared_ptr(o);
+		owner.handles().insert(object_ptr);
 
-		process_object_map->add(o->id(), object_ptr);
 		return object_ptr;
 	}
 };
@@ -24,7 +24,11 @@ struct operation_result {
 	static operation_result not_supported() { return operation_result { operation_result_code::not_supported, 0 }; }
 };
 
+class handle_table;
+
 class object {
+	friend class handle_table;
+
 public:
 	virtual ~object() { }
 
@@ -37,10 +41,16 @@ public:
 	virtual operation_result ioctl(u64 cmd, void *buffer, size_t length) { return operation_result::not_supported(); }
 	virtual operation_result wait_for_status_change() { return operation_result::not_supported(); }
 	virtual operation_result join() { return operation_result::not_supported(); }
+	virtual operation_result enter(u64 min_complete, u64 flags) { return operation_result::not_supported(); }
+
+	/**
+	 * The file behind the object, if it can be mapped into memory.
+	 */
+	virtual shared_ptr<fs::file> mappable_file() { return nullptr; }
 
 protected:
-	object(u64 id)
-		: id_(id)
+	object()
+		: id_(0)
 	{
 	}
 
@@ -50,8 +60,8 @@ private:
 
 class file_object : public object {
 public:
-	file_object(u64 id, shared_ptr<fs::file> file)
-		: object(id)
+	file_object(shared_ptr<fs::file> file)
+		: object()
 		, file_(file)
 	{
 	}
@@ -62,6 +72,8 @@ public:
 	virtual operation_result pwrite(const void *buffer, size_t length, size_t offset) { return operation_result::ok(file_->pwrite(buffer, offset, length)); }
 	virtual operation_result ioctl(u64 cmd, void *buffer, size_t length) { return operation_result::ok(file_->ioctl(cmd, buffer, length)); }
 
+	virtual shared_ptr<fs::file> mappable_file() override { return file_; }
+
 private:
 	shared_ptr<fs::file> file_;
 };
@@ -69,8 +81,8 @@ private:
 //Directory object class (subclass of object)
 class directory_object : public object {
 public:
-	directory_object(u64 id, shared_ptr<fs::directory> dir)
-		: object(id)
+	directory_object(shared_ptr<fs::directory> dir)
+		: object()
 		, directory_(dir)
 	{
 	}
@@ -83,8 +95,8 @@ private:
 
 class process_object : public object {
 public:
-	process_object(u64 id, shared_ptr<sched::process> proc)
-		: object(id)
+	process_object(shared_ptr<sched::process> proc)
+		: object()
 		, proc_(proc)
 	{
 	}
@@ -106,8 +118,8 @@ private:
 
 class thread_object : public object {
 public:
-	thread_object(u64 id, shared_ptr<sched::thread> thread)
-		: object(id)
+	thread_object(shared_ptr<sched::thread> thread)
+		: object()
 		, thread_(thread)
 	{
 	}
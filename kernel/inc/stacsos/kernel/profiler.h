@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+#include <stacsos/kernel/arch/core-manager.h>
+#include <stacsos/profile.h>
+
+namespace stacsos::kernel {
+/**
+ * A sampling profiler.  When enabled, each timer interrupt records where the interrupted core was (and,
+ * in the kernel, the chain of return addresses that led there) into that core's buffer.  As with the
+ * trace buffers, these are rings, and the oldest samples are overwritten once a buffer is full.
+ *
+ * In tickless mode, an idle core (or one running a single task) takes no timer interrupts, so it would
+ * never be sampled.  While the profiler is enabled, every core keeps a periodic tick instead.
+ */
+class profiler {
+	DEFINE_SINGLETON(profiler)
+
+public:
+	static const u64 samples_per_core = 4096;
+
+	void init();
+
+	bool enabled() const { return enabled_; }
+	void set_enabled(bool enabled);
+
+	/**
+	 * Takes a sample from the machine context of an interrupt.  This must be called on the core that
+	 * was interrupted, with interrupts disabled.
+	 */
+	void sample(const void *mcontext)
+	{
+		if (enabled_) {
+			take_sample(mcontext);
+		}
+	}
+
+	u64 head(int core) const { return *(volatile const u64 *)&buffers_[core].head; }
+
+	/**
+	 * Copies out the sample at the given position in a core's buffer.  Returns false if the sample is
+	 * still being written, or has been overwritten.
+	 */
+	bool read_sample(int core, u64 position, profile_sample &s) const;
+
+private:
+	profiler()
+		: enabled_(false)
+	{
+		for (auto &b : buffers_) {
+			b.samples = nullptr;
+			b.head = 0;
+		}
+	}
+
+	struct per_core_buffer {
+		profile_sample *samples;
+		u64 head;
+	} __aligned(64);
+
+	volatile bool enabled_;
+	per_core_buffer buffers_[arch::core_manager::max_cores];
+
+	void take_sample(const void *mcontext);
+};
+} // namespace stacsos::kernel
@@ -0,0 +1,49 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+#include <stacsos/kernel/sched/alg/scheduling-algorithm.h>
+#include <stacsos/kernel/sched/schedulable-entity.h>
+#include <stacsos/rb-tree.h>
+
+namespace stacsos::kernel::sched::alg {
+
+/**
+ * A CFS-style scheduler.  Runnable tasks are kept on a timeline (a red-black tree) ordered by
+ * virtual runtime, which advances more slowly for tasks with a higher weight (i.e. a lower nice
+ * level, set with the set_nice system call).  The task with the smallest virtual runtime is always
+ * chosen next, unless the current task has not yet run for the minimum granularity.
+ */
+class completely_fair_scheduler : public scheduling_algorithm {
+public:
+	completely_fair_scheduler();
+
+	virtual void add_to_runqueue(tcb &tcb) override;
+	virtual void remove_from_runqueue(tcb &tcb) override;
+	virtual tcb *select_next_task(tcb *current) override;
+	virtual tcb *select_steal_candidate(const tcb *current, const tcb *previous) override;
+	virtual u64 slice_end(const tcb &current, u64 now, u64 tick_length) override;
+	virtual const char *name() const { return "completely fair"; }
+
+private:
+	struct vruntime_less {
+		bool operator()(const tcb &a, const tcb &b) const { return (s64)(a.vruntime - b.vruntime) < 0; }
+	};
+
+	rb_tree<tcb, &tcb::timeline_node, vruntime_less> timeline_;
+
+	tcb *current_;
+	u64 min_vruntime_;
+	u64 min_granularity_us_;
+	u64 min_granularity_;
+
+	void update_current(u64 now);
+	void update_min_vruntime();
+	u64 granularity();
+};
+} // namespace stacsos::kernel::sched::alg
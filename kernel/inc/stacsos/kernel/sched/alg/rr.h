@@ -11,14 +11,30 @@
 
 namespace stacsos::kernel::sched::alg {
 
-// *** COURSEWORK NOTE *** //
-// Please edit this file in any way you see fit.
-
+/**
+ * A round-robin scheduler.  The runqueue is a FIFO, threaded through the task control blocks, so
+ * every operation is O(1).  Each task runs for a quantum (measured in timer ticks) before it is
+ * moved to the back of the queue.
+ */
 class round_robin : public scheduling_algorithm {
 public:
+	round_robin();
+
 	virtual void add_to_runqueue(tcb &tcb) override;
 	virtual void remove_from_runqueue(tcb &tcb) override;
 	virtual tcb *select_next_task(tcb *current) override;
+	virtual tcb *select_steal_candidate(const tcb *current, const tcb *previous) override;
+	virtual u64 slice_end(const tcb &current, u64 now, u64 tick_length) override;
 	virtual const char *name() const { return "round robin"; }
+
+private:
+	tcb *head_, *tail_;
+	tcb *current_;
+	u64 quantum_;
+	u64 tick_length_;
+
+	u64 tick_length();
+	void append(tcb &tcb);
+	void unlink(tcb &tcb);
 };
 } // namespace stacsos::kernel::sched::alg
@@ -17,6 +17,19 @@ public:
 	virtual void add_to_runqueue(tcb &tcb) = 0;
 	virtual void remove_from_runqueue(tcb &tcb) = 0;
 	virtual tcb *select_next_task(tcb *current) = 0;
+
+	/**
+	 * Chooses a task on this runqueue that another (idle) core may take.  The tasks given as
+	 * arguments may still be in use by the owning core, and must not be returned.
+	 */
+	virtual tcb *select_steal_candidate(const tcb *current, const tcb *previous) = 0;
+
+	/**
+	 * Returns the TSC value at which the running task should be preempted, if other tasks are waiting.
+	 * This is only consulted when the core is tickless; by default, the task runs for one tick.
+	 */
+	virtual u64 slice_end(const tcb &current, u64 now, u64 tick_length) { return now + tick_length; }
+
 	virtual const char *name() const = 0;
 };
 } // namespace stacsos::kernel::sched::alg
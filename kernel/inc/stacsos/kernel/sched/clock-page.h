@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+#include <stacsos/clock-page.h>
+#include <stacsos/kernel/lock.h>
+
+namespace stacsos::kernel::dev::misc {
+class rtc;
+}
+
+namespace stacsos::kernel::mem {
+class address_space;
+class page;
+} // namespace stacsos::kernel::mem
+
+namespace stacsos::kernel::sched {
+/**
+ * Publishes the time to userspace, in a page that is mapped read-only into every user address space,
+ * so that reading the clock doesn't need a system call.
+ */
+class clock_page {
+	DEFINE_SINGLETON(clock_page)
+
+public:
+	/**
+	 * Fills in the page from the calibrated TSC, and sets the wall clock from the RTC.  The monotonic
+	 * clock starts from zero here.  A kernel thread is started in the calling process, which sets the
+	 * wall clock from the RTC again every so often, so that it doesn't drift away from it.
+	 */
+	void init(dev::misc::rtc &rtc);
+
+	/**
+	 * Sets the wall clock from the RTC again.  The RTC only counts whole seconds, so if wait_for_tick
+	 * is set, this first waits (sleeping) for the next second to start, so that the time it reads is
+	 * exact, rather than up to a second behind.
+	 */
+	void synchronise(bool wait_for_tick = false);
+
+	/**
+	 * Maps the page into a user address space.  Does nothing if the page hasn't been set up yet.
+	 */
+	void map_into(mem::address_space &as);
+
+private:
+	static const u64 resync_interval_ms = 60'000;
+
+	clock_page()
+		: page_(nullptr)
+		, rtc_(nullptr)
+	{
+	}
+
+	spinlock_irq lock_;
+	mem::page *page_;
+	dev::misc::rtc *rtc_;
+
+	clock_page_data &data() const;
+
+	static u64 unix_time(u16 year, u16 month, u16 day, u16 hours, u16 minutes, u16 seconds);
+	static void resync_thread(void *arg);
+};
+} // namespace stacsos::kernel::sched
@@ -7,6 +7,7 @@
  */
 #pragma once
 
+#include <stacsos/kernel/lock.h>
 #include <stacsos/list.h>
 
 namespace stacsos::kernel::sched {
@@ -17,7 +18,19 @@ public:
 	void trigger();
 	void wait();
 
+	/**
+	 * Waits for the event, unless the flag is already set.  The flag is checked under the event's
+	 * lock, so a set_and_trigger() can't slip in between the check and going to sleep.
+	 */
+	void wait_unless(const volatile bool &flag);
+
+	/**
+	 * Sets the flag, and wakes up anything waiting for the event.
+	 */
+	void set_and_trigger(volatile bool &flag);
+
 private:
+	spinlock_irq lock_;
 	list<thread *> wait_list_;
 };
 } // namespace stacsos::kernel::sched
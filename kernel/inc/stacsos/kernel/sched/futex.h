@@ -0,0 +1,79 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+#include <stacsos/kernel/lock.h>
+
+namespace stacsos::kernel::sched {
+class thread;
+class process;
+struct futex_bucket;
+
+/**
+ * A thread waiting on a futex.  One of these is embedded in every thread, so waiting never allocates.
+ */
+struct futex_waiter {
+	thread *thr;
+	const process *owner;
+	u64 address;
+
+	// The bucket the waiter is queued on, or null.  This is only changed with that bucket's lock held.
+	futex_bucket *volatile bucket;
+	futex_waiter *next, *prev;
+};
+
+struct futex_bucket {
+	spinlock_irq lock;
+	futex_waiter *waiters;
+} __aligned(64);
+
+/**
+ * Lets user threads sleep until a word in their memory changes.  Waiters are kept in a table of
+ * buckets, hashed by process and address, so that unrelated futexes rarely share a lock.  Futexes are
+ * private to a process: the same address in two processes is two different futexes.
+ */
+class futex_table {
+	DEFINE_SINGLETON(futex_table)
+
+public:
+	/**
+	 * Puts the current thread to sleep on the 32-bit word at address, unless the word no longer holds
+	 * the expected value.  The check is made under the bucket's lock, so a wake() that follows a change
+	 * to the word can't be missed.  Returns false (without sleeping) if the value didn't match.
+	 */
+	bool wait(process &owner, u64 address, u32 expected);
+
+	/**
+	 * Wakes up to count threads waiting on the word at address, and returns the number woken.
+	 */
+	u64 wake(process &owner, u64 address, u64 count);
+
+	/**
+	 * Takes a thread off whichever futex it's waiting on, if any.  This is called when a thread is
+	 * stopped, so that a thread that will never be woken doesn't stay on the list.
+	 */
+	void cancel(thread &t);
+
+private:
+	static const u64 bucket_bits = 6;
+	static const u64 nr_buckets = 1 << bucket_bits;
+
+	futex_table()
+	{
+		for (auto &b : buckets_) {
+			b.waiters = nullptr;
+		}
+	}
+
+	futex_bucket buckets_[nr_buckets];
+
+	futex_bucket &bucket_for(const process &owner, u64 address);
+
+	static void unlink(futex_bucket &b, futex_waiter &w);
+};
+} // namespace stacsos::kernel::sched
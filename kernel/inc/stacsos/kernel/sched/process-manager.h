@@ -25,7 +25,11 @@ public:
 	void init();
 
 	shared_ptr<process> create_kernel_process(continuation_fn ep);
-	shared_ptr<process> create_process(const char *path, const char *args);
+	/**
+	 * Creates a process from the binary at path.  If there is a parent, relative paths are resolved
+	 * from its working directory, which the new process inherits.
+	 */
+	shared_ptr<process> create_process(const char *path, const char *args, process *parent = nullptr);
 
 private:
 	list<shared_ptr<process>> active_processes_;
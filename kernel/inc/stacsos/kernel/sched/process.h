@@ -9,16 +9,20 @@
 
 #include <stacsos/kernel/mem/address-space.h>
 #include <stacsos/kernel/mem/memory-manager.h>
+#include <stacsos/kernel/obj/handle-table.h>
 #include <stacsos/kernel/sched/event.h>
 #include <stacsos/kernel/sched/thread.h>
 #include <stacsos/list.h>
 #include <stacsos/memory.h>
+#include <stacsos/string.h>
+
+namespace stacsos::kernel::fs {
+class fs_node;
+}
 
 namespace stacsos::kernel::sched {
 class thread;
 
-enum exec_privilege { kernel, user };
-
 enum class process_state { created, started, terminated };
 
 class process {
@@ -30,6 +34,8 @@ public:
 		, state_(process_state::created)
 		, vma_(mem::memory_manager::get().root_address_space().create_linked(0x7fff'2000'0000))
 		, next_user_stack_(0x7fff'1000'0000)
+		, cwd_(nullptr)
+		, cwd_path_("/")
 	{
 	}
 
@@ -37,6 +43,11 @@ public:
 
 	shared_ptr<thread> create_thread(u64 entry_point, void *entry_arg = nullptr);
 
+	/**
+	 * Creates a thread that runs kernel code on behalf of this process, in its address space.
+	 */
+	shared_ptr<thread> create_kernel_thread(u64 entry_point, void *entry_arg = nullptr);
+
 	process_state state() const { return state_; }
 
 	void start();
@@ -46,6 +57,20 @@ public:
 
 	event &state_changed_event() { return state_changed_event_; }
 
+	obj::handle_table &handles() { return handles_; }
+
+	/**
+	 * The node that relative paths are resolved from.  Null means the root.
+	 */
+	fs::fs_node *cwd() const { return cwd_; }
+	const string &cwd_path() const { return cwd_path_; }
+
+	void set_cwd(fs::fs_node *node, const string &path)
+	{
+		cwd_ = node;
+		cwd_path_ = path;
+	}
+
 private:
 	exec_privilege priv_;
 	process_state state_;
@@ -54,6 +79,10 @@ private:
 	mem::address_space *vma_;
 	list<shared_ptr<thread>> threads_;
 	u64 next_user_stack_;
+	obj::handle_table handles_;
+
+	fs::fs_node *cwd_;
+	string cwd_path_;
 
 	void on_thread_stopped(thread &thread);
 };
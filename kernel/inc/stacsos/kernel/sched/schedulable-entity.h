@@ -9,6 +9,7 @@
 
 #include <stacsos/kernel/arch/x86/machine-context.h>
 #include <stacsos/memops.h>
+#include <stacsos/rb-tree.h>
 
 namespace stacsos::kernel::arch {
 class core;
@@ -26,12 +27,24 @@ struct tcb {
 	u64 start_time;	// 28
 	u64 stop_time;	// 30
 	u64 run_time;	// 38
-} __packed;
+
+	// Everything below here is private to the scheduling algorithms, and is not touched by
+	// assembly code.  The fields above are all eight bytes, so the layout is the same as if
+	// the structure were packed.
+	int nice;
+	u64 vruntime;
+	u64 exec_start;
+	u64 slice_start;
+	rb_tree_node timeline_node;
+
+	tcb *rq_next, *rq_prev;
+};
 
 class schedulable_entity {
 public:
 	schedulable_entity()
 		: owning_core_(nullptr)
+		, on_runqueue_(false)
 	{
 		memops::bzero(&tcb_, sizeof(tcb_));
 	}
@@ -39,8 +52,18 @@ public:
 	const tcb *get_tcb() const { return &tcb_; }
 	tcb *get_tcb() { return &tcb_; }
 
+	/**
+	 * The core that this entity belongs to, i.e. the core whose runqueue it is (or was last) on.  This is
+	 * only changed with that core's runqueue lock held.
+	 */
+	arch::core *owning_core() const { return owning_core_; }
+	bool on_runqueue() const { return on_runqueue_; }
+
 private:
+	friend class arch::core;
+
 	arch::core *owning_core_;
+	bool on_runqueue_;
 
 protected:
 	__aligned(16) tcb tcb_;
@@ -7,6 +7,10 @@
  */
 #pragma once
 
+namespace stacsos::kernel::arch {
+class core;
+}
+
 namespace stacsos::kernel::sched {
 class schedulable_entity;
 
@@ -19,5 +23,8 @@ private:
 public:
 	void add_to_schedule(schedulable_entity &e);
 	void remove_from_schedule(schedulable_entity &e);
+
+private:
+	arch::core &select_core();
 };
 } // namespace stacsos::kernel::sched
@@ -7,14 +7,19 @@
  */
 #pragma once
 
-#include <stacsos/list.h>
+#include <stacsos/kernel/lock.h>
+#include <stacsos/rb-tree.h>
 
 namespace stacsos::kernel::sched {
 class thread;
 
+/**
+ * A sleep record.  One of these is embedded in every thread, so going to sleep never allocates.
+ */
 struct sleeping_thread {
 	thread *thr;
 	u64 wakeup_deadline;
+	rb_tree_node node;
 };
 
 class sleeper {
@@ -24,11 +29,29 @@ public:
 	void sleep_ms(u64 duration_ms);
 	void check_wakeup();
 
+	/**
+	 * The TSC deadline of the next thread due to wake up, or ~0 if nothing is sleeping.
+	 */
+	u64 next_deadline() const { return *(volatile const u64 *)&next_deadline_; }
+
 private:
-	sleeper() { }
+	sleeper()
+		: next_deadline_(~0ull)
+	{
+	}
+
+	struct deadline_less {
+		bool operator()(const sleeping_thread &a, const sleeping_thread &b) const { return a.wakeup_deadline < b.wakeup_deadline; }
+	};
+
+	spinlock_irq lock_;
 
-	list<sleeping_thread *> sleeping_;
+	// Sleeping threads, ordered by deadline.  The earliest is cached by the tree, and its deadline
+	// is mirrored in next_deadline_, so the timer tick can check it without taking the lock.
+	rb_tree<sleeping_thread, &sleeping_thread::node, deadline_less> sleeping_;
+	u64 next_deadline_;
 
 	void do_sleep(u64 wakeup_deadline);
+	void update_next_deadline();
 };
 } // namespace stacsos::kernel::sched
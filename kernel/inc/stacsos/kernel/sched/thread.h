@@ -9,7 +9,9 @@
 
 #include <stacsos/kernel/arch/x86/machine-context.h>
 #include <stacsos/kernel/sched/event.h>
+#include <stacsos/kernel/sched/futex.h>
 #include <stacsos/kernel/sched/schedulable-entity.h>
+#include <stacsos/kernel/sched/sleeper.h>
 
 namespace stacsos::kernel::mem {
 class page;
@@ -24,6 +26,8 @@ using namespace stacsos::kernel::arch;
 
 enum class thread_states { created, runnable, running, suspended, terminated };
 
+enum exec_privilege { kernel, user };
+
 class process;
 
 class thread : public schedulable_entity {
@@ -33,6 +37,12 @@ public:
 
 	thread(process &owner, u64 ep = 0, void *ep_arg = nullptr, u64 user_stack = 0);
 
+	/**
+	 * Creates a thread with the given privilege, which can differ from its owner's.  A kernel thread
+	 * owned by a user process runs in that process's address space.
+	 */
+	thread(process &owner, exec_privilege priv, u64 ep, void *ep_arg, u64 user_stack);
+
 	thread_states state() const { return state_; }
 	event &state_changed_event() { return state_changed_event_; }
 
@@ -43,6 +53,9 @@ public:
 
 	process &owner() const { return owner_; }
 
+	sleeping_thread &sleep_record() { return sleep_record_; }
+	futex_waiter &futex_record() { return futex_record_; }
+
 	static thread &current();
 
 private:
@@ -52,11 +65,14 @@ private:
 	void change_state(thread_states new_state);
 
 	process &owner_;
+	exec_privilege priv_;
 	u64 ep_;
 	void *arg_;
 	thread_states state_;
 	mem::page *kernel_stack_;
 	u64 user_stack_;
 	event state_changed_event_;
+	sleeping_thread sleep_record_;
+	futex_waiter futex_record_;
 };
 } // namespace stacsos::kernel::sched
@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+namespace stacsos::kernel {
+/*
+ * Rings of entries that are written without locks, and read while they may be being written.  Each
+ * entry has a sequence number, which a writer zeroes before filling the entry in, and sets to one more
+ * than the entry's position afterwards.  A reader can then tell whether the copy it took is whole.
+ */
+
+template <class T> T &seq_ring_begin_write(T *ring, u64 size, u64 position)
+{
+	T &entry = ring[position % size];
+
+	entry.sequence = 0;
+	asm volatile("" ::: "memory");
+
+	return entry;
+}
+
+template <class T> void seq_ring_end_write(T &entry, u64 position)
+{
+	asm volatile("" ::: "memory");
+	entry.sequence = position + 1;
+}
+
+/**
+ * Copies out the entry at the given position, using copy(slot, out) for everything but the sequence
+ * number.  Returns false if the entry is still being written, or has been overwritten.
+ */
+template <class T, class CopyFn> bool seq_ring_read(const T *ring, u64 size, u64 position, T &out, CopyFn copy)
+{
+	const volatile T &slot = ring[position % size];
+
+	// If the sequence number is the same either side of the copy, then the entry wasn't changed while
+	// it was being copied.
+	u64 sequence = slot.sequence;
+	if (sequence != position + 1) {
+		return false;
+	}
+
+	asm volatile("" ::: "memory");
+
+	copy(slot, out);
+
+	asm volatile("" ::: "memory");
+
+	out.sequence = sequence;
+	return slot.sequence == sequence;
+}
+} // namespace stacsos::kernel
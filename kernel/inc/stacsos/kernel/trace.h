@@ -0,0 +1,93 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+#include <stacsos/kernel/arch/core-manager.h>
+#include <stacsos/kernel/seq-ring.h>
+#include <stacsos/trace.h>
+
+namespace stacsos::kernel {
+/**
+ * A buffer of trace records for each core.  Records are written without taking any locks: a core
+ * claims a slot by bumping its buffer's head, and fills it in.  The buffers are rings, so the oldest
+ * records are overwritten once a buffer is full.
+ */
+class trace_buffers {
+	DEFINE_SINGLETON(trace_buffers)
+
+public:
+	static const u64 records_per_core = 4096;
+
+	void init();
+
+	bool enabled() const { return enabled_; }
+	void set_enabled(bool enabled) { enabled_ = enabled; }
+
+	void record(trace_event event, u64 arg0, u64 arg1)
+	{
+		if (!enabled_) {
+			return;
+		}
+
+		u32 core;
+		u64 now = __builtin_ia32_rdtscp(&core);
+
+		per_core_buffer &b = buffers_[core % arch::core_manager::max_cores];
+		if (!b.records) {
+			return;
+		}
+
+		// The head is bumped atomically, because a thread can be moved to another core after reading
+		// the core number.  Either way, every record gets a slot of its own.
+		u64 position = __atomic_fetch_add(&b.head, 1, __ATOMIC_RELAXED);
+		trace_record &r = seq_ring_begin_write(b.records, records_per_core, position);
+
+		r.timestamp = now;
+		r.event = event;
+		r.core = core;
+		r.args[0] = arg0;
+		r.args[1] = arg1;
+
+		seq_ring_end_write(r, position);
+	}
+
+	/**
+	 * The number of records that have ever been written to a core's buffer.
+	 */
+	u64 head(int core) const { return *(volatile const u64 *)&buffers_[core].head; }
+
+	/**
+	 * Copies out the record at the given position in a core's buffer.  Returns false if the record is
+	 * still being written, or has been overwritten.
+	 */
+	bool read_record(int core, u64 position, trace_record &r) const;
+
+private:
+	trace_buffers()
+		: enabled_(false)
+	{
+		for (auto &b : buffers_) {
+			b.records = nullptr;
+			b.head = 0;
+		}
+	}
+
+	struct per_core_buffer {
+		trace_record *records;
+		u64 head;
+	} __aligned(64);
+
+	volatile bool enabled_;
+	per_core_buffer buffers_[arch::core_manager::max_cores];
+};
+
+/**
+ * Records a tracepoint on the current core.
+ */
+static inline void trace(trace_event event, u64 arg0 = 0, u64 arg1 = 0) { trace_buffers::get().record(event, arg0, arg1); }
+} // namespace stacsos::kernel
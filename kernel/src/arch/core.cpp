@@ -10,10 +10,14 @@
 #include <stacsos/kernel/arch/timer.h>
 #include <stacsos/kernel/arch/x86/cregs.h>
 #include <stacsos/kernel/arch/x86/machine-context.h>
+#include <stacsos/kernel/arch/x86/x86-core.h>
 #include <stacsos/kernel/debug.h>
 #include <stacsos/kernel/mem/memory-manager.h>
 #include <stacsos/kernel/mem/page-allocator.h>
+#include <stacsos/kernel/profiler.h>
 #include <stacsos/kernel/sched/schedulable-entity.h>
+#include <stacsos/kernel/sched/sleeper.h>
+#include <stacsos/kernel/trace.h>
 
 using namespace stacsos::kernel::arch;
 using namespace stacsos::kernel::arch::x86;
@@ -61,24 +65,214 @@ void core::run()
 
 	set_current_tcb(&idle_thread_);
 
-	dprintf("core [%d]: run\n", id());
-	local_timer().start(100); // 100 Hz
+	dprintf("core [%d]: run%s\n", id(), tickless_ ? " (tickless)" : "");
+
+	if (tickless_) {
+		// Take a single tick to get going.  From then on, schedule() arms the timer only when it's needed.
+		local_timer().start_oneshot();
+		local_timer().set_deadline(__builtin_ia32_rdtsc() + tick_length());
+	} else {
+		local_timer().start(tick_frequency);
+	}
 
 	// This will also enable interrupts, because the IF flag is set in rflags.
 	x86_return_to_task();
 	__unreachable();
 }
 
+bool core::add_to_runqueue(tcb &tcb)
+{
+	u64 nr_runnable = 0;
+
+	{
+		unique_irq_lock l(runqueue_lock_);
+
+		// The entity may have been claimed by another core in the meantime, in which case the
+		// caller needs to try again with the new owner.
+		if (tcb.entity->owning_core_ != nullptr && tcb.entity->owning_core_ != this) {
+			return false;
+		}
+
+		if (tcb.entity->on_runqueue_) {
+			return true;
+		}
+
+		enqueue_task(tcb);
+		nr_runnable = nr_runnable_;
+	}
+
+	if (tickless_) {
+		// If this core was idle, or running a single task, then it has no timer armed and won't notice
+		// the new task by itself.  If it now has tasks waiting, an idle core may want to take one.
+		if (nr_runnable <= 2) {
+			kick();
+		}
+
+		if (nr_runnable >= 2) {
+			kick_idle_core();
+		}
+	}
+
+	return true;
+}
+
+bool core::remove_from_runqueue(tcb &tcb)
+{
+	unique_irq_lock l(runqueue_lock_);
+
+	if (tcb.entity->owning_core_ != this) {
+		return false;
+	}
+
+	if (tcb.entity->on_runqueue_) {
+		dequeue_task(tcb);
+	}
+
+	return true;
+}
+
+void core::enqueue_task(tcb &tcb)
+{
+	tcb.entity->owning_core_ = this;
+	tcb.entity->on_runqueue_ = true;
+
+	sched_alg_->add_to_runqueue(tcb);
+	nr_runnable_++;
+}
+
+void core::dequeue_task(tcb &tcb)
+{
+	sched_alg_->remove_from_runqueue(tcb);
+	nr_runnable_--;
+
+	tcb.entity->on_runqueue_ = false;
+}
+
+void core::update_current(tcb *next)
+{
+	// Remember the task we're switching away from.  We're still running on its kernel stack until
+	// the trap returns, so it must not be stolen by another core until we next come through here.
+	previous_ = current_;
+	current_ = next;
+}
+
+tcb *core::steal_task()
+{
+	// Find the busiest core that has tasks waiting to run (i.e. more than the running task).
+	core *victim = nullptr;
+	for (auto *c : core_manager::get().cores()) {
+		if (c == this || !c->online() || c->nr_runnable() < 2) {
+			continue;
+		}
+
+		if (victim == nullptr || c->nr_runnable() > victim->nr_runnable()) {
+			victim = c;
+		}
+	}
+
+	if (victim == nullptr) {
+		return nullptr;
+	}
+
+	// Always take the runqueue locks in core id order, to avoid deadlocking with a core
+	// that is trying to steal from us.
+	core *first = id_ < victim->id_ ? this : victim;
+	core *second = id_ < victim->id_ ? victim : this;
+
+	unique_irq_lock l1(first->runqueue_lock_);
+	unique_irq_lock l2(second->runqueue_lock_);
+
+	tcb *candidate = victim->sched_alg_->select_steal_candidate(victim->current_, victim->previous_);
+	if (candidate == nullptr) {
+		return nullptr;
+	}
+
+	victim->dequeue_task(*candidate);
+	enqueue_task(*candidate);
+
+	update_current(candidate);
+	return candidate;
+}
+
 void core::schedule()
 {
-	tcb *next = sched_alg_->select_next_task(get_current_tcb());
+	tcb *prev = get_current_tcb();
+	tcb *next;
+
+	{
+		unique_irq_lock l(runqueue_lock_);
+
+		next = sched_alg_->select_next_task(get_current_tcb());
+		if (next) {
+			update_current(next);
+		}
+	}
+
+	// Nothing to do here, so see if there is work on another core before going idle.
+	if (!next) {
+		next = steal_task();
+	}
+
 	if (!next) {
+		unique_irq_lock l(runqueue_lock_);
+
 		next = &idle_thread_;
+		update_current(next);
+	}
+
+	if (tickless_) {
+		program_timer(next);
+	}
+
+	if (next != prev) {
+		trace(trace_event::context_switch, prev ? (u64)prev->entity : 0, (u64)next->entity);
 	}
 
 	set_current_tcb(next);
 }
 
+u64 core::tick_length() { return ((x86_core *)this)->local_tsc().frequency() / tick_frequency; }
+
+void core::program_timer(tcb *next)
+{
+	u64 now = __builtin_ia32_rdtsc();
+	u64 deadline = ~0ull;
+
+	// The running task only needs to be preempted if there's something else waiting to run.  Nothing
+	// can steal the running task, so it's safe to look at it without the runqueue lock.
+	if (next != &idle_thread_ && nr_runnable() > 1) {
+		deadline = sched_alg_->slice_end(*next, now, tick_length());
+	}
+
+	// Sleeping threads are woken up by the boot core, which is kicked whenever the earliest deadline
+	// moves forward.
+	if (this == &core_manager::get().get_boot_core()) {
+		deadline = min(deadline, sleeper::get().next_deadline());
+	}
+
+	// The profiler samples from the timer interrupt, so while it's running, every core keeps ticking.
+	if (profiler::get().enabled()) {
+		deadline = min(deadline, now + tick_length());
+	}
+
+	// Don't let the timer fire again before we've even returned from the interrupt.
+	if (deadline != ~0ull) {
+		deadline = max(deadline, now + (tick_length() / 100));
+	}
+
+	local_timer().set_deadline(deadline);
+}
+
+void core::kick_idle_core()
+{
+	for (auto *c : core_manager::get().cores()) {
+		if (c != this && c->online() && c->nr_runnable() == 0) {
+			c->kick();
+			return;
+		}
+	}
+}
+
 void core::update_accounting()
 {
 	// A thread has just been interrupted by the timer
@@ -5,8 +5,10 @@
  * Copyright (C) University of St Andrews 2024.  All Rights Reserved.
  * Tom Spink <tcs6@st-andrews.ac.uk>
  */
+#include <stacsos/elf.h>
 #include <stacsos/kernel/arch/x86/boot/multiboot.h>
 #include <stacsos/kernel/arch/x86/cpuid.h>
+#include <stacsos/kernel/arch/x86/cregs.h>
 #include <stacsos/kernel/debug.h>
 #include <stacsos/kernel/mem/memory-manager.h>
 #include <stacsos/kernel/mem/page-table.h>
@@ -65,6 +67,39 @@ static void initialise_memory(const multiboot_info *mbi)
 	}
 }
 
+/**
+ * Finds the kernel's symbol table, and hands it to the debug helper.  A boot loader may load the
+ * section headers (and the symbol table) for us, but QEMU's doesn't, so the kernel image can also be
+ * passed in as a module.  This must happen before the memory manager is initialised, as nothing stops
+ * the boot loader's copy from being allocated afterwards.
+ */
+static void load_kernel_symbols(const multiboot_info *mbi)
+{
+	if (mbi->flags & MULTIBOOT_INFO_ELF_SHDR) {
+		debug_helper::get().parse_image((const elf_sectionheader<32> *)phys_to_virt(mbi->elf_sec.addr), mbi->elf_sec.num, nullptr);
+		return;
+	}
+
+	if (mbi->flags & MULTIBOOT_INFO_MODS) {
+		const multiboot_module_entry *mods = (const multiboot_module_entry *)phys_to_virt(mbi->mods_addr);
+
+		for (u32 i = 0; i < mbi->mods_count; i++) {
+			const u8 *image = (const u8 *)phys_to_virt(mods[i].mod_start);
+			const elf_header<32> *hdr = (const elf_header<32> *)image;
+
+			if (mods[i].mod_end - mods[i].mod_start < sizeof(*hdr) || memops::memcmp(hdr->e_ident.ei_magic, "\x7f" "ELF", 4) != 0
+				|| hdr->e_shentsize != sizeof(elf_sectionheader<32>)) {
+				continue;
+			}
+
+			debug_helper::get().parse_image((const elf_sectionheader<32> *)(image + hdr->e_shoff), hdr->e_shnum, image);
+			return;
+		}
+	}
+
+	dprintf("debug: no kernel symbols (pass the kernel image as a module to get them)\n");
+}
+
 /* Command-line Handling */
 static char __boot_command_line[256];
 
@@ -97,12 +132,12 @@ static void check_arch_support()
 	cpuid c;
 	c.initialise();
 
-#ifdef USE_FSGSBASE
-	if (!c.get_feature(cpuid_features::fsgsbase)) {
-		dprintf("\e4ERROR:\e7 FSGSBASE IS NOT SUPPORTED.\n");
-		abort();
+	// The FS and GS bases are read and written on every trap, and the FSGSBASE instructions are much
+	// cheaper than the MSRs, so use them if they're there.
+	x86_fsgsbase_available = c.get_feature(cpuid_features::fsgsbase);
+	if (!x86_fsgsbase_available) {
+		dprintf("\e3WARNING:\e7 FSGSBASE is not supported, using MSRs for FS and GS bases\n");
 	}
-#endif
 }
 
 /* Architecture-indepentent kernel entry point */
@@ -138,6 +173,9 @@ extern "C" __noreturn void x86_start(const multiboot_info *multiboot_info)
 	process_command_line(multiboot_info);
 	dprintf("command-line: %s\n", __boot_command_line);
 
+	// Load the kernel's symbols, while the boot loader's copy is still intact.
+	load_kernel_symbols(multiboot_info);
+
 	// Initialise memory.
 	initialise_memory(multiboot_info);
 
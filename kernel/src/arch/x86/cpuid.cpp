@@ -1,8 +1,11 @@
 #include <stacsos/kernel/arch/x86/cpuid.h>
+#include <stacsos/kernel/arch/x86/cregs.h>
 #include <stacsos/kernel/debug.h>
 
 using namespace stacsos::kernel::arch::x86;
 
+bool stacsos::kernel::arch::x86::x86_fsgsbase_available = false;
+
 cpuid::cpuid()
 {
 #define feature(__name, __leaf, __reg, __bit)                                                                                                                  \
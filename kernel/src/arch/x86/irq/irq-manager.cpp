@@ -8,11 +8,14 @@
 #include <stacsos/kernel/arch/core.h>
 #include <stacsos/kernel/arch/x86/irq/irq-manager.h>
 #include <stacsos/kernel/arch/x86/irq/irq-traps.h>
+#include <stacsos/kernel/arch/x86/machine-context.h>
 #include <stacsos/kernel/arch/x86/x86-core.h>
 #include <stacsos/kernel/debug.h>
 #include <stacsos/kernel/sched/process-manager.h>
 #include <stacsos/kernel/sched/thread.h>
+#include <stacsos/kernel/trace.h>
 
+using namespace stacsos;
 using namespace stacsos::kernel;
 using namespace stacsos::kernel::arch::x86;
 using namespace stacsos::kernel::arch::x86::irq;
@@ -49,7 +52,11 @@ static irq_trap_fn_type irq_trap_functions[] = { x86_irq_trap_0, x86_irq_trap_1,
 	x86_irq_trap_241, x86_irq_trap_242, x86_irq_trap_243, x86_irq_trap_244, x86_irq_trap_245, x86_irq_trap_246, x86_irq_trap_247, x86_irq_trap_248,
 	x86_irq_trap_249, x86_irq_trap_250, x86_irq_trap_251, x86_irq_trap_252, x86_irq_trap_253, x86_irq_trap_254, x86_irq_trap_255 };
 
-extern "C" void x86_handle_irq(u8 irq_number, void *mcontext) { x86_core::this_core().irqmgr().handle_irq(irq_number, mcontext); }
+extern "C" void x86_handle_irq(u8 irq_number, void *mcontext)
+{
+	trace(trace_event::irq, irq_number, ((machine_context *)mcontext)->rip);
+	x86_core::this_core().irqmgr().handle_irq(irq_number, mcontext);
+}
 
 static void unhandled_interrupt(u8 irq_number, void *mcontext, void *arg)
 {
@@ -58,12 +65,15 @@ static void unhandled_interrupt(u8 irq_number, void *mcontext, void *arg)
 	dprintf("[%u] unhandled irq %u RIP=%p TASK=%p\n", stacsos::kernel::arch::core::this_core_id(), irq_number, mc->rip, &thread);
 	mc->dump();
 
-	u64 *ptr = (u64 *)mc->rbp;
-	while (*ptr) {
-		dprintf("Ret Addr=%p\n", ptr[1]);
-		ptr = (u64 *)ptr[0];
+	u64 start;
+	const char *name = debug_helper::get().symbolize(mc->rip, &start);
+	if (name) {
+		dprintf("in %s+0x%lx\n", name, mc->rip - start);
 	}
 
+	dprintf("backtrace:\n");
+	debug_helper::get().print_backtrace(mc->rbp);
+
 	abort();
 }
 
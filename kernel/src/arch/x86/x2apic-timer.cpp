@@ -5,11 +5,13 @@
  * Copyright (c) University of St Andrews 2024
  * Tom Spink <tcs6@st-andrews.ac.uk>
  */
+#include <stacsos/kernel/arch/x86/cpuid.h>
 #include <stacsos/kernel/arch/x86/machine-context.h>
 #include <stacsos/kernel/arch/x86/x2apic-timer.h>
 #include <stacsos/kernel/arch/x86/x2apic.h>
 #include <stacsos/kernel/arch/x86/x86-core.h>
 #include <stacsos/kernel/debug.h>
+#include <stacsos/kernel/profiler.h>
 #include <stacsos/kernel/sched/sleeper.h>
 
 using namespace stacsos::kernel;
@@ -19,6 +21,9 @@ using namespace stacsos::kernel::sched;
 void x2apic_timer::timer_irq_handler(u8 irq, void *context, void *arg)
 {
 	x2apic_timer *timer = (x2apic_timer *)arg;
+
+	profiler::get().sample(context);
+
 	timer->lapic_.owner().update_accounting();
 
 	sleeper::get().check_wakeup();
@@ -29,3 +34,49 @@ void x2apic_timer::timer_irq_handler(u8 irq, void *context, void *arg)
 }
 
 void x2apic_timer::init() { lapic_.set_timer_irq(lapic_.owner().irqmgr().allocate_irq(timer_irq_handler, this)); }
+
+void x2apic_timer::start_oneshot()
+{
+	cpuid c;
+	c.initialise();
+
+	// Prefer TSC-deadline mode, where the deadline is programmed directly.  Otherwise, fall back to
+	// one-shot mode, and convert the deadline into a count of (divided) LAPIC timer ticks.
+	use_tsc_deadline_ = c.get_feature(cpuid_features::tscdeadline);
+
+	if (use_tsc_deadline_) {
+		lapic_.set_timer_tsc_deadline();
+	} else {
+		lapic_.set_timer_one_shot();
+		lapic_.set_timer_divide(3);
+	}
+
+	lapic_.unmask_interrupts(x2apic_lvts::timer);
+}
+
+void x2apic_timer::set_deadline(u64 deadline)
+{
+	if (use_tsc_deadline_) {
+		// Writing zero disarms the timer.
+		msrs::ia32_tsc_deadline = deadline == ~0ull ? 0 : deadline;
+		return;
+	}
+
+	if (deadline == ~0ull) {
+		lapic_.set_timer_initial_count(0);
+		return;
+	}
+
+	auto &tsc = lapic_.owner().local_tsc();
+	u64 now = tsc.read();
+	u64 delta = deadline > now ? deadline - now : 0;
+
+	// Clamp to a second, which keeps the conversion below from overflowing.  If the deadline is
+	// further away than that, the interrupt will simply re-arm the timer.
+	if (delta > tsc.frequency()) {
+		delta = tsc.frequency();
+	}
+
+	u64 count = (delta * (lapic_.get_timer_frequency() >> 4)) / tsc.frequency();
+	lapic_.set_timer_initial_count(count ? (u32)count : 1);
+}
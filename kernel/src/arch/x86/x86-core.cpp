@@ -5,6 +5,7 @@
  * Copyright (c) University of St Andrews 2024
  * Tom Spink <tcs6@st-andrews.ac.uk>
  */
+#include <stacsos/kernel/arch/core-manager.h>
 #include <stacsos/kernel/arch/x86/cregs.h>
 #include <stacsos/kernel/arch/x86/msr.h>
 #include <stacsos/kernel/arch/x86/pit.h>
@@ -12,6 +13,7 @@
 #include <stacsos/kernel/debug.h>
 #include <stacsos/kernel/mem/memory-manager.h>
 #include <stacsos/kernel/sched/thread.h>
+#include <stacsos/kernel/trace.h>
 #include <stacsos/memops.h>
 
 using namespace stacsos;
@@ -79,6 +81,74 @@ static void yield_handler(u8 irq_nr, void *mcontext, void *arg)
 	c->schedule();
 }
 
+static void kick_handler(u8 irq_nr, void *mcontext, void *arg)
+{
+	x86_core *c = (x86_core *)arg;
+	c->schedule();
+	c->lapic().eoi();
+}
+
+// The vector used for the IPI that asks a (tickless) core to reschedule.
+#define KICK_IRQ 0xfe
+
+void x86_core::kick() { x86_core::this_core().lapic().send_ipi(apic_id_, KICK_IRQ); }
+
+// The vector used for the IPI that asks a core to flush its TLB.
+#define TLB_SHOOTDOWN_IRQ 0xfd
+
+void x86_core::flush_tlb()
+{
+	u64 requested = tlb_flush_requested_;
+
+	cr3::write(cr3::read());
+
+	// This may be interrupted by (or interrupt) another flush, so only ever move forwards.
+	u64 done = tlb_flush_done_;
+	while (done < requested && !__atomic_compare_exchange_n(&tlb_flush_done_, &done, requested, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) { }
+}
+
+void x86_core::tlb_shootdown_handler(u8 irq, void *mcontext, void *arg)
+{
+	x86_core *c = (x86_core *)arg;
+	c->flush_tlb();
+	c->lapic().eoi();
+}
+
+void x86_core::shootdown_tlb()
+{
+	x86_core &self = this_core();
+
+	u64 tickets[core_manager::max_cores];
+	for (auto *c : core_manager::get().cores()) {
+		x86_core *target = (x86_core *)c;
+		if (target == &self || !target->online()) {
+			continue;
+		}
+
+		tickets[target->id()] = __atomic_add_fetch(&target->tlb_flush_requested_, 1, __ATOMIC_SEQ_CST);
+		self.lapic().send_ipi(target->apic_id_, TLB_SHOOTDOWN_IRQ);
+	}
+
+	cr3::write(cr3::read());
+
+	for (auto *c : core_manager::get().cores()) {
+		x86_core *target = (x86_core *)c;
+		if (target == &self || !target->online()) {
+			continue;
+		}
+
+		while (target->tlb_flush_done_ < tickets[target->id()]) {
+			// Interrupts are probably disabled, so if another core is waiting on this one at the same
+			// time, its request has to be dealt with here.
+			if (self.tlb_flush_done_ < self.tlb_flush_requested_) {
+				self.flush_tlb();
+			}
+
+			__relax();
+		}
+	}
+}
+
 void x86_core::populate_dt()
 {
 	// Populate the GDT, with a NULL entry, then CODE and DATA segments for KERNEL and USER mode respectively.
@@ -100,41 +170,72 @@ void x86_core::populate_dt()
 	// The IRQ manager takes care of the IDT
 	irqs_.initialise();
 	irqs_.reserve_irq(0xff, yield_handler, this);
+	irqs_.reserve_irq(KICK_IRQ, kick_handler, this);
+	irqs_.reserve_irq(TLB_SHOOTDOWN_IRQ, tlb_shootdown_handler, this);
 
 	// The TSS is needed for swapping stacks if we're going into USER mode.
 	tss_.set_kernel_stack(0);
 	tss_.reload(0x28);
 }
 
-bool x86_core::remote_run() { return false; }
+// The AP startup trampoline (see boot/mpstartup.S) is copied to this physical address, which must be
+// page aligned and below 1M, since the SIPI vector is a page number.  The page immediately following
+// holds the temporary PML4 that the AP uses to get into long mode.
+#define MPSTARTUP_BASE 0x70000
+#define MPSTARTUP_PML4 (MPSTARTUP_BASE + PAGE_SIZE)
+
+// Each AP gets a temporary stack for initialisation, until it switches to its idle thread.
+#define MPSTARTUP_STACK_ORDER 2
 
-#if 0
 struct mpstartup_data {
-	u64 mpready;
-	u64 mpcr3;
-	x86_core *core_obj;
-	void *mpstack;
-	void (stacsos::kernel::arch::x86::x86_core::*trampoline)(void);
+	u64 cr4; // 00
+	u64 tmp_cr3; // 08
+	u64 cr3; // 10
+	u64 stack; // 18
+	x86_core *core_obj; // 20
+	void (*entry)(x86_core *); // 28
+	u64 ready; // 30
 } __packed;
 
-extern "C" char _MPSTARTUP_START, _MPSTARTUP_END, _MPSTARTUP_SIZE;
-extern "C" mpstartup_data _MPSTARTUP_DATA;
+extern "C" char _MPSTARTUP_START, _MPSTARTUP_END, _MPSTARTUP_DATA;
+
+static volatile mpstartup_data *get_mpstartup_data()
+{
+	// The data block lives inside the copy of the trampoline in low memory, not in the kernel image.
+	return (volatile mpstartup_data *)phys_to_virt(MPSTARTUP_BASE + (&_MPSTARTUP_DATA - &_MPSTARTUP_START));
+}
+
+static bool wait_for_ready(tsc &t, u64 milliseconds)
+{
+	u64 target = t.read() + ((t.frequency() * milliseconds) / 1000ull);
+
+	while (!get_mpstartup_data()->ready) {
+		if (t.read() >= target) {
+			return false;
+		}
+
+		__relax();
+	}
+
+	return true;
+}
 
 bool x86_core::remote_run()
 {
 	auto &me = this_core();
 
-	pfn_t mpstart_pfn = prepare_mpstartup_code();
+	prepare_mpstartup_code();
 
-	// Acquire a pointer to the mp startup data structure, which we need to fill in.  It should
-	// be volatile, so that we can check the mpready flag without worrying that the compiler
-	// optimises "redundant checks" away.
-	volatile mpstartup_data *d = (volatile mpstartup_data *)&_MPSTARTUP_DATA;
-	d->mpready = 0; // Is the core ready?
-	d->mpcr3 = __read_cr3(); // The pages tables to provide the core with (just the same as this core's)
-	d->core_obj = this; // A pointer to the core object that is coming online
-	d->mpstack = (void *)(((u64) new char[0x1000]) + 0x1000); // A temporary stack (which we need to remember to free at some point)
-	d->trampoline = &exegol::arch::x86::x86_core::complete_remote_init; // The function to call once we've gotten into 64-bit mode
+	// Fill in the mp startup data structure.  It's volatile, so that we can check the ready flag without
+	// worrying that the compiler optimises "redundant checks" away.
+	volatile mpstartup_data *d = get_mpstartup_data();
+	d->cr4 = (u64)cr4::read();
+	d->tmp_cr3 = MPSTARTUP_PML4;
+	d->cr3 = memory_manager::get().root_address_space().pgtable().effective_cr3();
+	d->stack = (u64)memory_manager::get().pgalloc().allocate_pages(MPSTARTUP_STACK_ORDER)->base_address_ptr() + (PAGE_SIZE << MPSTARTUP_STACK_ORDER);
+	d->core_obj = this;
+	d->entry = mpstartup_entry;
+	d->ready = 0;
 
 	// Stick in a full memory fence, just to be safe.
 	asm volatile("mfence" ::: "memory");
@@ -142,53 +243,57 @@ bool x86_core::remote_run()
 	// The sequence is INIT --> SIPI (--> SIPI)
 
 	// Send the INIT
-	me.lapic_.send_remote_init(id());
+	me.lapic_.send_remote_init(apic_id_);
 	me.tsc_.spin(10); // Wait for 10ms...
 
-	// Send the SIPI
-	me.lapic_.send_remote_sipi(id(), mpstart_pfn);
-	me.tsc_.spin(1); // Wait for 1ms...
-
-	// If the core didn't come online, send another SIPI and give it a second
-	if (!d->mpready) {
-		me.lapic_.send_remote_sipi(id(), mpstart_pfn);
-		me.tsc_.spin(1000); // 1s
+	// Send the SIPI.  The core signals that it is ready once it has been initialised, which
+	// includes calibrating its timers, so give it a reasonable amount of time.
+	me.lapic_.send_remote_sipi(apic_id_, MPSTARTUP_BASE >> PAGE_BITS);
+	if (wait_for_ready(me.tsc_, 200)) {
+		return true;
 	}
 
-	// Return whether or not the core came online.
-	return !!d->mpready;
+	// If the core didn't come online, send another SIPI and give it a second
+	me.lapic_.send_remote_sipi(apic_id_, MPSTARTUP_BASE >> PAGE_BITS);
+	return wait_for_ready(me.tsc_, 1000);
 }
 
-pfn_t x86_core::prepare_mpstartup_code()
+void x86_core::prepare_mpstartup_code()
 {
-	// This function is a total hack.  It just brutally copies the mp startup code and data into an arbitrary page,
-	// because we can only access PFNs < 0x100 when initialising other processors.
-
-	pfn_t target_pfn = 0; // Let's go for page 0.  The mp startup assembly is written to
-						  // work in page 0 -- there is one place where a relative address
-						  // computation is made, which assumes we're running in page zero.
-
-	// Copy the mp startup assembly into the right place.  Technically, we only need the 16-bit
-	// code, because once we jump into 32-bit mode, we're actually executing at normal addresses.
-	void *target_addr = (void *)(target_pfn << PAGE_BITS);
-	memops::memcpy(target_addr, (void *)&_MPSTARTUP_START, (size_t)&_MPSTARTUP_SIZE);
+	// Copy the mp startup code (and its data block) into low memory, because a starting processor
+	// can only begin executing at a page below 1M.  This memory is never handed out by the page
+	// allocator.
+	memops::memcpy(phys_to_virt(MPSTARTUP_BASE), &_MPSTARTUP_START, &_MPSTARTUP_END - &_MPSTARTUP_START);
+
+	// Build the temporary PML4.  This is a copy of the kernel's, but with the lower 512G identity mapped
+	// (by borrowing the physical memory mapping at 0xffff800000000000), so that the trampoline can keep
+	// executing once paging is enabled.
+	const u64 *kernel_pml4 = (const u64 *)phys_to_virt(memory_manager::get().root_address_space().pgtable().effective_cr3());
+	u64 *tmp_pml4 = (u64 *)phys_to_virt(MPSTARTUP_PML4);
+
+	for (int i = 0; i < 0x200; i++) {
+		tmp_pml4[i] = kernel_pml4[i];
+	}
 
-	// We really need to remember to unmap page zero later...
-	return target_pfn;
+	tmp_pml4[0] = kernel_pml4[0x100];
 }
 
+void x86_core::mpstartup_entry(x86_core *core) { core->complete_remote_init(); }
+
 void x86_core::complete_remote_init()
 {
-	// Update the TSC aux MSR with the core ID, so that the rdpid instruction works.
-	msr::write(msr_indicies::IA32_TSC_AUX, id());
+	// Update the TSC aux MSR with the core ID, so that this_core_id() works.
+	msrs::ia32_tsc_aux = id();
+
+	init();
 
 	dprintf("core [%d] online\n", id());
 
-	// Initialise and run this new core.
-	init();
+	// Let the BSP know we've made it.  After this point, the trampoline can be reused.
+	get_mpstartup_data()->ready = 1;
+
 	run();
 }
-#endif
 
 void x86_core::handle_gpf(machine_context *mc)
 {
@@ -202,7 +307,14 @@ void x86_core::handle_gpf(machine_context *mc)
 
 void x86_core::handle_page_fault(machine_context *mc)
 {
-	if (memory_manager::get().try_handle_page_fault(cr2::read())) {
+	// Bit 0 of the error code is set for protection violations, and bit 1 for writes.  Most protection
+	// violations can't be fixed, but a write to a copy-on-write page can.
+	bool present = !!(mc->extra & 1);
+	bool write = !!(mc->extra & 2);
+
+	trace(trace_event::page_fault, cr2::read(), mc->extra);
+
+	if (memory_manager::get().try_handle_page_fault(cr2::read(), write, present)) {
 		return;
 	}
 
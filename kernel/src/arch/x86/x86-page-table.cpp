@@ -43,6 +43,19 @@ void x86_page_table::map(page_table_allocator &pta, u64 virtual_address, u64 phy
 	// TODO: assert VA canonical
 	bool rw = (flags & mapping_flags::writable) == mapping_flags::writable;
 	bool user = (flags & mapping_flags::user_accessable) == mapping_flags::user_accessable;
+	bool nx = (flags & mapping_flags::no_execute) == mapping_flags::no_execute;
+
+	// The permissions of the intermediate levels are combined with those of the leaf, so widen them to
+	// cover this mapping.  That way, mappings that share a table can still have different protection.
+	auto widen = [rw, user](base_entry &e) {
+		if (rw) {
+			e.rw(true);
+		}
+
+		if (user) {
+			e.us(true);
+		}
+	};
 
 	pml4e &l4 = pml4_[pml4_index(virtual_address)];
 	if (!l4.present()) {
@@ -53,6 +66,8 @@ void x86_page_table::map(page_table_allocator &pta, u64 virtual_address, u64 phy
 		l4.present(true);
 		l4.rw(rw);
 		l4.us(user);
+	} else {
+		widen(l4);
 	}
 
 	pdpe &l3 = (*(pdp *)page::get_from_base_address(l4.base_address()).base_address_ptr())[pdp_index(virtual_address)];
@@ -66,6 +81,7 @@ void x86_page_table::map(page_table_allocator &pta, u64 virtual_address, u64 phy
 			l3.present(true);
 			l3.rw(rw);
 			l3.us(user);
+			l3.xd(nx);
 			return;
 		}
 	} else {
@@ -73,6 +89,8 @@ void x86_page_table::map(page_table_allocator &pta, u64 virtual_address, u64 phy
 			if (l3.size()) {
 				panic("overlapping mapping");
 			}
+
+			widen(l3);
 		} else {
 			page *l2page = pta.allocate();
 			l3.reset();
@@ -94,6 +112,7 @@ void x86_page_table::map(page_table_allocator &pta, u64 virtual_address, u64 phy
 			l2.present(true);
 			l2.rw(rw);
 			l2.us(user);
+			l2.xd(nx);
 			return;
 		}
 	} else {
@@ -101,6 +120,8 @@ void x86_page_table::map(page_table_allocator &pta, u64 virtual_address, u64 phy
 			if (l2.size()) {
 				panic("overlapping mapping");
 			}
+
+			widen(l2);
 		} else {
 			page *l1page = pta.allocate();
 			l2.reset();
@@ -117,6 +138,75 @@ void x86_page_table::map(page_table_allocator &pta, u64 virtual_address, u64 phy
 	l1.present(true);
 	l1.rw(rw);
 	l1.us(user);
+	l1.xd(nx);
+}
+
+void x86_page_table::unmap(page_table_allocator &pta, u64 virtual_address)
+{
+	// Only 4k mappings can be removed, and the page tables themselves are left in place.
+	const pml4e &l4 = pml4_[pml4_index(virtual_address)];
+	if (!l4.present()) {
+		return;
+	}
+
+	const pdpe &l3 = (*(const pdp *)page::get_from_base_address(l4.base_address()).base_address_ptr())[pdp_index(virtual_address)];
+	if (!l3.present() || l3.size()) {
+		return;
+	}
+
+	const pde &l2 = (*(const pd *)page::get_from_base_address(l3.base_address()).base_address_ptr())[pd_index(virtual_address)];
+	if (!l2.present() || l2.size()) {
+		return;
+	}
+
+	(*(pt *)page::get_from_base_address(l2.base_address()).base_address_ptr())[pt_index(virtual_address)].reset();
+}
+
+bool x86_page_table::is_mapped(u64 virtual_address) const
+{
+	u64 physical_address;
+	bool writable;
+
+	return translate(virtual_address, physical_address, writable);
+}
+
+bool x86_page_table::translate(u64 virtual_address, u64 &physical_address, bool &writable) const
+{
+	const pml4e &l4 = pml4_[pml4_index(virtual_address)];
+	if (!l4.present()) {
+		return false;
+	}
+
+	const pdpe &l3 = (*(const pdp *)page::get_from_base_address(l4.base_address()).base_address_ptr())[pdp_index(virtual_address)];
+	if (!l3.present()) {
+		return false;
+	}
+
+	if (l3.size()) {
+		physical_address = l3.base_address() + (virtual_address & (GB(1) - 1));
+		writable = l4.rw() && l3.rw();
+		return true;
+	}
+
+	const pde &l2 = (*(const pd *)page::get_from_base_address(l3.base_address()).base_address_ptr())[pd_index(virtual_address)];
+	if (!l2.present()) {
+		return false;
+	}
+
+	if (l2.size()) {
+		physical_address = l2.base_address() + (virtual_address & (MB(2) - 1));
+		writable = l4.rw() && l3.rw() && l2.rw();
+		return true;
+	}
+
+	const pte &l1 = (*(const pt *)page::get_from_base_address(l2.base_address()).base_address_ptr())[pt_index(virtual_address)];
+	if (!l1.present()) {
+		return false;
+	}
+
+	physical_address = l1.base_address() + (virtual_address & ~PAGE_MASK);
+	writable = l4.rw() && l3.rw() && l2.rw() && l1.rw();
+	return true;
 }
 
 void x86_page_table::dump() const
@@ -10,14 +10,16 @@
 #include <stacsos/kernel/arch/x86/pio.h>
 #include <stacsos/kernel/arch/x86/text-console.h>
 #include <stacsos/kernel/debug.h>
+#include <stacsos/memops.h>
 #include <stacsos/printf.h>
+#include <stacsos/sort.h>
 
 using namespace stacsos;
 using namespace stacsos::kernel;
 using namespace stacsos::kernel::arch;
 using namespace stacsos::kernel::arch::x86;
 
-extern "C" char _IMAGE_START[], _IMAGE_END[];
+extern "C" char _TEXT_START[], _TEXT_END[];
 
 static text_console x86_text_console;
 static console_interface *console;
@@ -74,41 +76,133 @@ __noreturn void panic_with_ctx(const void *ctx, const char *fmt, ...)
 	hang_loop();
 }
 
-void debug_helper::parse_image()
+/*
+ * The kernel's function symbols, sorted by address.  These are copied out of the ELF image before the
+ * memory manager is up (after which the boot loader's copy may be overwritten), so live in fixed-size
+ * tables.
+ */
+struct kernel_symbol {
+	u64 address;
+	u32 size;
+	u32 name;
+};
+
+static const u32 max_symbols = 8192;
+static kernel_symbol symbols[max_symbols];
+static u32 nr_symbols;
+
+static char symbol_names[256 * 1024];
+static u32 symbol_names_size;
+
+static const u8 *section_data(const elf_sectionheader<32> &sh, const u8 *image)
 {
-	/*u64 kernel_image_start = (u64)phys_to_virt((u64)&_IMAGE_START);
-	u64 kernel_image_end = (u64)phys_to_virt((u64)&_IMAGE_END);
+	return image ? image + sh.sh_offset : (const u8 *)phys_to_virt(sh.sh_addr);
+}
+
+void debug_helper::parse_image(const elf_sectionheader<32> *sections, u16 nr_sections, const u8 *image)
+{
+	const elf_sectionheader<32> *symtab = nullptr;
+	for (u16 i = 0; i < nr_sections; i++) {
+		if (sections[i].sh_type == SHT_SYMTAB) {
+			symtab = &sections[i];
+			break;
+		}
+	}
+
+	if (!symtab || symtab->sh_link >= nr_sections || sections[symtab->sh_link].sh_type != SHT_STRTAB) {
+		dprintf("debug: no kernel symbol table\n");
+		return;
+	}
+
+	const elf_sym<32> *sym = (const elf_sym<32> *)section_data(*symtab, image);
+	const elf_sym<32> *sym_end = (const elf_sym<32> *)(section_data(*symtab, image) + symtab->sh_size);
+	const char *strtab = (const char *)section_data(sections[symtab->sh_link], image);
+
+	for (; sym < sym_end; sym++) {
+		u8 type = ELF_ST_TYPE(sym->st_info);
+
+		// Only functions are interesting.  Assembly routines don't always say they are functions, so
+		// untyped symbols that are in the kernel's text are taken too.
+		u64 address = (u64)(s64)(s32)sym->st_value;
+		if (type != STT_FUNC && !(type == STT_NOTYPE && address >= (u64)_TEXT_START && address < (u64)_TEXT_END)) {
+			continue;
+		}
+
+		if (sym->st_shndx == 0 || address == 0) {
+			continue;
+		}
+
+		const char *name = &strtab[sym->st_name];
+		size_t name_length = memops::strlen(name) + 1;
+
+		if (nr_symbols == max_symbols || symbol_names_size + name_length > sizeof(symbol_names)) {
+			dprintf("debug: too many kernel symbols, some will be missing\n");
+			break;
+		}
 
-	dprintf("kernel image start=0x%lx, end=0x%lx, size=0x%lx bytes\n", kernel_image_start, kernel_image_end, kernel_image_end - kernel_image_start);
+		memops::memcpy(&symbol_names[symbol_names_size], name, name_length);
 
-	const elf_header<32> *kernel_image_header = (const elf_header<32> *)kernel_image_start;
+		symbols[nr_symbols].address = address;
+		symbols[nr_symbols].size = sym->st_size;
+		symbols[nr_symbols].name = symbol_names_size;
+		nr_symbols++;
 
-	if (kernel_image_header->e_ident.ei_magic[0] != 0x7f || kernel_image_header->e_ident.ei_magic[1] != 0x45 || kernel_image_header->e_ident.ei_magic[2] != 0x4c
-		|| kernel_image_header->e_ident.ei_magic[3] != 0x46) {
-		panic("Invalid magic number (%08x) for kernel image ELF header.", *(u32 *)kernel_image_header->e_ident.ei_magic);
+		symbol_names_size += name_length;
 	}
 
-	if (kernel_image_header->e_shentsize != 0x28) {
-		panic("Invalid section header entry size %d", kernel_image_header->e_shentsize);
+	shell_sort(symbols, nr_symbols, [](const kernel_symbol &a, const kernel_symbol &b) { return a.address < b.address; });
+
+	dprintf("debug: loaded %u kernel symbols\n", nr_symbols);
+}
+
+const char *debug_helper::symbolize(u64 address, u64 *start) const
+{
+	// Find the last symbol that starts at or before the address.
+	u32 low = 0, high = nr_symbols;
+	while (low < high) {
+		u32 mid = low + ((high - low) / 2);
+
+		if (symbols[mid].address <= address) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
 	}
 
-	dprintf("%x\n", kernel_image_header->e_shoff);
+	if (low == 0) {
+		return nullptr;
+	}
 
-	for (u16 shidx = 0; shidx < kernel_image_header->e_shnum; shidx++) {
-		const elf_sectionheader<32> *sh = &((const elf_sectionheader<32> *)(kernel_image_start + kernel_image_header->e_shoff))[shidx];
+	const kernel_symbol &s = symbols[low - 1];
 
-		dprintf("  %p %d\n", sh, sh->sh_name);
+	// Symbols from assembly may not have a size, in which case they run up to the next symbol.
+	if (s.size && address >= s.address + s.size) {
+		return nullptr;
+	}
 
-		if (sh->sh_type == SHT_SYMTAB) {
-			dprintf("found symbol table\n");
+	if (start) {
+		*start = s.address;
+	}
 
-			const elf_sym<32> *sym = ((const elf_sym<32> *)(kernel_image_start + sh->sh_offset));
-			const elf_sym<32> *sym_end = ((const elf_sym<32> *)(kernel_image_start + sh->sh_offset + sh->sh_size));
+	return &symbol_names[s.name];
+}
 
-			while (sym < sym_end) {
-				dprintf("symbol\n");
-				sym++;
-			}
+void debug_helper::print_backtrace(u64 rbp) const
+{
+	const u64 *frame = (const u64 *)rbp;
+
+	// Stop at the end of the chain, or if the chain wanders out of the kernel's address space.
+	for (int depth = 0; depth < 32 && (u64)frame >= 0xffff'8000'0000'0000ull && !((u64)frame & 7) && frame[0]; depth++) {
+		u64 return_address = frame[1];
+		u64 start;
+
+		const char *name = symbolize(return_address, &start);
+		if (name) {
+			dprintf("  %p <%s+0x%lx>\n", return_address, name, return_address - start);
+		} else {
+			dprintf("  %p\n", return_address);
 		}
-	}*/
+
+		frame = (const u64 *)frame[0];
+	}
 }
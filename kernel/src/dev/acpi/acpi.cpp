@@ -92,8 +92,12 @@ bool ACPI::parse_madt_lapic(const madt_record_lapic *lapic_record)
 {
 	dprintf("madt: lapic: id=%u, procid=%u, flags=%x\n", lapic_record->apic_id, lapic_record->acpi_processor_id, lapic_record->flags);
 
-	// bool bootstrap = lapic_record->apic_id == 0;
-	core_manager::get().register_core(*new x86_core(lapic_record->acpi_processor_id));
+	// Processors that are present in the table, but not enabled, can't be brought online.
+	if (!(lapic_record->flags & 1)) {
+		return true;
+	}
+
+	core_manager::get().register_core(*new x86_core(lapic_record->acpi_processor_id, lapic_record->apic_id));
 
 	return true;
 }
@@ -339,6 +339,35 @@ void virtual_console::clear()
 	}
 }
 
+bool virtual_console::blit(const virtual_console_blit &rect)
+{
+	// Written this way round, so that large values can't overflow past the checks.
+	if (rect.x > buffer_width() || rect.width > buffer_width() - rect.x) {
+		return false;
+	}
+
+	if (rect.y > buffer_height() || rect.height > buffer_height() - rect.y) {
+		return false;
+	}
+
+	if (rect.stride < rect.width || !rect.data) {
+		return false;
+	}
+
+	size_t row_length = rect.width * element_size();
+	const u8 *src = (const u8 *)rect.data;
+	u8 *dst = internal_buffer_ + ((rect.x + ((size_t)rect.y * buffer_width())) * element_size());
+
+	for (u32 row = 0; row < rect.height; row++) {
+		memops::memcpy(dst, src, row_length);
+
+		src += (size_t)rect.stride * element_size();
+		dst += buffer_width() * element_size();
+	}
+
+	return true;
+}
+
 void virtual_console::update_cursor()
 {
 	if (active_ && mode_ == virtual_console_mode::text) {
@@ -377,36 +406,33 @@ public:
 
 	virtual size_t pread(void *buffer, size_t offset, size_t length) override
 	{
-		size_t clamped_length = length;
-
-		if (vc_.mode() == virtual_console_mode::gfx) {
-			memops::memcpy(buffer, &((u32 *)vc_.internal_buffer_)[offset], clamped_length);
-		} else {
-			memops::memcpy(buffer, &((u16 *)vc_.internal_buffer_)[offset], clamped_length);
-		}
+		size_t clamped_length = clamp(offset, length);
+		memops::memcpy(buffer, vc_.internal_buffer_ + (offset * vc_.element_size()), clamped_length);
 
 		return clamped_length;
 	}
 
 	virtual size_t pwrite(const void *buffer, size_t offset, size_t length) override
 	{
-		size_t clamped_length = length;
-
-		if (vc_.mode() == virtual_console_mode::gfx) {
-			memops::memcpy(&((u32 *)vc_.internal_buffer_)[offset], buffer, clamped_length);
-		} else {
-			memops::memcpy(&((u16 *)vc_.internal_buffer_)[offset], buffer, clamped_length);
-		}
+		size_t clamped_length = clamp(offset, length);
+		memops::memcpy(vc_.internal_buffer_ + (offset * vc_.element_size()), buffer, clamped_length);
 
 		return clamped_length;
 	}
 
 	virtual u64 ioctl(u64 cmd, void *buffer, size_t length) override
 	{
-		switch (cmd) {
-		case 1:
+		switch ((virtual_console_ioctl)cmd) {
+		case virtual_console_ioctl::get_mode:
 			return (u64)vc_.mode();
 
+		case virtual_console_ioctl::blit:
+			if (length != sizeof(virtual_console_blit)) {
+				return 0;
+			}
+
+			return vc_.blit(*(const virtual_console_blit *)buffer) ? 1 : 0;
+
 		default:
 			return 0;
 		}
@@ -414,6 +440,16 @@ public:
 
 private:
 	virtual_console &vc_;
+
+	// The offset is in cells or pixels, but the length is in bytes.  Keep the access within the buffer.
+	size_t clamp(size_t offset, size_t length) const
+	{
+		if (offset >= vc_.internal_buffer_size_ / vc_.element_size()) {
+			return 0;
+		}
+
+		return min(length, vc_.internal_buffer_size_ - (offset * vc_.element_size()));
+	}
 };
 } // namespace stacsos::kernel::dev::console
 
@@ -7,7 +7,6 @@
  */
 #include <stacsos/kernel/debug.h>
 #include <stacsos/kernel/dev/devfs.h>
-#include <stacsos/kernel/dev/device-manager.h>
 
 using namespace stacsos;
 using namespace stacsos::kernel::dev;
@@ -15,21 +14,112 @@ using namespace stacsos::kernel::fs;
 
 devfs::devfs()
 	: root_(new devfs_node(*this, nullptr, fs_node_kind::directory, "", nullptr))
+	, nodes_head_(nullptr)
+	, nodes_tail_(nullptr)
 {
+	for (auto &b : buckets_) {
+		b = nullptr;
+	}
+}
+
+devfs_node *devfs::find(const string &name)
+{
+	devfs_node *node = buckets_[name.get_hash() % nr_buckets];
+	while (node && node->name() != name) {
+		node = node->hash_next_;
+	}
+
+	return node;
+}
+
+void devfs::add_device(const string &name, device &dev)
+{
+	{
+		unique_irq_lock l(lock_);
+
+		devfs_node *node = find(name);
+		if (node) {
+			node->dev_ = &dev;
+		} else {
+			node = new devfs_node(*this, root_, fs_node_kind::file, name, &dev);
+
+			devfs_node **bucket = &buckets_[name.get_hash() % nr_buckets];
+			node->hash_next_ = *bucket;
+			*bucket = node;
+
+			if (nodes_tail_) {
+				nodes_tail_->next_ = node;
+			} else {
+				nodes_head_ = node;
+			}
+
+			nodes_tail_ = node;
+		}
+	}
+
+	root_->child_added(name);
+}
+
+void devfs::remove_device(device &dev)
+{
+	list<devfs_node *> detached;
+
+	{
+		unique_irq_lock l(lock_);
+
+		for (devfs_node *node = nodes_head_; node; node = node->next_) {
+			if (node->dev_ == &dev) {
+				node->dev_ = nullptr;
+				detached.append(node);
+			}
+		}
+	}
+
+	for (auto *node : detached) {
+		root_->child_removed(node->name());
+	}
+}
+
+bool devfs::try_get_device(const string &name, device *&dev)
+{
+	unique_irq_lock l(lock_);
+
+	devfs_node *node = find(name);
+	if (!node || !node->dev_) {
+		return false;
+	}
+
+	dev = node->dev_;
+	return true;
 }
 
 fs_node *devfs_node::resolve_child(const string &name)
 {
-	if (dev_ != nullptr) {
+	devfs &dfs = (devfs &)fs();
+
+	// Only the root has children.
+	if (this != dfs.root_) {
 		return nullptr;
 	}
 
-	dprintf("devfs: resolve %s\n", name.c_str());
+	unique_irq_lock l(dfs.lock_);
 
-	device *dp;
-	if (!device_manager::get().try_get_device_by_name(name, dp)) {
-		return nullptr;
+	devfs_node *node = dfs.find(name);
+	return (node && node->dev_) ? node : nullptr;
+}
+
+void devfs_node::list_children(list<fs_node *> &children)
+{
+	devfs &dfs = (devfs &)fs();
+	if (this != dfs.root_) {
+		return;
 	}
 
-	return new devfs_node(fs(), this, fs_node_kind::file, name, dp);
+	unique_irq_lock l(dfs.lock_);
+
+	for (devfs_node *node = dfs.nodes_head_; node; node = node->next_) {
+		if (node->dev_) {
+			children.append(node);
+		}
+	}
 }
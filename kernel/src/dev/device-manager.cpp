@@ -6,6 +6,7 @@
  * Tom Spink <tcs6@st-andrews.ac.uk>
  */
 #include <stacsos/kernel/debug.h>
+#include <stacsos/kernel/dev/devfs.h>
 #include <stacsos/kernel/dev/device-manager.h>
 #include <stacsos/kernel/dev/device.h>
 
@@ -28,18 +29,38 @@ string device_manager::register_device(device &device)
 	dprintf("device-manager: registering device '%s'\n", devname.c_str());
 
 	device.configure();
-	devices_.add(devname.get_hash(), &device);
+
+	{
+		unique_irq_lock l(lock_);
+		devices_.append(&device);
+	}
+
+	devfs::get().add_device(devname, device);
 
 	return devname;
 }
 
-void device_manager::add_device_alias(device &device, const string &name) { devices_.add(name.get_hash(), &device); }
+void device_manager::add_device_alias(device &device, const string &name) { devfs::get().add_device(name, device); }
+
+void device_manager::unregister_device(device &device)
+{
+	dprintf("device-manager: unregistering device %p\n", &device);
+
+	{
+		unique_irq_lock l(lock_);
+		devices_.remove(&device);
+	}
+
+	devfs::get().remove_device(device);
+}
 
 bool device_manager::try_get_device_by_class(const device_class &dc, device *&dp)
 {
-	for (const auto &d : devices_) {
-		if (d.value->devclass().is_a(dc)) {
-			dp = d.value;
+	unique_irq_lock l(lock_);
+
+	for (auto *d : devices_) {
+		if (d->devclass().is_a(dc)) {
+			dp = d;
 			return true;
 		}
 	}
@@ -47,4 +68,4 @@ bool device_manager::try_get_device_by_class(const device_class &dc, device *&dp
 	return false;
 }
 
-bool device_manager::try_get_device_by_name(const string &name, device *&dp) { return devices_.try_get_value(name.get_hash(), dp); }
+bool device_manager::try_get_device_by_name(const string &name, device *&dp) { return devfs::get().try_get_device(name, dp); }
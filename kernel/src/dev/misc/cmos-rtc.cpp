@@ -1,8 +1,74 @@
+#include <stacsos/kernel/arch/x86/pio.h>
 #include <stacsos/kernel/dev/misc/cmos-rtc.h>
 
 using namespace stacsos::kernel::dev;
 using namespace stacsos::kernel::dev::misc;
+using namespace stacsos::kernel::arch::x86;
 
 device_class cmos_rtc::cmos_rtc_device_class(rtc::rtc_device_class, "cmos-rtc");
 
-rtc_timepoint cmos_rtc::read_timepoint() { panic("NOT IMPLEMENTED"); }
+u8 cmos_rtc::read_register(u8 index)
+{
+	// Bit 7 of the index port masks NMIs, which is left alone.
+	pio::outb(0x70, index);
+	return pio::inb(0x71);
+}
+
+rtc_timepoint cmos_rtc::read_raw()
+{
+	while (update_in_progress()) {
+		__relax();
+	}
+
+	rtc_timepoint tp;
+	tp.seconds = read_register(0x00);
+	tp.minutes = read_register(0x02);
+	tp.hours = read_register(0x04);
+	tp.day_of_month = read_register(0x07);
+	tp.month = read_register(0x08);
+	tp.year = read_register(0x09);
+
+	return tp;
+}
+
+static u16 from_bcd(u16 v) { return ((v >> 4) * 10) + (v & 0xf); }
+
+rtc_timepoint cmos_rtc::read_timepoint()
+{
+	// The registers can change part-way through being read, so keep reading them until two reads in a
+	// row agree.
+	rtc_timepoint tp = read_raw(), prev;
+
+	do {
+		prev = tp;
+		tp = read_raw();
+	} while (tp.seconds != prev.seconds || tp.minutes != prev.minutes || tp.hours != prev.hours || tp.day_of_month != prev.day_of_month
+		|| tp.month != prev.month || tp.year != prev.year);
+
+	u8 status_b = read_register(0x0b);
+	bool pm = tp.hours & 0x80;
+	tp.hours &= 0x7f;
+
+	// Status register B says whether the values are binary or BCD, and whether the clock is 12 or 24
+	// hour.
+	if (!(status_b & 0x04)) {
+		tp.seconds = from_bcd(tp.seconds);
+		tp.minutes = from_bcd(tp.minutes);
+		tp.hours = from_bcd(tp.hours);
+		tp.day_of_month = from_bcd(tp.day_of_month);
+		tp.month = from_bcd(tp.month);
+		tp.year = from_bcd(tp.year);
+	}
+
+	if (!(status_b & 0x02)) {
+		tp.hours %= 12;
+		if (pm) {
+			tp.hours += 12;
+		}
+	}
+
+	// The year is only two digits.  The century register isn't always there, so assume this one.
+	tp.year += 2000;
+
+	return tp;
+}
@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#include <stacsos/kernel/arch/x86/pio.h>
+#include <stacsos/kernel/dev/misc/debug-console-device.h>
+#include <stacsos/kernel/fs/file.h>
+
+using namespace stacsos;
+using namespace stacsos::kernel;
+using namespace stacsos::kernel::fs;
+using namespace stacsos::kernel::dev;
+using namespace stacsos::kernel::dev::misc;
+using namespace stacsos::kernel::arch::x86;
+
+device_class debug_console_device::debug_console_device_class(device_class::root, "debug-console");
+
+class debug_console_file : public file {
+public:
+	debug_console_file(spinlock_irq &lock)
+		: file(0)
+		, lock_(lock)
+	{
+	}
+
+	virtual size_t pread(void *buffer, size_t offset, size_t length) override { return 0; }
+	virtual size_t pwrite(const void *buffer, size_t offset, size_t length) override { return write(buffer, length); }
+
+	virtual size_t read(void *buffer, size_t length) override { return 0; }
+
+	virtual size_t write(const void *buffer, size_t length) override
+	{
+		unique_irq_lock l(lock_);
+
+		const u8 *data = (const u8 *)buffer;
+		for (size_t i = 0; i < length; i++) {
+			ioports::qemu_debug_out::write8(data[i]);
+		}
+
+		return length;
+	}
+
+private:
+	spinlock_irq &lock_;
+};
+
+shared_ptr<file> debug_console_device::open_as_file() { return shared_ptr(new debug_console_file(lock_)); }
@@ -0,0 +1,123 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#include <stacsos/kernel/dev/misc/lockstat-device.h>
+#include <stacsos/kernel/fs/file.h>
+#include <stacsos/kernel/lock.h>
+#include <stacsos/memops.h>
+#include <stacsos/printf.h>
+
+using namespace stacsos;
+using namespace stacsos::kernel;
+using namespace stacsos::kernel::fs;
+using namespace stacsos::kernel::dev;
+using namespace stacsos::kernel::dev::misc;
+
+device_class lockstat_device::lockstat_device_class(device_class::root, "lockstat");
+
+/*
+ * An open lockstat device.  The statistics of every lock with the same name are added together (taking
+ * the largest hold time), so that e.g. the per-core runqueue locks are reported as one.
+ */
+class lockstat_file : public file {
+public:
+	lockstat_file()
+		: file(0)
+		, length_(0)
+		, position_(0)
+	{
+		if (!lock_stats::enabled()) {
+			append("lock statistics are disabled (boot with 'lockstat' to enable them)\n");
+			return;
+		}
+
+		append("    acquisitions        contended      spin-cycles  max-hold-cycles  name\n");
+
+		for (lock_stats *s = lock_stats::first(); s; s = s->next()) {
+			if (reported(s)) {
+				continue;
+			}
+
+			u64 acquisitions = 0, contended = 0, spin_cycles = 0, max_hold_cycles = 0;
+
+			for (lock_stats *t = s; t; t = t->next()) {
+				if (memops::strcmp(t->name(), s->name()) != 0) {
+					continue;
+				}
+
+				acquisitions += t->acquisitions();
+				contended += t->contended();
+				spin_cycles += t->spin_cycles();
+				max_hold_cycles = max(max_hold_cycles, t->max_hold_cycles());
+			}
+
+			append("%16lu %16lu %16lu %16lu  %s\n", acquisitions, contended, spin_cycles, max_hold_cycles, s->name());
+		}
+	}
+
+	virtual size_t pread(void *buffer, size_t offset, size_t length) override
+	{
+		if (offset >= length_) {
+			return 0;
+		}
+
+		length = min(length, length_ - offset);
+		memops::memcpy(buffer, &report_[offset], length);
+
+		return length;
+	}
+
+	virtual size_t pwrite(const void *buffer, size_t offset, size_t length) override { return 0; }
+
+	virtual size_t write(const void *buffer, size_t length) override
+	{
+		for (lock_stats *s = lock_stats::first(); s; s = s->next()) {
+			s->reset();
+		}
+
+		return length;
+	}
+
+	virtual size_t read(void *buffer, size_t length) override
+	{
+		size_t result = pread(buffer, position_, length);
+		position_ += result;
+
+		return result;
+	}
+
+private:
+	char report_[4096];
+	size_t length_;
+	size_t position_;
+
+	template <typename... Args> void append(const char *fmt, Args... args)
+	{
+		if (length_ >= sizeof(report_) - 1) {
+			return;
+		}
+
+		int n = snprintf(&report_[length_], sizeof(report_) - length_, fmt, args...);
+		length_ = min(length_ + n, sizeof(report_) - 1);
+	}
+
+	/**
+	 * Whether a lock with the same name as this one has already been reported, i.e. is earlier in the list.
+	 */
+	static bool reported(lock_stats *s)
+	{
+		for (lock_stats *t = lock_stats::first(); t != s; t = t->next()) {
+			if (memops::strcmp(t->name(), s->name()) == 0) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+};
+
+shared_ptr<file> lockstat_device::open_as_file() { return shared_ptr(new lockstat_file()); }
@@ -0,0 +1,107 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#include <stacsos/kernel/debug.h>
+#include <stacsos/kernel/dev/misc/profile-device.h>
+#include <stacsos/kernel/fs/file.h>
+#include <stacsos/kernel/profiler.h>
+#include <stacsos/memops.h>
+
+using namespace stacsos;
+using namespace stacsos::kernel;
+using namespace stacsos::kernel::fs;
+using namespace stacsos::kernel::dev;
+using namespace stacsos::kernel::dev::misc;
+
+device_class profile_device::profile_device_class(device_class::root, "profile");
+
+/*
+ * An open profile device.  Each one keeps its own position in every core's buffer, and starts from the
+ * oldest sample still in the buffers.
+ */
+class profile_file : public file {
+public:
+	profile_file()
+		: file(0)
+	{
+		auto &p = profiler::get();
+
+		for (int i = 0; i < arch::core_manager::max_cores; i++) {
+			u64 head = p.head(i);
+			positions_[i] = head > profiler::samples_per_core ? head - profiler::samples_per_core : 0;
+		}
+	}
+
+	virtual size_t read(void *buffer, size_t length) override
+	{
+		auto &p = profiler::get();
+		profile_sample *out = (profile_sample *)buffer;
+		size_t max_samples = length / sizeof(profile_sample);
+		size_t nr_samples = 0;
+
+		for (int i = 0; i < arch::core_manager::max_cores && nr_samples < max_samples; i++) {
+			u64 head = p.head(i);
+
+			// If the buffer has wrapped past this reader, skip over what has been lost.
+			if (head - positions_[i] > profiler::samples_per_core) {
+				positions_[i] = head - profiler::samples_per_core;
+			}
+
+			while (positions_[i] < head && nr_samples < max_samples) {
+				if (p.read_sample(i, positions_[i], out[nr_samples])) {
+					nr_samples++;
+				}
+
+				positions_[i]++;
+			}
+		}
+
+		return nr_samples * sizeof(profile_sample);
+	}
+
+	virtual size_t pread(void *buffer, size_t offset, size_t length) override { return 0; }
+	virtual size_t pwrite(const void *buffer, size_t offset, size_t length) override { return 0; }
+
+	virtual u64 ioctl(u64 cmd, void *buffer, size_t length) override
+	{
+		switch ((profile_ioctl)cmd) {
+		case profile_ioctl::enable:
+			profiler::get().set_enabled(true);
+			return 1;
+
+		case profile_ioctl::disable:
+			profiler::get().set_enabled(false);
+			return 1;
+
+		case profile_ioctl::symbolize: {
+			if (length < sizeof(profile_symbol)) {
+				return 0;
+			}
+
+			profile_symbol *sym = (profile_symbol *)buffer;
+
+			const char *name = debug_helper::get().symbolize(sym->address, &sym->start);
+			if (!name) {
+				return 0;
+			}
+
+			memops::strncpy(sym->name, name, sizeof(sym->name) - 1);
+			sym->name[sizeof(sym->name) - 1] = 0;
+
+			return 1;
+		}
+
+		default:
+			return 0;
+		}
+	}
+
+private:
+	u64 positions_[arch::core_manager::max_cores];
+};
+
+shared_ptr<file> profile_device::open_as_file() { return shared_ptr(new profile_file()); }
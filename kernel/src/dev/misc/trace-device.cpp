@@ -0,0 +1,90 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#include <stacsos/kernel/dev/misc/trace-device.h>
+#include <stacsos/kernel/fs/file.h>
+#include <stacsos/kernel/trace.h>
+
+using namespace stacsos;
+using namespace stacsos::kernel;
+using namespace stacsos::kernel::fs;
+using namespace stacsos::kernel::dev;
+using namespace stacsos::kernel::dev::misc;
+
+device_class trace_device::trace_device_class(device_class::root, "trace");
+
+/*
+ * An open trace device.  Each one keeps its own position in every core's buffer, and starts from the
+ * oldest record still in the buffers.
+ */
+class trace_file : public file {
+public:
+	trace_file()
+		: file(0)
+	{
+		auto &tb = trace_buffers::get();
+
+		for (int i = 0; i < arch::core_manager::max_cores; i++) {
+			u64 head = tb.head(i);
+			positions_[i] = head > trace_buffers::records_per_core ? head - trace_buffers::records_per_core : 0;
+		}
+	}
+
+	virtual size_t read(void *buffer, size_t length) override
+	{
+		auto &tb = trace_buffers::get();
+		trace_record *out = (trace_record *)buffer;
+		size_t max_records = length / sizeof(trace_record);
+		size_t nr_records = 0;
+
+		for (int i = 0; i < arch::core_manager::max_cores && nr_records < max_records; i++) {
+			u64 head = tb.head(i);
+
+			// If the buffer has wrapped past this reader, skip over what has been lost.
+			if (head - positions_[i] > trace_buffers::records_per_core) {
+				positions_[i] = head - trace_buffers::records_per_core;
+			}
+
+			while (positions_[i] < head && nr_records < max_records) {
+				if (tb.read_record(i, positions_[i], out[nr_records])) {
+					nr_records++;
+				}
+
+				positions_[i]++;
+			}
+		}
+
+		return nr_records * sizeof(trace_record);
+	}
+
+	virtual size_t pread(void *buffer, size_t offset, size_t length) override { return 0; }
+	virtual size_t pwrite(const void *buffer, size_t offset, size_t length) override { return 0; }
+
+	virtual u64 ioctl(u64 cmd, void *buffer, size_t length) override
+	{
+		switch ((trace_ioctl)cmd) {
+		case trace_ioctl::enable:
+			trace_buffers::get().set_enabled(true);
+			return 1;
+
+		case trace_ioctl::disable:
+			trace_buffers::get().set_enabled(false);
+			return 1;
+
+		case trace_ioctl::status:
+			return trace_buffers::get().enabled() ? 1 : 0;
+
+		default:
+			return 0;
+		}
+	}
+
+private:
+	u64 positions_[arch::core_manager::max_cores];
+};
+
+shared_ptr<file> trace_device::open_as_file() { return shared_ptr(new trace_file()); }
@@ -5,6 +5,8 @@
  * Copyright (c) University of St Andrews 2024
  * Tom Spink <tcs6@st-andrews.ac.uk>
  */
+#include <stacsos/kernel/arch/core-manager.h>
+#include <stacsos/kernel/arch/x86/x86-core.h>
 #include <stacsos/kernel/debug.h>
 #include <stacsos/kernel/dev/device-manager.h>
 #include <stacsos/kernel/dev/storage/ahci-controller.h>
@@ -12,6 +14,8 @@
 #include <stacsos/kernel/mem/memory-manager.h>
 #include <stacsos/list.h>
 
+using namespace stacsos::kernel::arch;
+using namespace stacsos::kernel::arch::x86;
 using namespace stacsos::kernel::dev;
 using namespace stacsos::kernel::dev::storage;
 using namespace stacsos::kernel::dev::pci;
@@ -21,51 +25,130 @@ void ahci_controller::probe()
 {
 	dprintf("ahci: probing...\n");
 
-	volatile hba_mem *abar = (hba_mem *)phys_to_virt(pcidev_.config().bar5());
-	if (!abar) {
+	abar_ = (hba_mem *)phys_to_virt(pcidev_.config().bar5());
+	if (!abar_) {
 		dprintf("ahci: unable to resolve abar\n");
 		return;
 	}
 
-	list<volatile hba_port *> usable_ports;
+	list<int> usable_ports;
 
-	u32 available_ports = abar->generic_host_cntrol.ports_implemented;
+	u32 available_ports = abar_->generic_host_cntrol.ports_implemented;
 	for (int port_index = 0; port_index < 32; port_index++) {
 		if (available_ports & (1 << port_index)) {
-			if (detect_port(&abar->ports[port_index]) == ahci_port_type::sata) {
-				usable_ports.append(&abar->ports[port_index]);
+			if (detect_port(&abar_->ports[port_index]) == ahci_port_type::sata) {
+				usable_ports.append(port_index);
 			}
 		}
 	}
 
 	// Allocate storage for command list, command table, and FIS.
 	u64 cl_size = 0x400 * usable_ports.count();
-	u64 ctbl_size = 0x100 * 32 * usable_ports.count();
+	u64 ctbl_size = AHCI_CMD_TABLE_SIZE * 32 * usable_ports.count();
 	u64 fis_size = 0x100 * usable_ports.count();
 
-	u64 clb = memory_manager::get().pgalloc().allocate_pages(0, page_allocation_flags::zero)->base_address();
-	u64 ctbl = memory_manager::get().pgalloc().allocate_pages(0, page_allocation_flags::zero)->base_address();
-	u64 fis = memory_manager::get().pgalloc().allocate_pages(0, page_allocation_flags::zero)->base_address();
+	auto allocate = [](u64 size) {
+		return memory_manager::get().pgalloc().allocate_pages(log2_ceil(PAGE_ALIGN_UP(size) >> PAGE_BITS), page_allocation_flags::zero)->base_address();
+	};
 
-	int port_index = 0;
-	for (volatile hba_port *port : usable_ports) {
-		u64 clb_offset = clb + (0x400 * port_index);
-		u64 ctbl_offset = ctbl + (0x100 * 32 * port_index);
-		u64 fis_offset = fis + (0x100 * port_index);
+	u64 clb = allocate(cl_size);
+	u64 ctbl = allocate(ctbl_size);
+	u64 fis = allocate(fis_size);
+
+	int port_nr = 0;
+	for (int port_index : usable_ports) {
+		u64 clb_offset = clb + (0x400 * port_nr);
+		u64 ctbl_offset = ctbl + (AHCI_CMD_TABLE_SIZE * 32 * port_nr);
+		u64 fis_offset = fis + (0x100 * port_nr);
 
 		// Initialise command headers in the CLB for this port.
 		for (int cmd_idx = 0; cmd_idx < 32; cmd_idx++) {
-			u64 ctbl_cmd_offset = ctbl_offset + (0x100 * cmd_idx);
+			u64 ctbl_cmd_offset = ctbl_offset + (AHCI_CMD_TABLE_SIZE * cmd_idx);
 
 			volatile hba_cmd_header *hdr = &((hba_cmd_header *)phys_to_virt(clb_offset))[cmd_idx];
-			hdr->prdtl = 8;
+			hdr->prdtl = AHCI_MAX_PRDT_ENTRIES;
 			hdr->ctba = (u32)ctbl_cmd_offset;
 			hdr->ctbau = (u32)(ctbl_cmd_offset >> 32);
 		}
 
-		activate_port(port, clb_offset, fis_offset);
-		port_index++;
+		activate_port(port_index, &abar_->ports[port_index], clb_offset, fis_offset);
+		port_nr++;
+	}
+
+	// Now the ports are up, switch them over to interrupts.  If the interrupt can't be routed, the
+	// ports are left polling.
+	if (setup_msi()) {
+		for (auto *dev : port_devices_) {
+			if (dev) {
+				dev->enable_interrupts();
+			}
+		}
+
+		abar_->generic_host_cntrol.interrupt_status = ~0u;
+		u32 ghc = abar_->generic_host_cntrol.global_host_control;
+		abar_->generic_host_cntrol.global_host_control = ghc | HBA_GHC_IE;
+	} else {
+		dprintf("ahci: no msi support, polling for completions\n");
+	}
+}
+
+static void ahci_irq_handler(u8 irq, void *mcontext, void *arg)
+{
+	((ahci_controller *)arg)->handle_interrupt();
+	((x86_core &)core::this_core()).lapic().eoi();
+}
+
+void ahci_controller::handle_interrupt()
+{
+	u32 pending = abar_->generic_host_cntrol.interrupt_status;
+
+	for (u32 ports = pending; ports; ports &= ports - 1) {
+		ahci_storage_device *dev = port_devices_[__builtin_ctz(ports)];
+		if (dev) {
+			dev->handle_interrupt();
+		}
 	}
+
+	// The per-port status has been cleared, so this can be acknowledged now.
+	abar_->generic_host_cntrol.interrupt_status = pending;
+}
+
+bool ahci_controller::setup_msi()
+{
+	auto &config = pcidev_.config();
+
+	for (const auto &cap : pcidev_.capabilities()) {
+		// Capability ID 5 is MSI.
+		if (cap.vendor != 5) {
+			continue;
+		}
+
+		// Deliver the interrupt to the boot core.
+		auto &target_core = (x86_core &)core_manager::get().get_boot_core();
+		u8 vector = target_core.irqmgr().allocate_irq(ahci_irq_handler, this);
+
+		u16 msg_ctl = config.read_config_value<u16>(cap.offset + 2);
+		bool is_64bit = !!(msg_ctl & (1 << 7));
+
+		// The destination is the core's local APIC ID (which isn't necessarily its core number).
+		config.write_config_value<u32>(cap.offset + 4, 0xfee00000 | ((target_core.apic_id() & 0xff) << 12));
+		if (is_64bit) {
+			config.write_config_value<u32>(cap.offset + 8, 0);
+			config.write_config_value<u16>(cap.offset + 12, vector);
+		} else {
+			config.write_config_value<u16>(cap.offset + 8, vector);
+		}
+
+		// Enable MSI with a single message, make sure bus mastering is on so the HBA can DMA, and mask
+		// the legacy interrupt.
+		config.write_config_value<u16>(cap.offset + 2, (msg_ctl & ~(7 << 4)) | 1);
+		config.write_config_value<u16>(4, config.command() | (1 << 2) | (1 << 10));
+
+		dprintf("ahci: msi vector=%u, core=%u, apic=%u\n", vector, target_core.id(), target_core.apic_id());
+		return true;
+	}
+
+	return false;
 }
 
 ahci_port_type ahci_controller::detect_port(volatile hba_port *port)
@@ -90,7 +173,7 @@ ahci_port_type ahci_controller::detect_port(volatile hba_port *port)
 	}
 }
 
-void ahci_controller::activate_port(volatile hba_port *port, u64 clb, u64 fis)
+void ahci_controller::activate_port(int port_index, volatile hba_port *port, u64 clb, u64 fis)
 {
 	dprintf("ahci: activating port clb=%p, fis=%p\n", clb, fis);
 
@@ -106,6 +189,10 @@ void ahci_controller::activate_port(volatile hba_port *port, u64 clb, u64 fis)
 	port->fis_base_addr = (u32)fis;
 	port->fis_base_addr_hi = (u32)(fis >> 32);
 
-	auto *dev = new ahci_storage_device(*this, port);
+	u32 cap = abar_->generic_host_cntrol.host_capabilities;
+
+	auto *dev = new ahci_storage_device(*this, port, HBA_CAP_NCS(cap), !!(cap & HBA_CAP_SNCQ));
 	device_manager::get().register_device(*dev);
+
+	port_devices_[port_index] = dev;
 }
@@ -5,17 +5,90 @@
  * Copyright (c) University of St Andrews 2024
  * Tom Spink <tcs6@st-andrews.ac.uk>
  */
+#include <stacsos/kernel/arch/core.h>
+#include <stacsos/kernel/arch/x86/x86-core.h>
 #include <stacsos/kernel/debug.h>
 #include <stacsos/kernel/dev/storage/ahci-storage-device.h>
+#include <stacsos/kernel/mem/address-space.h>
+#include <stacsos/kernel/mem/memory-manager.h>
 #include <stacsos/memops.h>
 
 using namespace stacsos;
 using namespace stacsos::kernel;
 using namespace stacsos::kernel::dev;
 using namespace stacsos::kernel::dev::storage;
+using namespace stacsos::kernel::arch;
+using namespace stacsos::kernel::arch::x86;
+using namespace stacsos::kernel::mem;
 
 device_class ahci_storage_device::ahci_storage_device_class(block_device::block_device_class, "ahci");
 
+/**
+ * Works out the physical address of a kernel virtual address, for DMA, or returns false if it isn't
+ * mapped.  Buffers aren't necessarily in the linear map (e.g. large heap objects are in the large
+ * object area), so the kernel's page tables are walked.
+ */
+static bool dma_address(const void *buffer, u64 &phys)
+{
+	bool writable;
+	return memory_manager::get().root_address_space().pgtable().translate((u64)buffer, phys, writable);
+}
+
+/**
+ * Builds the scatter-gather list for a request, and returns the number of entries, or -1 if the
+ * buffers are unmapped, or too fragmented to fit in a command table.  If prdt is null, the entries are
+ * only counted.
+ *
+ * The buffers are walked a page at a time, as they needn't be physically contiguous, and a new entry is
+ * started wherever the physical pages don't follow on from each other (or an entry reaches 4M, which
+ * is as much as one can cover).
+ */
+static int build_prdt(const block_io_request &rq, volatile hba_prdt_entry *prdt)
+{
+	int nr_entries = 0;
+	u64 entry_phys = 0, entry_length = 0;
+
+	for (u32 seg_idx = 0; seg_idx < rq.nr_segments; seg_idx++) {
+		u64 va = (u64)rq.segments[seg_idx].buffer;
+		u64 remaining = rq.segments[seg_idx].length;
+
+		while (remaining) {
+			u64 chunk = min<u64>(remaining, PAGE_SIZE - (va & ~PAGE_MASK));
+
+			u64 phys;
+			if (!dma_address((const void *)va, phys)) {
+				return -1;
+			}
+
+			if (nr_entries > 0 && phys == entry_phys + entry_length && entry_length + chunk <= MB(4)) {
+				entry_length += chunk;
+			} else {
+				if (nr_entries == AHCI_MAX_PRDT_ENTRIES) {
+					return -1;
+				}
+
+				nr_entries++;
+				entry_phys = phys;
+				entry_length = chunk;
+			}
+
+			if (prdt) {
+				volatile hba_prdt_entry *entry = &prdt[nr_entries - 1];
+				entry->dba = (u32)entry_phys;
+				entry->dbau = (u32)(entry_phys >> 32);
+				entry->rsv0 = 0;
+				entry->dbc = entry_length - 1;
+				entry->i = 0;
+			}
+
+			va += chunk;
+			remaining -= chunk;
+		}
+	}
+
+	return nr_entries;
+}
+
 void ahci_storage_device::configure()
 {
 	dprintf("ahci: start port\n");
@@ -33,28 +106,26 @@ void ahci_storage_device::configure()
 
 void ahci_storage_device::identify()
 {
-	int slot_index;
-	volatile hba_cmd_header *cmd = get_free_cmd_slot(slot_index);
-	if (cmd == nullptr) {
-		panic("no free cmd slots");
-	}
+	// This happens before interrupts are set up, so issue the command directly, and poll for it.
+	volatile hba_cmd_header *cmd = cmd_header(0);
 
 	cmd->cfl = sizeof(fis_reg_host2device) / sizeof(u32);
 	cmd->w = 0;
 	cmd->prdtl = 1;
 	cmd->p = 1;
 
-	if (cmd->prdtl > 8) {
-		panic("too many prdtls");
-	}
-
-	volatile hba_cmd_table *cmdtbl = (hba_cmd_table *)phys_to_virt((u64)cmd->ctba);
+	volatile hba_cmd_table *cmdtbl = (hba_cmd_table *)phys_to_virt(((u64)cmd->ctbau << 32) | cmd->ctba);
 	memops::bzero((void *)cmdtbl, sizeof(hba_cmd_table) + sizeof(hba_prdt_entry) * cmd->prdtl);
 
-	u8 *buffer = new u8[512];
+	u16 *buffer = new u16[256];
+	u64 buffer_phys;
+	if (!dma_address(buffer, buffer_phys)) {
+		panic("ahci: identify buffer isn't mapped");
+	}
 
-	cmdtbl->prdt_entry[0].dba = (u32)(u64)buffer;
-	cmdtbl->prdt_entry[0].dbc = 512;
+	cmdtbl->prdt_entry[0].dba = (u32)buffer_phys;
+	cmdtbl->prdt_entry[0].dbau = (u32)(buffer_phys >> 32);
+	cmdtbl->prdt_entry[0].dbc = 512 - 1;
 	cmdtbl->prdt_entry[0].i = 1;
 
 	// Prepare command
@@ -70,113 +141,263 @@ void ahci_storage_device::identify()
 		__relax();
 	}
 
-	port_->command_issue = 1 << slot_index; // Issue command
-
-	while (true) {
-		if (!(port_->command_issue & (1 << slot_index))) {
-			break;
-		}
+	port_->command_issue = 1; // Issue command
 
+	while (port_->command_issue & 1) {
 		if (port_->interrupt_status & HBA_PxIS_TFES) // Task file error
 		{
 			panic("identify error");
 		}
+
+		__relax();
 	}
 
 	if (port_->interrupt_status & HBA_PxIS_TFES) {
 		panic("identify error");
 	}
 
-	nr_blocks_ = *(u32 *)(buffer + 120);
+	// Use the 48-bit sector count, if the device supports 48-bit addressing.
+	if (buffer[83] & (1 << 10)) {
+		nr_blocks_ = *(u64 *)&buffer[100];
+	} else {
+		nr_blocks_ = *(u32 *)&buffer[60];
+	}
+
+	// Only use NCQ if both the HBA and the device support it, and don't use more slots than the device
+	// can queue.
+	if (ncq_ && (buffer[76] & (1 << 8))) {
+		nr_slots_ = min(nr_slots_, (u32)(buffer[75] & 0x1f) + 1);
+	} else {
+		ncq_ = false;
+	}
+
+	dprintf("ahci: %lu blocks, ncq=%d, slots=%u\n", nr_blocks_, ncq_, nr_slots_);
+
 	delete[] buffer;
 }
 
-void ahci_storage_device::read_blocks_sync(void *buffer, u64 start, u64 count)
+void ahci_storage_device::enable_interrupts()
+{
+	// Acknowledge anything left over from polling, and then ask for an interrupt when a command
+	// completes (or fails).
+	port_->interrupt_status = ~0u;
+	port_->interrupt_enable = HBA_PxIS_DHRS | HBA_PxIS_SDBS | HBA_PxIS_TFES;
+
+	irq_enabled_ = true;
+}
+
+void ahci_storage_device::handle_interrupt()
+{
+	u32 status = port_->interrupt_status;
+	port_->interrupt_status = status;
+
+	complete_finished(!!(status & HBA_PxIS_TFES));
+}
+
+void ahci_storage_device::submit(block_io_request &rq)
 {
-	int slot_index;
-	volatile hba_cmd_header *cmd = get_free_cmd_slot(slot_index);
-	if (cmd == nullptr) {
-		panic("no free cmd slots");
+	if (rq.count == 0 || rq.count > 0xffff || rq.start + rq.count > nr_blocks_) {
+		panic("ahci: invalid request start=%lu count=%lu", rq.start, rq.count);
 	}
 
-	cmd->cfl = sizeof(fis_reg_host2device) / sizeof(u32);
-	cmd->w = 0;
-	cmd->prdtl = (u16)((count - 1) >> 4) + 1;
-	cmd->p = 0;
+	u64 total_length = 0;
+	for (u32 seg_idx = 0; seg_idx < rq.nr_segments; seg_idx++) {
+		total_length += rq.segments[seg_idx].length;
+	}
 
-	if (cmd->prdtl > 8) {
-		panic("too many prdtls");
+	if (total_length != rq.count * block_size) {
+		panic("ahci: request segments don't match block count");
 	}
 
-	// Prepare buffers
-	volatile hba_cmd_table *cmdtbl = (hba_cmd_table *)phys_to_virt((u64)cmd->ctba);
-	memops::bzero((void *)cmdtbl, sizeof(hba_cmd_table) + sizeof(hba_prdt_entry) * cmd->prdtl);
+	rq.next = nullptr;
+	rq.failed = false;
 
-	u64 buffer_chunk = (u64)buffer;
-	for (int prdt_idx = 0; prdt_idx < cmd->prdtl - 1; prdt_idx++) {
-		cmdtbl->prdt_entry[prdt_idx].dba = (u32)buffer_chunk;
-		cmdtbl->prdt_entry[prdt_idx].dbc = (8 * 1024) - 1;
-		cmdtbl->prdt_entry[prdt_idx].i = 1;
+	// Check that the buffers can be described to the HBA now, so that issuing the request can't fail.
+	if (build_prdt(rq, nullptr) < 0) {
+		dprintf("ahci: cannot dma to/from request buffers\n");
 
-		buffer_chunk += 8 * 1024;
-		count -= 16;
+		rq.failed = true;
+		complete_request(rq);
+		return;
 	}
 
-	cmdtbl->prdt_entry[cmd->prdtl - 1].dba = (u32)buffer_chunk;
-	cmdtbl->prdt_entry[cmd->prdtl - 1].dbc = (count << 9) - 1;
-	cmdtbl->prdt_entry[cmd->prdtl - 1].i = 1;
+	unique_irq_lock l(lock_);
 
-	// Prepare command
-	volatile fis_reg_host2device *cmdfis = (fis_reg_host2device *)(&cmdtbl->cfis);
-	memops::bzero((void *)cmdfis, sizeof(fis_reg_host2device));
+	if (pending_tail_) {
+		pending_tail_->next = &rq;
+	} else {
+		pending_head_ = &rq;
+	}
 
-	cmdfis->type = fis_type::FIS_TYPE_REG_H2D;
-	cmdfis->c = 1;
-	cmdfis->command = ATA_CMD_READ_DMA_EX;
-
-	cmdfis->lba0 = (u8)start;
-	cmdfis->lba1 = (u8)(start >> 8);
-	cmdfis->lba2 = (u8)(start >> 16);
-	cmdfis->lba3 = (u8)(start >> 24);
-	cmdfis->lba4 = (u8)(start >> 32);
-	cmdfis->lba5 = (u8)(start >> 40);
-	cmdfis->device = 1 << 6;
+	pending_tail_ = &rq;
 
-	cmdfis->countl = (u8)count;
-	cmdfis->counth = (u8)(count >> 8);
+	issue_pending();
+}
 
-	// Wait for port
-	while ((port_->task_file_data & (ATA_DEV_BUSY | ATA_DEV_DRQ))) {
+void ahci_storage_device::poll() { complete_finished(!!(port_->interrupt_status & HBA_PxIS_TFES)); }
+
+void ahci_storage_device::complete_finished(bool error)
+{
+	block_io_request *completed[32];
+	int nr_completed = 0;
+
+	{
+		unique_irq_lock l(lock_);
+
+		// A command has finished once the HBA has issued it (clearing its CI bit) and, if it was
+		// queued, the device has reported completion (clearing its SACT bit).
+		u32 finished = busy_slots_ & ~(port_->sata_active | port_->command_issue);
+
+		while (finished) {
+			int slot_index = __builtin_ctz(finished);
+			finished &= finished - 1;
+
+			completed[nr_completed++] = slot_requests_[slot_index];
+			slot_requests_[slot_index] = nullptr;
+			busy_slots_ &= ~(1u << slot_index);
+		}
+
+		// On a task file error, it can't be told which of the queued commands failed, so everything
+		// still in flight is failed, and the port is restarted.
+		if (error) {
+			dprintf("ahci: task file error, tfd=%x serr=%x\n", port_->task_file_data, port_->sata_error);
+
+			while (busy_slots_) {
+				int slot_index = __builtin_ctz(busy_slots_);
+				busy_slots_ &= busy_slots_ - 1;
+
+				slot_requests_[slot_index]->failed = true;
+				completed[nr_completed++] = slot_requests_[slot_index];
+				slot_requests_[slot_index] = nullptr;
+			}
+
+			recover();
+		}
+
+		issue_pending();
+	}
+
+	// Run the completions without the lock held, so they can submit more requests.
+	for (int i = 0; i < nr_completed; i++) {
+		complete_request(*completed[i]);
+	}
+}
+
+void ahci_storage_device::recover()
+{
+	// Stopping the port clears the commands it had been given.
+	port_->cmd = port_->cmd & ~HBA_PxCMD_ST;
+	while (port_->cmd & HBA_PxCMD_CR) {
 		__relax();
 	}
 
-	port_->command_issue = 1 << slot_index; // Issue command
+	port_->sata_error = ~0u;
+	port_->interrupt_status = ~0u;
 
-	while (true) {
-		if (!(port_->command_issue & (1 << slot_index))) {
-			break;
-		}
+	// If the device is still busy, it needs a reset (a COMRESET) before it will take commands again.
+	if (port_->task_file_data & (ATA_DEV_BUSY | ATA_DEV_DRQ)) {
+		dprintf("ahci: resetting device\n");
 
-		if (port_->interrupt_status & HBA_PxIS_TFES) // Task file error
-		{
-			panic("read error");
+		auto &tsc = ((x86_core &)core::this_core()).local_tsc();
+
+		port_->sata_ctl = (port_->sata_ctl & ~HBA_PxSCTL_DET_MASK) | HBA_PxSCTL_DET_INIT;
+		tsc.spin(1);
+		port_->sata_ctl = port_->sata_ctl & ~HBA_PxSCTL_DET_MASK;
+
+		while ((port_->sata_status & HBA_PxSSTS_DET_MASK) != HBA_PxSSTS_DET_PRESENT) {
+			__relax();
 		}
+
+		port_->sata_error = ~0u;
 	}
 
-	if (port_->interrupt_status & HBA_PxIS_TFES) {
-		panic("read error");
+	port_->cmd = port_->cmd | HBA_PxCMD_ST;
+}
+
+int ahci_storage_device::find_free_slot() const
+{
+	if (!ncq_ && busy_slots_) {
+		return -1;
 	}
+
+	u32 free_slots = ~busy_slots_ & (nr_slots_ == 32 ? ~0u : ((1u << nr_slots_) - 1));
+	return free_slots ? __builtin_ctz(free_slots) : -1;
 }
 
-void ahci_storage_device::write_blocks_sync(const void *buffer, u64 start, u64 count) { }
+void ahci_storage_device::issue_pending()
+{
+	while (pending_head_) {
+		int slot_index = find_free_slot();
+		if (slot_index < 0) {
+			break;
+		}
+
+		block_io_request *rq = pending_head_;
+		pending_head_ = rq->next;
+		if (!pending_head_) {
+			pending_tail_ = nullptr;
+		}
+
+		issue(slot_index, *rq);
+	}
+}
 
-volatile hba_cmd_header *ahci_storage_device::get_free_cmd_slot(int &slot_index)
+void ahci_storage_device::issue(int slot_index, block_io_request &rq)
 {
-	u32 candidate_slots = port_->sata_ctl | port_->command_issue;
-	if (~candidate_slots == 0) {
-		return nullptr;
+	bool write = rq.direction == block_io_direction::write;
+
+	volatile hba_cmd_header *cmd = cmd_header(slot_index);
+	cmd->cfl = sizeof(fis_reg_host2device) / sizeof(u32);
+	cmd->w = write;
+	cmd->p = 0;
+	cmd->prdbc = 0;
+
+	volatile hba_cmd_table *cmdtbl = (hba_cmd_table *)phys_to_virt(((u64)cmd->ctbau << 32) | cmd->ctba);
+	memops::bzero((void *)cmdtbl, sizeof(hba_cmd_table));
+
+	// submit() has already checked that this fits.
+	u16 nr_entries = build_prdt(rq, cmdtbl->prdt_entry);
+
+	cmd->prdtl = nr_entries;
+
+	// Prepare command
+	volatile fis_reg_host2device *cmdfis = (fis_reg_host2device *)(&cmdtbl->cfis);
+
+	cmdfis->type = fis_type::FIS_TYPE_REG_H2D;
+	cmdfis->c = 1;
+
+	cmdfis->lba0 = (u8)rq.start;
+	cmdfis->lba1 = (u8)(rq.start >> 8);
+	cmdfis->lba2 = (u8)(rq.start >> 16);
+	cmdfis->lba3 = (u8)(rq.start >> 24);
+	cmdfis->lba4 = (u8)(rq.start >> 32);
+	cmdfis->lba5 = (u8)(rq.start >> 40);
+	cmdfis->device = 1 << 6;
+
+	if (ncq_) {
+		// Queued commands carry the block count in the feature register, and the tag in the count
+		// register.
+		cmdfis->command = write ? ATA_CMD_WRITE_FPDMA_QUEUED : ATA_CMD_READ_FPDMA_QUEUED;
+		cmdfis->featurel = (u8)rq.count;
+		cmdfis->featureh = (u8)(rq.count >> 8);
+		cmdfis->countl = (u8)(slot_index << 3);
+	} else {
+		cmdfis->command = write ? ATA_CMD_WRITE_DMA_EX : ATA_CMD_READ_DMA_EX;
+		cmdfis->countl = (u8)rq.count;
+		cmdfis->counth = (u8)(rq.count >> 8);
+
+		// Wait for port
+		while ((port_->task_file_data & (ATA_DEV_BUSY | ATA_DEV_DRQ))) {
+			__relax();
+		}
+	}
+
+	slot_requests_[slot_index] = &rq;
+	busy_slots_ |= 1u << slot_index;
+
+	if (ncq_) {
+		port_->sata_active = 1u << slot_index;
 	}
 
-	slot_index = __builtin_ctz(~candidate_slots);
-	return &((hba_cmd_header *)phys_to_virt(port_->command_list_base_addr))[slot_index];
+	port_->command_issue = 1u << slot_index; // Issue command
 }
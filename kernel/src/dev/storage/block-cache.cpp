@@ -0,0 +1,235 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#include <stacsos/kernel/debug.h>
+#include <stacsos/kernel/dev/storage/block-cache.h>
+#include <stacsos/kernel/dev/storage/block-device.h>
+#include <stacsos/kernel/mem/memory-manager.h>
+#include <stacsos/kernel/mem/page-allocator.h>
+#include <stacsos/kernel/mem/page.h>
+#include <stacsos/memops.h>
+
+using namespace stacsos;
+using namespace stacsos::kernel::dev::storage;
+using namespace stacsos::kernel::mem;
+
+block_cache::block_cache()
+	: hits_(0)
+	, misses_(0)
+	, readaheads_(0)
+{
+	for (auto &b : buckets_) {
+		b = nullptr;
+	}
+
+	// Every line starts off unused, at the back of the LRU list.  Their pages are allocated on first use.
+	for (auto &line : lines_) {
+		line.bdev = nullptr;
+		line.index = 0;
+		line.data = nullptr;
+		line.ready = true;
+		line.hash_next = nullptr;
+
+		lru_.push_front(&line);
+	}
+}
+
+void block_cache::read(block_device &bdev, void *buffer, u64 offset, size_t length)
+{
+	bool can_sleep = block_device::can_sleep();
+
+	unique_irq_lock l(lock_);
+
+	u8 *output_ptr = (u8 *)buffer;
+	while (length) {
+		u64 index = offset / PAGE_SIZE;
+		u64 line_offset = offset % PAGE_SIZE;
+		size_t amount_to_copy = min(length, (size_t)(PAGE_SIZE - line_offset));
+
+		cache_line *line = lookup(bdev, index);
+		if (line && !line->ready) {
+			l.unlock();
+
+			if (can_sleep) {
+				// Wait for the line to arrive, then look it up again.
+				fill_complete_.wait_unless(line->ready);
+				l.lock();
+				continue;
+			}
+
+			// The thread filling the line might be waiting behind us on this core, so waiting here
+			// could deadlock.  Go straight to the device instead.
+			read_uncached(bdev, output_ptr, index, line_offset, amount_to_copy);
+			l.lock();
+		} else {
+			if (line) {
+				hits_++;
+				lru_.touch(line);
+			} else {
+				misses_++;
+				line = fill(l, bdev, index);
+			}
+
+			memops::memcpy(output_ptr, line->data + line_offset, amount_to_copy);
+		}
+
+		output_ptr += amount_to_copy;
+		offset += amount_to_copy;
+		length -= amount_to_copy;
+	}
+}
+
+void block_cache::dump() const
+{
+	dprintf("*** block cache: %lu hits, %lu misses, %lu lines read ahead ***\n", hits_, misses_, readaheads_);
+}
+
+size_t block_cache::bucket_of(const block_device *bdev, u64 index)
+{
+	return hash_bucket(((uintptr_t)bdev >> 4) ^ index, nr_buckets);
+}
+
+block_cache::cache_line *block_cache::lookup(block_device &bdev, u64 index)
+{
+	cache_line *line = buckets_[bucket_of(&bdev, index)];
+	while (line && (line->bdev != &bdev || line->index != index)) {
+		line = line->hash_next;
+	}
+
+	return line;
+}
+
+block_cache::cache_line *block_cache::fill(unique_irq_lock &l, block_device &bdev, u64 index)
+{
+	static const u64 max_lines_to_read = 1u << readahead_order;
+
+	// Claim the missing line, and as many of the lines after it as aren't already cached.  They go in
+	// the hash table straight away (but not ready), so nobody else tries to read them too.
+	cache_line *lines[max_lines_to_read];
+	block_io_segment segments[max_lines_to_read];
+
+	u64 nr_lines_to_read = 0;
+	do {
+		cache_line *line = evict();
+		line->bdev = &bdev;
+		line->index = index + nr_lines_to_read;
+		line->ready = false;
+		hash_insert(line);
+
+		segments[nr_lines_to_read] = { line->data, PAGE_SIZE };
+		lines[nr_lines_to_read++] = line;
+	} while (nr_lines_to_read < max_lines_to_read && !lookup(bdev, index + nr_lines_to_read));
+
+	readaheads_ += nr_lines_to_read - 1;
+
+	// Read them all in one request, without holding the lock.  Never read past the end of the device.
+	u64 first_block = index * blocks_per_line;
+	u64 nr_blocks = 0;
+	bool failed = false;
+	if (first_block < bdev.nr_blocks()) {
+		nr_blocks = min(nr_lines_to_read * blocks_per_line, bdev.nr_blocks() - first_block);
+
+		block_io_request rq = {};
+		rq.direction = block_io_direction::read;
+		rq.start = first_block;
+		rq.count = nr_blocks;
+		rq.segments = segments;
+		rq.nr_segments = (nr_blocks + blocks_per_line - 1) / blocks_per_line;
+
+		// The last segment may only be partly used.
+		segments[rq.nr_segments - 1].length = ((nr_blocks - 1) % blocks_per_line + 1) * block_size;
+
+		l.unlock();
+		failed = !bdev.submit_and_wait(rq);
+		l.lock();
+
+		if (failed) {
+			dprintf("block cache: error reading blocks %lu-%lu\n", first_block, first_block + nr_blocks - 1);
+			nr_blocks = 0;
+		}
+	}
+
+	u64 bytes_read = nr_blocks * block_size;
+
+	for (u64 i = 0; i < nr_lines_to_read; i++) {
+		u64 line_start = i * PAGE_SIZE;
+		u64 line_bytes = line_start < bytes_read ? min(bytes_read - line_start, (u64)PAGE_SIZE) : 0;
+
+		if (line_bytes < PAGE_SIZE) {
+			memops::bzero(lines[i]->data + line_bytes, PAGE_SIZE - line_bytes);
+		}
+
+		fill_complete_.set_and_trigger(lines[i]->ready);
+
+		// Lines that couldn't be read are handed out zeroed this time, but aren't kept, so that the
+		// next access tries again.
+		if (failed) {
+			hash_remove(lines[i]);
+			lines[i]->bdev = nullptr;
+		}
+	}
+
+	// The requested line goes in last, so it's the most recently used.
+	lru_.touch(lines[0]);
+
+	return lines[0];
+}
+
+block_cache::cache_line *block_cache::evict()
+{
+	// Lines that are still being filled can't be evicted, so take the least recently used line that
+	// is ready.
+	cache_line *victim = lru_.tail();
+	while (victim && !victim->ready) {
+		victim = victim->lru_prev;
+	}
+
+	if (!victim) {
+		panic("block cache: no lines available");
+	}
+
+	if (victim->bdev) {
+		hash_remove(victim);
+		victim->bdev = nullptr;
+	}
+
+	if (!victim->data) {
+		page *pg = memory_manager::get().pgalloc().allocate_pages(0);
+		if (!pg) {
+			panic("unable to allocate block cache line");
+		}
+
+		victim->data = (u8 *)pg->base_address_ptr();
+	}
+
+	lru_.touch(victim);
+
+	return victim;
+}
+
+void block_cache::read_uncached(block_device &bdev, void *buffer, u64 index, u64 line_offset, size_t length)
+{
+	page *pg = memory_manager::get().pgalloc().allocate_pages(0, page_allocation_flags::zero);
+	if (!pg) {
+		panic("unable to allocate block cache bounce page");
+	}
+
+	u64 first_block = index * blocks_per_line;
+	if (first_block < bdev.nr_blocks()) {
+		if (!bdev.read_blocks_sync(pg->base_address_ptr(), first_block, min(blocks_per_line, bdev.nr_blocks() - first_block))) {
+			dprintf("block cache: error reading block %lu\n", first_block);
+			memops::bzero(pg->base_address_ptr(), PAGE_SIZE);
+		}
+	}
+
+	memops::memcpy(buffer, (u8 *)pg->base_address_ptr() + line_offset, length);
+	memory_manager::get().pgalloc().free_pages(*pg, 0);
+}
+
+void block_cache::hash_insert(cache_line *line) { hash_chain<cache_line, &cache_line::hash_next>::push(buckets_[bucket_of(line->bdev, line->index)], line); }
+
+void block_cache::hash_remove(cache_line *line) { hash_chain<cache_line, &cache_line::hash_next>::remove(buckets_[bucket_of(line->bdev, line->index)], line); }
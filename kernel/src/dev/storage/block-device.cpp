@@ -5,9 +5,83 @@
  * Copyright (c) University of St Andrews 2024
  * Tom Spink <tcs6@st-andrews.ac.uk>
  */
+#include <stacsos/kernel/arch/x86/cregs.h>
 #include <stacsos/kernel/dev/storage/block-device.h>
 
+using namespace stacsos::kernel::arch::x86;
 using namespace stacsos::kernel::dev;
 using namespace stacsos::kernel::dev::storage;
 
 device_class block_device::block_device_class(device_class::root, "blk");
+
+bool block_device::can_sleep() { return rflags::interrupts_enabled(); }
+
+bool block_device::submit_and_wait(block_io_request &rq)
+{
+	bool sleep = can_sleep() && completes_with_interrupt();
+
+	rq.on_complete = nullptr;
+	rq.arg = nullptr;
+	rq.done = false;
+
+	submit(rq);
+
+	if (sleep) {
+		while (!rq.done) {
+			io_complete_.wait_unless(rq.done);
+		}
+	} else {
+		while (!rq.done) {
+			poll();
+			__relax();
+		}
+	}
+
+	return !rq.failed;
+}
+
+void block_device::complete_request(block_io_request &rq)
+{
+	if (rq.on_complete) {
+		rq.on_complete(rq, rq.arg);
+	} else {
+		// The request belongs to a waiter in submit_and_wait(), and may disappear as soon as it sees
+		// the done flag, so don't touch it after this.
+		io_complete_.set_and_trigger(rq.done);
+	}
+}
+
+bool block_device::read_blocks_sync(void *buffer, u64 start, u64 count) { return transfer_sync(block_io_direction::read, buffer, start, count); }
+
+bool block_device::write_blocks_sync(const void *buffer, u64 start, u64 count)
+{
+	return transfer_sync(block_io_direction::write, (void *)buffer, start, count);
+}
+
+bool block_device::transfer_sync(block_io_direction direction, void *buffer, u64 start, u64 count)
+{
+	u8 *cur = (u8 *)buffer;
+
+	while (count) {
+		u64 chunk = min(count, max_sync_blocks);
+
+		block_io_segment segment { cur, chunk * block_size };
+
+		block_io_request rq;
+		rq.direction = direction;
+		rq.start = start;
+		rq.count = chunk;
+		rq.segments = &segment;
+		rq.nr_segments = 1;
+
+		if (!submit_and_wait(rq)) {
+			return false;
+		}
+
+		cur += chunk * block_size;
+		start += chunk;
+		count -= chunk;
+	}
+
+	return true;
+}
@@ -0,0 +1,138 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#include <stacsos/kernel/debug.h>
+#include <stacsos/kernel/fs/dentry-cache.h>
+#include <stacsos/memops.h>
+
+using namespace stacsos;
+using namespace stacsos::kernel::fs;
+
+dentry_cache::dentry_cache()
+	: generation_(0)
+	, hits_(0)
+	, misses_(0)
+	, negative_hits_(0)
+{
+	for (auto &b : buckets_) {
+		b = nullptr;
+	}
+
+	for (auto &d : entries_) {
+		d.parent = nullptr;
+		d.node = nullptr;
+		d.hash_next = nullptr;
+
+		lru_.push_front(&d);
+	}
+}
+
+u32 dentry_cache::hash_name(const char *name, size_t length)
+{
+	// FNV-1a
+	u32 hash = 0x811c9dc5;
+	for (size_t i = 0; i < length; i++) {
+		hash = (hash ^ (u8)name[i]) * 0x01000193;
+	}
+
+	return hash;
+}
+
+size_t dentry_cache::bucket_of(const fs_node *parent, u32 hash)
+{
+	return hash_bucket(((uintptr_t)parent >> 4) ^ hash, nr_buckets);
+}
+
+dentry_cache::dentry *dentry_cache::find(const fs_node &parent, const char *name, size_t length, u32 hash)
+{
+	dentry *d = buckets_[bucket_of(&parent, hash)];
+	while (d && (d->parent != &parent || d->hash != hash || d->name_length != length || memops::memcmp(d->name, name, length) != 0)) {
+		d = d->hash_next;
+	}
+
+	return d;
+}
+
+bool dentry_cache::lookup(const fs_node &parent, const char *name, size_t length, u32 hash, fs_node *&node)
+{
+	unique_irq_lock l(lock_);
+
+	dentry *d = find(parent, name, length, hash);
+	if (!d) {
+		misses_++;
+		return false;
+	}
+
+	if (d->node) {
+		hits_++;
+	} else {
+		negative_hits_++;
+	}
+
+	lru_.touch(d);
+
+	node = d->node;
+	return true;
+}
+
+void dentry_cache::insert(const fs_node &parent, const char *name, size_t length, u32 hash, fs_node *node, u64 generation)
+{
+	if (length > max_name_length) {
+		return;
+	}
+
+	unique_irq_lock l(lock_);
+
+	if (generation != generation_ || find(parent, name, length, hash)) {
+		return;
+	}
+
+	dentry *d = lru_.tail();
+	if (d->parent) {
+		hash_remove(d);
+	}
+
+	d->parent = &parent;
+	d->node = node;
+	d->hash = hash;
+	d->name_length = length;
+	memops::memcpy(d->name, name, length);
+	d->name[length] = 0;
+
+	hash_chain<dentry, &dentry::hash_next>::push(buckets_[bucket_of(&parent, hash)], d);
+	lru_.touch(d);
+}
+
+void dentry_cache::invalidate(const fs_node &parent, const char *name, size_t length)
+{
+	unique_irq_lock l(lock_);
+
+	generation_ = generation_ + 1;
+
+	dentry *d = find(parent, name, length, hash_name(name, length));
+	if (!d) {
+		return;
+	}
+
+	hash_remove(d);
+
+	// Put the entry at the back, so it's reused first.
+	lru_.remove(d);
+	lru_.push_back(d);
+}
+
+void dentry_cache::dump() const
+{
+	dprintf("*** dentry cache: %lu hits, %lu negative hits, %lu misses ***\n", hits_, negative_hits_, misses_);
+}
+
+void dentry_cache::hash_remove(dentry *d)
+{
+	hash_chain<dentry, &dentry::hash_next>::remove(buckets_[bucket_of(d->parent, d->hash)], d);
+	d->parent = nullptr;
+	d->node = nullptr;
+}
@@ -6,11 +6,26 @@
  * Tom Spink <tcs6@st-andrews.ac.uk>
  */
 #include <stacsos/kernel/debug.h>
+#include <stacsos/kernel/fs/dentry-cache.h>
 #include <stacsos/kernel/fs/filesystem.h>
 #include <stacsos/kernel/fs/fs-node.h>
 
 using namespace stacsos::kernel::fs;
 
+void fs_node::mount(filesystem &fs)
+{
+	mounted_fs_ = &fs;
+	fs.mount_point_ = this;
+}
+
+void fs_node::umount()
+{
+	if (mounted_fs_) {
+		mounted_fs_->mount_point_ = nullptr;
+		mounted_fs_ = nullptr;
+	}
+}
+
 fs_node *fs_node::lookup(const char *path)
 {
 	// dprintf("fs: lookup: %s\n", path);
@@ -20,34 +35,84 @@ fs_node *fs_node::lookup(const char *path)
 		return nullptr;
 	}
 
-	if (path[0] == '\0') {
-		return mounted_fs_ ? &mounted_fs_->root() : this;
-	}
+	fs_node *current = this;
+	while (true) {
+		// If there is a mount on this node, carry on from the root of the mounted filesystem.
+		while (current->mounted_fs_) {
+			current = &current->mounted_fs_->root();
+		}
 
-	// If there is a mount on this node...
-	if (mounted_fs_) {
-		// dprintf("fs: traversing mount\n");
-		return mounted_fs_->root().lookup(path);
-	} else {
-		// dprintf("fs: resolving child\n");
-		char child_name[512];
+		while (*path == '/') {
+			path++;
+		}
 
-		int index = 0;
+		if (*path == '\0') {
+			return current;
+		}
+
+		const char *name = path;
 		while (*path && *path != '/') {
-			child_name[index++] = *path++;
+			path++;
 		}
-		child_name[index] = 0;
 
-		auto *child = resolve_child(child_name);
-		if (child) {
-			if (*path == '\0') {
-				return child;
+		size_t length = path - name;
+
+		if (length == 1 && name[0] == '.') {
+			continue;
+		}
+
+		if (length == 2 && name[0] == '.' && name[1] == '.') {
+			// The root of a mounted filesystem has no parent of its own, so leave the filesystem through
+			// the node it covers, in the same way as a path is canonicalised by name.
+			while (current == &current->fs_.root() && current->fs_.mount_point()) {
+				current = current->fs_.mount_point();
+			}
+
+			if (current->parent_node_) {
+				current = current->parent_node_;
 			}
 
-			// TODO: see if we need to skip the slash
-			return child->lookup(++path);
-		} else {
+			continue;
+		}
+
+		if (current->kind_ != fs_node_kind::directory) {
+			return nullptr;
+		}
+
+		current = current->lookup_child(name, length);
+		if (!current) {
 			return nullptr;
 		}
 	}
 }
+
+fs_node *fs_node::lookup_child(const char *name, size_t length)
+{
+	auto &dc = dentry_cache::get();
+
+	u32 hash = dentry_cache::hash_name(name, length);
+
+	fs_node *child;
+	if (dc.lookup(*this, name, length, hash, child)) {
+		return child;
+	}
+
+	char child_name[512];
+	if (length >= sizeof(child_name)) {
+		return nullptr;
+	}
+
+	memops::memcpy(child_name, name, length);
+	child_name[length] = 0;
+
+	// dprintf("fs: resolving child\n");
+	u64 generation = dc.generation();
+	child = resolve_child(child_name);
+
+	dc.insert(*this, name, length, hash, child, generation);
+	return child;
+}
+
+void fs_node::child_added(const string &name) { dentry_cache::get().invalidate(*this, name.c_str(), name.length()); }
+
+void fs_node::child_removed(const string &name) { dentry_cache::get().invalidate(*this, name.c_str(), name.length()); }
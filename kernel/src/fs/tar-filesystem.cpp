@@ -6,11 +6,13 @@
  * Tom Spink <tcs6@st-andrews.ac.uk>
  */
 #include <stacsos/kernel/debug.h>
+#include <stacsos/kernel/dev/storage/block-cache.h>
 #include <stacsos/kernel/dev/storage/block-device.h>
 #include <stacsos/kernel/fs/tar-filesystem.h>
 #include <stacsos/memops.h>
 
 using namespace stacsos;
+using namespace stacsos::kernel::dev::storage;
 using namespace stacsos::kernel::fs;
 
 fs_node *tarfs_node::resolve_child(const string &name)
@@ -51,7 +53,7 @@ void tar_filesystem::load_tree()
 	u64 current_block = 0;
 	u64 last_block = bdev_.nr_blocks();
 	while (current_block < last_block) {
-		bdev_.read_blocks_sync(buffer, current_block, 1);
+		block_cache::get().read(bdev_, buffer, current_block * sizeof(buffer), sizeof(buffer));
 
 		const tar_file_header *header = (const tar_file_header *)buffer;
 		if (header->file_path[0] == 0) {
@@ -111,31 +113,14 @@ size_t tarfs_file::pread(void *buffer, size_t offset, size_t length)
 {
 	// dprintf("tarfs: pread: offset=%d len=%d\n", offset, length);
 
-	size_t orig_length = length;
-	u64 current_file_block = offset / 512;
-	u64 start_block_offset = offset % 512;
-
-	u8 *output_ptr = (u8 *)buffer;
-	while (length) {
-		// dprintf("tarfs: pread: block=%d len=%d\n", current_file_block, length);
-		//   Need to read into a buffer, in case length < buffer size
-		char block_buffer[512];
-		read_file_blocks(block_buffer, current_file_block, 1);
-
-		u64 amount_to_copy = min(length, (size_t)(sizeof(block_buffer) - start_block_offset));
-		// dprintf("tarfs: atc: %lu, sbo: %lu\n", amount_to_copy, start_block_offset);
-
-		memops::memcpy(output_ptr, block_buffer + start_block_offset, amount_to_copy);
-
-		length -= amount_to_copy;
-		output_ptr += amount_to_copy;
-		current_file_block++;
-		start_block_offset = 0;
+	if (offset >= size()) {
+		return 0;
 	}
 
-	return orig_length;
+	length = min(length, (size_t)(size() - offset));
+	block_cache::get().read(fs_.bdev_, buffer, (data_start_ * 512) + offset, length);
+
+	return length;
 }
 
 size_t tarfs_file::pwrite(const void *buffer, size_t offset, size_t length) { return 0; }
-
-void tarfs_file::read_file_blocks(void *buffer, u64 offset, u64 count) { fs_.bdev_.read_blocks_sync(buffer, data_start_ + offset, count); }
@@ -7,7 +7,9 @@
  */
 #include <stacsos/kernel/debug.h>
 #include <stacsos/kernel/fs/vfs.h>
+#include <stacsos/memops.h>
 
+using namespace stacsos;
 using namespace stacsos::kernel;
 using namespace stacsos::kernel::fs;
 
@@ -16,14 +18,80 @@ void vfs::init()
 	//
 }
 
-fs_node *vfs::lookup(const char *path)
+fs_node *vfs::lookup(const char *path, fs_node *cwd)
 {
 	// dprintf("vfs: lookup '%s'\n", path);
 
-	// All paths MUST be absolute.  To avoid any confusion.
-	if (path[0] != '/') {
-		return nullptr;
+	if (path[0] == '/') {
+		return rootfs_.root().lookup(&path[1]);
 	}
 
-	return rootfs_.root().lookup(&path[1]);
+	return (cwd ? cwd : &rootfs_.root())->lookup(path);
+}
+
+bool vfs::canonicalise_path(const char *base, const char *path, char *buffer, size_t size)
+{
+	if (size < 2) {
+		return false;
+	}
+
+	size_t length = 0;
+
+	if (path[0] != '/' && !append_path(buffer, size, length, base)) {
+		return false;
+	}
+
+	if (!append_path(buffer, size, length, path)) {
+		return false;
+	}
+
+	if (length == 0) {
+		buffer[length++] = '/';
+	}
+
+	buffer[length] = 0;
+	return true;
+}
+
+bool vfs::append_path(char *buffer, size_t size, size_t &length, const char *path)
+{
+	while (*path) {
+		while (*path == '/') {
+			path++;
+		}
+
+		const char *name = path;
+		while (*path && *path != '/') {
+			path++;
+		}
+
+		size_t name_length = path - name;
+
+		if (name_length == 0 || (name_length == 1 && name[0] == '.')) {
+			continue;
+		}
+
+		if (name_length == 2 && name[0] == '.' && name[1] == '.') {
+			while (length > 0 && buffer[length - 1] != '/') {
+				length--;
+			}
+
+			if (length > 0) {
+				length--;
+			}
+
+			continue;
+		}
+
+		// Leave room for the separator and the terminator.
+		if (length + name_length + 2 > size) {
+			return false;
+		}
+
+		buffer[length++] = '/';
+		memops::memcpy(&buffer[length], name, name_length);
+		length += name_length;
+	}
+
+	return true;
 }
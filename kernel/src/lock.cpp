@@ -6,3 +6,248 @@
  * Tom Spink <tcs6@st-andrews.ac.uk>
  */
 #include <stacsos/kernel/lock.h>
+#include <stacsos/kernel/config.h>
+#include <stacsos/kernel/debug.h>
+#include <stacsos/memops.h>
+
+using namespace stacsos;
+using namespace stacsos::kernel;
+
+spinlock_implementation spinlock_base::implementation_ = spinlock_implementation::test_and_set;
+
+bool lock_stats::enabled_ = false;
+lock_stats *lock_stats::first_ = nullptr;
+
+lock_stats::lock_stats(const char *name)
+	: name_(name)
+	, next_(nullptr)
+	, acquisitions_(0)
+	, contended_(0)
+	, spin_cycles_(0)
+	, max_hold_cycles_(0)
+{
+	lock_stats *head = __atomic_load_n(&first_, __ATOMIC_RELAXED);
+	do {
+		next_ = head;
+	} while (!__atomic_compare_exchange_n(&first_, &head, this, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+void lock_stats::reset()
+{
+	acquisitions_ = 0;
+	contended_ = 0;
+	spin_cycles_ = 0;
+	max_hold_cycles_ = 0;
+}
+
+void spinlock_base::init()
+{
+	const char *name = config::get().get_option_or_default("spinlock", "tas");
+
+	if (memops::strcmp(name, "tas") == 0) {
+		implementation_ = spinlock_implementation::test_and_set;
+	} else if (memops::strcmp(name, "ticket") == 0) {
+		implementation_ = spinlock_implementation::ticket;
+	} else if (memops::strcmp(name, "mcs") == 0) {
+		implementation_ = spinlock_implementation::mcs;
+	} else {
+		panic("Unsupported spinlock implementation '%s'", name);
+	}
+
+	lock_stats::enabled_ = config::get().get_option("lockstat") != nullptr;
+
+	dprintf("lock: using %s spinlocks%s\n", name, lock_stats::enabled_ ? ", with statistics" : "");
+}
+
+void spinlock_base::acquire_raw()
+{
+	switch (implementation_) {
+	case spinlock_implementation::ticket:
+		ticket_acquire();
+		break;
+
+	case spinlock_implementation::mcs:
+		mcs_acquire();
+		break;
+
+	default:
+		::spinlock_acquire(&state_.tas);
+		break;
+	}
+}
+
+bool spinlock_base::try_acquire_raw()
+{
+	switch (implementation_) {
+	case spinlock_implementation::ticket:
+		return ticket_try_acquire();
+
+	case spinlock_implementation::mcs:
+		return mcs_try_acquire();
+
+	default:
+		return ::spinlock_try_acquire(&state_.tas);
+	}
+}
+
+void spinlock_base::release_raw()
+{
+	switch (implementation_) {
+	case spinlock_implementation::ticket:
+		ticket_release();
+		break;
+
+	case spinlock_implementation::mcs:
+		mcs_release();
+		break;
+
+	default:
+		::spinlock_release(&state_.tas);
+		break;
+	}
+}
+
+void spinlock_base::acquire_with_stats()
+{
+	u64 start = __builtin_ia32_rdtsc();
+	bool contended = !try_acquire_raw();
+
+	if (contended) {
+		acquire_raw();
+	}
+
+	// From here on, the lock is held, so the statistics can be updated without atomics.
+	u64 now = __builtin_ia32_rdtsc();
+
+	stats_->acquisitions_++;
+	if (contended) {
+		stats_->contended_++;
+		stats_->spin_cycles_ += now - start;
+	}
+
+	acquired_at_ = now;
+}
+
+void spinlock_base::release_with_stats()
+{
+	u64 held = __builtin_ia32_rdtsc() - acquired_at_;
+	if (held > stats_->max_hold_cycles_) {
+		stats_->max_hold_cycles_ = held;
+	}
+
+	release_raw();
+}
+
+void spinlock_base::ticket_acquire()
+{
+	u16 ticket = __atomic_fetch_add(&state_.ticket.next, 1, __ATOMIC_ACQUIRE);
+
+	while (__atomic_load_n(&state_.ticket.owner, __ATOMIC_ACQUIRE) != ticket) {
+		__relax();
+	}
+}
+
+bool spinlock_base::ticket_try_acquire()
+{
+	// The lock is free if the next ticket would be served straight away.  If nobody has taken that
+	// ticket in the meantime, the owner can't have moved on either.
+	u16 ticket = __atomic_load_n(&state_.ticket.owner, __ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&state_.ticket.next, __ATOMIC_RELAXED) != ticket) {
+		return false;
+	}
+
+	return __atomic_compare_exchange_n(&state_.ticket.next, &ticket, (u16)(ticket + 1), false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+void spinlock_base::ticket_release()
+{
+	// Only the holder writes the owner field, so this doesn't need to be a locked add.
+	__atomic_store_n(&state_.ticket.owner, (u16)(state_.ticket.owner + 1), __ATOMIC_RELEASE);
+}
+
+/*
+ * The MCS lock here is the variant from K42, which needs no queue node from the holder.  The lock's own
+ * node is used as follows:
+ *
+ *  - tail is null if the lock is free, points at the lock's node if it is held with nobody waiting,
+ *    and otherwise points at the last waiter's node.
+ *  - next points at the first waiter's node, if there is one.
+ *
+ * A waiter's tail is non-null for as long as it is waiting.
+ */
+
+void spinlock_base::mcs_acquire()
+{
+	mcs_node *lock_node = &state_.mcs;
+
+	while (true) {
+		mcs_node *prev = __atomic_load_n(&lock_node->tail, __ATOMIC_RELAXED);
+
+		if (!prev) {
+			if (__atomic_compare_exchange_n(&lock_node->tail, &prev, lock_node, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+				return;
+			}
+
+			continue;
+		}
+
+		mcs_node self;
+		self.tail = (mcs_node *)1; // Any non-null value will do.
+		self.next = nullptr;
+
+		if (!__atomic_compare_exchange_n(&lock_node->tail, &prev, &self, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+			continue;
+		}
+
+		__atomic_store_n(&prev->next, &self, __ATOMIC_RELEASE);
+
+		while (__atomic_load_n(&self.tail, __ATOMIC_ACQUIRE)) {
+			__relax();
+		}
+
+		// The lock is now held, but our node is still in the queue.  Hand our place over to the lock's
+		// own node before returning, as our node is about to go out of scope.
+		mcs_node *succ = __atomic_load_n(&self.next, __ATOMIC_ACQUIRE);
+		if (!succ) {
+			__atomic_store_n(&lock_node->next, nullptr, __ATOMIC_RELAXED);
+
+			mcs_node *expected = &self;
+			if (__atomic_compare_exchange_n(&lock_node->tail, &expected, lock_node, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+				return;
+			}
+
+			// Somebody has queued up behind us, but hasn't linked themselves in yet.
+			while (!(succ = __atomic_load_n(&self.next, __ATOMIC_ACQUIRE))) {
+				__relax();
+			}
+		}
+
+		__atomic_store_n(&lock_node->next, succ, __ATOMIC_RELAXED);
+		return;
+	}
+}
+
+bool spinlock_base::mcs_try_acquire()
+{
+	mcs_node *expected = nullptr;
+	return __atomic_compare_exchange_n(&state_.mcs.tail, &expected, &state_.mcs, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+void spinlock_base::mcs_release()
+{
+	mcs_node *lock_node = &state_.mcs;
+	mcs_node *succ = __atomic_load_n(&lock_node->next, __ATOMIC_ACQUIRE);
+
+	if (!succ) {
+		mcs_node *expected = lock_node;
+		if (__atomic_compare_exchange_n(&lock_node->tail, &expected, nullptr, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+			return;
+		}
+
+		while (!(succ = __atomic_load_n(&lock_node->next, __ATOMIC_ACQUIRE))) {
+			__relax();
+		}
+	}
+
+	__atomic_store_n(&succ->tail, nullptr, __ATOMIC_RELEASE);
+}
@@ -16,13 +16,21 @@
 #include <stacsos/kernel/dev/gfx/qemu-stdvga.h>
 #include <stacsos/kernel/dev/input/keyboard.h>
 #include <stacsos/kernel/dev/misc/cmos-rtc.h>
+#include <stacsos/kernel/dev/misc/debug-console-device.h>
+#include <stacsos/kernel/dev/misc/lockstat-device.h>
+#include <stacsos/kernel/dev/misc/profile-device.h>
+#include <stacsos/kernel/dev/misc/trace-device.h>
 #include <stacsos/kernel/dev/storage/ahci-storage-device.h>
 #include <stacsos/kernel/dev/tty/terminal.h>
 #include <stacsos/kernel/fs/filesystem.h>
 #include <stacsos/kernel/fs/vfs.h>
+#include <stacsos/kernel/lock.h>
 #include <stacsos/kernel/log.h>
 #include <stacsos/kernel/mem/memory-manager.h>
+#include <stacsos/kernel/profiler.h>
+#include <stacsos/kernel/sched/clock-page.h>
 #include <stacsos/kernel/sched/process-manager.h>
+#include <stacsos/kernel/trace.h>
 #include <stacsos/memops.h>
 
 using namespace stacsos::kernel;
@@ -98,6 +106,25 @@ static void continue_main()
 	device_manager::get().probe_buses();
 	init_console();
 
+	auto trace = new trace_device(device_manager::get().sysbus());
+	device_manager::get().register_device(*trace);
+	device_manager::get().add_device_alias(*trace, "trace");
+
+	auto lockstat = new lockstat_device(device_manager::get().sysbus());
+	device_manager::get().register_device(*lockstat);
+	device_manager::get().add_device_alias(*lockstat, "lockstat");
+
+	auto profile = new profile_device(device_manager::get().sysbus());
+	device_manager::get().register_device(*profile);
+	device_manager::get().add_device_alias(*profile, "profile");
+
+	auto debug_console = new debug_console_device(device_manager::get().sysbus());
+	device_manager::get().register_device(*debug_console);
+	device_manager::get().add_device_alias(*debug_console, "debug");
+
+	// Now that there is a clock, publish the time to userspace.
+	clock_page::get().init(device_manager::get().get_device_by_class<cmos_rtc>(cmos_rtc::cmos_rtc_device_class));
+
 	// Mount the root filesystem
 	auto *root = vfs::get().lookup("/");
 	if (!root) {
@@ -117,7 +144,7 @@ static void continue_main()
 		panic("unable to create directory for devfs");
 	}
 
-	devfs_dir->mount(*new devfs());
+	devfs_dir->mount(devfs::get());
 
 	// Launch the init process
 	auto init_proc = process_manager::get().create_process("/usr/init", "");
@@ -131,9 +158,11 @@ static void continue_main()
 
 __noreturn void main(const char *cmdline)
 {
-	debug_helper::get().parse_image();
 	stacsos::kernel::config::get().init(cmdline);
 
+	// Choose the spinlock implementation, before anything takes a lock.
+	stacsos::kernel::spinlock_base::init();
+
 	// Initialise the memory manager first, so we can allocate memory.
 	main_logger.log(log_level::info, "starting main kernel initialisation");
 	stacsos::kernel::mem::memory_manager::get().init();
@@ -148,6 +177,10 @@ __noreturn void main(const char *cmdline)
 	stacsos::kernel::dev::device_manager::get().init();
 	stacsos::kernel::arch::x86::x86_platform::get().probe();
 
+	// Now that the cores are known, give each of them a trace buffer and a profile buffer.
+	stacsos::kernel::trace_buffers::get().init();
+	stacsos::kernel::profiler::get().init();
+
 	// Initialise the process manager, so we can start running threads.
 	stacsos::kernel::sched::process_manager::get().init();
 
@@ -5,12 +5,17 @@
  * Copyright (c) University of St Andrews 2024
  * Tom Spink <tcs6@st-andrews.ac.uk>
  */
+#include <stacsos/kernel/arch/x86/x86-core.h>
 #include <stacsos/kernel/mem/address-space-region.h>
 #include <stacsos/kernel/mem/address-space.h>
 #include <stacsos/kernel/mem/memory-manager.h>
+#include <stacsos/kernel/mem/page-cache.h>
 #include <stacsos/kernel/mem/page-table-allocator.h>
 #include <stacsos/kernel/mem/page-table.h>
+#include <stacsos/memops.h>
 
+using namespace stacsos;
+using namespace stacsos::kernel::arch::x86;
 using namespace stacsos::kernel::mem;
 
 address_space *address_space::create_linked(u64 alloc_rgn_start)
@@ -34,6 +39,12 @@ address_space_region *address_space::add_region(u64 base, u64 size, region_flags
 	rgn->base = base;
 	rgn->size = size;
 	rgn->flags = flags;
+	rgn->file_offset = 0;
+	rgn->file_start = 0;
+	rgn->file_size = 0;
+	rgn->cached = false;
+	rgn->shared = false;
+	rgn->pinned = false;
 
 	//dprintf("as: add-region base=%lx size=%lx flags=%d alloc=%d\n", base, size, flags, allocate);
 
@@ -46,7 +57,7 @@ address_space_region *address_space::add_region(u64 base, u64 size, region_flags
 
 		for (u64 i = 0; i < pages; i++) {
 			//dprintf("map virt=%p phys=%p\n", cur_virt, cur_phys);
-			pt_->map(pta_, cur_virt, cur_phys, mapping_flags::present | mapping_flags::writable | mapping_flags::user_accessable, mapping_size::m4k);
+			pt_->map(pta_, cur_virt, cur_phys, flags_for(flags), mapping_size::m4k);
 			cur_virt += PAGE_SIZE;
 			cur_phys += PAGE_SIZE;
 		}
@@ -54,12 +65,247 @@ address_space_region *address_space::add_region(u64 base, u64 size, region_flags
 		rgn->storage = nullptr;
 	}
 
-	regions_.append(rgn);
+	{
+		unique_irq_lock l(fault_lock_);
+		regions_.append(rgn);
+	}
 
 	return rgn;
 }
 
-void address_space::remove_region(u64 base, u64 size, region_flags flags)
+address_space_region *address_space::map_file(shared_ptr<fs::file> file, u64 offset, u64 length, region_flags flags, bool shared)
+{
+	if (!file->identity().owner || (offset & ~PAGE_MASK) || length == 0) {
+		return nullptr;
+	}
+
+	auto rgn = alloc_region(length, flags, false);
+	rgn->file = file;
+	rgn->file_offset = offset;
+	rgn->file_start = 0;
+	rgn->file_size = offset < file->size() ? min(length, file->size() - offset) : 0;
+	rgn->cached = true;
+	rgn->shared = shared;
+
+	return rgn;
+}
+
+bool address_space::remove_region(u64 base, u64 size)
+{
+	address_space_region *rgn;
+	u64 nr_pages = PAGE_ALIGN_UP(size) >> PAGE_BITS;
+	page **pages = nullptr;
+
+	{
+		unique_irq_lock l(fault_lock_);
+
+		rgn = get_region_from_address(base);
+		if (!rgn || rgn->pinned || rgn->base != base || PAGE_ALIGN_UP(rgn->size) != PAGE_ALIGN_UP(size)) {
+			return false;
+		}
+
+		regions_.remove(rgn);
+		regions_generation_++;
+
+		// Unmap the pages now, but hang on to them until no core can still be using them.
+		if (!rgn->storage) {
+			pages = new page *[nr_pages];
+		}
+
+		for (u64 i = 0; i < nr_pages; i++) {
+			u64 address;
+			bool writable;
+
+			if (pages) {
+				pages[i] = pt_->translate(base + (i << PAGE_BITS), address, writable) ? &page::get_from_base_address(address) : nullptr;
+			}
+
+			pt_->unmap(pta_, base + (i << PAGE_BITS));
+		}
+	}
+
+	x86_core::shootdown_tlb();
+
+	if (rgn->storage) {
+		memory_manager::get().pgalloc().free_pages(*rgn->storage, log2_ceil(nr_pages));
+	} else {
+		for (u64 i = 0; i < nr_pages; i++) {
+			if (!pages[i]) {
+				continue;
+			}
+
+			// Pages from the page cache are given back to it, and anything else is private.
+			if (rgn->cached && page_cache::get().put(*rgn->file, file_page_index(*rgn, base + (i << PAGE_BITS)), *pages[i])) {
+				continue;
+			}
+
+			memory_manager::get().pgalloc().free_pages(*pages[i], 0);
+		}
+
+		delete[] pages;
+	}
+
+	delete rgn;
+	return true;
+}
+
+mapping_flags address_space::flags_for(region_flags flags)
+{
+	mapping_flags mf = mapping_flags::present | mapping_flags::user_accessable;
+
+	if ((flags & region_flags::writable) == region_flags::writable) {
+		mf = mf | mapping_flags::writable;
+	}
+
+	if ((flags & region_flags::executable) != region_flags::executable) {
+		mf = mf | mapping_flags::no_execute;
+	}
+
+	return mf;
+}
+
+page *address_space::copy_page(const page &source)
+{
+	page *pg = memory_manager::get().pgalloc().allocate_pages(0);
+	if (pg) {
+		memops::memcpy(pg->base_address_ptr(), source.base_address_ptr(), PAGE_SIZE);
+	}
+
+	return pg;
+}
+
+bool address_space::handle_fault(u64 address, bool write, bool present)
 {
-	//
+	unique_irq_lock l(fault_lock_);
+
+	address_space_region *rgn = get_region_from_address(address);
+	if (!rgn || rgn->storage || rgn->flags == region_flags::inaccessible) {
+		return false;
+	}
+
+	if (write && (rgn->flags & region_flags::writable) != region_flags::writable) {
+		return false;
+	}
+
+	u64 page_base = address & PAGE_MASK;
+
+	u64 mapped_address;
+	bool mapped_writable;
+	if (pt_->translate(page_base, mapped_address, mapped_writable)) {
+		// Another thread in this address space may have got here first.
+		if (!present) {
+			return true;
+		}
+
+		// Nothing can be done about e.g. executing a non-executable page.
+		if (!write) {
+			return false;
+		}
+
+		// The fault may have come from a stale TLB entry, after another thread made the page writable.
+		if (mapped_writable) {
+			return true;
+		}
+
+		if (!rgn->cached || rgn->shared) {
+			return false;
+		}
+
+		// This is the first write to a page of a private mapping, so it needs its own copy.
+		page &cached_page = page::get_from_base_address(mapped_address);
+
+		page *pg = copy_page(cached_page);
+		if (!pg) {
+			return false;
+		}
+
+		page_cache::get().put(*rgn->file, file_page_index(*rgn, page_base), cached_page);
+		pt_->map(pta_, page_base, pg->base_address(), flags_for(rgn->flags), mapping_size::m4k);
+
+		l.unlock();
+
+		// Other threads may still be looking at the cached page through their TLBs.
+		x86_core::shootdown_tlb();
+		return true;
+	}
+
+	// Filling the page may mean reading a file, and so waiting for a disk, which mustn't be done with the
+	// fault lock held.  Take what's needed from the region, and drop the lock until the page is ready.
+	shared_ptr<fs::file> file = rgn->file;
+	bool from_cache = rgn->cached && (page_base - rgn->base) < rgn->file_size;
+	bool read_file = file && !rgn->cached;
+	bool shared = rgn->shared;
+	mapping_flags mf = flags_for(rgn->flags);
+	u64 index = from_cache ? file_page_index(*rgn, page_base) : 0;
+
+	// For an uncached file, work out which part of the file data (if any) lands in this page.
+	u64 page_start = page_base - rgn->base;
+	u64 data_start = max(page_start, rgn->file_start);
+	u64 data_end = min(page_start + PAGE_SIZE, rgn->file_start + rgn->file_size);
+	u64 data_file_offset = rgn->file_offset + (data_start - rgn->file_start);
+
+	u64 generation = regions_generation_;
+
+	l.unlock();
+
+	// If cached_page is set, the page to be mapped is the page cache's, and a reference is held on it.
+	page *cached_page = nullptr;
+	page *pg;
+
+	if (from_cache) {
+		cached_page = page_cache::get().get(*file, index);
+		if (!cached_page) {
+			return false;
+		}
+
+		pg = cached_page;
+
+		if (!shared && write) {
+			pg = copy_page(*cached_page);
+			page_cache::get().put(*file, index, *cached_page);
+			cached_page = nullptr;
+
+			if (!pg) {
+				return false;
+			}
+		} else if (!shared) {
+			// Leave the page read-only, so that a write can be caught and given a copy.
+			mf = mf & ~mapping_flags::writable;
+		}
+	} else {
+		pg = memory_manager::get().pgalloc().allocate_pages(0, page_allocation_flags::zero);
+		if (!pg) {
+			return false;
+		}
+
+		if (read_file && data_start < data_end) {
+			u64 length = data_end - data_start;
+			void *target = (char *)pg->base_address_ptr() + (data_start - page_start);
+
+			if (file->pread(target, data_file_offset, length) != length) {
+				memory_manager::get().pgalloc().free_pages(*pg, 0);
+				return false;
+			}
+		}
+	}
+
+	l.lock();
+
+	// While the lock was dropped, the region may have been removed, or another thread may have mapped
+	// the page first.  Either way, let this page go, and have the access retried: it'll find the page
+	// mapped, or fault again with no region.
+	if (generation != regions_generation_ || pt_->translate(page_base, mapped_address, mapped_writable)) {
+		l.unlock();
+
+		if (cached_page) {
+			page_cache::get().put(*file, index, *cached_page);
+		} else {
+			memory_manager::get().pgalloc().free_pages(*pg, 0);
+		}
+
+		return true;
+	}
+
+	pt_->map(pta_, page_base, pg->base_address(), mf, mapping_size::m4k);
+	return true;
 }
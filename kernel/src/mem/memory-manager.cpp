@@ -11,6 +11,8 @@
 #include <stacsos/kernel/mem/page-allocator-buddy.h>
 #include <stacsos/kernel/mem/page-allocator-linear.h>
 #include <stacsos/kernel/mem/page.h>
+#include <stacsos/kernel/sched/process.h>
+#include <stacsos/kernel/sched/thread.h>
 
 extern "C" const char *_IMAGE_START;
 extern "C" const char *_IMAGE_END;
@@ -35,6 +37,9 @@ void memory_manager::init()
 	const char *pgalloc_algorithm_name = config::get().get_option_or_default("pgalloc", "linear");
 	dprintf("\e\x04mem: *** using the '%s' page allocator\e\x07\n", pgalloc_algorithm_name);
 
+	static_assert(sizeof(page_allocator_buddy) <= sizeof(page_allocator_structure));
+	static_assert(sizeof(page_allocator_linear) <= sizeof(page_allocator_structure));
+
 	void *page_allocator_object = (void *)page_allocator_structure;
 	if (memops::strcmp(pgalloc_algorithm_name, "buddy") == 0) {
 		pgalloc_ = new (page_allocator_object) page_allocator_buddy(*this);
@@ -87,7 +92,8 @@ void memory_manager::initialise_page_descriptors(u64 nr_page_descriptors)
 
 void memory_manager::initialise_page_allocator(u64 nr_page_descriptors)
 {
-	if (memops::strcmp(config::get().get_option_or_default("pgalloc-selftest", "no"), "yes") == 0) {
+	const char *selftest_mode = config::get().get_option_or_default("pgalloc-selftest", "no");
+	if (memops::strcmp(selftest_mode, "yes") == 0) {
 		pgalloc_->perform_selftest();
 		__unreachable();
 	}
@@ -129,7 +135,13 @@ void memory_manager::initialise_page_allocator(u64 nr_page_descriptors)
 
 	// Remove the page descriptors array
 	u64 page_descriptors_size = sizeof(page) * nr_page_descriptors;
-	pgalloc_->remove_pages(page::get_from_base_address((u64)&_DYNAMIC_DATA_START - 0xffff'ffff'8000'0000), PAGE_ALIGN_UP(page_descriptors_size) >> PAGE_BITS);
+	pgalloc_->remove_pages(page::get_from_base_address((u64)_DYNAMIC_DATA_START - 0xffff'ffff'8000'0000), PAGE_ALIGN_UP(page_descriptors_size) >> PAGE_BITS);
+
+	// The stress test runs on the real memory map, and leaves the allocator as it found it, so the
+	// system carries on booting afterwards.
+	if (memops::strcmp(selftest_mode, "stress") == 0) {
+		pgalloc_->perform_stress_test();
+	}
 }
 
 void memory_manager::initialise_object_allocator()
@@ -155,4 +167,12 @@ void memory_manager::activate_primary_mapping()
 	root_address_space_->pgtable().activate();
 }
 
-bool memory_manager::try_handle_page_fault(u64 faulting_address) { return false; }
+bool memory_manager::try_handle_page_fault(u64 faulting_address, bool write, bool present)
+{
+	// Only the lower half of the address space is demand paged -- the kernel's mappings are always present.
+	if (faulting_address >= 0x0000'8000'0000'0000) {
+		return false;
+	}
+
+	return sched::thread::current().owner().addrspace().handle_fault(faulting_address, write, present);
+}
@@ -16,14 +16,14 @@ using namespace stacsos::kernel::mem;
 #define VMALLOC_AREA 0xfffff00000000000
 
 object_allocator::object_allocator()
-	: loa_((void *)VMALLOC_AREA, GB(1))
+	: object_allocator_lock_stats_("object-allocator")
+	, object_allocator_lock_(object_allocator_lock_stats_)
+	, loa_((void *)VMALLOC_AREA, GB(1))
 {
 }
 
 void *object_allocator::alloc(size_t size)
 {
-	unique_irq_lock l(object_allocator_lock_);
-
 	if (size <= 16) {
 		return cache16_.allocate();
 	} else if (size <= 32) {
@@ -40,33 +40,31 @@ void *object_allocator::alloc(size_t size)
 		return cache1024_.allocate();
 	}
 
+	unique_irq_lock l(object_allocator_lock_);
 	return loa_.allocate(size);
 }
 
 void object_allocator::free(void *ptr)
 {
-	unique_irq_lock l(object_allocator_lock_);
+	if (!ptr) {
+		return;
+	}
 
 	if (loa_.ptr_in_region(ptr)) {
+		unique_irq_lock l(object_allocator_lock_);
+
 		if (!loa_.free(ptr)) {
 			panic("unable to free large object");
 		}
-	} else {
-		if (cache16_.try_free(ptr))
-			return;
-		if (cache32_.try_free(ptr))
-			return;
-		if (cache64_.try_free(ptr))
-			return;
-		if (cache128_.try_free(ptr))
-			return;
-		if (cache256_.try_free(ptr))
-			return;
-		if (cache512_.try_free(ptr))
-			return;
-		if (cache1024_.try_free(ptr))
-			return;
 
+		return;
+	}
+
+	// Small objects live in slabs, which are recorded in the page descriptor.
+	slab_header *slab = (slab_header *)page::get_from_base_address(virt_to_phys(ptr)).slab();
+	if (!slab) {
 		panic("unable to free object");
 	}
+
+	slab->cache->free(ptr);
 }
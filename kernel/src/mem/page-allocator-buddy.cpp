@@ -5,13 +5,16 @@
  * Copyright (c) University of St Andrews 2024
  * Tom Spink <tcs6@st-andrews.ac.uk>
  */
+#include <stacsos/kernel/arch/core.h>
 #include <stacsos/kernel/debug.h>
 #include <stacsos/kernel/mem/page-allocator-buddy.h>
 #include <stacsos/kernel/mem/page.h>
+#include <stacsos/kernel/trace.h>
 #include <stacsos/memops.h>
 
 using namespace stacsos;
 using namespace stacsos::kernel;
+using namespace stacsos::kernel::arch;
 using namespace stacsos::kernel::mem;
 
 void page_allocator_buddy::dump() const
@@ -29,11 +32,92 @@ void page_allocator_buddy::dump() const
 
 		dprintf("\n");
 	}
+
+	for (int i = 0; i < core_manager::max_cores; i++) {
+		if (page_caches_[i].count) {
+			dprintf("[core %d] %u cached pages\n", i, page_caches_[i].count);
+		}
+	}
+}
+
+u64 page_allocator_buddy::nr_free_pages() const
+{
+	u64 nr_free = total_free_;
+
+	for (const auto &pc : page_caches_) {
+		nr_free += pc.count;
+	}
+
+	return nr_free;
 }
 
-void page_allocator_buddy::insert_pages(page &range_start, u64 page_count) { panic("TODO"); }
+void page_allocator_buddy::insert_pages(page &range_start, u64 page_count)
+{
+	unique_irq_lock l(lock_);
+
+	u64 pfn = range_start.pfn();
+	u64 end = pfn + page_count;
 
-void page_allocator_buddy::remove_pages(page &range_start, u64 page_count) { panic("TODO"); }
+	if (end > max_pfn_) {
+		max_pfn_ = end;
+	}
+
+	// Carve the range up into the largest aligned blocks that fit, and free each one, so that they are
+	// merged with any free neighbours.
+	while (pfn < end) {
+		int order = LastOrder;
+		while (order > 0 && (!block_aligned(order, pfn) || pfn + pages_per_block(order) > end)) {
+			order--;
+		}
+
+		free_block(order, page::get_from_pfn(pfn));
+		pfn += pages_per_block(order);
+	}
+}
+
+void page_allocator_buddy::remove_pages(page &range_start, u64 page_count)
+{
+	unique_irq_lock l(lock_);
+
+	u64 pfn = range_start.pfn();
+	u64 end = min(pfn + page_count, max_pfn_);
+
+	while (pfn < end) {
+		// Find the free block that contains this page, if any.
+		int order;
+		page *block = nullptr;
+
+		for (order = 0; order <= LastOrder; order++) {
+			page &candidate = page::get_from_pfn(pfn & ~(pages_per_block(order) - 1));
+			if (is_free_block(order, candidate)) {
+				block = &candidate;
+				break;
+			}
+		}
+
+		// This page isn't free, so there's nothing to remove.
+		if (!block) {
+			pfn++;
+			continue;
+		}
+
+		// If the whole block is in the range, then take it out in one go.  Otherwise, split it, and have
+		// another look at the (now smaller) block containing this page.
+		if (block->pfn() == pfn && pfn + pages_per_block(order) <= end) {
+			remove_free_block(order, *block);
+			pfn += pages_per_block(order);
+		} else {
+			split_block(order, *block);
+		}
+	}
+}
+
+bool page_allocator_buddy::is_free_block(int order, page &block_start) const
+{
+	// Only the first page of a free block is marked as free, and it records the size of the block, so
+	// this doesn't need to search the free list.
+	return block_start.pfn() < max_pfn_ && block_start.state_ == page_state::free && block_start.free_block_size_ == pages_per_block(order);
+}
 
 void page_allocator_buddy::insert_free_block(int order, page &block_start)
 {
@@ -53,6 +137,10 @@ void page_allocator_buddy::insert_free_block(int order, page &block_start)
 
 	target->next_free_ = *slot;
 	*slot = target;
+
+	target->state_ = page_state::free;
+	target->free_block_size_ = pages_per_block(order);
+	total_free_ += pages_per_block(order);
 }
 
 void page_allocator_buddy::remove_free_block(int order, page &block_start)
@@ -74,12 +162,145 @@ void page_allocator_buddy::remove_free_block(int order, page &block_start)
 
 	*candidate_slot = target->next_free_;
 	target->next_free_ = nullptr;
+
+	target->state_ = page_state::allocated;
+	target->free_block_size_ = 0;
+	total_free_ -= pages_per_block(order);
 }
 
-void page_allocator_buddy::split_block(int order, page &block_start) { panic("TODO"); }
+void page_allocator_buddy::split_block(int order, page &block_start)
+{
+	assert(order > 0);
+
+	remove_free_block(order, block_start);
+
+	page &upper_half = page::get_from_pfn(block_start.pfn() + pages_per_block(order - 1));
+	insert_free_block(order - 1, block_start);
+	insert_free_block(order - 1, upper_half);
+}
 
-void page_allocator_buddy::merge_buddies(int order, page &buddy) { panic("TODO"); }
+void page_allocator_buddy::merge_buddies(int order, page &buddy)
+{
+	page *block = &buddy;
 
-page *page_allocator_buddy::allocate_pages(int order, page_allocation_flags flags) { panic("TODO"); }
+	// Keep merging the block with its buddy, for as long as the buddy is free.
+	while (order < LastOrder) {
+		page &other = page::get_from_pfn(block->pfn() ^ pages_per_block(order));
+		if (!is_free_block(order, other)) {
+			break;
+		}
 
-void page_allocator_buddy::free_pages(page &block_start, int order) { panic("TODO"); }
+		remove_free_block(order, *block);
+		remove_free_block(order, other);
+
+		if (other.pfn() < block->pfn()) {
+			block = &other;
+		}
+
+		order++;
+		insert_free_block(order, *block);
+	}
+}
+
+page *page_allocator_buddy::allocate_block(int order)
+{
+	// Find the smallest free block that is big enough...
+	int block_order = order;
+	while (block_order <= LastOrder && !free_list_[block_order]) {
+		block_order++;
+	}
+
+	if (block_order > LastOrder) {
+		return nullptr;
+	}
+
+	// ...and split it down to size.  The lower half stays at the front of the (sorted) free list.
+	while (block_order > order) {
+		split_block(block_order, *free_list_[block_order]);
+		block_order--;
+	}
+
+	page *block = free_list_[order];
+	remove_free_block(order, *block);
+
+	return block;
+}
+
+void page_allocator_buddy::free_block(int order, page &block_start)
+{
+	insert_free_block(order, block_start);
+	merge_buddies(order, block_start);
+}
+
+page_allocator_buddy::page_cache &page_allocator_buddy::local_page_cache()
+{
+	// Pages are allocated before the cores are brought up, so be careful with the core id.  Since the
+	// cache is locked, sharing it is harmless.
+	return page_caches_[(unsigned)core::this_core_id() % core_manager::max_cores];
+}
+
+page *page_allocator_buddy::allocate_pages(int order, page_allocation_flags flags)
+{
+	if (order < 0 || order > LastOrder) {
+		return nullptr;
+	}
+
+	page *block;
+
+	if (order == 0) {
+		page_cache &pc = local_page_cache();
+		unique_irq_lock l(pc.lock);
+
+		if (pc.count == 0) {
+			unique_irq_lock sl(lock_);
+
+			while (pc.count < page_cache_batch) {
+				page *pg = allocate_block(0);
+				if (!pg) {
+					break;
+				}
+
+				pc.pages[pc.count++] = pg;
+			}
+
+			trace(trace_event::page_refill, core::this_core_id(), pc.count);
+		}
+
+		block = pc.count ? pc.pages[--pc.count] : nullptr;
+	} else {
+		unique_irq_lock l(lock_);
+		block = allocate_block(order);
+	}
+
+	if (block && (flags & page_allocation_flags::zero) == page_allocation_flags::zero) {
+		memops::bzero(block->base_address_ptr(), pages_per_block(order) << PAGE_BITS);
+	}
+
+	return block;
+}
+
+void page_allocator_buddy::free_pages(page &block_start, int order)
+{
+	assert(order >= 0 && order <= LastOrder);
+
+	if (order == 0) {
+		page_cache &pc = local_page_cache();
+		unique_irq_lock l(pc.lock);
+
+		if (pc.count == page_cache_capacity) {
+			unique_irq_lock sl(lock_);
+
+			while (pc.count > page_cache_capacity - page_cache_batch) {
+				free_block(0, *pc.pages[--pc.count]);
+			}
+
+			trace(trace_event::page_drain, core::this_core_id(), page_cache_batch);
+		}
+
+		pc.pages[pc.count++] = &block_start;
+		return;
+	}
+
+	unique_irq_lock l(lock_);
+	free_block(order, block_start);
+}
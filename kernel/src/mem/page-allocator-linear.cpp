@@ -7,26 +7,58 @@
  */
 #include <stacsos/kernel/debug.h>
 #include <stacsos/kernel/mem/page-allocator-linear.h>
+#include <stacsos/kernel/mem/page.h>
+#include <stacsos/memops.h>
 
 using namespace stacsos::kernel::mem;
 
 void page_allocator_linear::insert_pages(page &range_start, u64 page_count)
 {
+	unique_irq_lock l(lock_);
+	insert_free_range(range_start, page_count);
+}
+
+void page_allocator_linear::insert_free_range(page &range_start, u64 page_count)
+{
+	u64 start = range_start.pfn();
+
+	// The free list is kept in address order, so that a range can be merged with its neighbours.
+	page *prev = nullptr;
 	page **slot = &free_list_;
 
-	while (*slot) {
+	while (*slot && (*slot)->pfn() < start) {
+		prev = *slot;
 		slot = &(*slot)->next_free_;
 	}
 
-	*slot = &range_start;
-	range_start.free_block_size_ = page_count;
+	page *next = *slot;
+
+	if (prev && prev->pfn() + prev->free_block_size_ == start) {
+		prev->free_block_size_ += page_count;
+
+		if (next && start + page_count == next->pfn()) {
+			prev->free_block_size_ += next->free_block_size_;
+			prev->next_free_ = next->next_free_;
+		}
+	} else if (next && start + page_count == next->pfn()) {
+		range_start.free_block_size_ = page_count + next->free_block_size_;
+		range_start.next_free_ = next->next_free_;
+		*slot = &range_start;
+	} else {
+		range_start.free_block_size_ = page_count;
+		range_start.next_free_ = next;
+		*slot = &range_start;
+	}
 }
 
 void page_allocator_linear::remove_pages(page &range_start_r, u64 page_count)
 {
-	page *free_block = free_list_;
+	unique_irq_lock l(lock_);
 
-	while (free_block) {
+	page **slot = &free_list_;
+
+	while (*slot) {
+		page *free_block = *slot;
 		u64 free_block_start = free_block->pfn();
 		u64 free_block_end = free_block_start + free_block->free_block_size_;
 		u64 range_start = range_start_r.pfn();
@@ -40,52 +72,92 @@ void page_allocator_linear::remove_pages(page &range_start_r, u64 page_count)
 			u64 offset = range_start - free_block_start;
 			// dprintf("  offset=%lx\n", offset);
 
-			free_block->free_block_size_ = offset;
-
 			u64 remainder_pages = range_end > free_block_end ? 0 : free_block_end - range_end;
 			// dprintf("  remainder=%lx\n", remainder_pages);
 
+			page *next = free_block->next_free_;
+
 			if (remainder_pages) {
-				page *tmp_next_free = free_block->next_free_;
+				page &remainder = page::get_from_pfn(range_end);
+				remainder.free_block_size_ = remainder_pages;
+				remainder.next_free_ = next;
+				next = &remainder;
+			}
 
-				free_block->next_free_ = &page::get_from_pfn(range_end);
-				free_block->next_free_->free_block_size_ = remainder_pages;
-				free_block->next_free_->next_free_ = tmp_next_free;
+			// An empty block must come off the list: its first page is no longer free, and could be
+			// given back to insert_free_range() while still on the list.
+			if (offset) {
+				free_block->free_block_size_ = offset;
+				free_block->next_free_ = next;
+			} else {
+				*slot = next;
 			}
 
 			break;
 		}
 
-		free_block = free_block->next_free_;
+		slot = &free_block->next_free_;
 	}
 }
 
 page *page_allocator_linear::allocate_pages(int order, page_allocation_flags flags)
 {
 	u64 page_count = 1 << order;
+	page *allocated = nullptr;
 
-	// find a free block with enough pages
-	// take from the end, so we can just reduce the free block size
+	{
+		unique_irq_lock l(lock_);
 
-	page *free_block = free_list_;
+		// find a free block with enough pages
+		// take from the end, so we can just reduce the free block size
 
-	while (free_block) {
-		if (free_block->free_block_size_ >= page_count) {
-			free_block->free_block_size_ -= page_count;
+		page **slot = &free_list_;
+
+		while (*slot) {
+			page *free_block = *slot;
+
+			if (free_block->free_block_size_ >= page_count) {
+				free_block->free_block_size_ -= page_count;
+
+				u64 start_pfn = free_block->pfn() + free_block->free_block_size_;
+				allocated = &page::get_from_pfn(start_pfn);
+
+				// If that used up the whole block, then its first page has just been handed out, so the
+				// block must come off the list.
+				if (free_block->free_block_size_ == 0) {
+					*slot = free_block->next_free_;
+				}
+
+				break;
+			}
 
-			u64 start_pfn = free_block->pfn() + free_block->free_block_size_;
-			return &page::get_from_pfn(start_pfn);
+			slot = &free_block->next_free_;
 		}
+	}
 
-		free_block = free_block->next_free_;
+	// Freed pages are reused, so they can't be assumed to be clean.
+	if (allocated && (flags & page_allocation_flags::zero) == page_allocation_flags::zero) {
+		memops::bzero(allocated->base_address_ptr(), page_count << PAGE_BITS);
 	}
 
-	return nullptr;
+	return allocated;
 }
 
 void page_allocator_linear::free_pages(page &base, int order)
 {
-	// TODO
+	unique_irq_lock l(lock_);
+	insert_free_range(base, 1 << order);
+}
+
+u64 page_allocator_linear::nr_free_pages() const
+{
+	u64 nr_free = 0;
+
+	for (page *free_block = free_list_; free_block; free_block = free_block->next_free_) {
+		nr_free += free_block->free_block_size_;
+	}
+
+	return nr_free;
 }
 
 void page_allocator_linear::dump() const
@@ -91,3 +91,109 @@ void page_allocator::perform_selftest()
 	dprintf("*** SELF TEST COMPLETE - SYSTEM TERMINATED ***\n");
 	abort();
 }
+
+void page_allocator::perform_stress_test()
+{
+	dprintf("*** PAGE ALLOCATOR STRESS TEST ***\n");
+
+	static const int nr_slots = 256;
+	static const int nr_iterations = 100000;
+	static const int max_order = 4;
+
+	struct allocation {
+		page *base;
+		int order;
+	};
+
+	static allocation allocations[nr_slots];
+
+	u64 initial_free = nr_free_pages();
+	u64 seed = __builtin_ia32_rdtsc() | 1;
+
+	dprintf("  seed=%lx, free pages=%lu\n", seed, initial_free);
+
+	auto next_random = [&seed]() {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+		return seed;
+	};
+
+	// Randomly allocate blocks into, and free blocks from, a set of slots, checking that no two
+	// outstanding allocations overlap.
+	for (int i = 0; i < nr_iterations; i++) {
+		allocation &a = allocations[next_random() % nr_slots];
+
+		if (a.base) {
+			free_pages(*a.base, a.order);
+			a.base = nullptr;
+			continue;
+		}
+
+		int order = next_random() % (max_order + 1);
+		page *pg = allocate_pages(order);
+		if (!pg) {
+			panic("page allocation failed during stress test (order=%d)", order);
+		}
+
+		u64 start = pg->pfn();
+		u64 end = start + (1 << order);
+
+		for (const auto &other : allocations) {
+			if (!other.base) {
+				continue;
+			}
+
+			u64 other_start = other.base->pfn();
+			u64 other_end = other_start + (1 << other.order);
+
+			if (start < other_end && other_start < end) {
+				panic("overlapping allocations during stress test: %lx--%lx and %lx--%lx", start, end, other_start, other_end);
+			}
+		}
+
+		a.base = pg;
+		a.order = order;
+	}
+
+	for (auto &a : allocations) {
+		if (a.base) {
+			free_pages(*a.base, a.order);
+			a.base = nullptr;
+		}
+	}
+
+	// Use up a whole free block, a page at a time.  The linear allocator hands pages out from the end of
+	// its first block (usually the small one below 640K), so this stops once that block's first page has
+	// been taken, and the next page comes from somewhere else.  Freeing them in reverse gives back the
+	// first page of an exhausted block.
+	static const int max_exact_fit = 1024;
+	static page *exact_fit[max_exact_fit];
+	int nr_exact_fit = 0;
+
+	while (nr_exact_fit < max_exact_fit) {
+		page *pg = allocate_pages(0);
+		if (!pg) {
+			panic("page allocation failed during stress test (exact fit)");
+		}
+
+		exact_fit[nr_exact_fit++] = pg;
+
+		if (nr_exact_fit > 1 && pg->pfn() + 1 != exact_fit[nr_exact_fit - 2]->pfn()) {
+			break;
+		}
+	}
+
+	dprintf("  exact fit: %d pages\n", nr_exact_fit);
+
+	while (nr_exact_fit > 0) {
+		free_pages(*exact_fit[--nr_exact_fit], 0);
+	}
+
+	u64 final_free = nr_free_pages();
+	if (final_free != initial_free) {
+		panic("pages leaked during stress test: before=%lu, after=%lu", initial_free, final_free);
+	}
+
+	dprintf("*** STRESS TEST PASSED ***\n");
+}
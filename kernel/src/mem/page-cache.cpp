@@ -0,0 +1,144 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#include <stacsos/kernel/debug.h>
+#include <stacsos/kernel/fs/file.h>
+#include <stacsos/kernel/mem/memory-manager.h>
+#include <stacsos/kernel/mem/page-allocator.h>
+#include <stacsos/kernel/mem/page-cache.h>
+#include <stacsos/kernel/mem/page.h>
+
+using namespace stacsos;
+using namespace stacsos::kernel::fs;
+using namespace stacsos::kernel::mem;
+
+page_cache::page_cache()
+	: nr_pages_(0)
+	, hits_(0)
+	, misses_(0)
+{
+	for (auto &b : buckets_) {
+		b = nullptr;
+	}
+}
+
+size_t page_cache::bucket_of(const void *owner, u64 id, u64 index)
+{
+	return hash_bucket(((uintptr_t)owner >> 4) ^ (id * 31) ^ index, nr_buckets);
+}
+
+page_cache::entry *page_cache::lookup(const void *owner, u64 id, u64 index)
+{
+	entry *e = buckets_[bucket_of(owner, id, index)];
+	while (e && (e->owner != owner || e->id != id || e->index != index)) {
+		e = e->hash_next;
+	}
+
+	return e;
+}
+
+page *page_cache::get(file &f, u64 index)
+{
+	file_identity fid = f.identity();
+	assert(fid.owner);
+
+	{
+		unique_irq_lock l(lock_);
+
+		entry *e = lookup(fid.owner, fid.id, index);
+		if (e) {
+			hits_++;
+
+			if (e->users++ == 0) {
+				idle_.remove(e);
+			}
+
+			return e->pg;
+		}
+
+		misses_++;
+	}
+
+	// Read the page in without holding the lock, since this can take a while.  Anything past the end
+	// of the file reads as zero.
+	page *pg = memory_manager::get().pgalloc().allocate_pages(0, page_allocation_flags::zero);
+	if (!pg) {
+		return nullptr;
+	}
+
+	u64 offset = index << PAGE_BITS;
+	if (offset < f.size()) {
+		f.pread(pg->base_address_ptr(), offset, min((u64)PAGE_SIZE, f.size() - offset));
+	}
+
+	unique_irq_lock l(lock_);
+
+	// Somebody else may have read the same page in the meantime, in which case theirs wins.
+	entry *e = lookup(fid.owner, fid.id, index);
+	if (e) {
+		if (e->users++ == 0) {
+			idle_.remove(e);
+		}
+
+		l.unlock();
+		memory_manager::get().pgalloc().free_pages(*pg, 0);
+		return e->pg;
+	}
+
+	while (nr_pages_ >= max_cached_pages && idle_.tail()) {
+		drop(idle_.tail());
+	}
+
+	e = new entry();
+	e->owner = fid.owner;
+	e->id = fid.id;
+	e->index = index;
+	e->pg = pg;
+	e->users = 1;
+	e->idle_prev = e->idle_next = nullptr;
+
+	hash_chain<entry, &entry::hash_next>::push(buckets_[bucket_of(fid.owner, fid.id, index)], e);
+
+	nr_pages_++;
+
+	return pg;
+}
+
+bool page_cache::put(file &f, u64 index, page &pg)
+{
+	file_identity fid = f.identity();
+	if (!fid.owner) {
+		return false;
+	}
+
+	unique_irq_lock l(lock_);
+
+	entry *e = lookup(fid.owner, fid.id, index);
+	if (!e || e->pg->pfn() != pg.pfn()) {
+		return false;
+	}
+
+	assert(e->users > 0);
+	if (--e->users == 0) {
+		idle_.push_front(e);
+	}
+
+	return true;
+}
+
+void page_cache::dump() const { dprintf("*** page cache: %lu pages, %lu hits, %lu misses ***\n", nr_pages_, hits_, misses_); }
+
+void page_cache::drop(entry *e)
+{
+	hash_chain<entry, &entry::hash_next>::remove(buckets_[bucket_of(e->owner, e->id, e->index)], e);
+
+	idle_.remove(e);
+	nr_pages_--;
+
+	memory_manager::get().pgalloc().free_pages(*e->pg, 0);
+	delete e;
+}
@@ -5,21 +5,127 @@
  * Copyright (c) University of St Andrews 2024
  * Tom Spink <tcs6@st-andrews.ac.uk>
  */
+#include <stacsos/kernel/arch/core.h>
 #include <stacsos/kernel/mem/memory-manager.h>
 #include <stacsos/kernel/mem/page-allocator.h>
 #include <stacsos/kernel/mem/page.h>
 #include <stacsos/kernel/mem/slab-cache.h>
+#include <stacsos/kernel/trace.h>
 
+using namespace stacsos::kernel;
+using namespace stacsos::kernel::arch;
 using namespace stacsos::kernel::mem;
 
-template <size_t object_size, int slab_page_order> void *slab_cache<object_size, slab_page_order>::allocate_slab()
+template <size_t object_size, int slab_page_order> typename slab_cache<object_size, slab_page_order>::magazine &slab_cache<object_size, slab_page_order>::local_magazine()
+{
+	// Objects are allocated before the cores are brought up, so be careful with the core id.  Since the
+	// magazine is locked, sharing it is harmless.
+	return magazines_[(unsigned)core::this_core_id() % core_manager::max_cores];
+}
+
+template <size_t object_size, int slab_page_order> void *slab_cache<object_size, slab_page_order>::allocate()
+{
+	magazine &m = local_magazine();
+	unique_irq_lock l(m.lock);
+
+	if (m.count == 0) {
+		unique_irq_lock sl(lock_);
+
+		while (m.count < magazine_batch) {
+			m.objects[m.count++] = allocate_object();
+		}
+	}
+
+	return m.objects[--m.count];
+}
+
+template <size_t object_size, int slab_page_order> void slab_cache<object_size, slab_page_order>::free(void *ptr)
+{
+	magazine &m = local_magazine();
+	unique_irq_lock l(m.lock);
+
+	if (m.count == magazine_capacity) {
+		unique_irq_lock sl(lock_);
+
+		while (m.count > magazine_capacity - magazine_batch) {
+			free_object(m.objects[--m.count]);
+		}
+	}
+
+	m.objects[m.count++] = ptr;
+}
+
+template <size_t object_size, int slab_page_order> void *slab_cache<object_size, slab_page_order>::allocate_object()
+{
+	// Prefer partially-used slabs, to keep the number of slabs in use down.
+	slab *s = partial_.head;
+	if (!s) {
+		s = empty_.head;
+	}
+
+	if (!s) {
+		s = allocate_slab();
+		empty_.push(s);
+	}
+
+	slab_state old_state = s->state();
+	void *ptr = s->allocate();
+
+	if (s->state() != old_state) {
+		list_for(old_state).remove(s);
+		list_for(s->state()).push(s);
+	}
+
+	return ptr;
+}
+
+template <size_t object_size, int slab_page_order> void slab_cache<object_size, slab_page_order>::free_object(void *ptr)
+{
+	slab *s = (slab *)page::get_from_base_address(virt_to_phys(ptr)).slab();
+
+	slab_state old_state = s->state();
+	s->free(ptr);
+
+	if (s->state() != old_state) {
+		list_for(old_state).remove(s);
+		list_for(s->state()).push(s);
+	}
+
+	if (empty_.count > max_empty_slabs) {
+		slab *empty = empty_.head;
+		empty_.remove(empty);
+
+		release_slab(empty);
+	}
+}
+
+template <size_t object_size, int slab_page_order> typename slab_cache<object_size, slab_page_order>::slab *slab_cache<object_size, slab_page_order>::allocate_slab()
 {
 	page *slab_page = (memory_manager::get().pgalloc().allocate_pages(slab_page_order));
 	if (!slab_page) {
 		panic("unable to allocate slab");
 	}
 
-	return slab_page->base_address_ptr();
+	slab *s = new (slab_page->base_address_ptr()) slab(this);
+
+	// Point every page of the slab at the slab header, so that objects can be freed without searching.
+	for (u64 i = 0; i < (1u << slab_page_order); i++) {
+		page::get_from_pfn(slab_page->pfn() + i).set_slab(s);
+	}
+
+	trace(trace_event::slab_grow, object_size, (u64)s);
+	return s;
+}
+
+template <size_t object_size, int slab_page_order> void slab_cache<object_size, slab_page_order>::release_slab(slab *s)
+{
+	page &slab_page = page::get_from_base_address(virt_to_phys(s));
+
+	for (u64 i = 0; i < (1u << slab_page_order); i++) {
+		page::get_from_pfn(slab_page.pfn() + i).set_slab(nullptr);
+	}
+
+	memory_manager::get().pgalloc().free_pages(slab_page, slab_page_order);
 }
 
 template class slab_cache<16, 0>;
@@ -0,0 +1,126 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#include <stacsos/kernel/obj/handle-table.h>
+#include <stacsos/kernel/obj/object.h>
+
+using namespace stacsos;
+using namespace stacsos::kernel::obj;
+
+handle_table::~handle_table() { delete[] slots_; }
+
+u64 handle_table::insert(shared_ptr<object> o)
+{
+	unique_irq_lock l(lock_);
+
+	if (free_head_ == no_slot) {
+		grow();
+	}
+
+	u32 index = free_head_;
+	slot &s = slots_[index];
+	free_head_ = s.next_free;
+
+	s.obj = o;
+
+	u64 handle = make_handle(index, s.generation);
+	o->id_ = handle;
+
+	return handle;
+}
+
+shared_ptr<object> handle_table::get(u64 handle)
+{
+	unique_irq_lock l(lock_);
+
+	slot *s = lookup(handle);
+	if (!s) {
+		return nullptr;
+	}
+
+	return s->obj;
+}
+
+shared_ptr<object> handle_table::remove(u64 handle)
+{
+	shared_ptr<object> o;
+
+	unique_irq_lock l(lock_);
+
+	slot *s = lookup(handle);
+	if (!s) {
+		return nullptr;
+	}
+
+	swap(o, s->obj);
+
+	// Generation zero is never used, so that zero is never a valid handle.
+	if (++s->generation == 0) {
+		s->generation = 1;
+	}
+
+	s->next_free = free_head_;
+	free_head_ = (u32)handle;
+
+	return o;
+}
+
+void handle_table::clear()
+{
+	slot *old_slots;
+
+	{
+		unique_irq_lock l(lock_);
+
+		old_slots = slots_;
+		slots_ = nullptr;
+		capacity_ = 0;
+		free_head_ = no_slot;
+	}
+
+	// Releasing the objects can do all sorts, so it happens with the table unlocked.
+	delete[] old_slots;
+}
+
+handle_table::slot *handle_table::lookup(u64 handle)
+{
+	u32 index = (u32)handle;
+	if (index >= capacity_) {
+		return nullptr;
+	}
+
+	slot *s = &slots_[index];
+	if (s->generation != (u32)(handle >> 32) || !s->obj) {
+		return nullptr;
+	}
+
+	return s;
+}
+
+void handle_table::grow()
+{
+	u32 new_capacity = capacity_ ? capacity_ * 2 : initial_capacity;
+	slot *new_slots = new slot[new_capacity];
+
+	for (u32 i = 0; i < capacity_; i++) {
+		swap(new_slots[i].obj, slots_[i].obj);
+		new_slots[i].generation = slots_[i].generation;
+		new_slots[i].next_free = slots_[i].next_free;
+	}
+
+	// Chain the new slots onto the free list, lowest first.
+	for (u32 i = new_capacity; i > capacity_; i--) {
+		new_slots[i - 1].generation = 1;
+		new_slots[i - 1].next_free = free_head_;
+		free_head_ = i - 1;
+	}
+
+	delete[] slots_;
+
+	slots_ = new_slots;
+	capacity_ = new_capacity;
+}
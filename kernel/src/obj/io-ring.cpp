@@ -0,0 +1,281 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#include <stacsos/kernel/mem/address-space.h>
+#include <stacsos/kernel/obj/io-ring.h>
+#include <stacsos/kernel/obj/object-manager.h>
+#include <stacsos/kernel/sched/process.h>
+#include <stacsos/kernel/sched/thread.h>
+
+using namespace stacsos;
+using namespace stacsos::kernel::obj;
+using namespace stacsos::kernel::sched;
+using namespace stacsos::kernel::mem;
+
+io_ring_object *io_ring_object::create(process &owner, u32 entries, io_ring_setup_flags flags)
+{
+	if (entries == 0 || entries > io_ring_max_entries) {
+		return nullptr;
+	}
+
+	u32 sq_entries = 1u << log2_ceil(entries);
+	u32 cq_entries = sq_entries * 2;
+
+	u32 sqe_offset = (sizeof(io_ring_header) + 63) & ~63u;
+	u32 cqe_offset = sqe_offset + (sq_entries * sizeof(io_ring_sqe));
+	u64 size = cqe_offset + (cq_entries * sizeof(io_ring_cqe));
+
+	// The ring is populated up front, so that draining it never takes a page fault on the ring itself.
+	auto rgn = owner.addrspace().alloc_region(size, region_flags::readwrite, true);
+	rgn->pinned = true;
+
+	auto header = (io_ring_header *)rgn->base;
+	header->sq_entries = sq_entries;
+	header->cq_entries = cq_entries;
+	header->sqe_offset = sqe_offset;
+	header->cqe_offset = cqe_offset;
+
+	bool poll = (flags & io_ring_setup_flags::poll) == io_ring_setup_flags::poll;
+	return new io_ring_object(owner, rgn, poll);
+}
+
+io_ring_object::io_ring_object(process &owner, address_space_region *region, bool poll)
+	: owner_(owner)
+	, region_(region)
+	, header_((io_ring_header *)region->base)
+	, sqes_((io_ring_sqe *)((uintptr_t)header_ + header_->sqe_offset))
+	, cqes_((io_ring_cqe *)((uintptr_t)header_ + header_->cqe_offset))
+	, sq_mask_(header_->sq_entries - 1)
+	, cq_entries_(header_->cq_entries)
+	, poll_(poll)
+	, stopping_(false)
+	, draining_(false)
+	, drain_pending_(false)
+	, completed_(false)
+	, wake_(false)
+{
+}
+
+io_ring_object::~io_ring_object()
+{
+	// The polling thread may have been stopped along with the process already.  Otherwise, ask it to
+	// stop, and wait until it has, as it uses the ring.
+	if (poller_) {
+		stopping_ = true;
+		wake_event_.set_and_trigger(wake_);
+
+		while (poller_->state() != thread_states::terminated) {
+			poller_->state_changed_event().wait();
+		}
+	}
+
+	// Once the process has gone, nothing can use its address space, so the ring can be left where it is.
+	if (owner_.state() != process_state::terminated) {
+		region_->pinned = false;
+		owner_.addrspace().remove_region(region_->base, region_->size);
+	}
+}
+
+void io_ring_object::start()
+{
+	if (poll_) {
+		auto t = owner_.create_kernel_thread((u64)poll_thread_entry, this);
+		poller_ = t;
+		poller_->start();
+	}
+}
+
+void io_ring_object::poll_thread_entry(void *arg) { ((io_ring_object *)arg)->poll(); }
+
+operation_result io_ring_object::enter(u64 min_complete, u64 flags)
+{
+	io_ring_enter_flags enter_flags = (io_ring_enter_flags)flags;
+	bool wait = (enter_flags & io_ring_enter_flags::wait) == io_ring_enter_flags::wait;
+
+	u32 submitted = 0;
+	if (poll_) {
+		// The polling thread does the work, so just make sure it's awake.  Waiting for completions
+		// would never finish if it were asleep, so that wakes it up too.
+		if (wait || (enter_flags & io_ring_enter_flags::wakeup) == io_ring_enter_flags::wakeup) {
+			wake_event_.set_and_trigger(wake_);
+		}
+	} else {
+		submitted = drain();
+	}
+
+	if (wait) {
+		wait_for_completions(min(min_complete, (u64)cq_entries_));
+	}
+
+	return operation_result::ok(submitted);
+}
+
+/**
+ * Carries out submissions until the queue is empty, or there's no room left for their completions.
+ * Only one thread drains the ring at a time.  If another thread turns up in the meantime, the one
+ * already draining goes round again, so nothing submitted before a call to enter() is left behind.
+ */
+u32 io_ring_object::drain()
+{
+	if (!begin_drain()) {
+		return 0;
+	}
+
+	u32 submitted = 0;
+
+	do {
+		u32 head = header_->sq_head;
+
+		while (head != header_->sq_tail && completions_waiting() < cq_entries_) {
+			asm volatile("" ::: "memory");
+
+			// Take a copy of the entry, so that the process can't change it while it's being carried out.
+			io_ring_sqe sqe = sqes_[head & sq_mask_];
+			header_->sq_head = ++head;
+
+			operation_result r = execute(sqe);
+
+			u32 tail = header_->cq_tail;
+			io_ring_cqe &cqe = cqes_[tail & (cq_entries_ - 1)];
+			cqe.user_data = sqe.user_data;
+			cqe.code = to_result_code(r.code);
+			cqe.result = r.data;
+
+			// The entry has to be filled in before the process can see it.
+			asm volatile("" ::: "memory");
+			header_->cq_tail = tail + 1;
+
+			submitted++;
+			completion_event_.set_and_trigger(completed_);
+		}
+	} while (!end_drain());
+
+	// Anything waiting on a drain that has now finished needs to look again, even if this drain didn't
+	// complete anything.
+	completion_event_.set_and_trigger(completed_);
+
+	return submitted;
+}
+
+bool io_ring_object::begin_drain()
+{
+	unique_irq_lock l(lock_);
+
+	if (draining_) {
+		drain_pending_ = true;
+		return false;
+	}
+
+	draining_ = true;
+	return true;
+}
+
+bool io_ring_object::end_drain()
+{
+	unique_irq_lock l(lock_);
+
+	if (drain_pending_) {
+		drain_pending_ = false;
+		return false;
+	}
+
+	draining_ = false;
+	return true;
+}
+
+syscall_result_code io_ring_object::to_result_code(operation_result_code code)
+{
+	switch (code) {
+	case operation_result_code::ok:
+		return syscall_result_code::ok;
+	case operation_result_code::not_found:
+		return syscall_result_code::not_found;
+	default:
+		return syscall_result_code::not_supported;
+	}
+}
+
+operation_result io_ring_object::execute(const io_ring_sqe &sqe)
+{
+	if (sqe.op == io_ring_op::nop) {
+		return operation_result::ok();
+	}
+
+	auto o = object_manager::get().get_object(owner_, sqe.object);
+	if (!o) {
+		return operation_result { operation_result_code::not_found, 0 };
+	}
+
+	// The ring can't be used on itself, as the polling thread could then end up destroying it.
+	if (o.get() == this) {
+		return operation_result::not_supported();
+	}
+
+	switch (sqe.op) {
+	case io_ring_op::read:
+		return o->read((void *)sqe.buffer, sqe.length);
+	case io_ring_op::write:
+		return o->write((const void *)sqe.buffer, sqe.length);
+	case io_ring_op::pread:
+		return o->pread((void *)sqe.buffer, sqe.length, sqe.offset);
+	case io_ring_op::pwrite:
+		return o->pwrite((const void *)sqe.buffer, sqe.length, sqe.offset);
+	case io_ring_op::ioctl:
+		return o->ioctl(sqe.offset, (void *)sqe.buffer, sqe.length);
+	default:
+		return operation_result::not_supported();
+	}
+}
+
+void io_ring_object::wait_for_completions(u32 count)
+{
+	while (completions_waiting() < count) {
+		completed_ = false;
+
+		if (completions_waiting() >= count) {
+			break;
+		}
+
+		// Without a polling thread, completions only turn up while some other thread is draining the ring.
+		if (!poll_ && !draining_) {
+			break;
+		}
+
+		completion_event_.wait_unless(completed_);
+	}
+}
+
+void io_ring_object::poll()
+{
+	u32 idle = 0;
+
+	while (!stopping_ && owner_.state() != process_state::terminated) {
+		if (drain()) {
+			idle = 0;
+			continue;
+		}
+
+		if (++idle < poll_idle_spins) {
+			__relax();
+			continue;
+		}
+
+		// Nothing has turned up for a while, so go to sleep until the process asks to be woken up.  The
+		// flag has to be visible before the queue is checked for the last time, otherwise a submission
+		// could slip in between and never be noticed.
+		wake_ = false;
+		header_->status = header_->status | io_ring_status::need_wakeup;
+		asm volatile("mfence" ::: "memory");
+
+		if (!submissions_waiting()) {
+			wake_event_.wait_unless(wake_);
+		}
+
+		header_->status = header_->status & ~io_ring_status::need_wakeup;
+		idle = 0;
+	}
+}
@@ -0,0 +1,114 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#include <stacsos/kernel/arch/core.h>
+#include <stacsos/kernel/arch/x86/machine-context.h>
+#include <stacsos/kernel/debug.h>
+#include <stacsos/kernel/mem/memory-manager.h>
+#include <stacsos/kernel/mem/page-allocator.h>
+#include <stacsos/kernel/mem/page.h>
+#include <stacsos/kernel/profiler.h>
+#include <stacsos/kernel/seq-ring.h>
+
+using namespace stacsos;
+using namespace stacsos::kernel;
+using namespace stacsos::kernel::arch;
+using namespace stacsos::kernel::arch::x86;
+using namespace stacsos::kernel::mem;
+
+void profiler::init()
+{
+	u64 nr_pages = PAGE_ALIGN_UP(samples_per_core * sizeof(profile_sample)) >> PAGE_BITS;
+
+	for (auto *c : core_manager::get().cores()) {
+		page *pg = memory_manager::get().pgalloc().allocate_pages(log2_ceil(nr_pages), page_allocation_flags::zero);
+		if (!pg) {
+			panic("unable to allocate profile buffer");
+		}
+
+		buffers_[c->id()].samples = (profile_sample *)pg->base_address_ptr();
+	}
+
+	dprintf("profiler: %lu samples per core\n", samples_per_core);
+}
+
+void profiler::set_enabled(bool enabled)
+{
+	enabled_ = enabled;
+
+	// Tickless cores only re-arm their timers when they next schedule, so kick them to start ticking now.
+	// When the profiler is disabled, they go back to being tickless by themselves.
+	if (enabled) {
+		for (auto *c : core_manager::get().cores()) {
+			if (c->online() && c->tickless()) {
+				c->kick();
+			}
+		}
+	}
+}
+
+void profiler::take_sample(const void *mcontext)
+{
+	const machine_context *mc = (const machine_context *)mcontext;
+
+	int core = core::this_core_id();
+	per_core_buffer &b = buffers_[core];
+	if (!b.samples) {
+		return;
+	}
+
+	// Interrupts are disabled, and only this core writes to its buffer, so there's no need for the
+	// head to be bumped atomically.
+	u64 position = b.head;
+	profile_sample &s = seq_ring_begin_write(b.samples, samples_per_core, position);
+
+	s.core = core;
+	s.user = (mc->cs & 3) != 0;
+	s.pcs[0] = mc->rip;
+	s.depth = 1;
+
+	// Only kernel stacks are walked.  The walk stops if the chain leaves the kernel's address space, or
+	// stops going up the stack, so that a stray frame pointer can't send it too far.
+	if (!s.user) {
+		const u64 *frame = (const u64 *)mc->rbp;
+		u64 stack_top = mc->rbp + 0x10000;
+
+		while (s.depth < profile_max_depth && (u64)frame >= 0xffff'8000'0000'0000ull && (u64)frame < stack_top && !((u64)frame & 7) && frame[1]) {
+			s.pcs[s.depth++] = frame[1];
+
+			const u64 *next = (const u64 *)frame[0];
+			if (next <= frame) {
+				break;
+			}
+
+			frame = next;
+		}
+	}
+
+	seq_ring_end_write(s, position);
+
+	*(volatile u64 *)&b.head = position + 1;
+}
+
+bool profiler::read_sample(int core, u64 position, profile_sample &s) const
+{
+	const per_core_buffer &b = buffers_[core];
+	if (!b.samples) {
+		return false;
+	}
+
+	return seq_ring_read(b.samples, samples_per_core, position, s, [](const volatile profile_sample &slot, profile_sample &s) {
+		s.core = slot.core;
+		s.user = slot.user;
+		s.depth = slot.depth;
+		s.reserved = 0;
+
+		for (int i = 0; i < profile_max_depth; i++) {
+			s.pcs[i] = i < s.depth ? slot.pcs[i] : 0;
+		}
+	});
+}
@@ -0,0 +1,164 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#include <stacsos/kernel/arch/x86/x86-core.h>
+#include <stacsos/kernel/config.h>
+#include <stacsos/kernel/debug.h>
+#include <stacsos/kernel/sched/alg/cfs.h>
+#include <stacsos/kernel/sched/schedulable-entity.h>
+
+using namespace stacsos::kernel;
+using namespace stacsos::kernel::sched;
+using namespace stacsos::kernel::sched::alg;
+using namespace stacsos::kernel::arch::x86;
+
+// The weight of a task at nice level 0.  Virtual runtime advances at real time for such a task.
+#define NICE_0_WEIGHT 1024
+
+// Weights for nice levels -20 to 19.  Each step is roughly a 10% change in CPU share.
+static const u32 nice_to_weight[40] = {
+	/* -20 */ 88761, 71755, 56483, 46273, 36291,
+	/* -15 */ 29154, 23254, 18705, 14949, 11916,
+	/* -10 */ 9548, 7620, 6100, 4904, 3906,
+	/*  -5 */ 3121, 2501, 1991, 1586, 1277,
+	/*   0 */ 1024, 820, 655, 526, 423,
+	/*   5 */ 335, 272, 215, 172, 137,
+	/*  10 */ 110, 87, 70, 56, 45,
+	/*  15 */ 36, 29, 23, 18, 15,
+};
+
+static u64 task_weight(const tcb &t)
+{
+	int nice = t.nice;
+	if (nice < -20) {
+		nice = -20;
+	} else if (nice > 19) {
+		nice = 19;
+	}
+
+	return nice_to_weight[nice + 20];
+}
+
+completely_fair_scheduler::completely_fair_scheduler()
+	: current_(nullptr)
+	, min_vruntime_(0)
+	, min_granularity_us_(config::get().get_option_u64_or_default("sched-min-granularity", 3000))
+	, min_granularity_(0)
+{
+}
+
+u64 completely_fair_scheduler::granularity()
+{
+	// The timestamp counter is calibrated after the scheduling algorithm is created, so work out the
+	// granularity in TSC ticks on first use.
+	if (!min_granularity_) {
+		min_granularity_ = (x86_core::this_core().local_tsc().frequency() * min_granularity_us_) / 1000000ull;
+	}
+
+	return min_granularity_;
+}
+
+void completely_fair_scheduler::update_current(u64 now)
+{
+	if (!current_) {
+		return;
+	}
+
+	u64 delta = now - current_->exec_start;
+	current_->exec_start = now;
+
+	current_->vruntime += (delta * NICE_0_WEIGHT) / task_weight(*current_);
+}
+
+void completely_fair_scheduler::update_min_vruntime()
+{
+	// The minimum virtual runtime only ever moves forwards, and tracks the smallest virtual runtime
+	// of the runnable tasks.
+	tcb *leftmost = timeline_.first();
+	if (!leftmost) {
+		return;
+	}
+
+	u64 candidate = leftmost->vruntime;
+	if (current_ && (s64)(current_->vruntime - candidate) < 0) {
+		candidate = current_->vruntime;
+	}
+
+	if ((s64)(candidate - min_vruntime_) > 0) {
+		min_vruntime_ = candidate;
+	}
+}
+
+void completely_fair_scheduler::add_to_runqueue(tcb &tcb)
+{
+	// Whilst off the runqueue, a task's virtual runtime is held relative to the minimum virtual runtime
+	// of the runqueue it left, so that it can be placed fairly on this one -- which may belong to a
+	// different core.  A new task starts with zero, i.e. at the front of the queue.
+	tcb.vruntime += min_vruntime_;
+
+	timeline_.insert(tcb);
+}
+
+void completely_fair_scheduler::remove_from_runqueue(tcb &tcb)
+{
+	if (&tcb == current_) {
+		update_current(__builtin_ia32_rdtsc());
+		current_ = nullptr;
+	}
+
+	timeline_.remove(tcb);
+	update_min_vruntime();
+
+	tcb.vruntime = (s64)(tcb.vruntime - min_vruntime_) > 0 ? tcb.vruntime - min_vruntime_ : 0;
+}
+
+tcb *completely_fair_scheduler::select_next_task(tcb *current)
+{
+	u64 now = __builtin_ia32_rdtsc();
+
+	// Charge the running task for the time it has used, and move it to its new place on the timeline.
+	if (current_) {
+		u64 ran_for = now - current_->slice_start;
+
+		update_current(now);
+		timeline_.remove(*current_);
+		timeline_.insert(*current_);
+
+		// Let the running task carry on until it has had its minimum slice.
+		if (ran_for < granularity()) {
+			update_min_vruntime();
+			return current_;
+		}
+	}
+
+	update_min_vruntime();
+
+	// The chosen task starts a new slice, even if it's the one that was already running.
+	tcb *next = timeline_.first();
+	if (next) {
+		next->exec_start = now;
+		next->slice_start = now;
+	}
+
+	current_ = next;
+	return next;
+}
+
+u64 completely_fair_scheduler::slice_end(const tcb &current, u64 now, u64 tick_length) { return current.slice_start + granularity(); }
+
+tcb *completely_fair_scheduler::select_steal_candidate(const tcb *current, const tcb *previous)
+{
+	// Take from the right of the timeline: these tasks have had the most CPU time, and won't run
+	// here for a while.
+	for (tcb *candidate = timeline_.last(); candidate != nullptr; candidate = timeline_.prev(*candidate)) {
+		if (candidate != current && candidate != previous) {
+			return candidate;
+		}
+	}
+
+	return nullptr;
+}
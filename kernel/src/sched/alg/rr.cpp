@@ -5,18 +5,119 @@
  * Copyright (c) University of St Andrews 2024
  * Tom Spink <tcs6@st-andrews.ac.uk>
  */
+#include <stacsos/kernel/arch/x86/x86-core.h>
+#include <stacsos/kernel/config.h>
 #include <stacsos/kernel/sched/alg/rr.h>
+#include <stacsos/kernel/sched/schedulable-entity.h>
 
-// *** COURSEWORK NOTE *** //
-// This will be where you are implementing your round-robin scheduling algorithm.
-// Please edit this file in any way you see fit.  You may also edit the rr.h
-// header file.
-
+using namespace stacsos::kernel;
 using namespace stacsos::kernel::sched;
 using namespace stacsos::kernel::sched::alg;
+using namespace stacsos::kernel::arch;
+using namespace stacsos::kernel::arch::x86;
+
+round_robin::round_robin()
+	: head_(nullptr)
+	, tail_(nullptr)
+	, current_(nullptr)
+	, quantum_(config::get().get_option_u64_or_default("rr-quantum", 1))
+	, tick_length_(0)
+{
+	if (quantum_ == 0) {
+		quantum_ = 1;
+	}
+}
+
+u64 round_robin::tick_length()
+{
+	// The timestamp counter is calibrated after the scheduling algorithm is created, so work out the
+	// length of a tick on first use.
+	if (!tick_length_) {
+		tick_length_ = x86_core::this_core().local_tsc().frequency() / core::tick_frequency;
+	}
+
+	return tick_length_;
+}
+
+void round_robin::append(tcb &tcb)
+{
+	tcb.rq_next = nullptr;
+	tcb.rq_prev = tail_;
+
+	if (tail_) {
+		tail_->rq_next = &tcb;
+	} else {
+		head_ = &tcb;
+	}
+
+	tail_ = &tcb;
+}
+
+void round_robin::unlink(tcb &tcb)
+{
+	if (tcb.rq_prev) {
+		tcb.rq_prev->rq_next = tcb.rq_next;
+	} else {
+		head_ = tcb.rq_next;
+	}
+
+	if (tcb.rq_next) {
+		tcb.rq_next->rq_prev = tcb.rq_prev;
+	} else {
+		tail_ = tcb.rq_prev;
+	}
+
+	tcb.rq_next = nullptr;
+	tcb.rq_prev = nullptr;
+}
+
+void round_robin::add_to_runqueue(tcb &tcb) { append(tcb); }
+
+void round_robin::remove_from_runqueue(tcb &tcb)
+{
+	if (&tcb == current_) {
+		current_ = nullptr;
+	}
+
+	unlink(tcb);
+}
+
+tcb *round_robin::select_next_task(tcb *current)
+{
+	u64 now = __builtin_ia32_rdtsc();
+
+	// If the task we last picked is still on the runqueue, then its slice has been interrupted
+	// (a task that blocks is removed from the runqueue before it yields), so keep it running until its
+	// quantum is used up.  Allow half a tick of slack, so that a periodic tick arriving fractionally
+	// early still counts.
+	if (current_) {
+		if ((now - current_->slice_start) + (tick_length() / 2) < quantum_ * tick_length()) {
+			return current_;
+		}
+
+		// Out of time: send it to the back of the queue.
+		unlink(*current_);
+		append(*current_);
+	}
+
+	current_ = head_;
+	if (current_) {
+		current_->slice_start = now;
+	}
+
+	return current_;
+}
 
-void round_robin::add_to_runqueue(tcb &tcb) { panic("TODO"); }
+u64 round_robin::slice_end(const tcb &current, u64 now, u64 tick_length) { return current.slice_start + (quantum_ * tick_length); }
 
-void round_robin::remove_from_runqueue(tcb &tcb) { panic("TODO"); }
+tcb *round_robin::select_steal_candidate(const tcb *current, const tcb *previous)
+{
+	// Take from the back of the queue -- these are the tasks that would wait longest here.
+	for (tcb *candidate = tail_; candidate != nullptr; candidate = candidate->rq_prev) {
+		if (candidate != current && candidate != previous) {
+			return candidate;
+		}
+	}
 
-tcb *round_robin::select_next_task(tcb *current) { panic("TODO"); }
+	return nullptr;
+}
@@ -34,3 +34,24 @@ tcb *simple_fair_scheduler::select_next_task(tcb *current)
 
 	return candidate;
 }
+
+tcb *simple_fair_scheduler::select_steal_candidate(const tcb *current, const tcb *previous)
+{
+	// Prefer the task that has had the most CPU time -- it's the one least likely to be
+	// chosen to run here any time soon.
+	u64 max_runtime = 0;
+	tcb *candidate = nullptr;
+
+	for (auto *thread : runqueue_) {
+		if (thread == current || thread == previous) {
+			continue;
+		}
+
+		if (candidate == nullptr || (thread->run_time > max_runtime)) {
+			max_runtime = thread->run_time;
+			candidate = thread;
+		}
+	}
+
+	return candidate;
+}
@@ -0,0 +1,117 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#include <stacsos/kernel/arch/core-manager.h>
+#include <stacsos/kernel/arch/core.h>
+#include <stacsos/kernel/arch/x86/x86-core.h>
+#include <stacsos/kernel/debug.h>
+#include <stacsos/kernel/dev/misc/rtc.h>
+#include <stacsos/kernel/mem/address-space.h>
+#include <stacsos/kernel/mem/memory-manager.h>
+#include <stacsos/kernel/mem/page.h>
+#include <stacsos/kernel/sched/clock-page.h>
+#include <stacsos/kernel/sched/process.h>
+#include <stacsos/kernel/sched/sleeper.h>
+#include <stacsos/kernel/sched/thread.h>
+
+using namespace stacsos;
+using namespace stacsos::kernel::sched;
+using namespace stacsos::kernel::mem;
+using namespace stacsos::kernel::arch;
+using namespace stacsos::kernel::arch::x86;
+using namespace stacsos::kernel::dev::misc;
+
+clock_page_data &clock_page::data() const { return *(clock_page_data *)page_->base_address_ptr(); }
+
+void clock_page::init(rtc &rtc)
+{
+	page_ = memory_manager::get().pgalloc().allocate_pages(0, page_allocation_flags::zero);
+	if (!page_) {
+		panic("unable to allocate clock page");
+	}
+
+	rtc_ = &rtc;
+
+	u64 frequency = ((x86_core &)core::this_core()).local_tsc().frequency();
+
+	auto &d = data();
+	d.tsc_frequency = frequency;
+	d.ns_mult = (1'000'000'000ull << 32) / frequency;
+	d.boot_tsc = __builtin_ia32_rdtsc();
+	d.nr_cores = core_manager::get().nr_cores();
+
+	synchronise();
+
+	rtc_timepoint tp = rtc.read_timepoint();
+	dprintf("clock: wall clock %04u-%02u-%02u %02u:%02u:%02u\n", tp.year, tp.month, tp.day_of_month, tp.hours, tp.minutes, tp.seconds);
+
+	thread::current().owner().create_kernel_thread((u64)resync_thread, nullptr)->start();
+}
+
+void clock_page::resync_thread(void *arg)
+{
+	while (true) {
+		sleeper::get().sleep_ms(resync_interval_ms);
+		clock_page::get().synchronise(true);
+	}
+}
+
+void clock_page::synchronise(bool wait_for_tick)
+{
+	rtc_timepoint tp = rtc_->read_timepoint();
+
+	if (wait_for_tick) {
+		u16 seconds = tp.seconds;
+		while (tp.seconds == seconds) {
+			sleeper::get().sleep_ms(5);
+			tp = rtc_->read_timepoint();
+		}
+	}
+
+	u64 now = unix_time(tp.year, tp.month, tp.day_of_month, tp.hours, tp.minutes, tp.seconds) * 1'000'000'000ull;
+	u64 tsc = __builtin_ia32_rdtsc();
+
+	unique_irq_lock l(lock_);
+	auto &d = data();
+
+	// The sequence count is odd while the fields are being changed.
+	u32 sequence = d.sequence;
+	d.sequence = sequence + 1;
+	asm volatile("" ::: "memory");
+
+	d.wall_clock_ns = now;
+	d.wall_clock_tsc = tsc;
+
+	asm volatile("" ::: "memory");
+	d.sequence = sequence + 2;
+}
+
+void clock_page::map_into(address_space &as)
+{
+	if (!page_) {
+		return;
+	}
+
+	as.pgtable().map(memory_manager::get().ptalloc(), clock_page_address, page_->base_address(),
+		mapping_flags::present | mapping_flags::user_accessable | mapping_flags::no_execute, mapping_size::m4k);
+}
+
+/**
+ * Converts a (proleptic Gregorian) date and time to the number of seconds since the Unix epoch.
+ */
+u64 clock_page::unix_time(u16 year, u16 month, u16 day, u16 hours, u16 minutes, u16 seconds)
+{
+	// Count years from March, so that the leap day comes at the end of the year.
+	u64 y = year - (month <= 2 ? 1 : 0);
+	u64 era = y / 400;
+	u64 year_of_era = y - (era * 400);
+	u64 day_of_year = ((153 * (month > 2 ? month - 3 : month + 9)) + 2) / 5 + day - 1;
+	u64 day_of_era = (year_of_era * 365) + (year_of_era / 4) - (year_of_era / 100) + day_of_year;
+	u64 days = (era * 146097) + day_of_era - 719468;
+
+	return (days * 86400) + (hours * 3600) + (minutes * 60) + seconds;
+}
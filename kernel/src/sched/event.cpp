@@ -17,8 +17,14 @@ void event::wait()
 
 	thread *ct = &thread::current();
 
-	wait_list_.append(ct);
-	ct->suspend();
+	{
+		// Suspend before going on the wait list, so that a trigger from another core can't slip
+		// in between and have its wake-up lost.
+		unique_irq_lock l(lock_);
+
+		ct->suspend();
+		wait_list_.append(ct);
+	}
 
 	asm volatile("int $0xff");
 }
@@ -27,6 +33,39 @@ void event::trigger()
 {
 	// dprintf("event %p trigger\n", this);
 
+	unique_irq_lock l(lock_);
+
+	for (auto thread : wait_list_) {
+		thread->resume();
+	}
+
+	wait_list_.clear();
+}
+
+void event::wait_unless(const volatile bool &flag)
+{
+	thread *ct = &thread::current();
+
+	{
+		unique_irq_lock l(lock_);
+
+		if (flag) {
+			return;
+		}
+
+		ct->suspend();
+		wait_list_.append(ct);
+	}
+
+	asm volatile("int $0xff");
+}
+
+void event::set_and_trigger(volatile bool &flag)
+{
+	unique_irq_lock l(lock_);
+
+	flag = true;
+
 	for (auto thread : wait_list_) {
 		thread->resume();
 	}
@@ -0,0 +1,129 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#include <stacsos/kernel/sched/futex.h>
+#include <stacsos/kernel/sched/process.h>
+#include <stacsos/kernel/sched/thread.h>
+#include <stacsos/lru-list.h>
+
+using namespace stacsos::kernel::sched;
+
+futex_bucket &futex_table::bucket_for(const process &owner, u64 address)
+{
+	return buckets_[hash_mix((address >> 2) ^ (u64)&owner) >> (64 - bucket_bits)];
+}
+
+bool futex_table::wait(process &owner, u64 address, u32 expected)
+{
+	volatile const u32 *word = (volatile const u32 *)address;
+
+	// Read the word before taking the lock, so that if the page isn't there yet, it is faulted in
+	// here rather than with the lock held.  This also saves taking the lock if it has changed already.
+	if (*word != expected) {
+		return false;
+	}
+
+	thread *ct = &thread::current();
+
+	futex_waiter &w = ct->futex_record();
+	w.thr = ct;
+	w.owner = &owner;
+	w.address = address;
+
+	futex_bucket &b = bucket_for(owner, address);
+
+	{
+		unique_irq_lock l(b.lock);
+
+		// If the thread has been stopped on the way in, cancel() may already have been and gone, so it
+		// mustn't go on the list.
+		if (*word != expected || ct->state() == thread_states::terminated) {
+			return false;
+		}
+
+		// Suspend before going on the list, in the same way as an event, so that a wake from another
+		// core can't be lost.
+		ct->suspend();
+
+		w.prev = nullptr;
+		w.next = b.waiters;
+		if (b.waiters) {
+			b.waiters->prev = &w;
+		}
+		b.waiters = &w;
+		w.bucket = &b;
+	}
+
+	asm volatile("int $0xff");
+	return true;
+}
+
+u64 futex_table::wake(process &owner, u64 address, u64 count)
+{
+	futex_bucket &b = bucket_for(owner, address);
+	u64 woken = 0;
+
+	unique_irq_lock l(b.lock);
+
+	// Waiters are pushed on to the front of the list, so walk to the back, and wake the longest waiting
+	// threads first.
+	futex_waiter *w = b.waiters;
+	while (w && w->next) {
+		w = w->next;
+	}
+
+	while (w && woken < count) {
+		futex_waiter *prev = w->prev;
+
+		if (w->owner == &owner && w->address == address) {
+			unlink(b, *w);
+
+			// The thread may have been stopped (along with its process) while it was waiting.
+			if (w->thr->state() == thread_states::suspended) {
+				w->thr->resume();
+				woken++;
+			}
+		}
+
+		w = prev;
+	}
+
+	return woken;
+}
+
+void futex_table::cancel(thread &t)
+{
+	futex_waiter &w = t.futex_record();
+
+	// The bucket can only change with its lock held, so check again once it's taken.
+	futex_bucket *b = w.bucket;
+	if (!b) {
+		return;
+	}
+
+	unique_irq_lock l(b->lock);
+
+	if (w.bucket == b) {
+		unlink(*b, w);
+	}
+}
+
+void futex_table::unlink(futex_bucket &b, futex_waiter &w)
+{
+	if (w.prev) {
+		w.prev->next = w.next;
+	} else {
+		b.waiters = w.next;
+	}
+
+	if (w.next) {
+		w.next->prev = w.prev;
+	}
+
+	w.next = w.prev = nullptr;
+	w.bucket = nullptr;
+}
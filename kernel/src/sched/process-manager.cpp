@@ -12,6 +12,7 @@
 #include <stacsos/kernel/fs/file.h>
 #include <stacsos/kernel/fs/vfs.h>
 #include <stacsos/kernel/mem/address-space.h>
+#include <stacsos/kernel/sched/clock-page.h>
 #include <stacsos/kernel/sched/process-manager.h>
 #include <stacsos/kernel/sched/thread.h>
 
@@ -22,6 +23,26 @@ using namespace stacsos::kernel::arch;
 
 void process_manager::init() { dprintf("processes: init\n"); }
 
+static region_flags segment_region_flags(elf_program_header_flags flags)
+{
+	u32 pf = (u32)flags;
+	region_flags rf = region_flags::inaccessible;
+
+	if (pf & (u32)elf_program_header_flags::pf_r) {
+		rf = rf | region_flags::readable;
+	}
+
+	if (pf & (u32)elf_program_header_flags::pf_w) {
+		rf = rf | region_flags::writable;
+	}
+
+	if (pf & (u32)elf_program_header_flags::pf_x) {
+		rf = rf | region_flags::executable;
+	}
+
+	return rf;
+}
+
 shared_ptr<process> process_manager::create_kernel_process(continuation_fn cfn)
 {
 	auto kp = new process(exec_privilege::kernel);
@@ -33,9 +54,9 @@ shared_ptr<process> process_manager::create_kernel_process(continuation_fn cfn)
 	return kpp;
 }
 
-shared_ptr<process> process_manager::create_process(const char *path, const char *args)
+shared_ptr<process> process_manager::create_process(const char *path, const char *args, process *parent)
 {
-	auto *binary = stacsos::kernel::fs::vfs::get().lookup(path);
+	auto *binary = stacsos::kernel::fs::vfs::get().lookup(path, parent ? parent->cwd() : nullptr);
 	if (!binary) {
 		dprintf("pm: binary '%s' not found\n", path);
 		return nullptr;
@@ -68,6 +89,11 @@ shared_ptr<process> process_manager::create_process(const char *path, const char
 	// create main thread
 
 	auto proc = new process(exec_privilege::user);
+	if (parent) {
+		proc->set_cwd(parent->cwd(), parent->cwd_path());
+	}
+
+	clock_page::get().map_into(proc->addrspace());
 
 	char *program_headers = new char[ehdr->e_phnum * ehdr->e_phentsize];
 	file->pread(program_headers, ehdr->e_phoff, ehdr->e_phnum * ehdr->e_phentsize);
@@ -83,15 +109,28 @@ shared_ptr<process> process_manager::create_process(const char *path, const char
 			u64 vaddr_page_offset = phdr->p_vaddr & ~PAGE_MASK;
 			u64 size = (phdr->p_memsz + vaddr_page_offset + (PAGE_SIZE - 1)) & PAGE_MASK;
 
-			auto rgn = proc->addrspace().add_region(vaddr_page, size, region_flags::all, true);
+			auto rgn = proc->addrspace().add_region(vaddr_page, size, segment_region_flags(phdr->p_flags), false);
 			if (!rgn) {
 				panic("unable to add region for segment");
 			}
 
-			// rgn->storage
-			void *target = (char *)rgn->storage->base_address_ptr() + vaddr_page_offset;
-			// dprintf("copy to %p\n", target);
-			file->pread(target, phdr->p_offset, phdr->p_filesz);
+			// The segment is read in from the binary a page at a time, as it's touched.
+			rgn->file = file;
+
+			// Read-only segments are mapped straight from the page cache, so that every process running
+			// the binary shares them.  This needs the segment to start at the same place in a page in the
+			// file as in memory.
+			bool writable = !!((u32)phdr->p_flags & (u32)elf_program_header_flags::pf_w);
+			if (file->identity().owner && !writable && phdr->p_filesz == phdr->p_memsz && (phdr->p_offset & ~PAGE_MASK) == vaddr_page_offset) {
+				rgn->file_offset = phdr->p_offset & PAGE_MASK;
+				rgn->file_start = 0;
+				rgn->file_size = phdr->p_filesz + vaddr_page_offset;
+				rgn->cached = true;
+			} else {
+				rgn->file_offset = phdr->p_offset;
+				rgn->file_start = vaddr_page_offset;
+				rgn->file_size = phdr->p_filesz;
+			}
 		}
 	}
 
@@ -23,7 +23,7 @@ shared_ptr<thread> process::create_thread(u64 entry_point, void *entry_arg)
 		next_user_stack_ += stack_size + 0x1000; // Allocate the stack size, but plus a "guard page".
 
 		user_stack = stack_base + stack_size;
-		addrspace().add_region(stack_base, stack_size, region_flags::readwrite, true);
+		addrspace().add_region(stack_base, stack_size, region_flags::readwrite, false);
 	}
 
 	shared_ptr<thread> t = shared_ptr(new thread(*this, entry_point, entry_arg, user_stack));
@@ -32,6 +32,14 @@ shared_ptr<thread> process::create_thread(u64 entry_point, void *entry_arg)
 	return t;
 }
 
+shared_ptr<thread> process::create_kernel_thread(u64 entry_point, void *entry_arg)
+{
+	shared_ptr<thread> t = shared_ptr(new thread(*this, exec_privilege::kernel, entry_point, entry_arg, 0));
+	threads_.append(t);
+
+	return t;
+}
+
 void process::start()
 {
 	for (auto &t : threads_) {
@@ -65,4 +73,7 @@ void process::on_thread_stopped(thread &thread)
 	dprintf("process terminated\n");
 	state_ = process_state::terminated;
 	state_changed_event_.trigger();
+
+	// Nothing is left to use the process's handles, so close them.
+	handles_.clear();
 }
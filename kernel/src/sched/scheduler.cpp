@@ -13,8 +13,46 @@
 using namespace stacsos::kernel::sched;
 using namespace stacsos::kernel::arch;
 
-// TODO: support multicore.
+void scheduler::add_to_schedule(schedulable_entity &e)
+{
+	// Entities stay with the core they last ran on (which, importantly, may be the core that is
+	// still executing on their stack).  Only brand new entities are placed, and they go to the
+	// least loaded core.  Idle cores will steal work to even things out later.
+	while (true) {
+		core *target = e.owning_core();
+		if (target == nullptr) {
+			target = &select_core();
+		}
 
-void scheduler::add_to_schedule(schedulable_entity &e) { core_manager::get().get_core(0).add_to_runqueue(*e.get_tcb()); }
+		if (target->add_to_runqueue(*e.get_tcb())) {
+			return;
+		}
+	}
+}
 
-void scheduler::remove_from_schedule(schedulable_entity &e) { core_manager::get().get_core(0).remove_from_runqueue(*e.get_tcb()); }
+void scheduler::remove_from_schedule(schedulable_entity &e)
+{
+	while (true) {
+		core *owner = e.owning_core();
+		if (owner == nullptr) {
+			return;
+		}
+
+		if (owner->remove_from_runqueue(*e.get_tcb())) {
+			return;
+		}
+	}
+}
+
+core &scheduler::select_core()
+{
+	core *best = &core::this_core();
+
+	for (auto *c : core_manager::get().cores()) {
+		if (c->online() && c->nr_runnable() < best->nr_runnable()) {
+			best = c;
+		}
+	}
+
+	return *best;
+}
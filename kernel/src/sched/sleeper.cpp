@@ -5,6 +5,7 @@
  * Copyright (c) University of St Andrews 2024
  * Tom Spink <tcs6@st-andrews.ac.uk>
  */
+#include <stacsos/kernel/arch/core-manager.h>
 #include <stacsos/kernel/arch/x86/tsc.h>
 #include <stacsos/kernel/arch/x86/x86-core.h>
 #include <stacsos/kernel/debug.h>
@@ -12,6 +13,7 @@
 #include <stacsos/kernel/sched/thread.h>
 
 using namespace stacsos::kernel::sched;
+using namespace stacsos::kernel::arch;
 using namespace stacsos::kernel::arch::x86;
 
 void sleeper::sleep_ms(u64 duration_ms)
@@ -25,31 +27,54 @@ void sleeper::sleep_ms(u64 duration_ms)
 void sleeper::do_sleep(u64 wakeup_deadline)
 {
 	thread *ct = &thread::current();
-	ct->suspend();
 
-	sleeping_thread *st = new sleeping_thread { ct, wakeup_deadline };
-	sleeping_.append(st);
+	sleeping_thread &st = ct->sleep_record();
+	st.thr = ct;
+	st.wakeup_deadline = wakeup_deadline;
+
+	{
+		unique_irq_lock l(lock_);
+
+		ct->suspend();
+		sleeping_.insert(st);
+		update_next_deadline();
+
+		// A tickless boot core only arms its timer for the deadline it knew about, so it needs to be
+		// told if this one is earlier.  If we are the boot core, the yield below takes care of that.
+		auto &boot_core = core_manager::get().get_boot_core();
+		if (boot_core.tickless() && sleeping_.first() == &st && &boot_core != &core::this_core()) {
+			boot_core.kick();
+		}
+	}
 
 	// dprintf("sleeper: sleeping %p deadline=%lu\n", ct, wakeup_deadline);
 
 	asm volatile("int $0xff");
 }
 
+void sleeper::update_next_deadline()
+{
+	sleeping_thread *first = sleeping_.first();
+	next_deadline_ = first ? first->wakeup_deadline : ~0ull;
+}
+
 void sleeper::check_wakeup()
 {
 	u64 ref_time = x86_core::this_core().local_tsc().read();
 
-	// TODO: some kind of priority queue
-	list<sleeping_thread *> resumed;
-	for (auto sleeping : sleeping_) {
-		if (ref_time > sleeping->wakeup_deadline) {
-			// dprintf("sleeper: waking %p\n", sleeping->thr);
-			sleeping->thr->resume();
-			resumed.append(sleeping);
-		}
+	// The common case: the earliest sleeper isn't due yet.
+	if (ref_time < next_deadline()) {
+		return;
 	}
 
-	for (auto resume : resumed) {
-		sleeping_.remove(resume);
+	unique_irq_lock l(lock_);
+
+	sleeping_thread *sleeping;
+	while ((sleeping = sleeping_.first()) != nullptr && ref_time >= sleeping->wakeup_deadline) {
+		// dprintf("sleeper: waking %p\n", sleeping->thr);
+		sleeping_.remove(*sleeping);
+		sleeping->thr->resume();
 	}
+
+	update_next_deadline();
 }
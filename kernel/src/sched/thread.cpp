@@ -18,12 +18,19 @@ using namespace stacsos::kernel::mem;
 using stacsos::kernel::arch::x86::machine_context;
 
 thread::thread(process &owner, u64 ep, void *ep_arg, u64 user_stack)
+	: thread(owner, owner.privilege(), ep, ep_arg, user_stack)
+{
+}
+
+thread::thread(process &owner, exec_privilege priv, u64 ep, void *ep_arg, u64 user_stack)
 	: owner_(owner)
+	, priv_(priv)
 	, ep_(ep)
 	, arg_(ep_arg)
 	, state_(thread_states::created)
 	, kernel_stack_(nullptr)
 	, user_stack_(user_stack)
+	, futex_record_ {}
 {
 	init_tcb();
 	change_state(thread_states::created);
@@ -43,6 +50,10 @@ void thread::start() { change_state(thread_states::runnable); }
 void thread::stop()
 {
 	change_state(thread_states::terminated);
+
+	// A thread stopped while waiting on a futex would otherwise stay on its list for good.
+	futex_table::get().cancel(*this);
+
 	owner_.on_thread_stopped(*this);
 }
 void thread::suspend() { change_state(thread_states::suspended); }
@@ -77,7 +88,7 @@ void thread::init_tcb()
 
 	// Fill in the required values for starting this task in the initial context.
 
-	if (owner_.privilege() == exec_privilege::kernel) {
+	if (priv_ == exec_privilege::kernel) {
 		tcb_.mcontext->cs = KERNEL_CODE_SEGMENT_SELECTOR;
 		tcb_.mcontext->ss = KERNEL_DATA_SEGMENT_SELECTOR;
 	} else {
@@ -87,7 +98,7 @@ void thread::init_tcb()
 
 	tcb_.mcontext->rflags = 0x202; // RSVD | IF
 
-	if (owner_.privilege() == exec_privilege::kernel) {
+	if (priv_ == exec_privilege::kernel) {
 		tcb_.mcontext->rip = (u64)task_entry_trampoline; // The actual entry point for a kernel task is the
 														 // trampoline.  This is so that tasks entry points can return, and
 														 // they won't return into "nothing", instead we'll take control back
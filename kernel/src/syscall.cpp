@@ -13,12 +13,15 @@
 #include <stacsos/kernel/fs/fs-node.h>
 #include <stacsos/kernel/fs/tar-filesystem.h>
 #include <stacsos/kernel/mem/address-space.h>
+#include <stacsos/memory-map.h>
 #include <stacsos/kernel/obj/object-manager.h>
 #include <stacsos/kernel/obj/object.h>
+#include <stacsos/kernel/sched/futex.h>
 #include <stacsos/kernel/sched/process-manager.h>
 #include <stacsos/kernel/sched/process.h>
 #include <stacsos/kernel/sched/sleeper.h>
 #include <stacsos/kernel/sched/thread.h>
+#include <stacsos/kernel/trace.h>
 #include <stacsos/syscalls.h>
 #include <stacsos/string.h>
 #include <stacsos/list.h>
@@ -34,7 +37,7 @@ using namespace stacsos::kernel::arch::x86;
 
 static syscall_result do_open(process &owner, const char *path)
 {
-	auto node = vfs::get().lookup(path);
+	auto node = vfs::get().lookup(path, owner.cwd());
 	if (node == nullptr) {
 		return syscall_result { syscall_result_code::not_found, 0 };
 	}
@@ -62,22 +65,22 @@ static syscall_result do_open(process &owner, const char *path)
  * @return syscall_result 
  */
 static syscall_result listdir_(process &owner, list<string> *names, list<u64> *sizes, list<fs_node_kind> *kinds, const char* path, bool is_l, bool is_a, bool is_U) {
-	tarfs_node* node = (tarfs_node*)vfs::get().lookup(path);
+	fs_node *node = vfs::get().lookup(path, owner.cwd());
 	if (node != nullptr) {
-		int number_of_children = node->get_num_children();
-
-		/* Since STACSOS has no concept of the current directory (as per the specification) it seemed appropriate not to include the implied ./ & ../ */
-		for (int i = 1; i < number_of_children; i++) {
-			fs_node* fs_node = node->get_child_fsnode(i);
-
-			stacsos::string name = fs_node->name();
-			(*names).append(name);
-
-			fs_node_kind type = fs_node->kind();
-			(*kinds).append(type);
-	
-			u64 size = node->get_child_size(i);
-			(*sizes).append(size);
+		list<fs_node *> children;
+		node->list_children(children);
+
+		// The path is looked up relative to the process's current directory.  The lookup understands "."
+		// and "..", but the filesystems don't store them, so they aren't listed.
+		for (fs_node *child : children) {
+			// Directory entries in a tar archive show up as an unnamed child of the directory.
+			if (child->name().length() == 0) {
+				continue;
+			}
+
+			(*names).append(child->name());
+			(*kinds).append(child->kind());
+			(*sizes).append(child->size());
 		}
 		
 		//Creates a directory.h object and created a shared ptr which allows the object to be accessed in user space via object manager.
@@ -90,156 +93,437 @@ static syscall_result listdir_(process &owner, list<string> *names, list<u64> *s
 	return syscall_result { syscall_result_code::not_found, 0 };
 }
 
-static syscall_result operation_result_to_syscall_result(operation_result &&o)
+static syscall_result do_chdir(process &owner, const char *path)
 {
-	syscall_result_code rc = (syscall_result_code)o.code;
-	return syscall_result { rc, o.data };
+	// The path is worked out by name, so that ".." always undoes the step that got here, even across a
+	// mount.
+	char new_path[256];
+	if (!vfs::canonicalise_path(owner.cwd_path().c_str(), path, new_path, sizeof(new_path))) {
+		return syscall_result { syscall_result_code::not_supported, 0 };
+	}
+
+	auto node = vfs::get().lookup(new_path);
+	if (node == nullptr) {
+		return syscall_result { syscall_result_code::not_found, 0 };
+	}
+
+	if (node->kind() != fs_node_kind::directory) {
+		return syscall_result { syscall_result_code::not_supported, 0 };
+	}
+
+	owner.set_cwd(node, new_path);
+	return syscall_result { syscall_result_code::ok, 0 };
 }
 
-extern "C" syscall_result handle_syscall(syscall_numbers index, u64 arg0, u64 arg1, u64 arg2, u64 arg3)
+static syscall_result do_getcwd(process &owner, char *buffer, size_t size)
 {
-	auto &current_thread = thread::current();
-	auto &current_process = current_thread.owner();
+	const string &path = owner.cwd_path();
+	if (path.length() + 1 > size) {
+		return syscall_result { syscall_result_code::not_supported, path.length() + 1 };
+	}
 
-	// dprintf("SYSCALL: %u %x %x %x %x\n", index, arg0, arg1, arg2, arg3);
+	memops::memcpy(buffer, path.c_str(), path.length() + 1);
+	return syscall_result { syscall_result_code::ok, path.length() };
+}
 
-	switch (index) {
-	case syscall_numbers::exit:
-		current_process.stop();
-		return syscall_result { syscall_result_code::ok, 0 };
+static syscall_result do_mmap(process &owner, u64 object_id, u64 offset, u64 length, memory_map_flags flags)
+{
+	auto o = object_manager::get().get_object(owner, object_id);
+	if (!o) {
+		return syscall_result { syscall_result_code::not_found, 0 };
+	}
 
-	case syscall_numbers::set_fs:
-		stacsos::kernel::arch::x86::fsbase::write(arg0);
-		return syscall_result { syscall_result_code::ok, 0 };
+	auto file = o->mappable_file();
+	if (!file) {
+		return syscall_result { syscall_result_code::not_supported, 0 };
+	}
 
-	case syscall_numbers::set_gs:
-		stacsos::kernel::arch::x86::gsbase::write(arg0);
-		return syscall_result { syscall_result_code::ok, 0 };
+	region_flags rf = region_flags::readable;
+	if ((flags & memory_map_flags::writable) == memory_map_flags::writable) {
+		rf |= region_flags::writable;
+	}
 
-	case syscall_numbers::open:
-		return do_open(current_process, (const char *)arg0);
+	if ((flags & memory_map_flags::executable) == memory_map_flags::executable) {
+		rf |= region_flags::executable;
+	}
 
-	case syscall_numbers::close:
-		object_manager::get().free_object(current_process, arg0);
-		return syscall_result { syscall_result_code::ok, 0 };
+	auto rgn = owner.addrspace().map_file(file, offset, length, rf, (flags & memory_map_flags::shared) == memory_map_flags::shared);
+	if (!rgn) {
+		return syscall_result { syscall_result_code::not_supported, 0 };
+	}
 
-	case syscall_numbers::write: {
-		auto o = object_manager::get().get_object(current_process, arg0);
-		if (!o) {
-			return syscall_result { syscall_result_code::not_found, 0 };
-		}
+	return syscall_result { syscall_result_code::ok, rgn->base };
+}
 
-		return operation_result_to_syscall_result(o->write((const void *)arg1, arg2));
+static syscall_result do_io_ring_setup(process &owner, u64 entries, io_ring_setup_flags flags, u64 *base)
+{
+	if (entries > io_ring_max_entries) {
+		return syscall_result { syscall_result_code::not_supported, 0 };
 	}
 
-	case syscall_numbers::pwrite: {
-		auto o = object_manager::get().get_object(current_process, arg0);
-		if (!o) {
-			return syscall_result { syscall_result_code::not_found, 0 };
-		}
+	u64 ring_base;
+	auto ring = object_manager::get().create_io_ring_object(owner, entries, flags, ring_base);
+	if (!ring) {
+		return syscall_result { syscall_result_code::not_supported, 0 };
+	}
+
+	*base = ring_base;
+	return syscall_result { syscall_result_code::ok, ring->id() };
+}
 
-		return operation_result_to_syscall_result(o->pwrite((const void *)arg1, arg2, arg3));
+/**
+ * Futex words must be aligned, and must be in memory the process has mapped, because the kernel reads
+ * them directly.
+ */
+static bool valid_futex_address(process &owner, u64 address)
+{
+	if (address & 3) {
+		return false;
 	}
 
-	case syscall_numbers::read: {
-		auto o = object_manager::get().get_object(current_process, arg0);
-		if (!o) {
-			return syscall_result { syscall_result_code::not_found, 0 };
-		}
+	return owner.addrspace().get_region_from_address(address) != nullptr;
+}
 
-		return operation_result_to_syscall_result(o->read((void *)arg1, arg2));
+static syscall_result do_futex_wait(process &owner, u64 address, u32 expected)
+{
+	if (!valid_futex_address(owner, address)) {
+		return syscall_result { syscall_result_code::not_supported, 0 };
 	}
 
-	case syscall_numbers::pread: {
-		auto o = object_manager::get().get_object(current_process, arg0);
-		if (!o) {
-			return syscall_result { syscall_result_code::not_found, 0 };
-		}
+	if (!futex_table::get().wait(owner, address, expected)) {
+		return syscall_result { syscall_result_code::would_block, 0 };
+	}
+
+	return syscall_result { syscall_result_code::ok, 0 };
+}
 
-		return operation_result_to_syscall_result(o->pread((void *)arg1, arg2, arg3));
+static syscall_result do_futex_wake(process &owner, u64 address, u64 count)
+{
+	if (!valid_futex_address(owner, address)) {
+		return syscall_result { syscall_result_code::not_supported, 0 };
 	}
 
-	case syscall_numbers::ioctl: {
-		auto o = object_manager::get().get_object(current_process, arg0);
-		if (!o) {
-			return syscall_result { syscall_result_code::not_found, 0 };
-		}
+	return syscall_result { syscall_result_code::ok, futex_table::get().wake(owner, address, count) };
+}
+
+static syscall_result operation_result_to_syscall_result(operation_result &&o)
+{
+	syscall_result_code rc = (syscall_result_code)o.code;
+	return syscall_result { rc, o.data };
+}
+
+/*
+ * Each system call has a handler, which is given all four arguments, whether it uses them or not.
+ * Handlers look up the current thread or process themselves, so that system calls that need neither
+ * don't pay for it.
+ */
+typedef syscall_result (*syscall_handler)(u64 arg0, u64 arg1, u64 arg2, u64 arg3);
+
+static syscall_result sys_exit(u64, u64, u64, u64)
+{
+	thread::current().owner().stop();
+	return syscall_result { syscall_result_code::ok, 0 };
+}
+
+static syscall_result sys_set_fs(u64 arg0, u64, u64, u64)
+{
+	fsbase::write(arg0);
+	return syscall_result { syscall_result_code::ok, 0 };
+}
 
-		return operation_result_to_syscall_result(o->ioctl(arg1, (void *)arg2, arg3));
+static syscall_result sys_set_gs(u64 arg0, u64, u64, u64)
+{
+	gsbase::write(arg0);
+	return syscall_result { syscall_result_code::ok, 0 };
+}
+
+static syscall_result sys_open(u64 arg0, u64, u64, u64) { return do_open(thread::current().owner(), (const char *)arg0); }
+
+static syscall_result sys_close(u64 arg0, u64, u64, u64)
+{
+	if (!object_manager::get().free_object(thread::current().owner(), arg0)) {
+		return syscall_result { syscall_result_code::not_found, 0 };
 	}
 
-	case syscall_numbers::alloc_mem: {
-		auto rgn = current_thread.owner().addrspace().alloc_region(PAGE_ALIGN_UP(arg0), region_flags::readwrite, true);
+	return syscall_result { syscall_result_code::ok, 0 };
+}
 
-		return syscall_result { syscall_result_code::ok, rgn->base };
+static syscall_result sys_write(u64 arg0, u64 arg1, u64 arg2, u64)
+{
+	auto o = object_manager::get().get_object(thread::current().owner(), arg0);
+	if (!o) {
+		return syscall_result { syscall_result_code::not_found, 0 };
 	}
 
-	case syscall_numbers::start_process: {
-		dprintf("start process: %s %s\n", arg0, arg1);
+	return operation_result_to_syscall_result(o->write((const void *)arg1, arg2));
+}
 
-		auto new_proc = process_manager::get().create_process((const char *)arg0, (const char *)arg1);
-		if (!new_proc) {
-			return syscall_result { syscall_result_code::not_found, 0 };
-		}
+static syscall_result sys_pwrite(u64 arg0, u64 arg1, u64 arg2, u64 arg3)
+{
+	auto o = object_manager::get().get_object(thread::current().owner(), arg0);
+	if (!o) {
+		return syscall_result { syscall_result_code::not_found, 0 };
+	}
 
-		new_proc->start();
-		return syscall_result { syscall_result_code::ok, object_manager::get().create_process_object(current_process, new_proc)->id() };
+	return operation_result_to_syscall_result(o->pwrite((const void *)arg1, arg2, arg3));
+}
+
+static syscall_result sys_read(u64 arg0, u64 arg1, u64 arg2, u64)
+{
+	auto o = object_manager::get().get_object(thread::current().owner(), arg0);
+	if (!o) {
+		return syscall_result { syscall_result_code::not_found, 0 };
 	}
 
-	case syscall_numbers::wait_for_process: {
-		// dprintf("wait process: %lu\n", arg0);
+	return operation_result_to_syscall_result(o->read((void *)arg1, arg2));
+}
 
-		auto process_object = object_manager::get().get_object(current_process, arg0);
-		if (!process_object) {
-			return syscall_result { syscall_result_code::not_found, 0 };
-		}
+static syscall_result sys_pread(u64 arg0, u64 arg1, u64 arg2, u64 arg3)
+{
+	auto o = object_manager::get().get_object(thread::current().owner(), arg0);
+	if (!o) {
+		return syscall_result { syscall_result_code::not_found, 0 };
+	}
+
+	return operation_result_to_syscall_result(o->pread((void *)arg1, arg2, arg3));
+}
 
-		return operation_result_to_syscall_result(process_object->wait_for_status_change());
+static syscall_result sys_ioctl(u64 arg0, u64 arg1, u64 arg2, u64 arg3)
+{
+	auto o = object_manager::get().get_object(thread::current().owner(), arg0);
+	if (!o) {
+		return syscall_result { syscall_result_code::not_found, 0 };
 	}
 
-	case syscall_numbers::start_thread: {
-		auto new_thread = current_thread.owner().create_thread((u64)arg0, (void *)arg1);
-		new_thread->start();
+	return operation_result_to_syscall_result(o->ioctl(arg1, (void *)arg2, arg3));
+}
+
+static syscall_result sys_alloc_mem(u64 arg0, u64, u64, u64)
+{
+	auto rgn = thread::current().owner().addrspace().alloc_region(PAGE_ALIGN_UP(arg0), region_flags::readwrite, false);
+
+	return syscall_result { syscall_result_code::ok, rgn->base };
+}
+
+static syscall_result sys_start_process(u64 arg0, u64 arg1, u64, u64)
+{
+	dprintf("start process: %s %s\n", arg0, arg1);
+
+	auto &current_process = thread::current().owner();
 
-		return syscall_result { syscall_result_code::ok, object_manager::get().create_thread_object(current_process, new_thread)->id() };
+	auto new_proc = process_manager::get().create_process((const char *)arg0, (const char *)arg1, &current_process);
+	if (!new_proc) {
+		return syscall_result { syscall_result_code::not_found, 0 };
 	}
 
-	case syscall_numbers::stop_current_thread: {
-		current_thread.stop();
-		asm volatile("int $0xff");
+	new_proc->start();
+	return syscall_result { syscall_result_code::ok, object_manager::get().create_process_object(current_process, new_proc)->id() };
+}
+
+static syscall_result sys_wait_for_process(u64 arg0, u64, u64, u64)
+{
+	// dprintf("wait process: %lu\n", arg0);
 
-		return syscall_result { syscall_result_code::ok, 0 };
+	auto process_object = object_manager::get().get_object(thread::current().owner(), arg0);
+	if (!process_object) {
+		return syscall_result { syscall_result_code::not_found, 0 };
 	}
 
-	case syscall_numbers::join_thread: {
-		auto thread_object = object_manager::get().get_object(current_process, arg0);
-		if (!thread_object) {
-			return syscall_result { syscall_result_code::not_found, 0 };
-		}
+	return operation_result_to_syscall_result(process_object->wait_for_status_change());
+}
+
+static syscall_result sys_start_thread(u64 arg0, u64 arg1, u64, u64)
+{
+	auto &current_process = thread::current().owner();
 
-		return operation_result_to_syscall_result(thread_object->join());
+	auto new_thread = current_process.create_thread((u64)arg0, (void *)arg1);
+	new_thread->start();
+
+	return syscall_result { syscall_result_code::ok, object_manager::get().create_thread_object(current_process, new_thread)->id() };
+}
+
+static syscall_result sys_stop_current_thread(u64, u64, u64, u64)
+{
+	thread::current().stop();
+	asm volatile("int $0xff");
+
+	return syscall_result { syscall_result_code::ok, 0 };
+}
+
+static syscall_result sys_join_thread(u64 arg0, u64, u64, u64)
+{
+	auto thread_object = object_manager::get().get_object(thread::current().owner(), arg0);
+	if (!thread_object) {
+		return syscall_result { syscall_result_code::not_found, 0 };
+	}
+
+	return operation_result_to_syscall_result(thread_object->join());
+}
+
+static syscall_result sys_yield(u64, u64, u64, u64)
+{
+	asm volatile("int $0xff");
+	return syscall_result { syscall_result_code::ok, 0 };
+}
+
+// Does nothing, so that the cost of a system call itself can be measured.
+static syscall_result sys_nop(u64, u64, u64, u64) { return syscall_result { syscall_result_code::ok, 0 }; }
+
+// Sets the calling thread's nice level, from -20 to 19.  Only the CFS scheduler takes any notice of it.
+static syscall_result sys_set_nice(u64 arg0, u64, u64, u64)
+{
+	s64 nice = (s64)arg0;
+	if (nice < -20 || nice > 19) {
+		return syscall_result { syscall_result_code::not_supported, 0 };
 	}
 
-	case syscall_numbers::sleep: {
-		sleeper::get().sleep_ms(arg0);
-		return syscall_result { syscall_result_code::ok, 0 };
+	thread::current().get_tcb()->nice = (int)nice;
+	return syscall_result { syscall_result_code::ok, 0 };
+}
+
+static syscall_result sys_sleep(u64 arg0, u64, u64, u64)
+{
+	sleeper::get().sleep_ms(arg0);
+	return syscall_result { syscall_result_code::ok, 0 };
+}
+
+static syscall_result sys_poweroff(u64, u64, u64, u64)
+{
+	pio::outw(0x604, 0x2000);
+	return syscall_result { syscall_result_code::ok, 0 };
+}
+
+//Calls static listdir_ function at top of syscall.cpp file
+static syscall_result sys_listdir_(u64 arg0, u64 arg1, u64 arg2, u64 arg3)
+{
+	list<string> names;
+	list<u64> sizes;
+	list<fs_node_kind> kinds;
+	return listdir_(thread::current().owner(), &names, &sizes, &kinds, (const char *)arg0, (bool)arg1, (bool)arg2, (bool)arg3);
+}
+
+static syscall_result sys_chdir(u64 arg0, u64, u64, u64) { return do_chdir(thread::current().owner(), (const char *)arg0); }
+
+static syscall_result sys_getcwd(u64 arg0, u64 arg1, u64, u64) { return do_getcwd(thread::current().owner(), (char *)arg0, arg1); }
+
+static syscall_result sys_mmap(u64 arg0, u64 arg1, u64 arg2, u64 arg3)
+{
+	return do_mmap(thread::current().owner(), arg0, arg1, arg2, (memory_map_flags)arg3);
+}
+
+static syscall_result sys_munmap(u64 arg0, u64 arg1, u64, u64)
+{
+	if (!thread::current().owner().addrspace().remove_region(arg0, arg1)) {
+		return syscall_result { syscall_result_code::not_found, 0 };
 	}
 
-	case syscall_numbers::poweroff: {
-		pio::outw(0x604, 0x2000);
-		return syscall_result { syscall_result_code::ok, 0 };
+	return syscall_result { syscall_result_code::ok, 0 };
+}
+
+static syscall_result sys_io_ring_setup(u64 arg0, u64 arg1, u64 arg2, u64)
+{
+	return do_io_ring_setup(thread::current().owner(), arg0, (io_ring_setup_flags)arg1, (u64 *)arg2);
+}
+
+static syscall_result sys_io_ring_enter(u64 arg0, u64 arg1, u64 arg2, u64)
+{
+	auto ring = object_manager::get().get_object(thread::current().owner(), arg0);
+	if (!ring) {
+		return syscall_result { syscall_result_code::not_found, 0 };
 	}
 
-	//Calls static listdir_ function at top of syscall.cpp file
-	case syscall_numbers::listdir_: {
-		list<string> names;
-		list<u64> sizes;
-		list<fs_node_kind> kinds;
-		return listdir_(current_process, &names, &sizes, &kinds, (const char *)arg0, (bool)arg1, (bool)arg2, (bool)arg3);
+	return operation_result_to_syscall_result(ring->enter(arg1, arg2));
+}
+
+static syscall_result sys_futex_wait(u64 arg0, u64 arg1, u64, u64) { return do_futex_wait(thread::current().owner(), arg0, (u32)arg1); }
+
+static syscall_result sys_futex_wake(u64 arg0, u64 arg1, u64, u64) { return do_futex_wake(thread::current().owner(), arg0, arg1); }
+
+struct syscall_table {
+	syscall_handler handlers[(u64)syscall_numbers::nr_syscalls];
+};
+
+static constexpr syscall_table build_syscall_table()
+{
+	struct entry {
+		syscall_numbers index;
+		syscall_handler handler;
+	};
+
+	const entry entries[] = {
+		{ syscall_numbers::exit, sys_exit },
+		{ syscall_numbers::open, sys_open },
+		{ syscall_numbers::close, sys_close },
+		{ syscall_numbers::read, sys_read },
+		{ syscall_numbers::pread, sys_pread },
+		{ syscall_numbers::write, sys_write },
+		{ syscall_numbers::pwrite, sys_pwrite },
+		{ syscall_numbers::set_fs, sys_set_fs },
+		{ syscall_numbers::set_gs, sys_set_gs },
+		{ syscall_numbers::alloc_mem, sys_alloc_mem },
+		{ syscall_numbers::start_process, sys_start_process },
+		{ syscall_numbers::wait_for_process, sys_wait_for_process },
+		{ syscall_numbers::start_thread, sys_start_thread },
+		{ syscall_numbers::stop_current_thread, sys_stop_current_thread },
+		{ syscall_numbers::join_thread, sys_join_thread },
+		{ syscall_numbers::sleep, sys_sleep },
+		{ syscall_numbers::poweroff, sys_poweroff },
+		{ syscall_numbers::ioctl, sys_ioctl },
+		{ syscall_numbers::listdir_, sys_listdir_ },
+		{ syscall_numbers::chdir, sys_chdir },
+		{ syscall_numbers::getcwd, sys_getcwd },
+		{ syscall_numbers::mmap, sys_mmap },
+		{ syscall_numbers::munmap, sys_munmap },
+		{ syscall_numbers::io_ring_setup, sys_io_ring_setup },
+		{ syscall_numbers::io_ring_enter, sys_io_ring_enter },
+		{ syscall_numbers::futex_wait, sys_futex_wait },
+		{ syscall_numbers::futex_wake, sys_futex_wake },
+		{ syscall_numbers::yield, sys_yield },
+		{ syscall_numbers::nop, sys_nop },
+		{ syscall_numbers::set_nice, sys_set_nice },
+	};
+
+	syscall_table table {};
+	for (const auto &e : entries) {
+		table.handlers[(u64)e.index] = e.handler;
 	}
 
-	default:
+	return table;
+}
+
+// The table is built at compile time, so a system call is an index, a bounds check and an indirect call.
+static constexpr syscall_table syscall_handlers = build_syscall_table();
+
+/*
+ * The slow path, taken when tracing is turned on, which records the system call on its way in and out.
+ */
+static __noinline syscall_result handle_traced_syscall(syscall_handler handler, syscall_numbers index, u64 arg0, u64 arg1, u64 arg2, u64 arg3)
+{
+	trace(trace_event::syscall_enter, (u64)index, arg0);
+	syscall_result r = handler(arg0, arg1, arg2, arg3);
+	trace(trace_event::syscall_exit, (u64)index, r.data);
+
+	return r;
+}
+
+/*
+ * Called from the system call entry point.  The system call number comes fourth, so that the first three
+ * arguments are already in the right registers when they arrive from userspace.
+ */
+extern "C" syscall_result handle_syscall(u64 arg0, u64 arg1, u64 arg2, syscall_numbers index, u64 arg3)
+{
+	// dprintf("SYSCALL: %u %x %x %x %x\n", index, arg0, arg1, arg2, arg3);
+
+	if ((u64)index >= ARRAY_SIZE(syscall_handlers.handlers) || !syscall_handlers.handlers[(u64)index]) {
 		dprintf("ERROR: unsupported syscall: %lx\n", index);
 		return syscall_result { syscall_result_code::not_supported, 0 };
 	}
+
+	syscall_handler handler = syscall_handlers.handlers[(u64)index];
+
+	if (trace_buffers::get().enabled()) {
+		return handle_traced_syscall(handler, index, arg0, arg1, arg2, arg3);
+	}
+
+	return handler(arg0, arg1, arg2, arg3);
 }
@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Kernel
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#include <stacsos/kernel/arch/core.h>
+#include <stacsos/kernel/debug.h>
+#include <stacsos/kernel/mem/memory-manager.h>
+#include <stacsos/kernel/mem/page-allocator.h>
+#include <stacsos/kernel/mem/page.h>
+#include <stacsos/kernel/trace.h>
+
+using namespace stacsos;
+using namespace stacsos::kernel;
+using namespace stacsos::kernel::arch;
+using namespace stacsos::kernel::mem;
+
+void trace_buffers::init()
+{
+	u64 nr_pages = PAGE_ALIGN_UP(records_per_core * sizeof(trace_record)) >> PAGE_BITS;
+
+	for (auto *c : core_manager::get().cores()) {
+		page *pg = memory_manager::get().pgalloc().allocate_pages(log2_ceil(nr_pages), page_allocation_flags::zero);
+		if (!pg) {
+			panic("unable to allocate trace buffer");
+		}
+
+		buffers_[c->id()].records = (trace_record *)pg->base_address_ptr();
+	}
+
+	// Tracing costs something on every hot path, so it stays off until it's asked for, with "trace on".
+	dprintf("trace: %lu records per core, disabled\n", records_per_core);
+}
+
+bool trace_buffers::read_record(int core, u64 position, trace_record &r) const
+{
+	const per_core_buffer &b = buffers_[core];
+	if (!b.records) {
+		return false;
+	}
+
+	return seq_ring_read(b.records, records_per_core, position, r, [](const volatile trace_record &slot, trace_record &r) {
+		r.timestamp = slot.timestamp;
+		r.event = slot.event;
+		r.core = slot.core;
+		r.reserved = 0;
+		r.args[0] = slot.args[0];
+		r.args[1] = slot.args[1];
+	});
+}
@@ -52,6 +52,7 @@ typedef __gnuc_va_list va_list;
 #define __weak __attribute__((weak))
 #define __packed __attribute__((packed))
 #define __noreturn __attribute__((noreturn))
+#define __noinline __attribute__((noinline))
 #define __ctor __attribute__((constructor))
 #define __ctor_priority(__n) __attribute__((constructor(__n)))
 #define __pure __attribute__((pure))
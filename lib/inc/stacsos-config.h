@@ -1,3 +1 @@
 #pragma once
-
-#define USE_FSGSBASE
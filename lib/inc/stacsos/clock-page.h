@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Utility Library
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+namespace stacsos {
+/**
+ * Where the kernel maps the (read-only) clock page, in every user address space.
+ */
+static constexpr u64 clock_page_address = 0x7fff'0000'0000;
+
+/**
+ * The contents of the clock page.  Times are worked out from the TSC: a number of ticks is converted to
+ * nanoseconds by multiplying by ns_mult, and shifting right by 32.
+ *
+ * The fields can change while they're being read, so they're protected by a sequence count, which is
+ * odd while an update is in progress.  A reader has to see the same, even, count before and after
+ * reading the fields for what it read to be consistent.
+ */
+struct clock_page_data {
+	volatile u32 sequence;
+
+	// The number of cores, which never changes once the page is published.  It lives here because
+	// this is the one page every process can read without a system call.
+	u32 nr_cores;
+
+	u64 tsc_frequency;
+	u64 ns_mult;
+
+	// The TSC at boot, which is time zero for the monotonic clock.
+	u64 boot_tsc;
+
+	// The wall clock time, in nanoseconds since the Unix epoch, when the TSC read wall_clock_tsc.
+	u64 wall_clock_ns;
+	u64 wall_clock_tsc;
+};
+} // namespace stacsos
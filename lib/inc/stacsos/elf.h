@@ -134,6 +134,11 @@ static_assert(sizeof(elf_sectionheader<64>) == 0x40, "incorrect elf_sectionheade
 
 #define SHT_NULL 0
 #define SHT_SYMTAB 2
+#define SHT_STRTAB 3
+
+#define STT_NOTYPE 0
+#define STT_FUNC 2
+#define ELF_ST_TYPE(__info) ((__info) & 0xf)
 
 template <int bits> struct elf_sym;
 
@@ -149,7 +154,7 @@ template <> struct elf_sym<64> {
 template <> struct elf_sym<32> {
 	u32 st_name;
 	u32 st_value;
-	u32 st_stize;
+	u32 st_size;
 	u8 st_info;
 	u8 st_other;
 	u16 st_shndx;
@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Utility Library
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+#include <stacsos/syscalls.h>
+
+namespace stacsos {
+/**
+ * The operations that can be submitted to an I/O ring.  Each one does the same thing as the system call
+ * of the same name, on an object id belonging to the process that owns the ring.
+ */
+enum class io_ring_op : u32 { nop = 0, read = 1, write = 2, pread = 3, pwrite = 4, ioctl = 5 };
+
+/**
+ * Setup flags.  A polled ring is drained by a kernel thread, so submissions don't need a system call
+ * at all while the thread is awake.
+ */
+enum class io_ring_setup_flags : u64 { none = 0, poll = 1 };
+
+/**
+ * Enter flags.  With wait, the call doesn't return until at least the requested number of completions
+ * are waiting to be reaped.  With wakeup, a sleeping polling thread is woken up.
+ */
+enum class io_ring_enter_flags : u64 { none = 0, wait = 1, wakeup = 2 };
+
+/**
+ * Flags the kernel sets in the ring header.
+ */
+enum class io_ring_status : u32 { none = 0, need_wakeup = 1 };
+
+DEFINE_ENUM_FLAG_OPERATIONS(io_ring_setup_flags)
+DEFINE_ENUM_FLAG_OPERATIONS(io_ring_enter_flags)
+DEFINE_ENUM_FLAG_OPERATIONS(io_ring_status)
+
+/**
+ * A submission queue entry.  For ioctl, offset holds the command.
+ */
+struct io_ring_sqe {
+	io_ring_op op;
+	u32 flags;
+	u64 object;
+	u64 buffer;
+	u64 length;
+	u64 offset;
+	u64 user_data;
+};
+
+/**
+ * A completion queue entry.  The user data is copied from the submission, so the two can be matched up.
+ */
+struct io_ring_cqe {
+	u64 user_data;
+	syscall_result_code code;
+	u64 result;
+};
+
+/**
+ * The start of the memory shared between a process and the kernel.  The submission and completion
+ * entries follow, at the given offsets.  Userspace owns the submission tail and the completion head,
+ * and the kernel owns the other two.  The indices are free-running, and the entry counts are powers of
+ * two, so an entry lives at (index & (count - 1)).
+ */
+struct io_ring_header {
+	volatile u32 sq_head, sq_tail;
+	volatile u32 cq_head, cq_tail;
+	u32 sq_entries, cq_entries;
+	volatile io_ring_status status;
+	u32 sqe_offset, cqe_offset;
+};
+
+/**
+ * The largest number of submission entries a ring can have.  There are twice as many completion
+ * entries.
+ */
+static constexpr u32 io_ring_max_entries = 256;
+} // namespace stacsos
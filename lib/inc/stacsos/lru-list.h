@@ -0,0 +1,119 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Utility Library
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+namespace stacsos {
+/**
+ * Mixes a key, so that keys that differ only in a few low bits (e.g. neighbouring pointers or indices)
+ * end up far apart.  This is Fibonacci hashing: the best-mixed bits are at the top of the result.
+ */
+static inline u64 hash_mix(u64 key) { return key * 0x9e3779b97f4a7c15ull; }
+
+/**
+ * Picks one of nr_buckets hash buckets for a key.
+ */
+static inline size_t hash_bucket(u64 key, size_t nr_buckets) { return (hash_mix(key) >> 32) % nr_buckets; }
+
+/**
+ * Operations on a hash bucket: a singly linked chain of objects, through their Next member.
+ */
+template <class T, T *T::*Next> struct hash_chain {
+	static void push(T *&head, T *item)
+	{
+		item->*Next = head;
+		head = item;
+	}
+
+	/**
+	 * Takes an object out of the chain.  The object must be on it.
+	 */
+	static void remove(T *&head, T *item)
+	{
+		T **slot = &head;
+		while (*slot != item) {
+			slot = &((*slot)->*Next);
+		}
+
+		*slot = item->*Next;
+		item->*Next = nullptr;
+	}
+};
+
+/**
+ * A doubly linked list of objects, through their Prev and Next members, for keeping them in least
+ * recently used order.  The most recently used object is at the head, and the least at the tail.
+ */
+template <class T, T *T::*Prev, T *T::*Next> class lru_list {
+public:
+	lru_list()
+		: head_(nullptr)
+		, tail_(nullptr)
+	{
+	}
+
+	T *head() const { return head_; }
+	T *tail() const { return tail_; }
+
+	void remove(T *item)
+	{
+		if (item->*Prev) {
+			(item->*Prev)->*Next = item->*Next;
+		} else {
+			head_ = item->*Next;
+		}
+
+		if (item->*Next) {
+			(item->*Next)->*Prev = item->*Prev;
+		} else {
+			tail_ = item->*Prev;
+		}
+
+		item->*Prev = item->*Next = nullptr;
+	}
+
+	void push_front(T *item)
+	{
+		item->*Prev = nullptr;
+		item->*Next = head_;
+
+		if (head_) {
+			head_->*Prev = item;
+		} else {
+			tail_ = item;
+		}
+
+		head_ = item;
+	}
+
+	void push_back(T *item)
+	{
+		item->*Next = nullptr;
+		item->*Prev = tail_;
+
+		if (tail_) {
+			tail_->*Next = item;
+		} else {
+			head_ = item;
+		}
+
+		tail_ = item;
+	}
+
+	/**
+	 * Marks an object on the list as the most recently used.
+	 */
+	void touch(T *item)
+	{
+		remove(item);
+		push_front(item);
+	}
+
+private:
+	T *head_, *tail_;
+};
+} // namespace stacsos
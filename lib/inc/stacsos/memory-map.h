@@ -0,0 +1,19 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Utility Library
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+namespace stacsos {
+/**
+ * How a file is mapped with the mmap system call.  Mappings are always readable.  Writes to a shared
+ * mapping are seen by everything else mapping the file, whereas a private mapping gets its own copy of
+ * a page when it's first written to.
+ */
+enum class memory_map_flags : u64 { none = 0, writable = 1, executable = 2, shared = 4 };
+
+DEFINE_ENUM_FLAG_OPERATIONS(memory_map_flags)
+} // namespace stacsos
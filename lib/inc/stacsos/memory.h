@@ -134,9 +134,8 @@ public:
 
 	shared_ptr<T> &operator=(shared_ptr<T> other)
 	{
+		// The copy has already taken a reference, which is released with the old value.
 		swap(*this, other);
-
-		acquire();
 		return *this;
 	}
 
@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Utility Library
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+namespace stacsos {
+/**
+ * The number of program counters kept for each sample: where the core was, followed by the return
+ * addresses found by walking the frame pointers.
+ */
+static const int profile_max_depth = 8;
+
+/**
+ * A sample taken by the profiler, as read from /dev/profile.  As with trace records, the sequence
+ * number is written last, and is one more than the sample's position in its core's buffer.
+ */
+struct profile_sample {
+	u64 sequence;
+	u16 core;
+	u8 user;
+	u8 depth;
+	u32 reserved;
+	u64 pcs[profile_max_depth];
+};
+
+/**
+ * Asks the kernel for the function containing an address.  If the address is in a known function, the
+ * start address and name are filled in, and the ioctl returns non-zero.
+ */
+struct profile_symbol {
+	u64 address;
+	u64 start;
+	char name[240];
+};
+
+/**
+ * Commands for /dev/profile.
+ */
+enum class profile_ioctl : u64 { enable = 1, disable = 2, symbolize = 3 };
+} // namespace stacsos
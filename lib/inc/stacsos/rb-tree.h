@@ -0,0 +1,378 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Utility Library
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+namespace stacsos {
+/**
+ * A node in an intrusive red-black tree.  This is embedded in the objects that are to be
+ * stored in the tree, so that insertion and removal never allocate memory.
+ */
+struct rb_tree_node {
+	rb_tree_node *parent;
+	rb_tree_node *left, *right;
+	bool red;
+};
+
+/**
+ * An intrusive red-black tree, ordered by the Less functor.  Objects comparing equal are
+ * inserted after existing ones.  A pointer to the left-most (i.e. smallest) object is
+ * cached, so first() is O(1).
+ */
+template <class T, rb_tree_node T::*Node, class Less> class rb_tree {
+	DELETE_DEFAULT_COPY_AND_MOVE(rb_tree)
+
+public:
+	rb_tree()
+		: root_(nullptr)
+		, leftmost_(nullptr)
+		, count_(0)
+	{
+	}
+
+	bool empty() const { return root_ == nullptr; }
+	u64 count() const { return count_; }
+
+	T *first() const { return leftmost_ ? owner(leftmost_) : nullptr; }
+
+	T *last() const
+	{
+		if (!root_) {
+			return nullptr;
+		}
+
+		rb_tree_node *n = root_;
+		while (n->right) {
+			n = n->right;
+		}
+
+		return owner(n);
+	}
+
+	T *next(T &item) const
+	{
+		rb_tree_node *n = successor(&(item.*Node));
+		return n ? owner(n) : nullptr;
+	}
+
+	T *prev(T &item) const
+	{
+		rb_tree_node *n = predecessor(&(item.*Node));
+		return n ? owner(n) : nullptr;
+	}
+
+	void insert(T &item)
+	{
+		rb_tree_node *n = &(item.*Node);
+		rb_tree_node *parent = nullptr;
+		rb_tree_node **link = &root_;
+		bool is_leftmost = true;
+
+		while (*link) {
+			parent = *link;
+
+			if (less_(item, *owner(parent))) {
+				link = &parent->left;
+			} else {
+				link = &parent->right;
+				is_leftmost = false;
+			}
+		}
+
+		n->parent = parent;
+		n->left = nullptr;
+		n->right = nullptr;
+		n->red = true;
+		*link = n;
+
+		if (is_leftmost) {
+			leftmost_ = n;
+		}
+
+		insert_fixup(n);
+		count_++;
+	}
+
+	void remove(T &item)
+	{
+		rb_tree_node *z = &(item.*Node);
+		rb_tree_node *y = z;
+		rb_tree_node *x, *x_parent;
+		bool removed_red = y->red;
+
+		if (z == leftmost_) {
+			leftmost_ = successor(z);
+		}
+
+		if (!z->left) {
+			x = z->right;
+			x_parent = z->parent;
+			transplant(z, z->right);
+		} else if (!z->right) {
+			x = z->left;
+			x_parent = z->parent;
+			transplant(z, z->left);
+		} else {
+			y = minimum(z->right);
+			removed_red = y->red;
+			x = y->right;
+
+			if (y->parent == z) {
+				x_parent = y;
+			} else {
+				x_parent = y->parent;
+				transplant(y, y->right);
+				y->right = z->right;
+				y->right->parent = y;
+			}
+
+			transplant(z, y);
+			y->left = z->left;
+			y->left->parent = y;
+			y->red = z->red;
+		}
+
+		if (!removed_red) {
+			remove_fixup(x, x_parent);
+		}
+
+		z->parent = z->left = z->right = nullptr;
+		count_--;
+	}
+
+private:
+	rb_tree_node *root_;
+	rb_tree_node *leftmost_;
+	u64 count_;
+	Less less_;
+
+	static T *owner(rb_tree_node *n)
+	{
+		// Recover the containing object from the embedded node.
+		const uintptr_t offset = (uintptr_t) & (((T *)nullptr)->*Node);
+		return (T *)((uintptr_t)n - offset);
+	}
+
+	static bool is_red(const rb_tree_node *n) { return n && n->red; }
+
+	static rb_tree_node *minimum(rb_tree_node *n)
+	{
+		while (n->left) {
+			n = n->left;
+		}
+
+		return n;
+	}
+
+	static rb_tree_node *successor(rb_tree_node *n)
+	{
+		if (n->right) {
+			return minimum(n->right);
+		}
+
+		while (n->parent && n == n->parent->right) {
+			n = n->parent;
+		}
+
+		return n->parent;
+	}
+
+	static rb_tree_node *predecessor(rb_tree_node *n)
+	{
+		if (n->left) {
+			n = n->left;
+			while (n->right) {
+				n = n->right;
+			}
+
+			return n;
+		}
+
+		while (n->parent && n == n->parent->left) {
+			n = n->parent;
+		}
+
+		return n->parent;
+	}
+
+	void rotate_left(rb_tree_node *x)
+	{
+		rb_tree_node *y = x->right;
+
+		x->right = y->left;
+		if (y->left) {
+			y->left->parent = x;
+		}
+
+		y->parent = x->parent;
+		if (!x->parent) {
+			root_ = y;
+		} else if (x == x->parent->left) {
+			x->parent->left = y;
+		} else {
+			x->parent->right = y;
+		}
+
+		y->left = x;
+		x->parent = y;
+	}
+
+	void rotate_right(rb_tree_node *x)
+	{
+		rb_tree_node *y = x->left;
+
+		x->left = y->right;
+		if (y->right) {
+			y->right->parent = x;
+		}
+
+		y->parent = x->parent;
+		if (!x->parent) {
+			root_ = y;
+		} else if (x == x->parent->right) {
+			x->parent->right = y;
+		} else {
+			x->parent->left = y;
+		}
+
+		y->right = x;
+		x->parent = y;
+	}
+
+	void transplant(rb_tree_node *u, rb_tree_node *v)
+	{
+		if (!u->parent) {
+			root_ = v;
+		} else if (u == u->parent->left) {
+			u->parent->left = v;
+		} else {
+			u->parent->right = v;
+		}
+
+		if (v) {
+			v->parent = u->parent;
+		}
+	}
+
+	void insert_fixup(rb_tree_node *z)
+	{
+		while (is_red(z->parent)) {
+			// The parent is red, so it can't be the root, and so the grandparent exists.
+			rb_tree_node *gp = z->parent->parent;
+
+			if (z->parent == gp->left) {
+				rb_tree_node *uncle = gp->right;
+
+				if (is_red(uncle)) {
+					z->parent->red = false;
+					uncle->red = false;
+					gp->red = true;
+					z = gp;
+				} else {
+					if (z == z->parent->right) {
+						z = z->parent;
+						rotate_left(z);
+					}
+
+					z->parent->red = false;
+					gp->red = true;
+					rotate_right(gp);
+				}
+			} else {
+				rb_tree_node *uncle = gp->left;
+
+				if (is_red(uncle)) {
+					z->parent->red = false;
+					uncle->red = false;
+					gp->red = true;
+					z = gp;
+				} else {
+					if (z == z->parent->left) {
+						z = z->parent;
+						rotate_right(z);
+					}
+
+					z->parent->red = false;
+					gp->red = true;
+					rotate_left(gp);
+				}
+			}
+		}
+
+		root_->red = false;
+	}
+
+	void remove_fixup(rb_tree_node *x, rb_tree_node *parent)
+	{
+		while (x != root_ && !is_red(x)) {
+			if (x == parent->left) {
+				rb_tree_node *w = parent->right;
+
+				if (is_red(w)) {
+					w->red = false;
+					parent->red = true;
+					rotate_left(parent);
+					w = parent->right;
+				}
+
+				if (!is_red(w->left) && !is_red(w->right)) {
+					w->red = true;
+					x = parent;
+					parent = x->parent;
+				} else {
+					if (!is_red(w->right)) {
+						w->left->red = false;
+						w->red = true;
+						rotate_right(w);
+						w = parent->right;
+					}
+
+					w->red = parent->red;
+					parent->red = false;
+					w->right->red = false;
+					rotate_left(parent);
+					x = root_;
+					parent = nullptr;
+				}
+			} else {
+				rb_tree_node *w = parent->left;
+
+				if (is_red(w)) {
+					w->red = false;
+					parent->red = true;
+					rotate_right(parent);
+					w = parent->left;
+				}
+
+				if (!is_red(w->left) && !is_red(w->right)) {
+					w->red = true;
+					x = parent;
+					parent = x->parent;
+				} else {
+					if (!is_red(w->left)) {
+						w->right->red = false;
+						w->red = true;
+						rotate_left(w);
+						w = parent->left;
+					}
+
+					w->red = parent->red;
+					parent->red = false;
+					w->left->red = false;
+					rotate_right(parent);
+					x = root_;
+					parent = nullptr;
+				}
+			}
+		}
+
+		if (x) {
+			x->red = false;
+		}
+	}
+};
+} // namespace stacsos
@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Utility Library
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+namespace stacsos {
+/**
+ * Sorts an array in place, in the order given by less().  This is a Shell sort, with gaps from Ciura's
+ * sequence: it needs no extra memory, and is quick enough for the few thousand items it's used on.
+ */
+template <class T, class Less> void shell_sort(T *items, size_t count, Less less)
+{
+	static const size_t gaps[] = { 701, 301, 132, 57, 23, 10, 4, 1 };
+
+	for (size_t gap : gaps) {
+		for (size_t i = gap; i < count; i++) {
+			T item = items[i];
+
+			size_t j = i;
+			while (j >= gap && less(item, items[j - gap])) {
+				items[j] = items[j - gap];
+				j -= gap;
+			}
+
+			items[j] = item;
+		}
+	}
+}
+} // namespace stacsos
@@ -8,7 +8,7 @@
 #pragma once
 
 namespace stacsos {
-enum class syscall_result_code : u64 { ok = 0, not_found = 1, not_supported = 2 };
+enum class syscall_result_code : u64 { ok = 0, not_found = 1, not_supported = 2, would_block = 3 };
 
 enum class syscall_numbers {
 	exit = 0,
@@ -29,7 +29,21 @@ enum class syscall_numbers {
 	sleep = 15,
 	poweroff = 16,
 	ioctl = 17,
-	listdir_ = 18 //New syscall added to table
+	listdir_ = 18, //New syscall added to table
+	chdir = 19,
+	getcwd = 20,
+	mmap = 21,
+	munmap = 22,
+	io_ring_setup = 23,
+	io_ring_enter = 24,
+	futex_wait = 25,
+	futex_wake = 26,
+	yield = 27,
+	nop = 28,
+	set_nice = 29,
+
+	// Not a system call: the number of system calls there are.
+	nr_syscalls
 };
 
 struct syscall_result {
@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Utility Library
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+namespace stacsos {
+/**
+ * The kernel's tracepoints.  Each one has a name, and the format its two arguments are printed with.
+ * The list is expanded into the event numbers, and into the table of formats, so the kernel and the
+ * tools reading its traces always agree.  New events go on the end, so existing numbers don't change.
+ */
+#define STACSOS_TRACE_EVENTS(X)                                                                                                                                \
+	X(context_switch, "from=%lx to=%lx")                                                                                                                       \
+	X(syscall_enter, "nr=%lu arg0=%lx")                                                                                                                        \
+	X(syscall_exit, "nr=%lu result=%lx")                                                                                                                       \
+	X(irq, "vector=%lu rip=%lx")                                                                                                                               \
+	X(page_fault, "address=%lx flags=%lx")                                                                                                                     \
+	X(page_refill, "core=%lu pages=%lu")                                                                                                                       \
+	X(page_drain, "core=%lu pages=%lu")                                                                                                                        \
+	X(slab_grow, "object-size=%lu slab=%lx")
+
+#define __TRACE_EVENT_ENUM(name, format) name,
+
+enum class trace_event : u16 { none = 0, STACSOS_TRACE_EVENTS(__TRACE_EVENT_ENUM) nr_events };
+
+#undef __TRACE_EVENT_ENUM
+
+struct trace_event_format {
+	const char *name;
+	const char *format;
+};
+
+#define __TRACE_EVENT_FORMAT(name, format) { #name, format },
+
+/**
+ * The name and format of each event, indexed by event number.
+ */
+static constexpr trace_event_format trace_event_formats[] = { { "none", "" }, STACSOS_TRACE_EVENTS(__TRACE_EVENT_FORMAT) };
+
+#undef __TRACE_EVENT_FORMAT
+
+/**
+ * A record in a trace buffer, as read from /dev/trace.  The sequence number is written last, and is one
+ * more than the record's position in its core's buffer, so a record that is still being written (or
+ * has been overwritten) can be spotted.
+ */
+struct trace_record {
+	u64 sequence;
+	u64 timestamp;
+	trace_event event;
+	u16 core;
+	u32 reserved;
+	u64 args[2];
+};
+
+/**
+ * Commands for /dev/trace.  status returns 1 if tracing is enabled, and 0 if it isn't.
+ */
+enum class trace_ioctl : u64 { enable = 1, disable = 2, status = 3 };
+} // namespace stacsos
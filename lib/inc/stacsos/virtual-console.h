@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - Utility Library
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+namespace stacsos {
+enum class virtual_console_ioctl : u64 { get_mode = 1, blit = 2 };
+
+/**
+ * Describes a rectangle to copy onto a virtual console with the blit ioctl.  Coordinates and sizes are
+ * in character cells (text mode) or pixels (graphics mode), and the rows of the source data are stride
+ * elements apart.
+ */
+struct virtual_console_blit {
+	u32 x, y;
+	u32 width, height;
+	u32 stride;
+	const void *data;
+};
+} // namespace stacsos
@@ -0,0 +1,521 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - bench utility
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#include <stacsos/async-io.h>
+#include <stacsos/clock.h>
+#include <stacsos/console.h>
+#include <stacsos/heap.h>
+#include <stacsos/memops.h>
+#include <stacsos/objects.h>
+#include <stacsos/printf.h>
+#include <stacsos/sort.h>
+#include <stacsos/sync.h>
+#include <stacsos/thread-pool.h>
+#include <stacsos/threads.h>
+#include <stacsos/user-syscall.h>
+
+using namespace stacsos;
+
+/*
+ * A micro-benchmark.  run() performs the operation being measured a number of times, and each sample
+ * is the time taken by one call to run(), divided by the number of operations.  The first few samples
+ * are thrown away, to warm up caches, and to let the kernel fault in anything that is touched lazily.
+ */
+struct benchmark {
+	const char *name;
+	const char *description;
+
+	bool (*setup)();
+	void (*run)(u64 count);
+	void (*teardown)();
+
+	u64 operations_per_sample;
+	u64 nr_samples;
+
+	// For throughput benchmarks: the number of bytes each operation moves.
+	u64 bytes_per_operation;
+};
+
+static const u64 warmup_samples = 3;
+static const u64 max_samples = 64;
+
+static const char *test_file_path = "/logo.ppm";
+static const size_t file_block_size = 4096;
+
+static object *debug_out;
+
+// The partner thread for the ping-pong benchmark.
+static semaphore ping, pong;
+static bool partner_stop;
+static thread *partner;
+
+// The test file, for the file benchmarks.
+static object *test_file;
+static u64 test_file_size;
+static u64 file_offset;
+static u8 *file_buffer;
+
+// The I/O ring, for comparing batched submissions with one system call per operation.
+static const u32 ring_batch = 16;
+static io_ring *ring;
+
+static u64 random_state = 0x2545f4914f6cdd1d;
+
+static u64 next_random()
+{
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 7;
+	random_state ^= random_state << 17;
+
+	return random_state;
+}
+
+static void bench_nop(u64 count)
+{
+	for (u64 i = 0; i < count; i++) {
+		syscalls::nop();
+	}
+}
+
+static void bench_yield(u64 count)
+{
+	for (u64 i = 0; i < count; i++) {
+		syscalls::yield();
+	}
+}
+
+static void *ping_pong_partner(void *)
+{
+	while (true) {
+		ping.acquire();
+		if (__atomic_load_n(&partner_stop, __ATOMIC_ACQUIRE)) {
+			break;
+		}
+
+		pong.release();
+	}
+
+	return nullptr;
+}
+
+static bool setup_ping_pong()
+{
+	partner_stop = false;
+	partner = thread::start(ping_pong_partner);
+
+	return partner != nullptr;
+}
+
+static void bench_ping_pong(u64 count)
+{
+	for (u64 i = 0; i < count; i++) {
+		ping.release();
+		pong.acquire();
+	}
+}
+
+static void teardown_ping_pong()
+{
+	__atomic_store_n(&partner_stop, true, __ATOMIC_RELEASE);
+	ping.release();
+
+	partner->join();
+	delete partner;
+}
+
+static void *empty_thread(void *) { return nullptr; }
+
+static void bench_thread_create(u64 count)
+{
+	for (u64 i = 0; i < count; i++) {
+		thread *t = thread::start(empty_thread);
+		t->join();
+		delete t;
+	}
+}
+
+static void bench_alloc_mem(u64 count)
+{
+	for (u64 i = 0; i < count; i++) {
+		auto r = syscalls::alloc_mem(KB(64));
+		syscalls::munmap(r.ptr, KB(64));
+	}
+}
+
+static void bench_heap(u64 count)
+{
+	for (u64 i = 0; i < count; i++) {
+		void *p = heap::allocate(64);
+		asm volatile("" ::"r"(p) : "memory");
+		heap::free(p);
+	}
+}
+
+static void bench_open_close(u64 count)
+{
+	for (u64 i = 0; i < count; i++) {
+		delete object::open(test_file_path);
+	}
+}
+
+static bool setup_file()
+{
+	test_file = object::open(test_file_path);
+	if (!test_file) {
+		return false;
+	}
+
+	file_buffer = new u8[file_block_size];
+
+	// There's no way to ask for the size of a file, so read it all once (which also brings it into the
+	// block cache, so that the benchmarks measure the system call path rather than the disk).
+	test_file_size = 0;
+	while (true) {
+		size_t n = test_file->pread(file_buffer, file_block_size, test_file_size);
+		if (n == 0) {
+			break;
+		}
+
+		test_file_size += n;
+	}
+
+	file_offset = 0;
+	return test_file_size >= file_block_size;
+}
+
+static void teardown_file()
+{
+	delete[] file_buffer;
+	delete test_file;
+}
+
+static void bench_sequential_read(u64 count)
+{
+	for (u64 i = 0; i < count; i++) {
+		if (file_offset + file_block_size > test_file_size) {
+			file_offset = 0;
+		}
+
+		test_file->pread(file_buffer, file_block_size, file_offset);
+		file_offset += file_block_size;
+	}
+}
+
+static void bench_random_read(u64 count)
+{
+	u64 nr_blocks = test_file_size / file_block_size;
+
+	for (u64 i = 0; i < count; i++) {
+		test_file->pread(file_buffer, file_block_size, (next_random() % nr_blocks) * file_block_size);
+	}
+}
+
+static bool setup_ring()
+{
+	ring = io_ring::create(ring_batch);
+	return ring != nullptr;
+}
+
+static void teardown_ring() { delete ring; }
+
+/*
+ * Submits a batch of queued operations to the ring, waits for them, and throws the completions away.
+ */
+static void complete_ring_batch(u32 batch)
+{
+	ring->submit(batch);
+
+	io_ring_cqe cqe;
+	while (ring->next_completion(cqe)) { }
+}
+
+static void bench_ring_nop(u64 count)
+{
+	while (count) {
+		u32 batch = min<u64>(count, ring_batch);
+		for (u32 i = 0; i < batch; i++) {
+			*ring->get_sqe() = io_ring_sqe { io_ring_op::nop, 0, 0, 0, 0, 0, i };
+		}
+
+		complete_ring_batch(batch);
+		count -= batch;
+	}
+}
+
+static bool setup_file_ring() { return setup_file() && setup_ring(); }
+
+static void teardown_file_ring()
+{
+	teardown_ring();
+	teardown_file();
+}
+
+static void bench_sequential_read_ring(u64 count)
+{
+	while (count) {
+		u32 batch = min<u64>(count, ring_batch);
+		for (u32 i = 0; i < batch; i++) {
+			if (file_offset + file_block_size > test_file_size) {
+				file_offset = 0;
+			}
+
+			ring->queue(io_ring_op::pread, *test_file, file_buffer, file_block_size, file_offset, i);
+			file_offset += file_block_size;
+		}
+
+		complete_ring_batch(batch);
+		count -= batch;
+	}
+}
+
+static const char console_line[] = "bench: console write throughput .......................................\n";
+
+static void bench_console(u64 count)
+{
+	for (u64 i = 0; i < count; i++) {
+		console::get().write(console_line);
+	}
+}
+
+static const benchmark benchmarks[] = {
+	{ "null-syscall", "a system call that does nothing", nullptr, bench_nop, nullptr, 1000, 31, 0 },
+	{ "yield", "a yield with nothing else to run", nullptr, bench_yield, nullptr, 100, 31, 0 },
+	{ "ping-pong", "a round trip between two threads, through futexes", setup_ping_pong, bench_ping_pong, teardown_ping_pong, 100, 31, 0 },
+	{ "thread-create", "starting and joining an empty thread", nullptr, bench_thread_create, nullptr, 4, 15, 0 },
+	{ "alloc-mem", "reserving and releasing 64K of memory", nullptr, bench_alloc_mem, nullptr, 50, 31, 0 },
+	{ "heap-64", "allocating and freeing 64 bytes", nullptr, bench_heap, nullptr, 1000, 31, 0 },
+	{ "open-close", "opening and closing a file", nullptr, bench_open_close, nullptr, 50, 31, 0 },
+	{ "pread-seq", "4K reads, sequentially through a file", setup_file, bench_sequential_read, teardown_file, 50, 31, file_block_size },
+	{ "pread-random", "4K reads, at random offsets in a file", setup_file, bench_random_read, teardown_file, 50, 31, file_block_size },
+	{ "ring-nop", "a no-op through an i/o ring, in batches of 16 (cf. null-syscall)", setup_ring, bench_ring_nop, teardown_ring, 1024, 31, 0 },
+	{ "ring-pread-seq", "pread-seq through an i/o ring, in batches of 16", setup_file_ring, bench_sequential_read_ring, teardown_file_ring, 64, 31,
+		file_block_size },
+	{ "console-write", "writing a line to the console", nullptr, bench_console, nullptr, 8, 15, sizeof(console_line) - 1 },
+};
+
+/*
+ * Writes a line of machine-readable output to the debug console, if it could be opened.
+ */
+static void emit(const char *fmt, ...)
+{
+	if (!debug_out) {
+		return;
+	}
+
+	char line[256];
+
+	va_list args;
+	va_start(args, fmt);
+	int n = vsnprintf(line, sizeof(line), fmt, args);
+	va_end(args);
+
+	debug_out->write(line, min(n, (int)sizeof(line) - 1));
+}
+
+// Picks the sample at or below the given percentile.  Benchmarks take 15-31 samples, which is too few to
+// say anything about the 99th percentile, so the tail is reported as p95 and the maximum.
+static u64 percentile(const u64 *sorted, u64 count, u64 p) { return sorted[((count - 1) * p) / 100]; }
+
+/*
+ * Prints a benchmark's results.  Samples are in cycles per operation.
+ */
+static void report(const char *name, u64 *samples, u64 count, u64 bytes_per_operation)
+{
+	shell_sort(samples, count, [](u64 a, u64 b) { return a < b; });
+
+	u64 fastest = samples[0];
+	u64 p50 = percentile(samples, count, 50);
+	u64 p90 = percentile(samples, count, 90);
+	u64 p95 = percentile(samples, count, 95);
+	u64 slowest = samples[count - 1];
+
+	u64 p50_ns = clock::cycles_to_ns(p50);
+
+	console::get().writef("%16s %12lu %12lu %12lu %12lu %12lu %10lu", name, fastest, p50, p90, p95, slowest, p50_ns);
+
+	// Throughput is worked out from the median.
+	u64 kb_per_second = 0;
+	if (bytes_per_operation && p50_ns) {
+		kb_per_second = (bytes_per_operation * 1'000'000'000ull) / (p50_ns * 1024);
+		console::get().writef(" %10lu", kb_per_second);
+	}
+
+	console::get().write("\n");
+
+	emit("bench name=%s samples=%lu min=%lu p50=%lu p90=%lu p95=%lu max=%lu p50_ns=%lu", name, count, fastest, p50, p90, p95, slowest, p50_ns);
+	if (bytes_per_operation) {
+		emit(" bytes_per_op=%lu kb_per_s=%lu", bytes_per_operation, kb_per_second);
+	}
+	emit("\n");
+}
+
+/*
+ * Takes a benchmark's samples, after warming up.  Returns the number of samples taken.
+ */
+static u64 measure(void (*run)(u64), u64 operations_per_sample, u64 nr_samples, u64 *samples)
+{
+	nr_samples = min(nr_samples, max_samples);
+
+	for (u64 i = 0; i < warmup_samples; i++) {
+		run(operations_per_sample);
+	}
+
+	for (u64 i = 0; i < nr_samples; i++) {
+		u64 start = clock::cycles();
+		run(operations_per_sample);
+		u64 end = clock::cycles();
+
+		samples[i] = (end - start) / operations_per_sample;
+	}
+
+	return nr_samples;
+}
+
+static void print_header()
+{
+	console::get().write("       benchmark   min-cycles   p50-cycles   p90-cycles   p95-cycles   max-cycles     p50-ns       KB/s\n");
+}
+
+static void run_benchmark(const benchmark &b)
+{
+	if (b.setup && !b.setup()) {
+		console::get().writef("%16s failed to set up\n", b.name);
+		emit("bench name=%s error=setup\n", b.name);
+		return;
+	}
+
+	u64 samples[max_samples];
+	u64 count = measure(b.run, b.operations_per_sample, b.nr_samples, samples);
+
+	if (b.teardown) {
+		b.teardown();
+	}
+
+	report(b.name, samples, count, b.bytes_per_operation);
+}
+
+/*
+ * Mandelbrot scaling: the same image, drawn into memory by pools of one thread up to one per core.
+ */
+static const int mandelbrot_width = 160;
+static const int mandelbrot_height = 50;
+static const int mandelbrot_iterations = 4096;
+static const int mandelbrot_bits = 26;
+
+static thread_pool *mandelbrot_pool;
+static u32 *mandelbrot_image;
+
+static void mandelbrot_row(u64 y)
+{
+	const s64 one = 1ll << mandelbrot_bits;
+	const s64 real_min = -2 * one, imag_max = one;
+	const s64 delta_real = (3 * one) / (mandelbrot_width - 1);
+	const s64 delta_imag = (2 * one) / (mandelbrot_height - 1);
+
+	for (int x = 0; x < mandelbrot_width; x++) {
+		s64 real0 = real_min + x * delta_real;
+		s64 imag0 = imag_max - (s64)y * delta_imag;
+		s64 real = real0, imag = imag0;
+
+		int count;
+		for (count = 0; count < mandelbrot_iterations; count++) {
+			s64 realq = (real * real) >> mandelbrot_bits;
+			s64 imagq = (imag * imag) >> mandelbrot_bits;
+
+			if (realq + imagq > 4 * one) {
+				break;
+			}
+
+			imag = ((real * imag) >> (mandelbrot_bits - 1)) + imag0;
+			real = realq - imagq + real0;
+		}
+
+		mandelbrot_image[(y * mandelbrot_width) + x] = count;
+	}
+}
+
+static void bench_mandelbrot(u64 count)
+{
+	for (u64 i = 0; i < count; i++) {
+		mandelbrot_pool->parallel_for(0, mandelbrot_height, [](u64 y) { mandelbrot_row(y); }, 1);
+	}
+}
+
+static void run_mandelbrot_scaling()
+{
+	mandelbrot_image = new u32[mandelbrot_width * mandelbrot_height];
+
+	u32 nr_cores = thread::hardware_concurrency();
+	u64 single_thread_p50 = 0;
+
+	for (u32 n = 1; n <= nr_cores; n++) {
+		mandelbrot_pool = new thread_pool(n);
+
+		u64 samples[max_samples];
+		u64 count = measure(bench_mandelbrot, 1, 7, samples);
+
+		delete mandelbrot_pool;
+
+		char name[32];
+		snprintf(name, sizeof(name), "mandelbrot-%u", n);
+		report(name, samples, count, 0);
+
+		// Speedup is reported in hundredths, relative to one thread.
+		u64 p50 = samples[count / 2];
+		if (n == 1) {
+			single_thread_p50 = p50;
+		}
+
+		u64 speedup = p50 ? (single_thread_p50 * 100) / p50 : 0;
+		emit("bench name=%s threads=%u speedup_x100=%lu\n", name, n, speedup);
+	}
+
+	delete[] mandelbrot_image;
+}
+
+static bool selected(const char *name, const char *filter)
+{
+	if (!filter || !*filter) {
+		return true;
+	}
+
+	int length = memops::strlen(filter);
+	return memops::strlen(name) >= length && memops::memcmp(name, filter, length) == 0;
+}
+
+int main(const char *cmdline)
+{
+	if (cmdline && memops::strcmp(cmdline, "list") == 0) {
+		for (const auto &b : benchmarks) {
+			console::get().writef("%16s  %s\n", b.name, b.description);
+		}
+
+		console::get().writef("%16s  %s\n", "mandelbrot-N", "drawing a Mandelbrot image with N threads");
+		return 0;
+	}
+
+	// The machine-readable results go to the debug console, so they can be collected from the host.
+	debug_out = object::open("/dev/debug");
+
+	emit("bench-start tsc_hz=%lu cores=%u\n", clock::cycles_per_second(), thread::hardware_concurrency());
+	print_header();
+
+	for (const auto &b : benchmarks) {
+		if (selected(b.name, cmdline)) {
+			run_benchmark(b);
+		}
+	}
+
+	if (selected("mandelbrot-", cmdline)) {
+		run_mandelbrot_scaling();
+	}
+
+	emit("bench-end\n");
+
+	delete debug_out;
+	return 0;
+}
@@ -5,12 +5,17 @@
  * Copyright (c) University of St Andrews 2024
  * Tom Spink <tcs6@st-andrews.ac.uk>
  */
+#include <stacsos/async-io.h>
 #include <stacsos/console.h>
 #include <stacsos/memops.h>
 #include <stacsos/objects.h>
 
 using namespace stacsos;
 
+// The file is read a batch of chunks at a time, through an I/O ring, so each batch is one system call.
+static const u32 nr_chunks = 8;
+static const size_t chunk_size = 4096;
+
 int main(const char *cmdline)
 {
 	if (!cmdline || memops::strlen(cmdline) == 0) {
@@ -24,16 +29,54 @@ int main(const char *cmdline)
 		return 1;
 	}
 
-	char buffer[64];
-	int bytes_read;
+	io_ring *ring = io_ring::create(nr_chunks);
+	if (!ring) {
+		console::get().write("error: unable to create i/o ring\n");
+		delete file;
+		return 1;
+	}
+
+	// Each chunk has room for a terminator, so it can be written out as a string.
+	char *buffers = new char[nr_chunks * (chunk_size + 1)];
+	size_t lengths[nr_chunks];
+	size_t offset = 0;
+	bool done = false;
+
+	while (!done) {
+		for (u32 i = 0; i < nr_chunks; i++) {
+			ring->queue(io_ring_op::pread, *file, &buffers[i * (chunk_size + 1)], chunk_size, offset + (i * chunk_size), i);
+			lengths[i] = 0;
+		}
+
+		ring->submit(nr_chunks);
 
-	do {
-		bytes_read = file->read(buffer, sizeof(buffer) - 1);
-		buffer[bytes_read] = 0;
+		io_ring_cqe cqe;
+		while (ring->next_completion(cqe)) {
+			if (cqe.code == syscall_result_code::ok) {
+				lengths[cqe.user_data] = cqe.result;
+			}
+		}
 
-		console::get().writef("%s", buffer);
-	} while (bytes_read > 0);
+		// The completions can arrive in any order, but the chunks are written out in file order, up to
+		// the first one that comes up short.
+		for (u32 i = 0; i < nr_chunks; i++) {
+			char *chunk = &buffers[i * (chunk_size + 1)];
+			chunk[lengths[i]] = 0;
 
+			console::get().write(chunk);
+
+			if (lengths[i] < chunk_size) {
+				done = true;
+				break;
+			}
+		}
+
+		offset += nr_chunks * chunk_size;
+	}
+
+	delete[] buffers;
+	delete ring;
 	delete file;
+
 	return 0;
 }
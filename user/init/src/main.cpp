@@ -6,6 +6,7 @@
  * Tom Spink <tcs6@st-andrews.ac.uk>
  */
 #include <stacsos/console.h>
+#include <stacsos/framebuffer.h>
 #include <stacsos/objects.h>
 #include <stacsos/process.h>
 #include <stacsos/user-syscall.h>
@@ -16,10 +17,12 @@ using namespace stacsos;
 
 static void logo()
 {
-	object *fb = object::open("/dev/virtcon0");
+	framebuffer *fb = framebuffer::open("/dev/virtcon0");
+	if (!fb) {
+		return;
+	}
 
-	int console_mode = (int)fb->ioctl(1, nullptr, 0);
-	if (console_mode == 0) {
+	if (fb->mode() == framebuffer_mode::text) {
 		console::get().write("\e\xb0                                                                                ");
 		console::get().write("\e\xb0                             Welcome to StACSOS!                                ");
 		console::get().write("\e\xb0                                                                                ");
@@ -29,12 +32,23 @@ static void logo()
 		auto logo_file = object::open("/logo.ppm");
 		if (!logo_file) {
 			console::get().write("logo not found\n");
+			delete fb;
+			return;
 		}
 
-		u8 *logo_data = new u8[170415];
-		logo_file->read(logo_data, 170415);
+		// Map the image, rather than reading it all into the heap.
+		const size_t logo_size = 170415;
+		u8 *logo_mapping = (u8 *)logo_file->mmap(0, logo_size);
 		delete logo_file;
 
+		if (!logo_mapping) {
+			console::get().write("unable to map logo\n");
+			delete fb;
+			return;
+		}
+
+		const u8 *logo_data = logo_mapping;
+
 		logo_data++; // 0x50 P
 		logo_data++; // 0x36 6
 		logo_data++; // 0x0a
@@ -63,20 +77,25 @@ static void logo()
 
 		logo_data++;
 
-		object *fb = object::open("/dev/virtcon0");
-		const u8 *pixel_data = (const u8 *)logo_data;
+		const u8 *pixel_data = logo_data;
+		u32 *pixels = new u32[width * height];
 
 		for (int y = 0; y < height; y++) {
 			for (int x = 0; x < width; x++) {
 				u32 data_pixel_offset = (x + (y * width)) * 3;
-				u32 screen_pixel_offset = (x + ((640 - width) / 2)) + (y * 640);
 
-				u32 pixel = pixel_data[data_pixel_offset] << 16 | pixel_data[data_pixel_offset + 1] << 8 | pixel_data[data_pixel_offset + 2] << 0;
-
-				fb->pwrite((const void *)&pixel, 4, screen_pixel_offset);
+				pixels[x + (y * width)] = pixel_data[data_pixel_offset] << 16 | pixel_data[data_pixel_offset + 1] << 8 | pixel_data[data_pixel_offset + 2] << 0;
 			}
 		}
+
+		// Draw the whole logo in one go, centred at the top of the screen.
+		fb->draw_rect((fb->width() - width) / 2, 0, width, height, width, pixels);
+		delete[] pixels;
+
+		object::munmap(logo_mapping, logo_size);
 	}
+
+	delete fb;
 }
 
 int main(const char *cmdline)
@@ -18,9 +18,9 @@ using namespace stacsos;
  */
 int main(const char *cmdline)
 {
+	// With no path, the current directory is listed.
 	if (!cmdline || memops::strlen(cmdline) == 0) {
-		console::get().write("error: usage: /usr/ls <-la> <path>\n");
-		return 1;
+		cmdline = ".";
 	}
 
     //Argument parsing
@@ -30,7 +30,7 @@ int main(const char *cmdline)
     bool is_a = false; //Reveals hidden files
     bool is_l = false; //Long listing
     bool is_U = false; //Unsorts directory listing
-    bool path_ind = 0;
+    const char *path = ".";
     for (int i = 0; i < args.count(); i++) {
         if (args.at(i).c_str()[0] == '-') {
 
@@ -46,13 +46,13 @@ int main(const char *cmdline)
                 }
             }
         }
-        else if (args.at(i).c_str()[0] == '/') {
-            path_ind = i;
+        else {
+            path = args.at(i).c_str();
         }
     }
 
     //Creates an object which invokes a syscall.
-    object* dir = object::listdir_(args.at(path_ind).c_str(), is_l, is_a, is_U);
+    object* dir = object::listdir_(path, is_l, is_a, is_U);
     if (!dir) {
         console::get().writef("ls: No such file or directory or flags incorrect\n");
         return 1;
@@ -15,10 +15,9 @@
  * A program that prints a rather crude version of the Mandelbrot fractal to the StACSOS terminal.
  */
 
-#include <stacsos/atomic.h>
 #include <stacsos/console.h>
-#include <stacsos/objects.h>
-#include <stacsos/threads.h>
+#include <stacsos/framebuffer.h>
+#include <stacsos/thread-pool.h>
 
 using namespace stacsos;
 
@@ -47,59 +46,50 @@ s64 realMin, realMax;
 s64 imagMin, imagMax;
 s64 deltaReal, deltaImag;
 
-int width = 80; // frame is 80x25
-int height = 25;
+static const int width = 80; // frame is 80x25
+static const int height = 25;
 
-atomic<u32> next_pixel = 0;
-u32 last_pixel;
+framebuffer *fb;
 
-object *fb;
+static u16 makechar(int attr, unsigned char c) { return (attr << 8) | c; }
 
-static void drawchar(int x, int y, int attr, unsigned char c)
-{
-	u16 u = (attr << 8) | c;
-	fb->pwrite((const char *)&u, sizeof(u), x + (y * 80));
-}
-
-void output(int value, int i, int j)
+static u16 output(int value)
 {
 	if (value == 10000000) {
-		drawchar(j, i, BLACK, ' ');
+		return makechar(BLACK, ' ');
 	} else if (value > 9000000) {
-		drawchar(j, i, RED, '*');
+		return makechar(RED, '*');
 	} else if (value > 5000000) {
-		drawchar(j, i, L_RED, '*');
+		return makechar(L_RED, '*');
 	} else if (value > 1000000) {
-		drawchar(j, i, ORANGE, '*');
+		return makechar(ORANGE, '*');
 	} else if (value > 500) {
-		drawchar(j, i, YELLOW, '*');
+		return makechar(YELLOW, '*');
 	} else if (value > 100) {
-		drawchar(j, i, L_GREEN, '*');
+		return makechar(L_GREEN, '*');
 	} else if (value > 10) {
-		drawchar(j, i, GREEN, '*');
+		return makechar(GREEN, '*');
 	} else if (value > 5) {
-		drawchar(j, i, L_CYAN, '*');
+		return makechar(L_CYAN, '*');
 	} else if (value > 4) {
-		drawchar(j, i, CYAN, '*');
+		return makechar(CYAN, '*');
 	} else if (value > 3) {
-		drawchar(j, i, L_BLUE, '*');
+		return makechar(L_BLUE, '*');
 	} else if (value > 2) {
-		drawchar(j, i, BLUE, '*');
+		return makechar(BLUE, '*');
 	} else if (value > 1) {
-		drawchar(j, i, MAGENTA, '*');
+		return makechar(MAGENTA, '*');
 	} else {
-		drawchar(j, i, L_MAGENTA, '*');
+		return makechar(L_MAGENTA, '*');
 	}
 }
 
-static void *mandelbrot(void *arg)
+static void mandelbrot_row(int y)
 {
-	u32 my_next_pixel = next_pixel++;
-
-	while (my_next_pixel <= last_pixel) {
-		int x = my_next_pixel % width;
-		int y = my_next_pixel / width;
+	// Work a row at a time, so that each row is drawn with a single syscall.
+	u16 row[width];
 
+	for (int x = 0; x < width; x++) {
 		s64 real0, imag0, realq, imagq, real, imag;
 		int count;
 
@@ -119,26 +109,26 @@ static void *mandelbrot(void *arg)
 			real = realq - imagq + real0;
 		}
 
-		output(count, y, x);
-		my_next_pixel = next_pixel++;
+		row[x] = output(count);
 	}
 
-	return nullptr;
+	fb->draw_rect(0, y, width, 1, width, row);
 }
 
 int main(const char *cmdline)
 {
-	fb = object::open("/dev/virtcon0");
+	fb = framebuffer::open("/dev/virtcon0");
 
 	if (!fb) {
 		console::get().write("error: unable to open virtual console\n");
 		return 1;
 	}
 
-	//    printf("\033\x09How many threads would you like to use?\n");
-	//    int numThreads = getch();
-	int numThreads = 8;
-	thread *threads[numThreads];
+	if (fb->mode() != framebuffer_mode::text) {
+		console::get().write("error: mandelbrot needs a text mode console\n");
+		delete fb;
+		return 1;
+	}
 
 	realMin = -2 * NORM_FACT;
 	realMax = 1 * NORM_FACT;
@@ -148,15 +138,9 @@ int main(const char *cmdline)
 	deltaReal = (realMax - realMin) / (width - 1);
 	deltaImag = (imagMax - imagMin) / (height - 1);
 
-	last_pixel = width * height;
-
-	for (int k = 0; k < numThreads; k++) {
-		threads[k] = thread::start(mandelbrot, (void *)(u64)k);
-	}
-
-	for (int k = 0; k < numThreads; k++) {
-		threads[k]->join();
-	}
+	// Rows near the middle of the set take far longer than those at the edges, so they're handed out
+	// a row at a time, and the pool balances them between its workers.
+	thread_pool::get().parallel_for(0, height, [](u64 y) { mandelbrot_row(y); }, 1);
 
 	// wait for input so the prompt doesn't ruin the lovely image
 	// remove this when timing!
@@ -0,0 +1,294 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - profile utility
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#include <stacsos/console.h>
+#include <stacsos/memops.h>
+#include <stacsos/objects.h>
+#include <stacsos/profile.h>
+
+using namespace stacsos;
+
+static const size_t max_samples = 16384;
+static const size_t max_functions = 1024;
+static const size_t max_edges = 4096;
+static const size_t address_cache_size = 4096;
+static const size_t top_functions = 20;
+
+/*
+ * A function that appeared in the samples.  Samples taken in userspace, and addresses the kernel
+ * couldn't symbolize, are each collected into a function of their own.
+ */
+struct function {
+	u64 start;
+	char name[sizeof(profile_symbol::name)];
+	u64 self;
+	u64 total;
+};
+
+/*
+ * A call from one function to another, as seen in the samples' stacks.
+ */
+struct edge {
+	u32 caller;
+	u32 callee;
+	u64 count;
+};
+
+struct address_cache_entry {
+	u64 address;
+	u32 function;
+};
+
+static object *profile;
+
+static function *functions;
+static size_t nr_functions;
+
+static edge *edges;
+static size_t nr_edges;
+
+static address_cache_entry *address_cache;
+
+static u32 add_function(u64 start, const char *name)
+{
+	for (size_t i = 0; i < nr_functions; i++) {
+		if (functions[i].start == start && memops::strcmp(functions[i].name, name) == 0) {
+			return i;
+		}
+	}
+
+	// If the table is full, everything else is lumped in with the last function.
+	if (nr_functions == max_functions) {
+		return max_functions - 1;
+	}
+
+	function &f = functions[nr_functions];
+	f.start = start;
+	memops::strncpy(f.name, name, sizeof(f.name) - 1);
+	f.name[sizeof(f.name) - 1] = 0;
+	f.self = 0;
+	f.total = 0;
+
+	return nr_functions++;
+}
+
+/*
+ * Finds the function containing a kernel address.  Each address is only looked up in the kernel once.
+ */
+static u32 lookup_function(u64 address)
+{
+	size_t slot = (address >> 2) % address_cache_size;
+
+	for (size_t probe = 0; probe < address_cache_size; probe++) {
+		address_cache_entry &e = address_cache[(slot + probe) % address_cache_size];
+
+		if (e.address == address) {
+			return e.function;
+		}
+
+		if (e.address == 0) {
+			profile_symbol sym;
+			sym.address = address;
+
+			u32 fn;
+			if (profile->ioctl((u64)profile_ioctl::symbolize, &sym, sizeof(sym))) {
+				fn = add_function(sym.start, sym.name);
+			} else {
+				fn = add_function(0, "[unknown]");
+			}
+
+			e.address = address;
+			e.function = fn;
+
+			return fn;
+		}
+	}
+
+	return add_function(0, "[unknown]");
+}
+
+static void add_edge(u32 caller, u32 callee)
+{
+	for (size_t i = 0; i < nr_edges; i++) {
+		if (edges[i].caller == caller && edges[i].callee == callee) {
+			edges[i].count++;
+			return;
+		}
+	}
+
+	if (nr_edges < max_edges) {
+		edges[nr_edges++] = edge { caller, callee, 1 };
+	}
+}
+
+static void account_sample(const profile_sample &s)
+{
+	if (s.user) {
+		u32 fn = add_function(0, "[user]");
+		functions[fn].self++;
+		functions[fn].total++;
+		return;
+	}
+
+	if (s.depth == 0) {
+		return;
+	}
+
+	u32 chain[profile_max_depth];
+	int depth = 0;
+
+	for (int i = 0; i < s.depth && i < profile_max_depth; i++) {
+		// Return addresses point just past the call, which may be the start of the next function.
+		chain[depth++] = lookup_function(i == 0 ? s.pcs[i] : s.pcs[i] - 1);
+	}
+
+	functions[chain[0]].self++;
+
+	for (int i = 0; i < depth; i++) {
+		// Count each function once per sample, even if it appears more than once (i.e. recursion).
+		bool seen = false;
+		for (int j = 0; j < i; j++) {
+			if (chain[j] == chain[i]) {
+				seen = true;
+				break;
+			}
+		}
+
+		if (!seen) {
+			functions[chain[i]].total++;
+		}
+
+		if (i > 0) {
+			add_edge(chain[i], chain[i - 1]);
+		}
+	}
+}
+
+static void print_percentage(u64 count, u64 total)
+{
+	u64 hundredths = total ? (count * 10000) / total : 0;
+	console::get().writef("%3lu.%02lu%%", hundredths / 100, hundredths % 100);
+}
+
+int main(const char *cmdline)
+{
+	profile = object::open("/dev/profile");
+	if (!profile) {
+		console::get().write("error: unable to open /dev/profile\n");
+		return 1;
+	}
+
+	// Turning the profiler on and off is done with an argument, otherwise the profile is reported.
+	if (cmdline && memops::strcmp(cmdline, "on") == 0) {
+		profile->ioctl((u64)profile_ioctl::enable, nullptr, 0);
+		delete profile;
+		return 0;
+	}
+
+	if (cmdline && memops::strcmp(cmdline, "off") == 0) {
+		profile->ioctl((u64)profile_ioctl::disable, nullptr, 0);
+		delete profile;
+		return 0;
+	}
+
+	if (cmdline && memops::strlen(cmdline) > 0) {
+		console::get().write("error: usage: profile [on|off]\n");
+		delete profile;
+		return 1;
+	}
+
+	// Stop sampling while the profile is built, so that it doesn't profile itself.
+	profile->ioctl((u64)profile_ioctl::disable, nullptr, 0);
+
+	profile_sample *samples = new profile_sample[max_samples];
+	size_t count = 0;
+
+	while (count < max_samples) {
+		size_t bytes = profile->read(&samples[count], (max_samples - count) * sizeof(profile_sample));
+		if (bytes == 0) {
+			break;
+		}
+
+		count += bytes / sizeof(profile_sample);
+	}
+
+	if (count == 0) {
+		console::get().write("no samples (turn the profiler on with 'profile on')\n");
+		delete[] samples;
+		delete profile;
+		return 0;
+	}
+
+	functions = new function[max_functions];
+	edges = new edge[max_edges];
+	address_cache = new address_cache_entry[address_cache_size];
+	memops::bzero(address_cache, sizeof(address_cache_entry) * address_cache_size);
+
+	for (size_t i = 0; i < count; i++) {
+		account_sample(samples[i]);
+	}
+
+	// Order the functions by the number of samples taken in them.
+	u32 *order = new u32[nr_functions];
+	for (size_t i = 0; i < nr_functions; i++) {
+		u32 fn = i;
+
+		size_t j = i;
+		while (j > 0 && functions[order[j - 1]].self < functions[fn].self) {
+			order[j] = order[j - 1];
+			j--;
+		}
+
+		order[j] = fn;
+	}
+
+	console::get().writef("flat profile (%lu samples):\n", count);
+	console::get().write("   self   total  samples  function\n");
+
+	for (size_t i = 0; i < nr_functions && i < top_functions; i++) {
+		const function &f = functions[order[i]];
+
+		print_percentage(f.self, count);
+		console::get().write(" ");
+		print_percentage(f.total, count);
+		console::get().writef(" %8lu  %s\n", f.self, f.name);
+	}
+
+	console::get().write("\ncall graph:\n");
+
+	for (size_t i = 0; i < nr_functions && i < top_functions; i++) {
+		u32 fn = order[i];
+		if (functions[fn].start == 0) {
+			continue;
+		}
+
+		console::get().writef("%s (total %lu)\n", functions[fn].name, functions[fn].total);
+
+		for (size_t e = 0; e < nr_edges; e++) {
+			if (edges[e].callee == fn) {
+				console::get().writef("  <- %6lu  %s\n", edges[e].count, functions[edges[e].caller].name);
+			}
+		}
+
+		for (size_t e = 0; e < nr_edges; e++) {
+			if (edges[e].caller == fn) {
+				console::get().writef("  -> %6lu  %s\n", edges[e].count, functions[edges[e].callee].name);
+			}
+		}
+	}
+
+	profile->ioctl((u64)profile_ioctl::enable, nullptr, 0);
+
+	delete[] order;
+	delete[] address_cache;
+	delete[] edges;
+	delete[] functions;
+	delete[] samples;
+	delete profile;
+
+	return 0;
+}
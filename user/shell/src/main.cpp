@@ -8,6 +8,7 @@
 #include <stacsos/console.h>
 #include <stacsos/memops.h>
 #include <stacsos/process.h>
+#include <stacsos/user-syscall.h>
 
 using namespace stacsos;
 
@@ -26,7 +27,41 @@ static void run_command(const char *cmd)
 	if (*cmd)
 		cmd++;
 
-	auto pcmd = process::create(prog, cmd);
+	if (memops::strcmp("cd", prog) == 0) {
+		if (syscalls::chdir(*cmd ? cmd : "/") != syscall_result_code::ok) {
+			console::get().writef("error: unable to change directory to '%s'\n", cmd);
+		}
+
+		return;
+	}
+
+	if (memops::strcmp("pwd", prog) == 0) {
+		char cwd[256];
+		if (syscalls::getcwd(cwd, sizeof(cwd)).code == syscall_result_code::ok) {
+			console::get().writef("%s\n", cwd);
+		}
+
+		return;
+	}
+
+	// Bare command names are looked for in /usr first.
+	bool has_slash = false;
+	for (int i = 0; i < n; i++) {
+		has_slash |= prog[i] == '/';
+	}
+
+	process *pcmd = nullptr;
+	if (!has_slash) {
+		char path[70] = "/usr/";
+		memops::memcpy(&path[5], prog, n + 1);
+
+		pcmd = process::create(path, cmd);
+	}
+
+	if (!pcmd) {
+		pcmd = process::create(prog, cmd);
+	}
+
 	if (!pcmd) {
 		console::get().writef("error: unable to run program '%s'\n", prog);
 	} else {
@@ -36,13 +71,18 @@ static void run_command(const char *cmd)
 
 int main(void)
 {
-	console::get().write("This is the StACSOS shell.  Path resolution is \e\x0fnot-yet-implemented\e\x07, so you\n"
-						 "must type the command EXACTLY.\n\n");
+	console::get().write("This is the StACSOS shell.  Programs in /usr can be run by name, and cd and pwd are\n"
+						 "built in.\n\n");
 
-	console::get().write("Use the cat program to view the README: /usr/cat /docs/README\n\n");
+	console::get().write("Use the cat program to view the README: cat /docs/README\n\n");
 
 	while (true) {
-		console::get().write("> ");
+		char cwd[256];
+		if (syscalls::getcwd(cwd, sizeof(cwd)).code != syscall_result_code::ok) {
+			cwd[0] = 0;
+		}
+
+		console::get().writef("%s> ", cwd);
 
 		char command_buffer[128];
 		int n = 0;
@@ -0,0 +1,98 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - trace utility
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#include <stacsos/clock.h>
+#include <stacsos/console.h>
+#include <stacsos/memops.h>
+#include <stacsos/objects.h>
+#include <stacsos/sort.h>
+#include <stacsos/trace.h>
+
+using namespace stacsos;
+
+static const size_t max_records = 8192;
+
+/*
+ * Sorts the records by timestamp, so that the cores' buffers are merged into one timeline.
+ */
+static void sort_records(trace_record *records, size_t count)
+{
+	shell_sort(records, count, [](const trace_record &a, const trace_record &b) { return a.timestamp < b.timestamp; });
+}
+
+static void print_record(const trace_record &r, u64 start)
+{
+	u64 ns = clock::cycles_to_ns(r.timestamp - start);
+
+	const trace_event_format &fmt = (u16)r.event < (u16)trace_event::nr_events ? trace_event_formats[(u16)r.event] : trace_event_formats[0];
+
+	console::get().writef("%6lu.%06lu cpu%u %s ", ns / 1'000'000'000, (ns / 1000) % 1'000'000, r.core, fmt.name);
+	console::get().writef(fmt.format, r.args[0], r.args[1]);
+	console::get().write("\n");
+}
+
+int main(const char *cmdline)
+{
+	object *trace = object::open("/dev/trace");
+	if (!trace) {
+		console::get().write("error: unable to open /dev/trace\n");
+		return 1;
+	}
+
+	// Turning tracing on and off is done with an argument, otherwise the buffers are dumped.
+	if (cmdline && memops::strcmp(cmdline, "on") == 0) {
+		trace->ioctl((u64)trace_ioctl::enable, nullptr, 0);
+		delete trace;
+		return 0;
+	}
+
+	if (cmdline && memops::strcmp(cmdline, "off") == 0) {
+		trace->ioctl((u64)trace_ioctl::disable, nullptr, 0);
+		delete trace;
+		return 0;
+	}
+
+	if (cmdline && memops::strlen(cmdline) > 0) {
+		console::get().write("error: usage: trace [on|off]\n");
+		delete trace;
+		return 1;
+	}
+
+	// Stop tracing while the buffers are read, so that printing the trace doesn't fill them up again, and
+	// put it back the way it was afterwards.
+	bool was_enabled = trace->ioctl((u64)trace_ioctl::status, nullptr, 0) == 1;
+	trace->ioctl((u64)trace_ioctl::disable, nullptr, 0);
+
+	trace_record *records = new trace_record[max_records];
+	size_t count = 0;
+
+	while (count < max_records) {
+		size_t bytes = trace->read(&records[count], (max_records - count) * sizeof(trace_record));
+		if (bytes == 0) {
+			break;
+		}
+
+		count += bytes / sizeof(trace_record);
+	}
+
+	sort_records(records, count);
+
+	for (size_t i = 0; i < count; i++) {
+		print_record(records[i], records[0].timestamp);
+	}
+
+	console::get().writef("%lu records\n", count);
+
+	if (was_enabled) {
+		trace->ioctl((u64)trace_ioctl::enable, nullptr, 0);
+	}
+
+	delete[] records;
+	delete trace;
+
+	return 0;
+}
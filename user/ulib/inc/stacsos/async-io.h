@@ -0,0 +1,75 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - userspace standard library
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+#include <stacsos/io-ring.h>
+#include <stacsos/objects.h>
+
+namespace stacsos {
+/**
+ * A ring for submitting object operations to the kernel in batches.  Operations are queued up, and then
+ * handed to the kernel in one go with submit().  Their results turn up as completions, in the order the
+ * kernel finishes them, tagged with the user data they were queued with.
+ *
+ * With a polled ring, a kernel thread picks up submissions as soon as they're made, and submit() only
+ * enters the kernel if that thread has gone to sleep, or if it has been asked to wait.
+ */
+class io_ring {
+public:
+	static io_ring *create(u32 entries, io_ring_setup_flags flags = io_ring_setup_flags::none);
+
+	/**
+	 * Closes the ring.  The kernel unmaps the ring's memory once it has finished with it, so nothing
+	 * that was taken from the ring can be used after this.
+	 */
+	~io_ring();
+
+	/**
+	 * Returns the next free submission entry, or null if the queue is full.  The kernel won't look at the
+	 * entry until submit() is called.
+	 */
+	io_ring_sqe *get_sqe();
+
+	/**
+	 * Queues up an operation on an object.  For ioctl, offset is the command.  Returns false if the
+	 * queue is full.
+	 */
+	bool queue(io_ring_op op, const object &o, const void *buffer, size_t length, u64 offset, u64 user_data);
+
+	/**
+	 * Hands everything queued up so far to the kernel, and then waits until at least wait_for completions
+	 * are ready.  Returns the number of submissions the kernel carried out during the call.
+	 */
+	u32 submit(u32 wait_for = 0);
+
+	/**
+	 * Takes the oldest completion off the ring.  Returns false if there isn't one.
+	 */
+	bool next_completion(io_ring_cqe &cqe);
+
+private:
+	DELETE_DEFAULT_COPY_AND_MOVE(io_ring)
+
+	u64 handle_;
+	io_ring_header *header_;
+	io_ring_sqe *sqes_;
+	io_ring_cqe *cqes_;
+	u32 sq_tail_;
+	bool poll_;
+
+	io_ring(u64 handle, io_ring_header *header, bool poll)
+		: handle_(handle)
+		, header_(header)
+		, sqes_((io_ring_sqe *)((uintptr_t)header + header->sqe_offset))
+		, cqes_((io_ring_cqe *)((uintptr_t)header + header->cqe_offset))
+		, sq_tail_(header->sq_tail)
+		, poll_(poll)
+	{
+	}
+};
+} // namespace stacsos
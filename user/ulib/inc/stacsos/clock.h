@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - userspace standard library
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+#include <stacsos/clock-page.h>
+
+namespace stacsos {
+/**
+ * Reads the time from the clock page the kernel maps into every process, so none of these make a
+ * system call.
+ */
+class clock {
+public:
+	/**
+	 * The raw TSC, for timing short stretches of code.
+	 */
+	static u64 cycles() { return __builtin_ia32_rdtsc(); }
+
+	static u64 cycles_per_second() { return page().tsc_frequency; }
+
+	static u64 cycles_to_ns(u64 cycles) { return (u64)(((unsigned __int128)cycles * page().ns_mult) >> 32); }
+
+	/**
+	 * Nanoseconds since the kernel started publishing the time.
+	 */
+	static u64 monotonic_ns() { return cycles_to_ns(cycles() - page().boot_tsc); }
+
+	/**
+	 * Nanoseconds since the Unix epoch.
+	 */
+	static u64 wall_clock_ns()
+	{
+		const clock_page_data &p = page();
+		u32 seq;
+		u64 base_ns, base_tsc;
+
+		do {
+			seq = p.sequence;
+			asm volatile("" ::: "memory");
+
+			base_ns = p.wall_clock_ns;
+			base_tsc = p.wall_clock_tsc;
+
+			asm volatile("" ::: "memory");
+		} while ((seq & 1) || p.sequence != seq);
+
+		return base_ns + cycles_to_ns(cycles() - base_tsc);
+	}
+
+private:
+	static const clock_page_data &page() { return *(const clock_page_data *)clock_page_address; }
+};
+} // namespace stacsos
@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - userspace standard library
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+namespace stacsos {
+class object;
+
+enum class framebuffer_mode { text = 0, gfx = 1 };
+
+/**
+ * Draws onto a virtual console.  Text mode consoles are made of 16-bit character cells, and graphics
+ * mode consoles of 32-bit pixels.
+ */
+class framebuffer {
+public:
+	static framebuffer *open(const char *path);
+
+	~framebuffer();
+
+	framebuffer_mode mode() const { return mode_; }
+
+	u32 width() const { return mode_ == framebuffer_mode::text ? 80 : 640; }
+	u32 height() const { return mode_ == framebuffer_mode::text ? 25 : 480; }
+
+	/**
+	 * Copies a width x height rectangle of cells or pixels to (x, y), with one syscall.  Rows of the
+	 * source data are stride elements apart.  Returns false if the rectangle doesn't fit on the screen.
+	 */
+	bool draw_rect(u32 x, u32 y, u32 width, u32 height, u32 stride, const void *data);
+
+private:
+	framebuffer(object *vc, framebuffer_mode mode)
+		: vc_(vc)
+		, mode_(mode)
+	{
+	}
+
+	object *vc_;
+	framebuffer_mode mode_;
+};
+} // namespace stacsos
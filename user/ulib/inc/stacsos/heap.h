@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - userspace standard library
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+namespace stacsos {
+/**
+ * The userspace heap, which is behind every new and delete.
+ *
+ * Small objects are rounded up to one of a set of size classes.  Each thread keeps a cache of free
+ * objects of each class, which is refilled from (and drained back to) the central free lists in
+ * batches, so most allocations and frees take no locks.  The central free lists carve objects out of
+ * spans of pages, which come from a page heap that merges neighbouring free spans.  Medium objects
+ * are given a span of their own, and large objects are given a mapping of their own.
+ */
+class heap {
+public:
+	static void *allocate(size_t size);
+	static void *reallocate(void *ptr, size_t size);
+	static void free(void *ptr);
+
+	/**
+	 * The number of bytes that can actually be used at an allocated pointer.
+	 */
+	static size_t usable_size(void *ptr);
+
+	/**
+	 * Gives the calling thread's cached objects back to the central free lists.  This is called when
+	 * a thread exits.
+	 */
+	static void release_thread_cache();
+};
+} // namespace stacsos
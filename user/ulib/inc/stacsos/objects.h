@@ -7,6 +7,8 @@
  */
 #pragma once
 
+#include <stacsos/memory-map.h>
+
 namespace stacsos {
 class object {
 public:
@@ -23,6 +25,15 @@ public:
 
 	u64 ioctl(u64 cmd, void *buffer, size_t length);
 
+	/**
+	 * Maps length bytes of the object, from offset (which must be page aligned), into memory.  Returns
+	 * null if the object can't be mapped.  The mapping stays valid after the object is closed.
+	 */
+	void *mmap(size_t offset, size_t length, memory_map_flags flags = memory_map_flags::none);
+	static bool munmap(void *ptr, size_t length);
+
+	u64 handle() const { return handle_; }
+
 private:
 	u64 handle_;
 
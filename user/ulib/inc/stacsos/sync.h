@@ -0,0 +1,184 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - userspace standard library
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+namespace stacsos {
+/**
+ * Synchronisation between threads, built on the kernel's futexes.  Each primitive is a word (or two)
+ * of memory that is updated with atomic instructions, and a thread only makes a system call when it
+ * has to sleep, or when it knows that another thread is sleeping.
+ *
+ * All of these can be used as globals, as their constructors are evaluated at compile time.
+ */
+class mutex {
+public:
+	constexpr mutex()
+		: state_(unlocked)
+	{
+	}
+
+	void lock()
+	{
+		u32 expected = unlocked;
+		if (!__atomic_compare_exchange_n(&state_, &expected, locked, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			lock_contended(expected);
+		}
+	}
+
+	bool try_lock()
+	{
+		u32 expected = unlocked;
+		return __atomic_compare_exchange_n(&state_, &expected, locked, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+	}
+
+	void unlock()
+	{
+		if (__atomic_exchange_n(&state_, unlocked, __ATOMIC_RELEASE) == locked_with_waiters) {
+			unlock_contended();
+		}
+	}
+
+private:
+	friend class condition_variable;
+
+	DELETE_DEFAULT_COPY_AND_MOVE(mutex)
+
+	// A mutex that is locked_with_waiters may have threads sleeping on it, so unlocking it has to wake
+	// one of them up.
+	static const u32 unlocked = 0;
+	static const u32 locked = 1;
+	static const u32 locked_with_waiters = 2;
+
+	u32 state_;
+
+	void lock_contended(u32 state);
+	void unlock_contended();
+};
+
+/**
+ * Holds a mutex for as long as it is in scope.
+ */
+class unique_lock {
+public:
+	unique_lock(mutex &m)
+		: m_(m)
+	{
+		m_.lock();
+	}
+
+	~unique_lock() { m_.unlock(); }
+
+	mutex &underlying() { return m_; }
+
+private:
+	DELETE_DEFAULT_COPY_AND_MOVE(unique_lock)
+
+	mutex &m_;
+};
+
+class condition_variable {
+public:
+	constexpr condition_variable()
+		: sequence_(0)
+		, waiters_(0)
+	{
+	}
+
+	/**
+	 * Unlocks the mutex, waits to be notified, and locks the mutex again.  Waits can end without a
+	 * notification, so the condition being waited for must be checked in a loop.
+	 */
+	void wait(mutex &m);
+	void wait(unique_lock &l) { wait(l.underlying()); }
+
+	template <typename P> void wait(unique_lock &l, P predicate)
+	{
+		while (!predicate()) {
+			wait(l);
+		}
+	}
+
+	void notify_one() { notify(1); }
+	void notify_all() { notify(~0ull); }
+
+private:
+	DELETE_DEFAULT_COPY_AND_MOVE(condition_variable)
+
+	u32 sequence_;
+	u32 waiters_;
+
+	void notify(u64 count);
+};
+
+/**
+ * A counting semaphore.
+ */
+class semaphore {
+public:
+	constexpr explicit semaphore(u32 initial = 0)
+		: count_(initial)
+		, waiters_(0)
+	{
+	}
+
+	void acquire()
+	{
+		if (!try_acquire()) {
+			acquire_contended();
+		}
+	}
+
+	bool try_acquire()
+	{
+		u32 count = __atomic_load_n(&count_, __ATOMIC_RELAXED);
+		while (count > 0) {
+			if (__atomic_compare_exchange_n(&count_, &count, count - 1, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void release(u32 n = 1);
+
+private:
+	DELETE_DEFAULT_COPY_AND_MOVE(semaphore)
+
+	u32 count_;
+	u32 waiters_;
+
+	void acquire_contended();
+};
+
+/**
+ * Holds threads back until a fixed number of them have arrived.  A barrier can be used over and over
+ * again.
+ */
+class barrier {
+public:
+	constexpr explicit barrier(u32 count)
+		: count_(count)
+		, arrived_(0)
+		, generation_(0)
+	{
+	}
+
+	/**
+	 * Waits for the rest of the threads.  Returns true in exactly one of them (the last to arrive).
+	 */
+	bool arrive_and_wait();
+
+private:
+	DELETE_DEFAULT_COPY_AND_MOVE(barrier)
+
+	u32 count_;
+	u32 arrived_;
+	u32 generation_;
+};
+} // namespace stacsos
@@ -0,0 +1,389 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - userspace standard library
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#pragma once
+
+#include <stacsos/helpers.h>
+#include <stacsos/sync.h>
+
+namespace stacsos {
+class thread;
+class thread_pool;
+
+/**
+ * A unit of work for a thread pool.  Tasks are allocated with new, and deleted by the pool once they
+ * have run.
+ */
+class task {
+	friend class thread_pool;
+
+public:
+	virtual ~task() { }
+	virtual void run() = 0;
+
+private:
+	task *next_;
+};
+
+/**
+ * Counts the tasks that something is waiting for.  The count goes up before each task is handed to
+ * the pool, and down as each one finishes.
+ *
+ * The count and a flag saying that something is asleep waiting for it share one word, so that the last
+ * signal() can tell whether to wake anything up from the same atomic operation that brings the count to
+ * zero.  The waiter may return (and the completion go away) as soon as that happens.
+ */
+class task_completion {
+	friend class thread_pool;
+
+public:
+	constexpr task_completion()
+		: state_(0)
+	{
+	}
+
+	void add(u32 count = 1) { __atomic_fetch_add(&state_, count, __ATOMIC_RELAXED); }
+	void signal();
+
+	bool done() const { return (__atomic_load_n(&state_, __ATOMIC_ACQUIRE) & pending_mask) == 0; }
+
+private:
+	DELETE_DEFAULT_COPY_AND_MOVE(task_completion)
+
+	static const u32 waiting = 1u << 31;
+	static const u32 pending_mask = waiting - 1;
+
+	u32 state_;
+};
+
+/**
+ * The result of a task run with thread_pool::async().
+ */
+template <typename T> struct future_value {
+	alignas(T) u8 storage[sizeof(T)];
+	bool present;
+
+	future_value()
+		: present(false)
+	{
+	}
+
+	~future_value()
+	{
+		if (present) {
+			((T *)storage)->~T();
+		}
+	}
+
+	template <typename F> void set_from(F &f)
+	{
+		new (storage) T(f());
+		present = true;
+	}
+
+	T take() { return move(*(T *)storage); }
+};
+
+template <> struct future_value<void> {
+	template <typename F> void set_from(F &f) { f(); }
+	void take() { }
+};
+
+template <typename T> struct future_state {
+	thread_pool *pool;
+	task_completion done;
+	u32 refs;
+	future_value<T> value;
+
+	future_state(thread_pool *pool)
+		: pool(pool)
+		, refs(2)
+	{
+		done.add();
+	}
+
+	void release()
+	{
+		if (__atomic_sub_fetch(&refs, 1, __ATOMIC_ACQ_REL) == 0) {
+			delete this;
+		}
+	}
+};
+
+template <typename T> class future {
+public:
+	future()
+		: state_(nullptr)
+	{
+	}
+
+	explicit future(future_state<T> *state)
+		: state_(state)
+	{
+	}
+
+	future(future &&other)
+		: state_(other.state_)
+	{
+		other.state_ = nullptr;
+	}
+
+	future &operator=(future &&other)
+	{
+		if (this != &other) {
+			if (state_) {
+				state_->release();
+			}
+
+			state_ = other.state_;
+			other.state_ = nullptr;
+		}
+
+		return *this;
+	}
+
+	~future()
+	{
+		if (state_) {
+			state_->release();
+		}
+	}
+
+	bool valid() const { return state_ != nullptr; }
+	bool ready() const { return state_->done.done(); }
+
+	/**
+	 * Waits for the task to finish, and returns its result.  This can only be called once.
+	 */
+	T get();
+
+private:
+	future(const future &) = delete;
+	future &operator=(const future &) = delete;
+
+	future_state<T> *state_;
+};
+
+/**
+ * A pool of worker threads, one per core by default, that run tasks.  Each worker has a deque of
+ * tasks: it pushes and pops tasks at one end, and idle workers steal from the other end of another
+ * worker's deque, so work spreads out without a shared queue.  Tasks handed to the pool by threads that
+ * aren't its workers go on a shared queue instead.  Workers with nothing to do sleep on a futex.
+ *
+ * A worker that waits for tasks (e.g. in parallel_for(), or future::get()) runs other tasks while it
+ * waits, so tasks can wait for tasks without using up the workers.
+ */
+class thread_pool {
+public:
+	/**
+	 * Starts a pool with the given number of workers, or one per core if that is zero.
+	 */
+	explicit thread_pool(u32 nr_workers = 0);
+	~thread_pool();
+
+	/**
+	 * The pool shared by the whole program, which is started the first time it is asked for.
+	 */
+	static thread_pool &get();
+
+	u32 nr_workers() const { return nr_workers_; }
+
+	/**
+	 * Hands a task to the pool.  From one of the pool's workers, the task goes on that worker's deque,
+	 * otherwise it goes on the shared queue.
+	 */
+	void spawn(task *t);
+
+	/**
+	 * Waits until a completion has no pending tasks.  Workers run other tasks while they wait.
+	 */
+	void wait(task_completion &c);
+
+	/**
+	 * Runs a function in the pool, and returns a future for its result.
+	 */
+	template <typename F> auto async(F f) -> future<decltype(f())>
+	{
+		using T = decltype(f());
+
+		auto state = new future_state<T>(this);
+		spawn(new async_task<F, T>(move(f), state));
+
+		return future<T>(state);
+	}
+
+	/**
+	 * Calls body(i) for every i in [begin, end), spread over the pool, and waits for them all.
+	 *
+	 * The range is split lazily: a worker splits off half of what it has left only when its deque is
+	 * empty, which means that the last piece it split off has been stolen, so another worker is short
+	 * of work.  Ranges are never split smaller than the grain size, which is worked out from the size
+	 * of the range and the number of workers if it is not given.
+	 */
+	template <typename F> void parallel_for(u64 begin, u64 end, F body, u64 grain = 0)
+	{
+		if (begin >= end) {
+			return;
+		}
+
+		if (grain == 0) {
+			grain = max<u64>(1, (end - begin) / (nr_workers_ * 8));
+		}
+
+		task_completion done;
+		done.add();
+		spawn(new range_task<F>(this, &body, grain, &done, begin, end));
+		wait(done);
+	}
+
+private:
+	DELETE_DEFAULT_COPY_AND_MOVE(thread_pool)
+
+	struct worker;
+
+	template <typename F, typename T> class async_task : public task {
+	public:
+		async_task(F &&f, future_state<T> *state)
+			: f_(move(f))
+			, state_(state)
+		{
+		}
+
+		void run() override
+		{
+			state_->value.set_from(f_);
+			state_->done.signal();
+			state_->release();
+		}
+
+	private:
+		F f_;
+		future_state<T> *state_;
+	};
+
+	template <typename F> class range_task : public task {
+	public:
+		range_task(thread_pool *pool, F *body, u64 grain, task_completion *done, u64 begin, u64 end)
+			: pool_(pool)
+			, body_(body)
+			, grain_(grain)
+			, done_(done)
+			, begin_(begin)
+			, end_(end)
+		{
+		}
+
+		void run() override
+		{
+			u64 begin = begin_, end = end_;
+
+			while (begin < end) {
+				if (end - begin > grain_ && pool_->should_split()) {
+					u64 mid = begin + ((end - begin) / 2);
+
+					done_->add();
+					pool_->spawn(new range_task(pool_, body_, grain_, done_, mid, end));
+
+					end = mid;
+					continue;
+				}
+
+				u64 chunk_end = min(begin + grain_, end);
+				for (; begin < chunk_end; begin++) {
+					(*body_)(begin);
+				}
+			}
+
+			done_->signal();
+		}
+
+	private:
+		thread_pool *pool_;
+		F *body_;
+		u64 grain_;
+		task_completion *done_;
+		u64 begin_, end_;
+	};
+
+	u32 nr_workers_;
+	worker **workers_;
+	thread **threads_;
+	bool stopping_;
+
+	// Tasks from threads that aren't workers.  The head is checked without the lock, so that workers
+	// looking for something to do don't all take it.
+	mutex injected_lock_;
+	task *injected_head_, *injected_tail_;
+
+	// Idle workers sleep on the epoch, which is bumped whenever there might be new work for them.
+	u32 epoch_;
+	u32 sleepers_;
+
+	static void *worker_entry(void *arg);
+	void worker_loop(worker &w);
+
+	worker *current_worker() const;
+	bool should_split() const;
+
+	task *find_task(worker &w);
+	task *take_injected();
+	void execute(task *t);
+	void notify(bool all = false);
+};
+
+template <typename T> T future<T>::get()
+{
+	state_->pool->wait(state_->done);
+	return state_->value.take();
+}
+
+/**
+ * A set of tasks that can be waited for together.  Destroying the group waits for its tasks.
+ */
+class task_group {
+public:
+	explicit task_group(thread_pool &pool = thread_pool::get())
+		: pool_(pool)
+	{
+	}
+
+	~task_group() { wait(); }
+
+	template <typename F> void run(F f)
+	{
+		done_.add();
+		pool_.spawn(new group_task<F>(move(f), done_));
+	}
+
+	void wait() { pool_.wait(done_); }
+
+private:
+	DELETE_DEFAULT_COPY_AND_MOVE(task_group)
+
+	template <typename F> class group_task : public task {
+	public:
+		group_task(F &&f, task_completion &done)
+			: f_(move(f))
+			, done_(done)
+		{
+		}
+
+		void run() override
+		{
+			f_();
+			done_.signal();
+		}
+
+	private:
+		F f_;
+		task_completion &done_;
+	};
+
+	thread_pool &pool_;
+	task_completion done_;
+};
+} // namespace stacsos
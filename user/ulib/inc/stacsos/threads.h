@@ -10,10 +10,36 @@
 namespace stacsos {
 typedef void *(*thread_entry_fn)(void *);
 
+/**
+ * The state ulib keeps for each thread.  The FS base points at the running thread's block, and the
+ * first word of the block points back at itself, so it can be found with a single load.
+ */
+struct thread_block {
+	thread_block *self;
+	void *heap_cache;
+
+	// The thread pool worker this thread is, if it is one.
+	void *pool_worker;
+
+	static thread_block &current()
+	{
+		thread_block *tb;
+		asm("mov %%fs:0, %0" : "=r"(tb));
+
+		return *tb;
+	}
+
+	/**
+	 * Makes this the running thread's block.
+	 */
+	void activate();
+};
+
 struct thread_context {
 	thread_entry_fn ep_;
 	void *arg_;
 	void *result_;
+	thread_block block_;
 };
 
 class thread {
@@ -22,6 +48,11 @@ public:
 
 	static thread *start(thread_entry_fn ep, void *arg = nullptr);
 
+	/**
+	 * The number of cores, i.e. the number of threads that can actually run at the same time.
+	 */
+	static u32 hardware_concurrency();
+
 	void *join();
 
 private:
@@ -7,6 +7,8 @@
  */
 #pragma once
 
+#include <stacsos/io-ring.h>
+#include <stacsos/memory-map.h>
 #include <stacsos/syscalls.h>
 
 namespace stacsos {
@@ -85,6 +87,21 @@ public:
 
 	static syscall_result sleep(u64 ms) { return syscall1(syscall_numbers::sleep, ms); }
 
+	/**
+	 * Gives up the rest of the current thread's time slice.
+	 */
+	static syscall_result_code yield() { return syscall0(syscall_numbers::yield).code; }
+
+	/**
+	 * A system call that does nothing.
+	 */
+	static syscall_result_code nop() { return syscall0(syscall_numbers::nop).code; }
+
+	/**
+	 * Sets the calling thread's nice level, from -20 (the largest share of the CPU) to 19 (the smallest).
+	 */
+	static syscall_result_code set_nice(int nice) { return syscall1(syscall_numbers::set_nice, (u64)(s64)nice).code; }
+
 	static void poweroff() { syscall0(syscall_numbers::poweroff); }
 
 	/**
@@ -101,32 +118,91 @@ public:
 		return fa_result { r.code, r.data };
 	}
 
+	static syscall_result_code chdir(const char *path) { return syscall1(syscall_numbers::chdir, (u64)path).code; }
+
+	static rw_result getcwd(char *buffer, u64 size)
+	{
+		auto r = syscall2(syscall_numbers::getcwd, (u64)buffer, size);
+		return rw_result { r.code, r.data };
+	}
+
+	static alloc_result mmap(u64 object, u64 offset, u64 length, memory_map_flags flags)
+	{
+		auto r = syscall4(syscall_numbers::mmap, object, offset, length, (u64)flags);
+		return alloc_result { r.code, (void *)r.data };
+	}
+
+	static syscall_result_code munmap(void *ptr, u64 length) { return syscall2(syscall_numbers::munmap, (u64)ptr, length).code; }
+
+	static fa_result io_ring_setup(u32 entries, io_ring_setup_flags flags, void **base)
+	{
+		// The kernel writes the base address behind the compiler's back.
+		volatile u64 ring_base = 0;
+
+		auto r = syscall3(syscall_numbers::io_ring_setup, entries, (u64)flags, (u64)&ring_base);
+		*base = (void *)ring_base;
+
+		return fa_result { r.code, r.data };
+	}
+
+	static rw_result io_ring_enter(u64 ring, u32 min_complete, io_ring_enter_flags flags)
+	{
+		auto r = syscall3(syscall_numbers::io_ring_enter, ring, min_complete, (u64)flags);
+		return rw_result { r.code, r.data };
+	}
+
+	/**
+	 * Sleeps until woken by futex_wake() on the same address, unless the word at the address no longer
+	 * holds the expected value (in which case the result is would_block).
+	 */
+	static syscall_result_code futex_wait(const u32 *address, u32 expected) { return syscall2(syscall_numbers::futex_wait, (u64)address, expected).code; }
+
+	/**
+	 * Wakes up to count threads sleeping on the address, and returns how many were woken.
+	 */
+	static syscall_result futex_wake(const u32 *address, u64 count) { return syscall2(syscall_numbers::futex_wake, (u64)address, count); }
+
 private:
+	/*
+	 * The kernel keeps RBX, RBP, RSP and R12-R15 intact across a system call, returns the result in RAX
+	 * and RDX, and may change any other general-purpose register (including the argument registers), so
+	 * those are all declared as clobbered.  The kernel may also read and write memory that it was handed,
+	 * hence the memory clobber.
+	 */
 	static syscall_result syscall0(syscall_numbers id)
 	{
 		syscall_result r;
-		asm volatile("syscall" : "=a"(r.code), "=d"(r.data) : "a"(id) : "flags", "rcx");
+		asm volatile("syscall" : "=a"(r.code), "=d"(r.data) : "a"(id) : "flags", "memory", "rcx", "rsi", "rdi", "r8", "r9", "r10", "r11");
 		return r;
 	}
 
 	static syscall_result syscall1(syscall_numbers id, u64 arg0)
 	{
 		syscall_result r;
-		asm volatile("syscall" : "=a"(r.code), "=d"(r.data) : "a"(id), "D"(arg0) : "flags", "rcx");
+		asm volatile("syscall"
+					 : "=a"(r.code), "=d"(r.data), "+D"(arg0)
+					 : "a"(id)
+					 : "flags", "memory", "rcx", "rsi", "r8", "r9", "r10", "r11");
 		return r;
 	}
 
 	static syscall_result syscall2(syscall_numbers id, u64 arg0, u64 arg1)
 	{
 		syscall_result r;
-		asm volatile("syscall" : "=a"(r.code), "=d"(r.data) : "a"(id), "D"(arg0), "S"(arg1) : "flags", "rcx");
+		asm volatile("syscall"
+					 : "=a"(r.code), "=d"(r.data), "+D"(arg0), "+S"(arg1)
+					 : "a"(id)
+					 : "flags", "memory", "rcx", "r8", "r9", "r10", "r11");
 		return r;
 	}
 
 	static syscall_result syscall3(syscall_numbers id, u64 arg0, u64 arg1, u64 arg2)
 	{
 		syscall_result r;
-		asm volatile("syscall" : "=a"(r.code), "=d"(r.data) : "a"(id), "D"(arg0), "S"(arg1), "d"(arg2) : "flags", "rcx");
+		asm volatile("syscall"
+					 : "=a"(r.code), "=d"(r.data), "+D"(arg0), "+S"(arg1)
+					 : "a"(id), "d"(arg2)
+					 : "flags", "memory", "rcx", "r8", "r9", "r10", "r11");
 		return r;
 	}
 
@@ -135,7 +211,10 @@ private:
 		u64 forced_arg3 asm("r8") = arg3;
 
 		syscall_result r;
-		asm volatile("syscall" : "=a"(r.code), "=d"(r.data) : "a"(id), "D"(arg0), "S"(arg1), "d"(arg2), "r"(forced_arg3) : "flags", "rcx", "r11");
+		asm volatile("syscall"
+					 : "=a"(r.code), "=d"(r.data), "+D"(arg0), "+S"(arg1), "+r"(forced_arg3)
+					 : "a"(id), "d"(arg2)
+					 : "flags", "memory", "rcx", "r9", "r10", "r11");
 		return r;
 	}
 };
@@ -0,0 +1,89 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - userspace standard library
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#include <stacsos/async-io.h>
+#include <stacsos/user-syscall.h>
+
+using namespace stacsos;
+
+io_ring *io_ring::create(u32 entries, io_ring_setup_flags flags)
+{
+	void *base;
+	auto result = syscalls::io_ring_setup(entries, flags, &base);
+	if (result.code != syscall_result_code::ok) {
+		return nullptr;
+	}
+
+	return new io_ring(result.id, (io_ring_header *)base, (flags & io_ring_setup_flags::poll) == io_ring_setup_flags::poll);
+}
+
+io_ring::~io_ring() { syscalls::close(handle_); }
+
+io_ring_sqe *io_ring::get_sqe()
+{
+	if (sq_tail_ - header_->sq_head == header_->sq_entries) {
+		return nullptr;
+	}
+
+	return &sqes_[sq_tail_++ & (header_->sq_entries - 1)];
+}
+
+bool io_ring::queue(io_ring_op op, const object &o, const void *buffer, size_t length, u64 offset, u64 user_data)
+{
+	io_ring_sqe *sqe = get_sqe();
+	if (!sqe) {
+		return false;
+	}
+
+	sqe->op = op;
+	sqe->flags = 0;
+	sqe->object = o.handle();
+	sqe->buffer = (u64)buffer;
+	sqe->length = length;
+	sqe->offset = offset;
+	sqe->user_data = user_data;
+
+	return true;
+}
+
+u32 io_ring::submit(u32 wait_for)
+{
+	// The entries have to be filled in before the kernel can see them.
+	asm volatile("" ::: "memory");
+	header_->sq_tail = sq_tail_;
+
+	io_ring_enter_flags flags = wait_for ? io_ring_enter_flags::wait : io_ring_enter_flags::none;
+
+	if (poll_) {
+		// This pairs with the polling thread setting the flag and then checking the queue, so that either
+		// it sees the new tail, or the flag is seen here.
+		asm volatile("mfence" ::: "memory");
+
+		if ((header_->status & io_ring_status::need_wakeup) == io_ring_status::need_wakeup) {
+			flags |= io_ring_enter_flags::wakeup;
+		} else if (!wait_for) {
+			return 0;
+		}
+	}
+
+	return syscalls::io_ring_enter(handle_, wait_for, flags).length;
+}
+
+bool io_ring::next_completion(io_ring_cqe &cqe)
+{
+	u32 head = header_->cq_head;
+	if (head == header_->cq_tail) {
+		return false;
+	}
+
+	// Don't read the entry until the tail has been seen to move past it.
+	asm volatile("" ::: "memory");
+	cqe = cqes_[head & (header_->cq_entries - 1)];
+	header_->cq_head = head + 1;
+
+	return true;
+}
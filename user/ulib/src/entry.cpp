@@ -7,15 +7,16 @@
  */
 #include <stacsos/objects.h>
 #include <stacsos/console.h>
+#include <stacsos/threads.h>
 #include <stacsos/user-syscall.h>
 
 using namespace stacsos;
 
 extern int main(const char *cmdline);
 
-static char tls[256];
+static thread_block main_thread_block;
 
-static void init_tls() { stacsos::syscalls::set_fs((u64)tls); }
+static void init_tls() { main_thread_block.activate(); }
 
 extern "C" void start_main(const char *cmdline)
 {
@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - userspace standard library
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#include <stacsos/framebuffer.h>
+#include <stacsos/objects.h>
+#include <stacsos/virtual-console.h>
+
+using namespace stacsos;
+
+framebuffer *framebuffer::open(const char *path)
+{
+	object *vc = object::open(path);
+	if (!vc) {
+		return nullptr;
+	}
+
+	return new framebuffer(vc, (framebuffer_mode)vc->ioctl((u64)virtual_console_ioctl::get_mode, nullptr, 0));
+}
+
+framebuffer::~framebuffer() { delete vc_; }
+
+bool framebuffer::draw_rect(u32 x, u32 y, u32 width, u32 height, u32 stride, const void *data)
+{
+	virtual_console_blit rect { x, y, width, height, stride, data };
+	return vc_->ioctl((u64)virtual_console_ioctl::blit, &rect, sizeof(rect)) != 0;
+}
@@ -5,105 +5,625 @@
  * Copyright (c) University of St Andrews 2024
  * Tom Spink <tcs6@st-andrews.ac.uk>
  */
+#include <stacsos/heap.h>
+#include <stacsos/memops.h>
+#include <stacsos/sync.h>
+#include <stacsos/threads.h>
 #include <stacsos/user-syscall.h>
 
+using namespace stacsos;
+
 extern "C" {
 void *__dso_handle = &__dso_handle;
 int __cxa_atexit(void (*destructor)(void *), void *arg, void *dso) { return 0; }
 }
 
-struct memory_block;
-static memory_block *free_list;
+/*
+ * Memory comes from the kernel in arenas, which are aligned to their size, so the arena containing any
+ * pointer can be found by masking it.  The first few pages of an arena hold a header, which maps each
+ * of its pages to the span that page belongs to.  Large objects get a mapping of their own, which is
+ * aligned in the same way and starts with the same header (without the page map).
+ *
+ * Nothing here can rely on constructors running, as userspace programs don't run them for globals, so
+ * the globals are either zeroed or initialised at compile time.
+ */
+static const u64 arena_size = MB(4);
+static const u64 pages_per_arena = arena_size >> PAGE_BITS;
+static const u64 arena_header_pages = 3;
+
+static const size_t max_small_size = KB(8);
+static const size_t max_medium_size = MB(1);
+
+static const int nr_size_classes = 32;
+
+// Objects in a span start after the span's descriptor.
+static const size_t span_header_size = 64;
+
+static const u32 mapping_magic = 0x48656170;
+
+enum class span_state : u8 { free, small, medium };
+
+/*
+ * A run of pages within an arena.  The descriptor lives at the start of the span's first page.
+ */
+struct span {
+	span *next, *prev;
+	u64 nr_pages;
+	span_state state;
+	u8 size_class;
+
+	// For small spans: the number of objects handed out, the number of objects that fit, the number
+	// that have been carved out of the span so far, and the objects that have been given back.
+	u32 nr_allocated;
+	u32 capacity;
+	u32 carved;
+	void *free_objects;
+};
+
+static_assert(sizeof(span) <= span_header_size);
+
+enum class mapping_kind : u32 { arena, large };
+
+struct mapping_header {
+	u32 magic;
+	mapping_kind kind;
+
+	// What the kernel gave us, so that it can be given back.
+	u64 mapping_base;
+	u64 mapping_size;
+
+	// For large objects: the usable size of the object.
+	u64 size;
+
+	span *pagemap[pages_per_arena];
+};
+
+static_assert(sizeof(mapping_header) <= (arena_header_pages << PAGE_BITS));
+
+static mapping_header &mapping_of(const void *ptr) { return *(mapping_header *)((u64)ptr & ~(arena_size - 1)); }
+
+static u64 page_index_of(const void *ptr) { return ((u64)ptr & (arena_size - 1)) >> PAGE_BITS; }
+
+static span *span_of(const void *ptr) { return mapping_of(ptr).pagemap[page_index_of(ptr)]; }
+
+static void span_push(span *&head, span *s)
+{
+	s->prev = nullptr;
+	s->next = head;
+
+	if (head) {
+		head->prev = s;
+	}
+
+	head = s;
+}
+
+static void span_remove(span *&head, span *s)
+{
+	if (s->prev) {
+		s->prev->next = s->next;
+	} else {
+		head = s->next;
+	}
+
+	if (s->next) {
+		s->next->prev = s->prev;
+	}
+
+	s->next = s->prev = nullptr;
+}
+
+/*
+ * Reserves an aligned block of address space from the kernel.  The kernel doesn't let us choose the
+ * alignment, so twice as much is asked for (it is only backed by memory when touched).
+ */
+static void *reserve_aligned(u64 size, u64 &mapping_base, u64 &mapping_size)
+{
+	mapping_size = size + arena_size;
+
+	auto r = syscalls::alloc_mem(mapping_size);
+	if (r.code != syscall_result_code::ok || !r.ptr) {
+		return nullptr;
+	}
 
-struct memory_block {
-	memory_block *next, *prev;
-	size_t size;
+	mapping_base = (u64)r.ptr;
+	return (void *)((mapping_base + arena_size - 1) & ~(arena_size - 1));
+}
 
-	void remove()
+/*
+ * Hands out spans of pages.  Free spans are kept on lists by size (with everything larger than the
+ * last list on that list), and are merged with their free neighbours when they are given back.
+ */
+class page_heap {
+public:
+	/*
+	 * Allocates a span for the given use.  The state is set before the lock is dropped, as a free()
+	 * of a neighbouring span would otherwise see this one as free, and merge with it.
+	 */
+	span *allocate(u64 nr_pages, span_state state)
 	{
-		memory_block **slot = &free_list;
-		while (*slot) {
-			if (*slot == this) {
-				*slot = this->next;
-				return;
+		lock_.lock();
+
+		span *s;
+		while (!(s = find(nr_pages))) {
+			if (!grow()) {
+				lock_.unlock();
+				return nullptr;
 			}
 		}
+
+		remove(s);
+
+		if (s->nr_pages > nr_pages) {
+			span *rest = (span *)((u64)s + (nr_pages << PAGE_BITS));
+			rest->nr_pages = s->nr_pages - nr_pages;
+			insert(rest);
+
+			s->nr_pages = nr_pages;
+		}
+
+		s->state = state;
+
+		// Every page of an allocated span is mapped, so that any pointer into it can be looked up.
+		mapping_header &m = mapping_of(s);
+		u64 first = page_index_of(s);
+		for (u64 i = 0; i < nr_pages; i++) {
+			m.pagemap[first + i] = s;
+		}
+
+		lock_.unlock();
+		return s;
+	}
+
+	void free(span *s)
+	{
+		lock_.lock();
+
+		mapping_header &m = mapping_of(s);
+		u64 first = page_index_of(s);
+
+		if (first > arena_header_pages) {
+			span *left = m.pagemap[first - 1];
+			if (left && left->state == span_state::free) {
+				remove(left);
+				left->nr_pages += s->nr_pages;
+				s = left;
+			}
+		}
+
+		u64 after = page_index_of(s) + s->nr_pages;
+		if (after < pages_per_arena) {
+			span *right = m.pagemap[after];
+			if (right && right->state == span_state::free) {
+				remove(right);
+				s->nr_pages += right->nr_pages;
+			}
+		}
+
+		insert(s);
+
+		lock_.unlock();
 	}
 
-	void insert()
+private:
+	static const u64 nr_lists = 64;
+
+	mutex lock_;
+	span *free_lists_[nr_lists] {};
+
+	static u64 list_index(u64 nr_pages) { return min(nr_pages, nr_lists) - 1; }
+
+	span *find(u64 nr_pages)
 	{
-		memory_block **slot = &free_list;
-		while (*slot) {
-			slot = &(*slot)->next;
+		for (u64 i = list_index(nr_pages); i < nr_lists; i++) {
+			for (span *s = free_lists_[i]; s; s = s->next) {
+				if (s->nr_pages >= nr_pages) {
+					return s;
+				}
+			}
 		}
 
-		*slot = this;
+		return nullptr;
 	}
 
-	memory_block *split(size_t size)
+	/*
+	 * Free spans only need their first and last pages mapped, as those are the only ones their
+	 * neighbours look at.
+	 */
+	void insert(span *s)
 	{
-		size_t orig_size = this->size;
-		this->size = size;
+		s->state = span_state::free;
 
-		memory_block *new_block = (memory_block *)((u64)this + size + sizeof(memory_block));
-		new_block->next = nullptr;
-		new_block->prev = nullptr;
-		new_block->size = orig_size - size;
+		mapping_header &m = mapping_of(s);
+		u64 first = page_index_of(s);
+		m.pagemap[first] = s;
+		m.pagemap[first + s->nr_pages - 1] = s;
 
-		return new_block;
+		span_push(free_lists_[list_index(s->nr_pages)], s);
 	}
 
-	void *ptr() { return (void *)((u64)this + sizeof(this)); }
+	void remove(span *s) { span_remove(free_lists_[list_index(s->nr_pages)], s); }
+
+	bool grow()
+	{
+		u64 mapping_base, mapping_size;
+		mapping_header *m = (mapping_header *)reserve_aligned(arena_size, mapping_base, mapping_size);
+		if (!m) {
+			return false;
+		}
+
+		m->magic = mapping_magic;
+		m->kind = mapping_kind::arena;
+		m->mapping_base = mapping_base;
+		m->mapping_size = mapping_size;
+		m->size = 0;
+		memops::bzero(m->pagemap, sizeof(m->pagemap));
+
+		span *s = (span *)((u64)m + (arena_header_pages << PAGE_BITS));
+		s->nr_pages = pages_per_arena - arena_header_pages;
+		insert(s);
+
+		return true;
+	}
 };
 
-static void *allocate(size_t size)
+static page_heap pages;
+
+/*
+ * Small sizes are rounded up to one of 32 classes: multiples of 16 up to 128, and then four classes
+ * between each power of two, up to 8K.
+ */
+static int size_class(size_t size)
+{
+	if (size <= 128) {
+		return size ? (size - 1) >> 4 : 0;
+	}
+
+	int p = 63 - __builtin_clzll(size - 1);
+	return 8 + ((p - 7) * 4) + (int)(((size - 1) - (1ull << p)) >> (p - 2));
+}
+
+static size_t class_size(int cls)
+{
+	if (cls < 8) {
+		return (cls + 1) << 4;
+	}
+
+	size_t base = 128ull << ((cls - 8) / 4);
+	return base + (((cls - 8) % 4) + 1) * (base / 4);
+}
+
+/*
+ * Spans for a class hold at least eight objects.
+ */
+static u64 span_pages(int cls) { return max<u64>(4, PAGE_ALIGN_UP(span_header_size + (class_size(cls) * 8)) >> PAGE_BITS); }
+
+/*
+ * The number of objects moved between a thread's cache and the central lists at once.
+ */
+static u32 batch_size(int cls) { return (u32)max<u64>(2, min<u64>(64, KB(16) / class_size(cls))); }
+
+/*
+ * The central free lists, one per class, which keep the spans of that class that have free objects.
+ */
+struct central_list {
+	mutex lock;
+	span *partial = nullptr;
+};
+
+static central_list central[nr_size_classes];
+
+static span *new_small_span(int cls)
+{
+	span *s = pages.allocate(span_pages(cls), span_state::small);
+	if (!s) {
+		return nullptr;
+	}
+
+	s->size_class = cls;
+	s->nr_allocated = 0;
+	s->capacity = ((s->nr_pages << PAGE_BITS) - span_header_size) / class_size(cls);
+	s->carved = 0;
+	s->free_objects = nullptr;
+
+	return s;
+}
+
+static bool span_full(const span *s) { return !s->free_objects && s->carved == s->capacity; }
+
+/*
+ * Takes up to count objects of a class from the central lists, and chains them together through their
+ * first words.  Returns the number taken.
+ */
+static u32 fetch_objects(int cls, u32 count, void *&head)
+{
+	central_list &c = central[cls];
+	u32 taken = 0;
+
+	head = nullptr;
+
+	c.lock.lock();
+
+	while (taken < count) {
+		span *s = c.partial;
+		if (!s) {
+			s = new_small_span(cls);
+			if (!s) {
+				break;
+			}
+
+			span_push(c.partial, s);
+		}
+
+		while (taken < count && !span_full(s)) {
+			void *o;
+
+			// Objects that have been given back are reused first, then new ones are carved off the end
+			// of the span, so pages are only touched when they are needed.
+			if (s->free_objects) {
+				o = s->free_objects;
+				s->free_objects = *(void **)o;
+			} else {
+				o = (void *)((u64)s + span_header_size + (s->carved++ * class_size(cls)));
+			}
+
+			*(void **)o = head;
+			head = o;
+
+			s->nr_allocated++;
+			taken++;
+		}
+
+		if (span_full(s)) {
+			span_remove(c.partial, s);
+		}
+	}
+
+	c.lock.unlock();
+
+	return taken;
+}
+
+/*
+ * Gives a chain of objects of a class back to the central lists.  Spans that become empty are given
+ * back to the page heap.
+ */
+static void return_objects(int cls, void *head)
 {
-	memory_block *candidate_block = free_list;
+	central_list &c = central[cls];
+
+	c.lock.lock();
+
+	while (head) {
+		void *o = head;
+		head = *(void **)o;
 
-	while (candidate_block) {
-		if (candidate_block->size >= size) {
-			candidate_block->remove();
+		span *s = span_of(o);
+		bool was_full = span_full(s);
 
-			if (candidate_block->size > size) {
-				memory_block *new_block = candidate_block->split(size);
-				new_block->insert();
+		*(void **)o = s->free_objects;
+		s->free_objects = o;
+		s->nr_allocated--;
+
+		if (s->nr_allocated == 0) {
+			if (!was_full) {
+				span_remove(c.partial, s);
 			}
 
-			return candidate_block->ptr();
+			pages.free(s);
+		} else if (was_full) {
+			span_push(c.partial, s);
 		}
+	}
+
+	c.lock.unlock();
+}
+
+/*
+ * A thread's cache of free objects.
+ */
+struct thread_cache {
+	struct {
+		void *head;
+		u32 count;
+	} lists[nr_size_classes];
+};
 
-		candidate_block = candidate_block->next;
+static thread_cache *local_cache()
+{
+	thread_block &tb = thread_block::current();
+
+	if (!tb.heap_cache) {
+		void *cache;
+		if (fetch_objects(size_class(sizeof(thread_cache)), 1, cache) == 0) {
+			return nullptr;
+		}
+
+		memops::bzero(cache, sizeof(thread_cache));
+		tb.heap_cache = cache;
 	}
 
-	size_t new_size = max(0x1000ul, (size + sizeof(memory_block) + 0xfff) & ~0xfff);
-	auto alloc_result = stacsos::syscalls::alloc_mem(new_size);
-	if (alloc_result.code != stacsos::syscall_result_code::ok) {
+	return (thread_cache *)tb.heap_cache;
+}
+
+static void *allocate_small(size_t size)
+{
+	int cls = size_class(size);
+
+	thread_cache *tc = local_cache();
+	if (!tc) {
 		return nullptr;
 	}
 
-	candidate_block = (memory_block *)alloc_result.ptr;
-	candidate_block->next = nullptr;
-	candidate_block->prev = nullptr;
-	candidate_block->size = new_size - sizeof(memory_block);
+	auto &l = tc->lists[cls];
+	if (!l.head) {
+		l.count = fetch_objects(cls, batch_size(cls), l.head);
+		if (!l.head) {
+			return nullptr;
+		}
+	}
+
+	void *o = l.head;
+	l.head = *(void **)o;
+	l.count--;
+
+	return o;
+}
 
-	if (new_size > size) {
-		memory_block *new_block = candidate_block->split(size);
-		new_block->insert();
+static void free_small(void *ptr, int cls)
+{
+	thread_cache *tc = local_cache();
+	if (!tc) {
+		*(void **)ptr = nullptr;
+		return_objects(cls, ptr);
+		return;
 	}
 
-	return candidate_block->ptr();
+	auto &l = tc->lists[cls];
+	*(void **)ptr = l.head;
+	l.head = ptr;
+	l.count++;
+
+	// Don't let a thread that frees more than it allocates hoard memory.
+	u32 batch = batch_size(cls);
+	if (l.count > batch * 2) {
+		void *chain = l.head;
+		void *last = chain;
+		for (u32 i = 1; i < batch; i++) {
+			last = *(void **)last;
+		}
+
+		l.head = *(void **)last;
+		l.count -= batch;
+
+		*(void **)last = nullptr;
+		return_objects(cls, chain);
+	}
 }
 
-void free(void *ptr)
+static void *allocate_medium(size_t size)
 {
-	//
+	span *s = pages.allocate(PAGE_ALIGN_UP(span_header_size + size) >> PAGE_BITS, span_state::medium);
+	if (!s) {
+		return nullptr;
+	}
+
+	return (void *)((u64)s + span_header_size);
+}
+
+static void *allocate_large(size_t size)
+{
+	u64 length = PAGE_ALIGN_UP(size) + PAGE_SIZE;
+	u64 mapping_base, mapping_size;
+
+	mapping_header *m = (mapping_header *)reserve_aligned(length, mapping_base, mapping_size);
+	if (!m) {
+		return nullptr;
+	}
+
+	m->magic = mapping_magic;
+	m->kind = mapping_kind::large;
+	m->mapping_base = mapping_base;
+	m->mapping_size = mapping_size;
+	m->size = length - PAGE_SIZE;
+
+	return (void *)((u64)m + PAGE_SIZE);
+}
+
+void *heap::allocate(size_t size)
+{
+	if (size <= max_small_size) {
+		return allocate_small(size);
+	} else if (size <= max_medium_size) {
+		return allocate_medium(size);
+	} else {
+		return allocate_large(size);
+	}
+}
+
+void heap::free(void *ptr)
+{
+	if (!ptr) {
+		return;
+	}
+
+	mapping_header &m = mapping_of(ptr);
+	if (m.kind == mapping_kind::large) {
+		syscalls::munmap((void *)m.mapping_base, m.mapping_size);
+		return;
+	}
+
+	span *s = span_of(ptr);
+	if (s->state == span_state::small) {
+		free_small(ptr, s->size_class);
+	} else {
+		pages.free(s);
+	}
+}
+
+size_t heap::usable_size(void *ptr)
+{
+	mapping_header &m = mapping_of(ptr);
+	if (m.kind == mapping_kind::large) {
+		return m.size;
+	}
+
+	span *s = span_of(ptr);
+	if (s->state == span_state::small) {
+		return class_size(s->size_class);
+	}
+
+	return (s->nr_pages << PAGE_BITS) - span_header_size;
+}
+
+void *heap::reallocate(void *ptr, size_t size)
+{
+	if (!ptr) {
+		return allocate(size);
+	}
+
+	size_t old_size = usable_size(ptr);
+	if (size <= old_size) {
+		return ptr;
+	}
+
+	void *new_ptr = allocate(size);
+	if (!new_ptr) {
+		return nullptr;
+	}
+
+	memops::memcpy(new_ptr, ptr, old_size);
+	free(ptr);
+
+	return new_ptr;
+}
+
+void heap::release_thread_cache()
+{
+	thread_block &tb = thread_block::current();
+
+	thread_cache *tc = (thread_cache *)tb.heap_cache;
+	if (!tc) {
+		return;
+	}
+
+	for (int cls = 0; cls < nr_size_classes; cls++) {
+		if (tc->lists[cls].head) {
+			return_objects(cls, tc->lists[cls].head);
+		}
+	}
+
+	tb.heap_cache = nullptr;
+
+	*(void **)tc = nullptr;
+	return_objects(size_class(sizeof(thread_cache)), tc);
 }
 
-void *operator new(size_t size) { return allocate(size); }
+void *operator new(size_t size) { return heap::allocate(size); }
 
 void *operator new[](size_t size) { return operator new(size); }
 
-void operator delete(void *p) { free(p); }
+void operator delete(void *p) { heap::free(p); }
 
 void operator delete[](void *p) { operator delete(p); }
 
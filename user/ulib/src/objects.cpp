@@ -45,3 +45,15 @@ size_t object::write(const void *buffer, size_t length) { return syscalls::write
 size_t object::pwrite(const void *buffer, size_t length, size_t offset) { return syscalls::pwrite(handle_, buffer, length, offset).length; }
 size_t object::pread(void *buffer, size_t length, size_t offset) { return syscalls::pread(handle_, buffer, length, offset).length; }
 u64 object::ioctl(u64 cmd, void *buffer, size_t length) { return syscalls::ioctl(handle_, cmd, buffer, length).length; }
+
+void *object::mmap(size_t offset, size_t length, memory_map_flags flags)
+{
+	auto result = syscalls::mmap(handle_, offset, length, flags);
+	if (result.code != syscall_result_code::ok) {
+		return nullptr;
+	}
+
+	return result.ptr;
+}
+
+bool object::munmap(void *ptr, size_t length) { return syscalls::munmap(ptr, length) == syscall_result_code::ok; }
@@ -0,0 +1,116 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - userspace standard library
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#include <stacsos/sync.h>
+#include <stacsos/user-syscall.h>
+
+using namespace stacsos;
+
+// How many times to look at a contended mutex before going to sleep on it.  Critical sections are
+// often short enough that the holder is gone before a system call would have finished.
+static const int mutex_spin_limit = 100;
+
+void mutex::lock_contended(u32 state)
+{
+	for (int i = 0; i < mutex_spin_limit && state != locked_with_waiters; i++) {
+		__relax();
+
+		state = __atomic_load_n(&state_, __ATOMIC_RELAXED);
+		if (state == unlocked && __atomic_compare_exchange_n(&state_, &state, locked, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			return;
+		}
+	}
+
+	// Mark the mutex as having waiters before sleeping, so that the holder knows to wake us.  It stays
+	// marked after we get it, as we can't tell if anything else is still waiting.
+	if (state != locked_with_waiters) {
+		state = __atomic_exchange_n(&state_, locked_with_waiters, __ATOMIC_ACQUIRE);
+	}
+
+	while (state != unlocked) {
+		syscalls::futex_wait(&state_, locked_with_waiters);
+		state = __atomic_exchange_n(&state_, locked_with_waiters, __ATOMIC_ACQUIRE);
+	}
+}
+
+void mutex::unlock_contended() { syscalls::futex_wake(&state_, 1); }
+
+void condition_variable::wait(mutex &m)
+{
+	__atomic_fetch_add(&waiters_, 1, __ATOMIC_SEQ_CST);
+	u32 sequence = __atomic_load_n(&sequence_, __ATOMIC_SEQ_CST);
+
+	m.unlock();
+
+	// If a notification comes between unlocking and sleeping, the sequence number will have moved on,
+	// and the kernel won't let us sleep.
+	syscalls::futex_wait(&sequence_, sequence);
+
+	__atomic_fetch_sub(&waiters_, 1, __ATOMIC_RELAXED);
+
+	// Other waiters may have been woken at the same time, so take the mutex as if it were contended.
+	// Otherwise, unlocking it later wouldn't wake them.
+	u32 state = __atomic_exchange_n(&m.state_, mutex::locked_with_waiters, __ATOMIC_ACQUIRE);
+	if (state != mutex::unlocked) {
+		m.lock_contended(mutex::locked_with_waiters);
+	}
+}
+
+void condition_variable::notify(u64 count)
+{
+	__atomic_fetch_add(&sequence_, 1, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&waiters_, __ATOMIC_SEQ_CST) == 0) {
+		return;
+	}
+
+	syscalls::futex_wake(&sequence_, count);
+}
+
+void semaphore::acquire_contended()
+{
+	__atomic_fetch_add(&waiters_, 1, __ATOMIC_SEQ_CST);
+
+	while (!try_acquire()) {
+		syscalls::futex_wait(&count_, 0);
+	}
+
+	__atomic_fetch_sub(&waiters_, 1, __ATOMIC_RELAXED);
+}
+
+void semaphore::release(u32 n)
+{
+	__atomic_fetch_add(&count_, n, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&waiters_, __ATOMIC_SEQ_CST) > 0) {
+		syscalls::futex_wake(&count_, n);
+	}
+}
+
+bool barrier::arrive_and_wait()
+{
+	u32 generation = __atomic_load_n(&generation_, __ATOMIC_ACQUIRE);
+
+	if (__atomic_add_fetch(&arrived_, 1, __ATOMIC_ACQ_REL) == count_) {
+		// Everyone is here.  The count is reset before the generation moves on, because nothing can
+		// arrive for the next generation until it has.
+		__atomic_store_n(&arrived_, 0, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&generation_, 1, __ATOMIC_RELEASE);
+
+		if (count_ > 1) {
+			syscalls::futex_wake(&generation_, ~0ull);
+		}
+
+		return true;
+	}
+
+	while (__atomic_load_n(&generation_, __ATOMIC_ACQUIRE) == generation) {
+		syscalls::futex_wait(&generation_, generation);
+	}
+
+	return false;
+}
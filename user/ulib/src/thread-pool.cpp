@@ -0,0 +1,380 @@
+/* SPDX-License-Identifier: MIT */
+
+/* StACSOS - userspace standard library
+ *
+ * Copyright (c) University of St Andrews 2024
+ * Tom Spink <tcs6@st-andrews.ac.uk>
+ */
+#include <stacsos/thread-pool.h>
+#include <stacsos/threads.h>
+#include <stacsos/user-syscall.h>
+
+using namespace stacsos;
+
+// How many times an idle worker looks for work before going to sleep.
+static const int idle_spin_limit = 64;
+
+/*
+ * A Chase-Lev work-stealing deque.  The owning worker pushes and takes tasks at the bottom, and other
+ * workers steal them from the top.  Only the owner writes the bottom, and the top is only ever moved
+ * with a compare-and-swap, which is how a take and a steal racing for the last task are settled.
+ *
+ * The deque doesn't grow: when it is full, the owner runs the task it was going to push instead.
+ */
+class work_deque {
+public:
+	static const s64 capacity = 4096;
+
+	work_deque()
+		: top_(0)
+		, bottom_(0)
+	{
+	}
+
+	bool push(task *t)
+	{
+		s64 bottom = __atomic_load_n(&bottom_, __ATOMIC_RELAXED);
+		s64 top = __atomic_load_n(&top_, __ATOMIC_ACQUIRE);
+
+		if (bottom - top >= capacity) {
+			return false;
+		}
+
+		__atomic_store_n(&tasks_[bottom & (capacity - 1)], t, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		__atomic_store_n(&bottom_, bottom + 1, __ATOMIC_RELAXED);
+
+		return true;
+	}
+
+	task *take()
+	{
+		s64 bottom = __atomic_load_n(&bottom_, __ATOMIC_RELAXED) - 1;
+		__atomic_store_n(&bottom_, bottom, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+		s64 top = __atomic_load_n(&top_, __ATOMIC_RELAXED);
+		if (top > bottom) {
+			__atomic_store_n(&bottom_, bottom + 1, __ATOMIC_RELAXED);
+			return nullptr;
+		}
+
+		task *t = __atomic_load_n(&tasks_[bottom & (capacity - 1)], __ATOMIC_RELAXED);
+		if (top == bottom) {
+			// The last task: whoever moves the top gets it.
+			if (!__atomic_compare_exchange_n(&top_, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+				t = nullptr;
+			}
+
+			__atomic_store_n(&bottom_, bottom + 1, __ATOMIC_RELAXED);
+		}
+
+		return t;
+	}
+
+	task *steal()
+	{
+		s64 top = __atomic_load_n(&top_, __ATOMIC_ACQUIRE);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		s64 bottom = __atomic_load_n(&bottom_, __ATOMIC_ACQUIRE);
+
+		if (top >= bottom) {
+			return nullptr;
+		}
+
+		task *t = __atomic_load_n(&tasks_[top & (capacity - 1)], __ATOMIC_RELAXED);
+		if (!__atomic_compare_exchange_n(&top_, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+			return nullptr;
+		}
+
+		return t;
+	}
+
+	bool empty() const { return __atomic_load_n(&bottom_, __ATOMIC_RELAXED) <= __atomic_load_n(&top_, __ATOMIC_RELAXED); }
+
+private:
+	// The two ends are kept apart, so thieves moving the top don't slow the owner down.  (The padding
+	// is used instead of alignment, as the heap doesn't do over-aligned allocations.)
+	s64 top_;
+	u8 padding_[64 - sizeof(s64)];
+	s64 bottom_;
+	task *tasks_[capacity];
+};
+
+struct thread_pool::worker {
+	thread_pool *pool;
+	u32 index;
+	u64 random;
+	work_deque deque;
+
+	worker(thread_pool *pool, u32 index)
+		: pool(pool)
+		, index(index)
+		, random(index + 1)
+	{
+	}
+
+	/*
+	 * Picks a worker to steal from, with xorshift.
+	 */
+	u32 next_victim(u32 nr_workers)
+	{
+		random ^= random << 13;
+		random ^= random >> 7;
+		random ^= random << 17;
+
+		return random % nr_workers;
+	}
+};
+
+void task_completion::signal()
+{
+	// Only the address is used after the count reaches zero, as the completion may have gone by then.
+	// (If the memory has been reused for another futex, that just gets a spurious wake-up.)
+	u32 *address = &state_;
+
+	u32 old = __atomic_fetch_sub(address, 1, __ATOMIC_SEQ_CST);
+	if (old == (waiting | 1)) {
+		syscalls::futex_wake(address, ~0ull);
+	}
+}
+
+thread_pool::thread_pool(u32 nr_workers)
+	: nr_workers_(nr_workers ? nr_workers : thread::hardware_concurrency())
+	, stopping_(false)
+	, injected_head_(nullptr)
+	, injected_tail_(nullptr)
+	, epoch_(0)
+	, sleepers_(0)
+{
+	// Every worker exists before any of them start, as they look at each other's deques.
+	workers_ = new worker *[nr_workers_];
+	for (u32 i = 0; i < nr_workers_; i++) {
+		workers_[i] = new worker(this, i);
+	}
+
+	threads_ = new thread *[nr_workers_];
+	for (u32 i = 0; i < nr_workers_; i++) {
+		threads_[i] = thread::start(worker_entry, workers_[i]);
+	}
+}
+
+thread_pool::~thread_pool()
+{
+	__atomic_store_n(&stopping_, true, __ATOMIC_SEQ_CST);
+	notify(true);
+
+	for (u32 i = 0; i < nr_workers_; i++) {
+		if (threads_[i]) {
+			threads_[i]->join();
+			delete threads_[i];
+		}
+
+		delete workers_[i];
+	}
+
+	delete[] threads_;
+	delete[] workers_;
+}
+
+thread_pool &thread_pool::get()
+{
+	static thread_pool i;
+	return i;
+}
+
+void *thread_pool::worker_entry(void *arg)
+{
+	worker *w = (worker *)arg;
+	w->pool->worker_loop(*w);
+
+	return nullptr;
+}
+
+void thread_pool::worker_loop(worker &w)
+{
+	thread_block::current().pool_worker = &w;
+
+	int idle = 0;
+	while (!__atomic_load_n(&stopping_, __ATOMIC_ACQUIRE)) {
+		task *t = find_task(w);
+		if (t) {
+			execute(t);
+			idle = 0;
+			continue;
+		}
+
+		if (idle++ < idle_spin_limit) {
+			__relax();
+			continue;
+		}
+
+		// Announce that we're going to sleep before looking for work one last time.  Anything that
+		// hands out work after this sees the sleeper, and moves the epoch on, so the futex wait fails.
+		u32 epoch = __atomic_load_n(&epoch_, __ATOMIC_SEQ_CST);
+		__atomic_fetch_add(&sleepers_, 1, __ATOMIC_SEQ_CST);
+
+		t = find_task(w);
+		if (!t && !__atomic_load_n(&stopping_, __ATOMIC_SEQ_CST)) {
+			syscalls::futex_wait(&epoch_, epoch);
+		}
+
+		__atomic_fetch_sub(&sleepers_, 1, __ATOMIC_SEQ_CST);
+
+		if (t) {
+			execute(t);
+		}
+
+		idle = 0;
+	}
+}
+
+thread_pool::worker *thread_pool::current_worker() const
+{
+	worker *w = (worker *)thread_block::current().pool_worker;
+	return (w && w->pool == this) ? w : nullptr;
+}
+
+bool thread_pool::should_split() const
+{
+	worker *w = current_worker();
+	return !w || w->deque.empty();
+}
+
+void thread_pool::spawn(task *t)
+{
+	worker *w = current_worker();
+
+	if (w) {
+		if (!w->deque.push(t)) {
+			execute(t);
+			return;
+		}
+	} else {
+		t->next_ = nullptr;
+
+		injected_lock_.lock();
+
+		if (injected_tail_) {
+			injected_tail_->next_ = t;
+		} else {
+			__atomic_store_n(&injected_head_, t, __ATOMIC_RELAXED);
+		}
+
+		injected_tail_ = t;
+
+		injected_lock_.unlock();
+	}
+
+	notify();
+}
+
+void thread_pool::notify(bool all)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&sleepers_, __ATOMIC_SEQ_CST) == 0) {
+		return;
+	}
+
+	__atomic_fetch_add(&epoch_, 1, __ATOMIC_SEQ_CST);
+	syscalls::futex_wake(&epoch_, all ? ~0ull : 1);
+}
+
+task *thread_pool::take_injected()
+{
+	if (!__atomic_load_n(&injected_head_, __ATOMIC_SEQ_CST)) {
+		return nullptr;
+	}
+
+	injected_lock_.lock();
+
+	task *t = injected_head_;
+	if (t) {
+		__atomic_store_n(&injected_head_, t->next_, __ATOMIC_RELAXED);
+		if (!t->next_) {
+			injected_tail_ = nullptr;
+		}
+	}
+
+	injected_lock_.unlock();
+
+	return t;
+}
+
+task *thread_pool::find_task(worker &w)
+{
+	task *t = w.deque.take();
+	if (t) {
+		return t;
+	}
+
+	t = take_injected();
+	if (t) {
+		return t;
+	}
+
+	u32 first = w.next_victim(nr_workers_);
+	for (u32 i = 0; i < nr_workers_; i++) {
+		u32 victim = (first + i) % nr_workers_;
+		if (victim == w.index) {
+			continue;
+		}
+
+		t = workers_[victim]->deque.steal();
+		if (t) {
+			return t;
+		}
+	}
+
+	return nullptr;
+}
+
+void thread_pool::execute(task *t)
+{
+	t->run();
+	delete t;
+}
+
+void thread_pool::wait(task_completion &c)
+{
+	worker *w = current_worker();
+	int idle = 0;
+
+	while (true) {
+		u32 state = __atomic_load_n(&c.state_, __ATOMIC_ACQUIRE);
+		if ((state & task_completion::pending_mask) == 0) {
+			// Nothing will wake a waiter up now, so clear the flag (unless more work has been added),
+			// so that the next time the count reaches zero doesn't make a system call for nothing.
+			if (state == task_completion::waiting) {
+				__atomic_compare_exchange_n(&c.state_, &state, 0, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+			}
+
+			return;
+		}
+
+		// A worker helps out, rather than sleeping, for as long as there is something to do.
+		if (w) {
+			task *t = find_task(*w);
+			if (t) {
+				execute(t);
+				idle = 0;
+				continue;
+			}
+
+			if (idle++ < idle_spin_limit) {
+				__relax();
+				continue;
+			}
+		}
+
+		// Set the flag before going to sleep.  If the count changes in the meantime, the exchange fails,
+		// and it's all looked at again.
+		if (!(state & task_completion::waiting)
+			&& !__atomic_compare_exchange_n(&c.state_, &state, state | task_completion::waiting, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+			continue;
+		}
+
+		syscalls::futex_wait(&c.state_, state | task_completion::waiting);
+	}
+}
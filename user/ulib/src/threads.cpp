@@ -5,20 +5,36 @@
  * Copyright (c) University of St Andrews 2024
  * Tom Spink <tcs6@st-andrews.ac.uk>
  */
+#include <stacsos/clock-page.h>
+#include <stacsos/heap.h>
 #include <stacsos/threads.h>
 #include <stacsos/user-syscall.h>
 
 using namespace stacsos;
 
+void thread_block::activate()
+{
+	self = this;
+	heap_cache = nullptr;
+	pool_worker = nullptr;
+
+	syscalls::set_fs((u64)this);
+}
+
 static void thread_entry_proc(thread_context *tc)
 {
+	tc->block_.activate();
+
 	tc->result_ = tc->ep_(tc->arg_);
+
+	// Anything left in this thread's heap cache would otherwise be lost.
+	heap::release_thread_cache();
 	syscalls::stop_current_thread();
 }
 
 thread *thread::start(thread_entry_fn ep, void *arg)
 {
-	auto tc = new thread_context { ep, arg, nullptr };
+	auto tc = new thread_context { ep, arg, nullptr, {} };
 
 	auto r = syscalls::start_thread((void *)thread_entry_proc, tc);
 	if (r.code != syscall_result_code::ok) {
@@ -33,3 +49,9 @@ void *thread::join()
 	auto r = syscalls::join_thread(handle_);
 	return tc_->result_;
 }
+
+u32 thread::hardware_concurrency()
+{
+	u32 nr_cores = ((const clock_page_data *)clock_page_address)->nr_cores;
+	return nr_cores ? nr_cores : 1;
+}